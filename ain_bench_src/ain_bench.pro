@@ -0,0 +1,78 @@
+QT += core gui concurrent
+QT -= widgets
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+QMAKE_CXXFLAGS += -O3
+QMAKE_CXXFLAGS_RELEASE += -O3
+
+OBJECTS_DIR=object
+MOC_DIR=moc
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# Headless benchmark of the common_src image kernels, it is not part of ain_suite.pro:
+#   cd ain_bench_src && qmake && make && ./ain_bench -h
+
+SOURCES += \
+	main.cpp \
+	synthframe.cpp \
+	../common_src/coordconv.c \
+	../common_src/utils.cpp \
+	../common_src/imagepreview.cpp \
+	../common_src/image_stats.cpp \
+	../common_src/fits.c \
+	../common_src/xisf.c \
+	../common_src/ser.c \
+	../common_src/xml.c \
+	../common_src/dslr_raw.c \
+	../common_src/stretcher.cpp \
+	../common_src/pipetrace.cpp \
+	../common_src/pixel_kernels.cpp \
+	../common_src/calibration.cpp \
+	../common_src/defectmap.cpp \
+	../common_src/stardetector.cpp \
+	../common_src/sharpness.cpp
+
+HEADERS += \
+	synthframe.h \
+	../common_src/version.h \
+	../common_src/utils.h \
+	../common_src/image_preview_lut.h \
+	../common_src/imagepreview.h \
+	../common_src/image_stats.h \
+	../common_src/fits.h \
+	../common_src/xisf.h \
+	../common_src/ser.h \
+	../common_src/xml.h \
+	../common_src/pixelformat.h \
+	../common_src/coordconv.h \
+	../common_src/dslr_raw.h \
+	../common_src/stretcher.h \
+	../common_src/pipetrace.h \
+	../common_src/pixel_kernels.h \
+	../common_src/pixel_kernels_impl.h \
+	../common_src/pixel_kernels_reference.h \
+	../common_src/calibration.h \
+	../common_src/defectmap.h \
+	../common_src/stardetector.h \
+	../common_src/sharpness.h
+
+INCLUDEPATH += "../indigo/indigo_libs" + "../external" + "../external/libraw/" + "../external/lz4/" + "../common_src"
+LIBS += -L"../external/libraw/lib" -L"../../external/libraw/lib" -L"../../external/lz4" -L"../external/lz4" -lraw -lz
+
+unix:!mac {
+	INCLUDEPATH += "../external/libjpeg"
+	LIBS += -L"../external/libjpeg/.libs" -L"../indigo/build/lib" -l:libindigo.a -lz -ljpeg -l:liblz4.a
+}
+
+unix:mac {
+	INCLUDEPATH += "../external/libjpeg"
+	LIBS += -L"../external/libjpeg/.libs" -L"../indigo/build/lib" -lindigo -ljpeg -llz4
+}
+
+win32 {
+	DEFINES += INDIGO_WINDOWS
+	INCLUDEPATH += ../../external/indigo_sdk/include
+	LIBS += -llz4 ../../external/indigo_sdk/lib/libindigo_client.lib -lws2_32
+}
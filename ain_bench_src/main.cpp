@@ -0,0 +1,485 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Headless benchmark of the image kernels in common_src. Synthetic frames are
+// encoded in memory, every kernel is timed for each frame, size and thread count
+// and the results are written as JSON to compare revisions:
+//
+//   ain_bench -m 1,16,60 -t 1,4,8 -l `git describe --always` -o results.json
+//
+// -c checks that the kernel sets give the same bits as the scalar reference and
+// exits, -s selects the set to benchmark, -s reference times the reference itself.
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <functional>
+#include <QCoreApplication>
+#include <QThread>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QVector>
+#include <fits.h>
+#include <xisf.h>
+#include <imagepreview.h>
+#include <image_stats.h>
+#include <stretcher.h>
+#include <stardetector.h>
+#include <sharpness.h>
+#include <utils.h>
+#include <pixel_kernels.h>
+#include <version.h>
+#include "synthframe.h"
+
+#define BENCH_MAX_MEGAPIXELS 100
+#define BENCH_DEFAULT_REPEATS 5
+#define BENCH_USAGE_WIDTH 60      /* of the kernel list in the usage */
+
+typedef struct {
+	const char *kernel;
+	const char *variant;
+	const char *frame;
+	int width;
+	int height;
+	int threads;
+	int runs;
+	double min_ms;
+	double median_ms;
+	double mean_ms;
+} bench_result;
+
+typedef struct {
+	QVector<int> megapixels;
+	QVector<int> threads;
+	QStringList frames;
+	QStringList kernels;
+	int repeats;
+	const char *label;
+	const char *output;
+} bench_config;
+
+static const struct {
+	const char *name;
+	synth_frame_layout layout;
+	synth_frame_sample sample;
+} bench_frames[] = {
+	{ "mono8", FRAME_MONO, SAMPLE_8 },
+	{ "mono16", FRAME_MONO, SAMPLE_16 },
+	{ "mono32", FRAME_MONO, SAMPLE_32 },
+	{ "monof", FRAME_MONO, SAMPLE_FLOAT },
+	{ "cfa8", FRAME_CFA, SAMPLE_8 },
+	{ "cfa16", FRAME_CFA, SAMPLE_16 },
+	{ "cfa32", FRAME_CFA, SAMPLE_32 },
+	{ "cfaf", FRAME_CFA, SAMPLE_FLOAT },
+	{ "rgb24", FRAME_RGB, SAMPLE_8 },
+	{ "rgb48", FRAME_RGB, SAMPLE_16 },
+	{ "rgb96", FRAME_RGB, SAMPLE_32 },
+	{ "rgbf", FRAME_RGB, SAMPLE_FLOAT }
+};
+
+static const char *bench_kernels[] = {
+	"fits_process_data",
+	"xisf_decompress",
+	"parallel_debayer",
+	"calibrate",
+	"computeParams",
+	"stretch",
+	"imageStats",
+	"detect_stars",
+	"frame_sharpness",
+	"create_jpeg_preview",
+	"create_preview"
+};
+
+static QVector<bench_result> results;
+
+/* One warm up run, then the median of the timed runs is the result. */
+static bool time_kernel(const bench_config &config, const char *kernel, const char *variant, const SynthFrame &frame, int threads, std::function<bool()> run) {
+	if (!run()) {
+		fprintf(stderr, "%-20s %-8s %-7s %5dx%-5d failed\n", kernel, variant, frame.name(), frame.width(), frame.height());
+		return false;
+	}
+	QVector<double> times;
+	QElapsedTimer timer;
+	for (int i = 0; i < config.repeats; i++) {
+		timer.start();
+		run();
+		times.append(timer.nsecsElapsed() / 1e6);
+	}
+	std::sort(times.begin(), times.end());
+	double sum = 0;
+	for (double t : times) sum += t;
+
+	bench_result result;
+	result.kernel = kernel;
+	result.variant = variant;
+	result.frame = frame.name();
+	result.width = frame.width();
+	result.height = frame.height();
+	result.threads = threads;
+	result.runs = times.size();
+	result.min_ms = times.first();
+	result.median_ms = (times.size() % 2) ? times[times.size() / 2] : (times[times.size() / 2 - 1] + times[times.size() / 2]) / 2;
+	result.mean_ms = sum / times.size();
+	results.append(result);
+
+	fprintf(stderr, "%-20s %-8s %-7s %5dx%-5d %3d threads %10.2f ms %8.1f MP/s\n",
+		kernel, variant, frame.name(), frame.width(), frame.height(), threads,
+		result.median_ms, frame.width() * (double)frame.height() / 1000 / result.median_ms);
+	return true;
+}
+
+static void set_threads(int threads) {
+	set_number_of_cores(threads);
+	QThreadPool::globalInstance()->setMaxThreadCount(threads);
+}
+
+static void bench_frame(const bench_config &config, const SynthFrame &frame) {
+	const stretch_config_t sconfig = { PREVIEW_STRETCH_NORMAL, COLOR_BALANCE_AUTO, BAYER_PAT_AUTO };
+	const bool cfa = frame.layout() == FRAME_CFA;
+	const int single = config.threads.first();
+
+	// single threaded kernels run once, with the first thread count
+	if (config.kernels.contains("fits_process_data")) {
+		QByteArray fits = frame.encode_fits();
+		fits_header header;
+		if (fits_read_header((const uint8_t *)fits.constData(), fits.size(), &header) == FITS_OK) {
+			char *native = (char *)malloc(fits_get_buffer_size(&header));
+			set_threads(single);
+			time_kernel(config, "fits_process_data", "", frame, single, [&]() {
+				return fits_process_data((const uint8_t *)fits.constData(), fits.size(), &header, native) == FITS_OK;
+			});
+			free(native);
+		}
+	}
+
+	if (config.kernels.contains("xisf_decompress")) {
+		static const char *codecs[] = { "lz4", "zlib", "zlib+sh" };
+		for (const char *codec : codecs) {
+			QByteArray xisf = frame.encode_xisf(codec);
+			xisf_metadata metadata;
+			if (xisf_read_metadata((uint8_t *)xisf.data(), xisf.size(), &metadata) != XISF_OK) continue;
+			uint8_t *decompressed = (uint8_t *)malloc(metadata.uncompressed_data_size);
+			set_threads(single);
+			time_kernel(config, "xisf_decompress", codec, frame, single, [&]() {
+				return xisf_decompress((uint8_t *)xisf.data(), &metadata, decompressed) == XISF_OK;
+			});
+			free(decompressed);
+		}
+	}
+
+	if (cfa && config.kernels.contains("parallel_debayer")) {
+		const int offsets = get_bayer_offsets(frame.pix_format());
+		uint8_t *rgb = (uint8_t *)malloc(frame.size() * 3);
+		for (int threads : config.threads) {
+			set_threads(threads);
+			time_kernel(config, "parallel_debayer", "", frame, threads, [&]() {
+				switch (frame.sample()) {
+					case SAMPLE_8:
+						parallel_debayer((uint8_t *)frame.data(), frame.width(), frame.height(), offsets, (uint8_t *)rgb);
+						break;
+					case SAMPLE_16:
+						parallel_debayer((uint16_t *)frame.data(), frame.width(), frame.height(), offsets, (uint16_t *)rgb);
+						break;
+					case SAMPLE_32:
+						parallel_debayer((uint32_t *)frame.data(), frame.width(), frame.height(), offsets, (uint32_t *)rgb);
+						break;
+					case SAMPLE_FLOAT:
+						parallel_debayer((float *)frame.data(), frame.width(), frame.height(), offsets, (float *)rgb);
+						break;
+				}
+				return true;
+			});
+		}
+		free(rgb);
+	}
+
+	// dark subtraction and flat division as done for the FITS previews
+	if (frame.layout() != FRAME_RGB && config.kernels.contains("calibrate")) {
+		const size_t count = (size_t)frame.width() * frame.height();
+		pixel_type type = PIXEL_U8;
+		switch (frame.sample()) {
+			case SAMPLE_8:
+				type = PIXEL_U8;
+				break;
+			case SAMPLE_16:
+				type = PIXEL_U16;
+				break;
+			case SAMPLE_32:
+				type = PIXEL_U32;
+				break;
+			case SAMPLE_FLOAT:
+				type = PIXEL_F32;
+				break;
+		}
+		// zero dark and unit flat keep the samples, so every run does the same work
+		float *dark = (float *)qMallocAligned(count * sizeof(float), 64);
+		float *flat = (float *)qMallocAligned(count * sizeof(float), 64);
+		std::fill(dark, dark + count, 0.0f);
+		std::fill(flat, flat + count, 1.0f);
+		QByteArray data((const char *)frame.data(), frame.size());
+		set_threads(single);
+		time_kernel(config, "calibrate", "", frame, single, [&]() {
+			pixel_kernels()->calibrate[type](data.data(), count, dark, flat);
+			return true;
+		});
+		qFreeAligned(dark);
+		qFreeAligned(flat);
+	}
+
+	// lucky imaging ranks each video frame, the video frames are 8 or 16 bit
+	if ((frame.sample() == SAMPLE_8 || frame.sample() == SAMPLE_16) && config.kernels.contains("frame_sharpness")) {
+		set_threads(single);
+		time_kernel(config, "frame_sharpness", "", frame, single, [&]() {
+			return frame_sharpness(frame.data(), frame.width(), frame.height(), frame.pix_format()) > 0;
+		});
+	}
+
+	// the stretch and statistics kernels work on debayered data
+	if (!cfa) {
+		Stretcher stretcher(frame.width(), frame.height(), frame.pix_format());
+		StretchParams params = stretcher.computeParams(frame.data());
+		if (config.kernels.contains("computeParams")) {
+			set_threads(single);
+			time_kernel(config, "computeParams", "", frame, single, [&]() {
+				params = stretcher.computeParams(frame.data());
+				return true;
+			});
+		}
+		if (config.kernels.contains("stretch")) {
+			QImage output(frame.width(), frame.height(), QImage::Format_RGB32);
+			stretcher.setParams(params);
+			for (int threads : config.threads) {
+				set_threads(threads);
+				time_kernel(config, "stretch", "", frame, threads, [&]() {
+					stretcher.stretch(frame.data(), &output, 1);
+					return true;
+				});
+			}
+		}
+		if (config.kernels.contains("imageStats")) {
+			set_threads(single);
+			time_kernel(config, "imageStats", "", frame, single, [&]() {
+				return imageStats(frame.data(), frame.width(), frame.height(), frame.pix_format()).channels > 0;
+			});
+		}
+		if (config.kernels.contains("detect_stars")) {
+			for (int threads : config.threads) {
+				set_threads(threads);
+				time_kernel(config, "detect_stars", "", frame, threads, [&]() {
+					star_detection detection;
+					return detect_stars(frame.data(), frame.width(), frame.height(), frame.pix_format(), &detection) >= 0;
+				});
+			}
+		}
+	}
+
+	if (config.kernels.contains("create_jpeg_preview")) {
+		QByteArray jpeg = frame.encode_jpeg();
+		if (!jpeg.isEmpty()) {
+			set_threads(single);
+			time_kernel(config, "create_jpeg_preview", "", frame, single, [&]() {
+				preview_image *preview = create_jpeg_preview((unsigned char *)jpeg.data(), jpeg.size());
+				const bool created = preview != nullptr;
+				delete preview;
+				return created;
+			});
+		}
+	}
+
+	// the whole BLOB to preview path, as done for each received frame
+	if (config.kernels.contains("create_preview")) {
+		for (const char *format : { "fits", "xisf", "raw" }) {
+			QByteArray data;
+			if (!strcmp(format, "fits")) {
+				data = frame.encode_fits();
+			} else if (!strcmp(format, "xisf")) {
+				data = frame.encode_xisf();
+			} else {
+				data = frame.encode_raw();
+			}
+			if (data.isEmpty()) continue;
+			QByteArray extension = QByteArray(".") + format;
+			for (int threads : config.threads) {
+				set_threads(threads);
+				time_kernel(config, "create_preview", format, frame, threads, [&]() {
+					preview_image *preview = create_preview((unsigned char *)data.data(), data.size(), extension.constData(), sconfig);
+					const bool created = preview != nullptr;
+					delete preview;
+					return created;
+				});
+			}
+		}
+	}
+}
+
+static void json_string(FILE *file, const char *str) {
+	fputc('"', file);
+	for (const char *c = str; *c; c++) {
+		if (*c == '"' || *c == '\\') fputc('\\', file);
+		fputc(*c, file);
+	}
+	fputc('"', file);
+}
+
+static bool write_results(const bench_config &config) {
+	FILE *file = stdout;
+	if (config.output) {
+		file = fopen(config.output, "w");
+		if (file == nullptr) {
+			fprintf(stderr, "Can not create '%s'\n", config.output);
+			return false;
+		}
+	}
+	char date[64];
+	time_t now = time(nullptr);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+	fprintf(file, "{\n\"benchmark\": \"ain_bench\",\n\"version\": \"%s\",\n\"label\": ", AIN_VERSION);
+	json_string(file, config.label ? config.label : "");
+	fprintf(file, ",\n\"date\": \"%s\",\n\"qt\": \"%s\",\n\"cores\": %d,\n\"pixel_kernels\": \"%s\",\n\"repeats\": %d,\n\"results\": [\n", date, qVersion(), QThread::idealThreadCount(), pixel_kernels()->name, config.repeats);
+	for (int i = 0; i < results.size(); i++) {
+		const bench_result &r = results[i];
+		double megapixels = r.width * (double)r.height / 1e6;
+		fprintf(file,
+			"{\"kernel\": \"%s\", \"variant\": \"%s\", \"frame\": \"%s\", \"width\": %d, \"height\": %d, \"threads\": %d, \"runs\": %d, "
+			"\"min_ms\": %.3f, \"median_ms\": %.3f, \"mean_ms\": %.3f, \"mpix_per_s\": %.2f}%s\n",
+			r.kernel, r.variant, r.frame, r.width, r.height, r.threads, r.runs,
+			r.min_ms, r.median_ms, r.mean_ms, megapixels * 1000 / r.median_ms, i < results.size() - 1 ? "," : "");
+	}
+	fprintf(file, "]\n}\n");
+	if (file != stdout) fclose(file);
+	return true;
+}
+
+static void usage(const char *name) {
+	const pixel_kernel_set *sets[8];
+	int count = pixel_kernels_available(sets, 8);
+	QString kernel_sets;
+	for (int i = 0; i < count; i++) kernel_sets += QString(i ? " " : "") + sets[i]->name;
+	kernel_sets += QString(" reference (default ") + pixel_kernels()->name + ")";
+	// listed from the tables, so that new kernels show up
+	QString frames;
+	for (auto frame : bench_frames) frames += QString(frames.isEmpty() ? "" : " ") + frame.name;
+	QString kernels;
+	int line_length = 0;
+	for (auto kernel : bench_kernels) {
+		if (line_length > 0 && line_length + (int)strlen(kernel) > BENCH_USAGE_WIDTH) {
+			kernels += "\n                ";
+			line_length = 0;
+		}
+		kernels += QString(line_length ? " " : "") + kernel;
+		line_length += (int)strlen(kernel) + 1;
+	}
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -m MP,...     frame sizes in megapixels, 1 - %d (default 1,4,16)\n"
+		"  -t N,...      thread counts of the parallel kernels (default 1,2,4 and all cores)\n"
+		"  -f FRAME,...  frames: %s (default all)\n"
+		"  -k KERNEL,... kernels: %s (default all)\n"
+		"  -r N          timed runs of each kernel (default %d)\n"
+		"  -l LABEL      revision label stored with the results\n"
+		"  -o FILE       write the JSON results to FILE instead of stdout\n"
+		"  -s SET        pixel kernel set: %s\n"
+		"  -c            check the pixel kernel sets against the scalar reference and exit\n",
+		name, BENCH_MAX_MEGAPIXELS, frames.toUtf8().constData(), kernels.toUtf8().constData(), BENCH_DEFAULT_REPEATS, kernel_sets.toUtf8().constData());
+}
+
+static bool parse_list(const char *arg, QVector<int> &list, int max) {
+	list.clear();
+	for (const QString &value : QString(arg).split(",", QString::SkipEmptyParts)) {
+		bool ok;
+		int n = value.toInt(&ok);
+		if (!ok || n < 1 || n > max) return false;
+		list.append(n);
+	}
+	return !list.isEmpty();
+}
+
+int main(int argc, char *argv[]) {
+	QCoreApplication app(argc, argv);
+	indigo_set_log_level(INDIGO_LOG_ERROR);
+
+	const int cores = QThread::idealThreadCount();
+	bench_config config;
+	config.megapixels = { 1, 4, 16 };
+	for (int threads : { 1, 2, 4 }) {
+		if (threads < cores) config.threads.append(threads);
+	}
+	config.threads.append(cores);
+	for (auto frame : bench_frames) config.frames.append(frame.name);
+	for (auto kernel : bench_kernels) config.kernels.append(kernel);
+	config.repeats = BENCH_DEFAULT_REPEATS;
+	config.label = nullptr;
+	config.output = nullptr;
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+		bool ok = value != nullptr;
+		if (!strcmp(arg, "-c")) {
+			int failed = pixel_kernels_self_check();
+			fprintf(stderr, "Pixel kernels: %s\n", failed ? "MISMATCH" : "all sets match the reference");
+			return failed ? 1 : 0;
+		} else if (!strcmp(arg, "-m") && ok) {
+			ok = parse_list(value, config.megapixels, BENCH_MAX_MEGAPIXELS);
+		} else if (!strcmp(arg, "-t") && ok) {
+			ok = parse_list(value, config.threads, 1024);
+		} else if (!strcmp(arg, "-f") && ok) {
+			config.frames = QString(value).split(",", QString::SkipEmptyParts);
+		} else if (!strcmp(arg, "-k") && ok) {
+			config.kernels = QString(value).split(",", QString::SkipEmptyParts);
+		} else if (!strcmp(arg, "-r") && ok) {
+			config.repeats = atoi(value);
+			ok = config.repeats > 0;
+		} else if (!strcmp(arg, "-l") && ok) {
+			config.label = value;
+		} else if (!strcmp(arg, "-o") && ok) {
+			config.output = value;
+		} else if (!strcmp(arg, "-s") && ok) {
+			ok = pixel_kernels_select(value);
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+		if (!ok) {
+			fprintf(stderr, "Invalid value of %s: '%s'\n", arg, value ? value : "");
+			return 1;
+		}
+		i++;
+	}
+
+	for (int megapixels : config.megapixels) {
+		// 3:2 sensor
+		int width = (int)(sqrt(megapixels * 1e6 * 1.5)) & ~1;
+		int height = (int)(megapixels * 1e6 / width) & ~1;
+		for (auto f : bench_frames) {
+			if (!config.frames.contains(f.name)) continue;
+			SynthFrame frame(f.layout, f.sample, width, height);
+			if (!frame.is_valid()) {
+				fprintf(stderr, "Can not allocate %s frame of %d MP\n", f.name, megapixels);
+				continue;
+			}
+			bench_frame(config, frame);
+		}
+	}
+	return write_results(config) ? 0 : 1;
+}
@@ -0,0 +1,363 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <math.h>
+#include <string.h>
+#include <stdio.h>
+#include <zlib.h>
+#include <lz4.h>
+#include <QImage>
+#include <QBuffer>
+#include <indigo/indigo_bus.h>
+#include <pixelformat.h>
+#include <fits.h>
+#include <xisf.h>
+#include "synthframe.h"
+
+#define SKY_BACKGROUND 0.05
+#define READ_NOISE 0.002        /* of the full range */
+#define SHOT_NOISE 0.0005       /* variance per unit of signal */
+#define STAR_DENSITY 5000       /* pixels per star */
+#define FLOAT_RANGE 65535.0     /* float frames are calibrated 16 bit data */
+#define XISF_BLOCK 4096
+
+/* xorshift, the generator only needs to be fast and repeatable */
+static inline uint32_t next_random(uint32_t &state) {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+static inline float uniform_random(uint32_t &state) {
+	return (next_random(state) >> 8) * (1.0f / 16777216.0f);
+}
+
+/* Irwin-Hall approximation of the standard normal distribution */
+static inline float normal_random(uint32_t &state) {
+	return uniform_random(state) + uniform_random(state) + uniform_random(state) + uniform_random(state) - 2.0f;
+}
+
+/* relative response of the channels, RGGB for the mosaic */
+static const float channel_response[3] = { 0.8f, 1.0f, 0.6f };
+
+static inline int cfa_channel(int x, int y) {
+	return (y & 1) ? ((x & 1) ? 2 : 1) : ((x & 1) ? 1 : 0);
+}
+
+SynthFrame::SynthFrame(synth_frame_layout layout, synth_frame_sample sample, int width, int height, unsigned int seed) {
+	m_layout = layout;
+	m_sample = sample;
+	m_width = width;
+	m_height = height;
+	m_data = nullptr;
+	if (width <= 0 || height <= 0) return;
+	m_data = (uint8_t *)malloc(size());
+	if (m_data) render(seed);
+}
+
+SynthFrame::~SynthFrame() {
+	free(m_data);
+}
+
+const char *SynthFrame::name() const {
+	static const char *names[3][4] = {
+		{ "mono8", "mono16", "mono32", "monof" },
+		{ "cfa8", "cfa16", "cfa32", "cfaf" },
+		{ "rgb24", "rgb48", "rgb96", "rgbf" }
+	};
+	int sample = m_sample == SAMPLE_8 ? 0 : m_sample == SAMPLE_16 ? 1 : m_sample == SAMPLE_32 ? 2 : 3;
+	return names[m_layout][sample];
+}
+
+uint32_t SynthFrame::pix_format() const {
+	static const uint32_t formats[3][4] = {
+		{ PIX_FMT_Y8, PIX_FMT_Y16, PIX_FMT_Y32, PIX_FMT_F32 },
+		{ PIX_FMT_SRGGB8, PIX_FMT_SRGGB16, PIX_FMT_SRGGB32, PIX_FMT_SRGGBF },
+		{ PIX_FMT_RGB24, PIX_FMT_RGB48, PIX_FMT_RGB96, PIX_FMT_RGBF }
+	};
+	int sample = m_sample == SAMPLE_8 ? 0 : m_sample == SAMPLE_16 ? 1 : m_sample == SAMPLE_32 ? 2 : 3;
+	return formats[m_layout][sample];
+}
+
+void SynthFrame::render(unsigned int seed) {
+	uint32_t state = seed ? seed : 1;
+	const size_t pixels = (size_t)m_width * m_height;
+
+	// the star field is rendered once in full range and sampled by every channel
+	float *sky = (float *)malloc(pixels * sizeof(float));
+	if (sky == nullptr) {
+		free(m_data);
+		m_data = nullptr;
+		return;
+	}
+	for (size_t i = 0; i < pixels; i++) sky[i] = SKY_BACKGROUND;
+
+	// faint stars are more common, sigma is the seeing
+	const int stars = pixels / STAR_DENSITY + 1;
+	for (int star = 0; star < stars; star++) {
+		const float cx = uniform_random(state) * m_width;
+		const float cy = uniform_random(state) * m_height;
+		const float f = uniform_random(state);
+		const float peak = 0.01f + 0.9f * f * f * f * f;
+		const float sigma = 1.2f + 1.3f * uniform_random(state);
+		const float k = -1.0f / (2 * sigma * sigma);
+		const int radius = (int)ceilf(4 * sigma);
+		const int x0 = (int)cx - radius < 0 ? 0 : (int)cx - radius;
+		const int x1 = (int)cx + radius >= m_width ? m_width - 1 : (int)cx + radius;
+		const int y0 = (int)cy - radius < 0 ? 0 : (int)cy - radius;
+		const int y1 = (int)cy + radius >= m_height ? m_height - 1 : (int)cy + radius;
+		for (int y = y0; y <= y1; y++) {
+			float *row = sky + (size_t)y * m_width;
+			const float dy = y + 0.5f - cy;
+			for (int x = x0; x <= x1; x++) {
+				const float dx = x + 0.5f - cx;
+				row[x] += peak * expf((dx * dx + dy * dy) * k);
+			}
+		}
+	}
+
+	const int ch = channels();
+	const double range = m_sample == SAMPLE_8 ? 255.0 : m_sample == SAMPLE_16 ? 65535.0 : m_sample == SAMPLE_32 ? 4294967295.0 : FLOAT_RANGE;
+	for (int y = 0; y < m_height; y++) {
+		for (int x = 0; x < m_width; x++) {
+			const size_t index = (size_t)y * m_width + x;
+			for (int c = 0; c < ch; c++) {
+				float value = sky[index] * channel_response[m_layout == FRAME_CFA ? cfa_channel(x, y) : m_layout == FRAME_RGB ? c : 1];
+				value += normal_random(state) * sqrtf(READ_NOISE * READ_NOISE + value * SHOT_NOISE);
+				if (value < 0) value = 0;
+				if (value > 1) value = 1;
+				const size_t sample = index * ch + c;
+				switch (m_sample) {
+					case SAMPLE_8:
+						m_data[sample] = (uint8_t)(value * range + 0.5);
+						break;
+					case SAMPLE_16:
+						((uint16_t *)m_data)[sample] = (uint16_t)(value * range + 0.5);
+						break;
+					case SAMPLE_32:
+						((uint32_t *)m_data)[sample] = (uint32_t)(value * range + 0.5);
+						break;
+					case SAMPLE_FLOAT:
+						((float *)m_data)[sample] = (float)(value * range);
+						break;
+				}
+			}
+		}
+	}
+	free(sky);
+}
+
+static int fits_padding(int size) {
+	return (FITS_HEADER_BLOCK_SIZE - size % FITS_HEADER_BLOCK_SIZE) % FITS_HEADER_BLOCK_SIZE;
+}
+
+static void fits_card(QByteArray &header, const char *keyword, const char *value) {
+	char card[81];
+	if (value && value[0] == '\'') {
+		snprintf(card, sizeof(card), "%-8s= %-20s", keyword, value);
+	} else if (value) {
+		snprintf(card, sizeof(card), "%-8s= %20s", keyword, value);
+	} else {
+		snprintf(card, sizeof(card), "%-8s", keyword);
+	}
+	header.append(QByteArray(card).leftJustified(80, ' ', true));
+}
+
+/* FITS stores big endian signed integers, unsigned data is offset by BZERO */
+QByteArray SynthFrame::encode_fits() const {
+	if (!is_valid()) return QByteArray();
+	char value[32];
+	QByteArray fits;
+	fits_card(fits, "SIMPLE", "T");
+	snprintf(value, sizeof(value), "%d", (int)m_sample);
+	fits_card(fits, "BITPIX", value);
+	fits_card(fits, "NAXIS", m_layout == FRAME_RGB ? "3" : "2");
+	snprintf(value, sizeof(value), "%d", m_width);
+	fits_card(fits, "NAXIS1", value);
+	snprintf(value, sizeof(value), "%d", m_height);
+	fits_card(fits, "NAXIS2", value);
+	if (m_layout == FRAME_RGB) {
+		fits_card(fits, "NAXIS3", "3");
+		fits_card(fits, "CTYPE3", "'RGB'");
+	}
+	if (m_sample == SAMPLE_16) {
+		fits_card(fits, "BZERO", "32768");
+	} else if (m_sample == SAMPLE_32) {
+		fits_card(fits, "BZERO", "2147483648");
+	}
+	fits_card(fits, "BSCALE", "1");
+	if (m_layout == FRAME_CFA) {
+		fits_card(fits, "BAYERPAT", "'RGGB'");
+		fits_card(fits, "XBAYROFF", "0");
+		fits_card(fits, "YBAYROFF", "0");
+	}
+	fits_card(fits, "END", nullptr);
+	fits.append(QByteArray(fits_padding(fits.size()), ' '));
+
+	// RGB is stored as planes
+	const int ch = channels();
+	const int ss = sample_size();
+	const size_t pixels = (size_t)m_width * m_height;
+	const int header_size = fits.size();
+	fits.resize(header_size + size());
+	uint8_t *out = (uint8_t *)fits.data() + header_size;
+	for (int c = 0; c < ch; c++) {
+		for (size_t i = 0; i < pixels; i++) {
+			const uint8_t *in = m_data + (i * ch + c) * ss;
+			uint8_t *o = out + (c * pixels + i) * ss;
+			if (ss == 1) {
+				o[0] = in[0];
+			} else if (m_sample == SAMPLE_16) {
+				uint16_t v = *(const uint16_t *)in ^ 0x8000;
+				o[0] = v >> 8;
+				o[1] = v & 0xFF;
+			} else {
+				uint32_t v = *(const uint32_t *)in;
+				if (m_sample == SAMPLE_32) v ^= 0x80000000;
+				o[0] = v >> 24;
+				o[1] = (v >> 16) & 0xFF;
+				o[2] = (v >> 8) & 0xFF;
+				o[3] = v & 0xFF;
+			}
+		}
+	}
+	fits.append(QByteArray(fits_padding(fits.size()), '\0'));
+	return fits;
+}
+
+/* byte planes of the samples, the inverse of the un_shuffle() in xisf.c */
+static void shuffle(uint8_t *output, const uint8_t *input, size_t size, size_t item_size) {
+	const size_t items = size / item_size;
+	uint8_t *o = output;
+	for (size_t j = 0; j < item_size; j++) {
+		const uint8_t *s = input + j;
+		for (size_t i = 0; i < items; i++, o++, s += item_size) {
+			*o = *s;
+		}
+	}
+	memcpy(o, input + items * item_size, size % item_size);
+}
+
+QByteArray SynthFrame::encode_xisf(const char *compression) const {
+	if (!is_valid()) return QByteArray();
+	static const char *sample_formats[] = { "UInt8", "UInt16", "UInt32", "Float32" };
+	const char *sample_format = sample_formats[m_sample == SAMPLE_8 ? 0 : m_sample == SAMPLE_16 ? 1 : m_sample == SAMPLE_32 ? 2 : 3];
+
+	QByteArray payload;
+	QString compression_attr;
+	if (compression == nullptr || compression[0] == '\0') {
+		payload = QByteArray::fromRawData((const char *)m_data, size());
+	} else if (!strcmp(compression, "lz4")) {
+		int bound = LZ4_compressBound(size());
+		payload.resize(bound);
+		int compressed = LZ4_compress_default((const char *)m_data, payload.data(), size(), bound);
+		if (compressed <= 0) return QByteArray();
+		payload.resize(compressed);
+		compression_attr = QString(" compression=\"lz4:%1\"").arg(size());
+	} else if (!strcmp(compression, "zlib") || !strcmp(compression, "zlib+sh")) {
+		const bool shuffled = !strcmp(compression, "zlib+sh");
+		uint8_t *input = m_data;
+		if (shuffled) {
+			input = (uint8_t *)malloc(size());
+			if (input == nullptr) return QByteArray();
+			shuffle(input, m_data, size(), sample_size());
+		}
+		uLongf compressed = compressBound(size());
+		payload.resize(compressed);
+		int res = compress2((Bytef *)payload.data(), &compressed, input, size(), Z_DEFAULT_COMPRESSION);
+		if (shuffled) free(input);
+		if (res != Z_OK) return QByteArray();
+		payload.resize(compressed);
+		if (shuffled) {
+			compression_attr = QString(" compression=\"zlib+sh:%1:%2\"").arg(size()).arg(sample_size());
+		} else {
+			compression_attr = QString(" compression=\"zlib:%1\"").arg(size());
+		}
+	} else {
+		return QByteArray();
+	}
+
+	// the attachment starts at the first block after the header
+	const int data_offset = XISF_BLOCK;
+	QString xml = QString(
+		"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<xisf version=\"1.0\" xmlns=\"http://www.pixinsight.com/xisf\">\n"
+		"<Image geometry=\"%1:%2:%3\" sampleFormat=\"%4\" colorSpace=\"%5\" pixelStorage=\"Normal\" byteOrder=\"little\" location=\"attachment:%6:%7\"%8>\n"
+	).arg(m_width).arg(m_height).arg(channels()).arg(sample_format).arg(m_layout == FRAME_RGB ? "RGB" : "Gray").arg(data_offset).arg(payload.size()).arg(compression_attr);
+	if (m_layout == FRAME_CFA) {
+		xml += "<ColorFilterArray pattern=\"RGGB\" width=\"2\" height=\"2\"/>\n";
+	}
+	xml += "</Image>\n</xisf>\n";
+	QByteArray xml_data = xml.toUtf8();
+	if ((int)sizeof(xisf_header) + xml_data.size() > data_offset) return QByteArray();
+
+	xisf_header header;
+	memcpy(header.signature, "XISF0100", 8);
+	header.xml_length = xml_data.size();
+	header.reserved = 0;
+
+	QByteArray xisf((const char *)&header, sizeof(header));
+	xisf.append(xml_data);
+	xisf.append(QByteArray(data_offset - xisf.size(), '\0'));
+	xisf.append(payload);
+	return xisf;
+}
+
+/* INDIGO RAW can hold only 8 and 16 bit data, the mosaic is described in the extension */
+QByteArray SynthFrame::encode_raw() const {
+	if (!is_valid()) return QByteArray();
+	indigo_raw_header header;
+	if (m_layout == FRAME_RGB) {
+		if (m_sample == SAMPLE_8) {
+			header.signature = INDIGO_RAW_RGB24;
+		} else if (m_sample == SAMPLE_16) {
+			header.signature = INDIGO_RAW_RGB48;
+		} else {
+			return QByteArray();
+		}
+	} else {
+		if (m_sample == SAMPLE_8) {
+			header.signature = INDIGO_RAW_MONO8;
+		} else if (m_sample == SAMPLE_16) {
+			header.signature = INDIGO_RAW_MONO16;
+		} else {
+			return QByteArray();
+		}
+	}
+	header.width = m_width;
+	header.height = m_height;
+
+	QByteArray raw((const char *)&header, sizeof(header));
+	raw.append((const char *)m_data, size());
+	if (m_layout == FRAME_CFA) {
+		raw.append("SIMPLE=T;BAYERPAT='RGGB';");
+	}
+	return raw;
+}
+
+/* JPEG can hold only 8 bit data */
+QByteArray SynthFrame::encode_jpeg(int quality) const {
+	if (!is_valid() || m_sample != SAMPLE_8 || m_layout == FRAME_CFA) return QByteArray();
+	QImage image(m_data, m_width, m_height, m_width * channels(), m_layout == FRAME_RGB ? QImage::Format_RGB888 : QImage::Format_Grayscale8);
+	QByteArray jpeg;
+	QBuffer buffer(&jpeg);
+	buffer.open(QIODevice::WriteOnly);
+	if (!image.save(&buffer, "JPG", quality)) return QByteArray();
+	return jpeg;
+}
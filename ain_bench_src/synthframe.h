@@ -0,0 +1,80 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _SYNTHFRAME_H
+#define _SYNTHFRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <QByteArray>
+
+typedef enum {
+	FRAME_MONO = 0,
+	FRAME_CFA,      /* RGGB mosaic */
+	FRAME_RGB
+} synth_frame_layout;
+
+/* sample types, the values are FITS BITPIX */
+typedef enum {
+	SAMPLE_8 = 8,
+	SAMPLE_16 = 16,
+	SAMPLE_32 = 32,
+	SAMPLE_FLOAT = -32
+} synth_frame_sample;
+
+/* A star field with sky background, Gaussian stars and read/shot noise. The pixels are
+   native endian, RGB frames are interleaved (PIX_FMT_RGB24 ... PIX_FMT_RGBF). The same
+   seed and geometry always give the same pixels so results of revisions are comparable. */
+class SynthFrame {
+public:
+	SynthFrame(synth_frame_layout layout, synth_frame_sample sample, int width, int height, unsigned int seed = 1);
+	~SynthFrame();
+
+	bool is_valid() const { return m_data != nullptr; }
+	const char *name() const;
+
+	synth_frame_layout layout() const { return m_layout; }
+	synth_frame_sample sample() const { return m_sample; }
+	int width() const { return m_width; }
+	int height() const { return m_height; }
+	int channels() const { return m_layout == FRAME_RGB ? 3 : 1; }
+	int sample_size() const { return abs((int)m_sample) / 8; }
+	size_t size() const { return (size_t)m_width * m_height * channels() * sample_size(); }
+	const uint8_t *data() const { return m_data; }
+
+	/* PIX_FMT_* of data(), CFA frames give the Bayer format */
+	uint32_t pix_format() const;
+
+	/* in memory images as received in a BLOB, empty if the format can not hold the frame */
+	QByteArray encode_fits() const;
+	QByteArray encode_xisf(const char *compression = nullptr) const;  /* nullptr, "lz4", "zlib", "zlib+sh" */
+	QByteArray encode_raw() const;
+	QByteArray encode_jpeg(int quality = 90) const;
+
+private:
+	synth_frame_layout m_layout;
+	synth_frame_sample m_sample;
+	int m_width;
+	int m_height;
+	uint8_t *m_data;
+
+	void render(unsigned int seed);
+};
+
+#endif /* _SYNTHFRAME_H */
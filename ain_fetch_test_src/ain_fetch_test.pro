@@ -0,0 +1,46 @@
+QT += core gui network
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+OBJECTS_DIR=object
+MOC_DIR=moc
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# Tests the BLOB fetcher of Ain Imager against a local HTTP stand-in server, it is not
+# part of ain_suite.pro:
+#   cd ain_fetch_test_src && qmake && make && ./ain_fetch_test
+
+SOURCES += \
+	main.cpp \
+	../ain_imager_src/blobfetcher.cpp \
+	../ain_imager_src/videocapture.cpp \
+	../common_src/ser.c \
+	../common_src/sharpness.cpp \
+	../common_src/pipetrace.cpp
+
+HEADERS += \
+	../ain_imager_src/blobfetcher.h \
+	../ain_imager_src/videocapture.h \
+	../common_src/ser.h \
+	../common_src/sharpness.h \
+	../common_src/pipetrace.h
+
+INCLUDEPATH += "../indigo/indigo_libs" + "../external" + "../external/lz4/" + "../common_src" + "../ain_imager_src"
+LIBS += -L"../external/lz4" -L"../../external/lz4" -lz
+
+unix:!mac {
+	INCLUDEPATH += "../external/libjpeg"
+	LIBS += -L"../external/libjpeg/.libs" -L"../indigo/build/lib" -l:libindigo.a -lz -ljpeg -l:liblz4.a
+}
+
+unix:mac {
+	INCLUDEPATH += "../external/libjpeg"
+	LIBS += -L"../external/libjpeg/.libs" -L"../indigo/build/lib" -lindigo -ljpeg -llz4
+}
+
+win32 {
+	DEFINES += INDIGO_WINDOWS
+	INCLUDEPATH += ../../external/indigo_sdk/include
+	LIBS += -llz4 ../../external/indigo_sdk/lib/libindigo_client.lib -lws2_32
+}
@@ -0,0 +1,275 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+// Tests BlobFetcher against a local HTTP server standing in for the INDIGO server:
+// the downloaded data, the progress, superseded and canceled downloads, properties
+// deleted right after the fetch and the reuse of the recycled buffers. Prints the
+// result of each check and exits with the number of the failed ones.
+
+#include <stdio.h>
+#include <string.h>
+#include <functional>
+#include <mutex>
+#include <QCoreApplication>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QList>
+#include <blobfetcher.h>
+#include <sessionrecorder.h>
+
+#define TEST_CHUNK (16 * 1024)
+#define TEST_CHUNK_INTERVAL 20  /* ms */
+#define TEST_TIMEOUT 10000      /* ms */
+#define TEST_QUIET_TIME 1500    /* ms, longer than a slow response */
+#define TEST_DEVICE "Imager Agent"
+#define TEST_PROPERTY "CCD_IMAGE"
+
+/* The session recorder is not tested here, the fetcher only asks if it records. */
+SessionRecorder::SessionRecorder() {
+	m_recording = false;
+	m_file = nullptr;
+	m_records = 0;
+	m_bytes = 0;
+}
+
+void SessionRecorder::record_blob(const char *device, const char *property, indigo_item *item) {
+	Q_UNUSED(device);
+	Q_UNUSED(property);
+	Q_UNUSED(item);
+}
+
+static uint8_t test_byte(qint64 offset, int seed) {
+	return (uint8_t)(offset * 31 + (offset >> 8) + seed * 7);
+}
+
+typedef struct {
+	QByteArray data;
+	bool slow;
+} test_response;
+
+/* Answers the requests of one connection in order, the fetcher pipelines them. */
+class StandInConnection : public QObject {
+public:
+	StandInConnection(QTcpSocket *socket) : m_socket(socket), m_offset(0) {
+		m_timer.setInterval(TEST_CHUNK_INTERVAL);
+		connect(&m_timer, &QTimer::timeout, this, &StandInConnection::write_chunk);
+		connect(socket, &QTcpSocket::readyRead, this, &StandInConnection::read_requests);
+		connect(socket, &QTcpSocket::disconnected, this, &StandInConnection::close);
+	}
+
+private:
+	QTcpSocket *m_socket;
+	QByteArray m_input;
+	QList<test_response> m_responses;
+	QTimer m_timer;
+	int m_offset;
+
+	/* GET /<size>/<seed>[/slow] */
+	void read_requests() {
+		m_input += m_socket->readAll();
+		int end;
+		while ((end = m_input.indexOf("\r\n\r\n")) >= 0) {
+			QList<QByteArray> request_line = m_input.left(m_input.indexOf("\r\n")).split(' ');
+			m_input.remove(0, end + 4);
+			QList<QByteArray> path = request_line.value(1).split('/');
+			qint64 size = path.value(1).toLongLong();
+			int seed = path.value(2).toInt();
+			test_response response;
+			response.slow = path.value(3) == "slow";
+			response.data = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: " + QByteArray::number(size) + "\r\n\r\n";
+			int header_size = response.data.size();
+			response.data.resize(header_size + size);
+			for (qint64 i = 0; i < size; i++) response.data[(int)(header_size + i)] = (char)test_byte(i, seed);
+			m_responses.append(response);
+		}
+		if (!m_timer.isActive()) write_responses();
+	}
+
+	void write_responses() {
+		while (!m_responses.isEmpty() && !m_responses.first().slow) {
+			m_socket->write(m_responses.takeFirst().data);
+		}
+		if (!m_responses.isEmpty()) m_timer.start();
+	}
+
+	void write_chunk() {
+		const QByteArray &data = m_responses.first().data;
+		int size = qMin(TEST_CHUNK, data.size() - m_offset);
+		m_socket->write(data.constData() + m_offset, size);
+		m_offset += size;
+		if (m_offset == data.size()) {
+			m_responses.removeFirst();
+			m_offset = 0;
+			m_timer.stop();
+			write_responses();
+		}
+	}
+
+	void close() {
+		m_timer.stop();
+		m_socket->deleteLater();
+		deleteLater();
+	}
+};
+
+class StandInServer : public QTcpServer {
+public:
+	QString url(qint64 size, int seed, bool slow = false) const {
+		return QString("http://127.0.0.1:%1/%2/%3%4").arg(serverPort()).arg(size).arg(seed).arg(slow ? "/slow" : "");
+	}
+
+protected:
+	void incomingConnection(qintptr descriptor) override {
+		QTcpSocket *socket = new QTcpSocket(this);
+		socket->setSocketDescriptor(descriptor);
+		new StandInConnection(socket);
+	}
+};
+
+typedef struct {
+	indigo_property *property;
+	indigo_item *item;
+} test_result;
+
+static std::mutex results_mutex;
+static QList<test_result> results;
+static qint64 progress_received = 0;
+static qint64 progress_total = 0;
+
+static int result_count() {
+	std::lock_guard<std::mutex> lock(results_mutex);
+	return results.size();
+}
+
+/* the server runs on this thread, the events are processed while waiting */
+static bool wait_for(std::function<bool()> done, int timeout) {
+	QElapsedTimer timer;
+	timer.start();
+	while (!done()) {
+		if (timer.elapsed() > timeout) return false;
+		QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
+		QThread::msleep(1);
+	}
+	return true;
+}
+
+static void wait_quiet(int time) {
+	wait_for([]() { return false; }, time);
+}
+
+/* the property is freed right away as if it was deleted on the bus meanwhile */
+static void fetch(const QString &url, qint64 size) {
+	indigo_property *property = (indigo_property *)calloc(1, sizeof(indigo_property));
+	strcpy(property->device, TEST_DEVICE);
+	strcpy(property->name, TEST_PROPERTY);
+	indigo_item *item = (indigo_item *)calloc(1, sizeof(indigo_item));
+	strcpy(item->name, "IMAGE");
+	strcpy(item->blob.format, ".raw");
+	strncpy(item->blob.url, url.toUtf8().constData(), INDIGO_VALUE_SIZE - 1);
+	item->blob.size = size;
+	BlobFetcher::instance().fetch(property, item);
+	memset(property, 0xff, sizeof(indigo_property));
+	free(property);
+}
+
+static void cancel() {
+	indigo_property property;
+	memset(&property, 0, sizeof(property));
+	strcpy(property.device, TEST_DEVICE);
+	strcpy(property.name, TEST_PROPERTY);
+	BlobFetcher::instance().cancel(&property);
+}
+
+static bool check_result(int index, qint64 size, int seed) {
+	std::lock_guard<std::mutex> lock(results_mutex);
+	if (index >= results.size()) return false;
+	const test_result &result = results[index];
+	if (strcmp(result.property->device, TEST_DEVICE) || strcmp(result.property->name, TEST_PROPERTY)) return false;
+	if (result.item->blob.size != size || result.item->blob.value == nullptr) return false;
+	const uint8_t *data = (const uint8_t *)result.item->blob.value;
+	for (qint64 i = 0; i < size; i++) {
+		if (data[i] != test_byte(i, seed)) return false;
+	}
+	return true;
+}
+
+static int report(const char *check, bool ok) {
+	printf("%-40s %s\n", check, ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+	QCoreApplication app(argc, argv);
+	StandInServer server;
+	if (!server.listen(QHostAddress::LocalHost, 0)) {
+		fprintf(stderr, "can not start the stand-in server: %s\n", server.errorString().toUtf8().constData());
+		return 1;
+	}
+
+	BlobFetcher &fetcher = BlobFetcher::instance();
+	QObject::connect(&fetcher, &BlobFetcher::blob_fetched, [](indigo_property *property, indigo_item *item) {
+		std::lock_guard<std::mutex> lock(results_mutex);
+		results.append({ property, item });
+	});
+	QObject::connect(&fetcher, &BlobFetcher::blob_progress, [](QString device, QString property, qint64 received, qint64 total) {
+		Q_UNUSED(device);
+		Q_UNUSED(property);
+		std::lock_guard<std::mutex> lock(results_mutex);
+		progress_received = received;
+		progress_total = total;
+	});
+	fetcher.start();
+
+	int failed = 0;
+	const qint64 size = 3 * 1024 * 1024 + 123;
+
+	fetch(server.url(size, 1), size);
+	bool ok = wait_for([]() { return result_count() == 1; }, TEST_TIMEOUT) && check_result(0, size, 1);
+	failed += report("download", ok);
+	failed += report("progress", progress_received == size && progress_total == size);
+
+	void *buffer = results[0].item->blob.value;
+	fetcher.recycle(buffer, results[0].item->blob.size);
+	results[0].item->blob.value = nullptr;
+	fetch(server.url(size, 2), size);
+	ok = wait_for([]() { return result_count() == 2; }, TEST_TIMEOUT) && check_result(1, size, 2);
+	failed += report("download to a recycled buffer", ok && results[1].item->blob.value == buffer);
+
+	fetch(server.url(size / 4, 3, true), size / 4);
+	fetch(server.url(size / 2, 4), size / 2);
+	ok = wait_for([]() { return result_count() == 3; }, TEST_TIMEOUT) && check_result(2, size / 2, 4);
+	wait_quiet(TEST_QUIET_TIME);
+	failed += report("superseded download", ok && result_count() == 3);
+
+	fetch(server.url(size / 4, 5, true), size / 4);
+	wait_quiet(TEST_QUIET_TIME / 10);
+	cancel();
+	wait_quiet(TEST_QUIET_TIME);
+	failed += report("canceled download", result_count() == 3);
+
+	fetcher.stop();
+	for (auto result : results) {
+		free(result.item->blob.value);
+		free(result.item);
+	}
+	return failed;
+}
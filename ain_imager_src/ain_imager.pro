@@ -38,11 +38,22 @@ SOURCES += \
 	imagerwindow.cpp \
 	qindigoservice.cpp \
 	indigoclient.cpp \
+	blobfetcher.cpp \
+	localdrivers.cpp \
+	sessionrecorder.cpp \
+	videocapture.cpp \
 	qindigoservers.cpp \
 	propertycache.cpp \
 	handlepropertychange.cpp \
 	focusgraph.cpp \
+	guidehistory.cpp \
+	logwriter.cpp \
+	objectsearch.cpp \
+	catalogindex.cpp \
+	catalogfile.cpp \
+	visibility.cpp \
 	blobpreview.cpp \
+	previewlane.cpp \
 	sequence_editor.cpp \
 	sequence_tab.cpp \
 	syncutils.cpp \
@@ -54,8 +65,15 @@ SOURCES += \
 	../common_src/imageviewer.cpp \
 	../common_src/fits.c \
 	../common_src/xisf.c \
+	../common_src/ser.c \
 	../common_src/xml.c \
 	../common_src/stretcher.cpp \
+	../common_src/livestack.cpp \
+	../common_src/pipetrace.cpp \
+	../common_src/pixel_kernels.cpp \
+	../common_src/calibration.cpp \
+	../common_src/defectmap.cpp \
+	../common_src/sharpness.cpp \
 	../common_src/image_stats.cpp \
 	../common_src/dslr_raw.c \
 	../external/qcustomplot/qcustomplot.cpp
@@ -120,6 +138,10 @@ HEADERS += \
 	imagerwindow.h \
 	qindigoservice.h \
 	indigoclient.h \
+	blobfetcher.h \
+	localdrivers.h \
+	sessionrecorder.h \
+	videocapture.h \
 	propertycache.h \
 	customobject.h \
 	customobjectmodel.h \
@@ -127,9 +149,17 @@ HEADERS += \
 	qindigoservers.h \
 	logger.h \
 	focusgraph.h \
+	ringseries.h \
+	guidehistory.h \
+	logwriter.h \
+	objectsearch.h \
+	catalogindex.h \
+	catalogfile.h \
+	visibility.h \
 	conf.h \
 	widget_state.h \
 	blobpreview.h \
+	previewlane.h \
 	sequence_editor.h \
 	syncutils.h \
 	qconfigdialog.h \
@@ -141,11 +171,21 @@ HEADERS += \
 	../common_src/imageviewer.h \
 	../common_src/fits.h \
 	../common_src/xisf.h \
+	../common_src/ser.h \
 	../common_src/xml.h \
 	../common_src/pixelformat.h \
 	../external/qcustomplot/qcustomplot.h \
 	../common_src/coordconv.h \
 	../common_src/stretcher.h \
+	../common_src/livestack.h \
+	../common_src/pipetrace.h \
+	../common_src/pixel_kernels.h \
+	../common_src/pixel_kernels_impl.h \
+	../common_src/pixel_kernels_reference.h \
+	../common_src/calibration.h \
+	../common_src/defectmap.h \
+	../common_src/stardetector.h \
+	../common_src/sharpness.h \
 	../common_src/image_stats.h \
 	../common_src/dslr_raw.h
 
@@ -168,6 +208,15 @@ unix:!mac {
 	LIBS += -L"../external/libjpeg/.libs" -L"../indigo/build/lib" -lindigo -ljpeg -l:liblz4.a
 }
 
+# "qmake CATALOG_STARS=tycho2.csv && make ain_catalog.aincat" generates a binary
+# catalog from star lists, catalog files in <config path>/catalogs are loaded at
+# startup, see catalogfile.h. The built in objects are compiled in already.
+for(stars, CATALOG_STARS): CATALOG_SOURCES += -s $$stars
+catalog.target = ain_catalog.aincat
+catalog.commands = perl $$PWD/../object_data/bin_catalog_generate.pl $$CATALOG_SOURCES -o $$catalog.target
+catalog.depends = $$CATALOG_STARS $$PWD/../object_data/bin_catalog_generate.pl
+QMAKE_EXTRA_TARGETS += catalog
+
 DISTFILES += \
 	README.md \
 	LICENCE.md \
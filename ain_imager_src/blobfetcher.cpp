@@ -0,0 +1,304 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <QNetworkAccessManager>
+#include <QNetworkRequest>
+#include <QNetworkReply>
+#include <QUrl>
+#include <pipetrace.h>
+#include "blobfetcher.h"
+#include "sessionrecorder.h"
+#include "videocapture.h"
+
+BlobFetcher::BlobFetcher() {
+	m_manager = nullptr;
+	moveToThread(&m_thread);
+	connect(&m_thread, &QThread::started, this, &BlobFetcher::on_started);
+	connect(this, &BlobFetcher::fetch_requested, this, &BlobFetcher::on_fetch, Qt::QueuedConnection);
+	connect(this, &BlobFetcher::cancel_requested, this, &BlobFetcher::on_cancel, Qt::QueuedConnection);
+}
+
+BlobFetcher::~BlobFetcher() {
+	stop();
+	for (auto property : m_properties) free(property);
+}
+
+void BlobFetcher::start() {
+	if (m_thread.isRunning()) return;
+	m_thread.setObjectName("BLOB fetcher");
+	m_thread.start();
+}
+
+void BlobFetcher::stop() {
+	if (!m_thread.isRunning()) return;
+	QMetaObject::invokeMethod(this, "on_stop", Qt::BlockingQueuedConnection);
+	m_thread.quit();
+	m_thread.wait();
+}
+
+void BlobFetcher::fetch(indigo_property *property, indigo_item *blob_item) {
+	// the property is not used after the queued hop, it may be deleted meanwhile
+	emit(fetch_requested(QString(property->device), QString(property->name), blob_item));
+}
+
+void BlobFetcher::cancel(indigo_property *property) {
+	emit(cancel_requested(QString(property->device), QString(property->name)));
+}
+
+void BlobFetcher::recycle(void *buffer, qint64 size) {
+	if (buffer == nullptr) return;
+	release_buffer((char *)buffer, size);
+}
+
+QString BlobFetcher::create_key(const QString &device, const QString &property, indigo_item *item) {
+	return device + "." + property + "." + QString(item->name);
+}
+
+/* The receivers get this copy instead of the bus property, it is kept as long as the
+   fetcher exists as they may still hold it. Downloads are started for OK properties only. */
+indigo_property *BlobFetcher::blob_property(const QString &device, const QString &property) {
+	QString key = device + "." + property;
+	indigo_property *copy = m_properties.value(key, nullptr);
+	if (copy == nullptr) {
+		copy = (indigo_property *)calloc(1, sizeof(indigo_property));
+		strncpy(copy->device, device.toUtf8().constData(), INDIGO_NAME_SIZE - 1);
+		strncpy(copy->name, property.toUtf8().constData(), INDIGO_NAME_SIZE - 1);
+		copy->type = INDIGO_BLOB_VECTOR;
+		copy->state = INDIGO_OK_STATE;
+		copy->perm = INDIGO_RO_PERM;
+		m_properties.insert(key, copy);
+	}
+	return copy;
+}
+
+void BlobFetcher::on_started() {
+	m_manager = new QNetworkAccessManager();
+	indigo_debug("BLOB fetcher started\n");
+}
+
+void BlobFetcher::on_stop() {
+	while (!m_transfers.isEmpty()) {
+		abort(m_transfers.begin().value());
+	}
+	m_pool_mutex.lock();
+	while (!m_buffer_pool.isEmpty()) {
+		free(m_buffer_pool.takeFirst().first);
+	}
+	m_pool_mutex.unlock();
+	delete m_manager;
+	m_manager = nullptr;
+	indigo_debug("BLOB fetcher stopped\n");
+}
+
+void BlobFetcher::on_fetch(QString device, QString property, indigo_item *blob_item) {
+	QString key = create_key(device, property, blob_item);
+
+	// a new image makes the previous one obsolete, there is no point in finishing it
+	blob_transfer *old_transfer = m_transfers.value(key, nullptr);
+	if (old_transfer) {
+		indigo_debug("%s: download superseded (%lld bytes received)\n", key.toUtf8().constData(), old_transfer->received);
+		VideoCapture::instance().frame_lost(blob_property(device, property));
+		abort(old_transfer);
+	}
+
+	if (m_manager == nullptr) {
+		free(blob_item);
+		return;
+	}
+
+	blob_transfer *transfer = new blob_transfer;
+	transfer->key = key;
+	transfer->device = device;
+	transfer->name = property;
+	transfer->item = blob_item;
+	transfer->buffer = nullptr;
+	transfer->buffer_size = 0;
+	transfer->received = 0;
+	transfer->reported = 0;
+	transfer->trace_start = pipe_trace_enabled() ? pipe_trace_now() : 0;
+
+	QNetworkRequest request(QUrl(QString(blob_item->blob.url)));
+	request.setAttribute(QNetworkRequest::HttpPipeliningAllowedAttribute, true);
+	transfer->reply = m_manager->get(request);
+	transfer->reply->setReadBufferSize(BLOB_PROGRESS_STEP);
+	m_transfers.insert(key, transfer);
+
+	connect(transfer->reply, &QNetworkReply::readyRead, this, [this, transfer]() {
+		read_data(transfer);
+	});
+	connect(transfer->reply, &QNetworkReply::finished, this, [this, transfer]() {
+		finish(transfer);
+	});
+	indigo_debug("%s: downloading %s\n", key.toUtf8().constData(), blob_item->blob.url);
+}
+
+void BlobFetcher::on_cancel(QString device, QString property) {
+	QList<blob_transfer*> canceled;
+	for (auto transfer : m_transfers) {
+		if (transfer->device == device && transfer->name == property) canceled.append(transfer);
+	}
+	for (auto transfer : canceled) {
+		indigo_debug("%s: download canceled\n", transfer->key.toUtf8().constData());
+		abort(transfer);
+	}
+}
+
+bool BlobFetcher::read_data(blob_transfer *transfer) {
+	QNetworkReply *reply = transfer->reply;
+	if (transfer->buffer == nullptr) {
+		// the content length is the compressed size for gzip encoded transfers, the buffer grows if needed
+		qint64 size = reply->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+		if (size < transfer->item->blob.size) size = transfer->item->blob.size;
+		if (size <= 0) size = BLOB_PROGRESS_STEP;
+		transfer->buffer = acquire_buffer(size, &transfer->buffer_size);
+		if (transfer->buffer == nullptr) {
+			indigo_error("%s: can not allocate %lld bytes\n", transfer->key.toUtf8().constData(), size);
+			abort(transfer);
+			return false;
+		}
+	}
+
+	qint64 available;
+	while ((available = reply->bytesAvailable()) > 0) {
+		if (transfer->received + available > transfer->buffer_size) {
+			qint64 new_size = transfer->buffer_size * 2;
+			if (new_size < transfer->received + available) new_size = transfer->received + available;
+			char *buffer = (char *)realloc(transfer->buffer, new_size);
+			if (buffer == nullptr) {
+				indigo_error("%s: can not allocate %lld bytes\n", transfer->key.toUtf8().constData(), new_size);
+				abort(transfer);
+				return false;
+			}
+			transfer->buffer = buffer;
+			transfer->buffer_size = new_size;
+		}
+		qint64 read = reply->read(transfer->buffer + transfer->received, available);
+		if (read <= 0) break;
+		transfer->received += read;
+	}
+
+	if (transfer->received - transfer->reported >= BLOB_PROGRESS_STEP) {
+		transfer->reported = transfer->received;
+		qint64 total = reply->header(QNetworkRequest::ContentLengthHeader).toLongLong();
+		if (total < transfer->received) total = transfer->item->blob.size;
+		emit(blob_progress(transfer->device, transfer->name, transfer->received, total));
+	}
+	return true;
+}
+
+void BlobFetcher::finish(blob_transfer *transfer) {
+	QNetworkReply *reply = transfer->reply;
+	if (reply->error() != QNetworkReply::NoError) {
+		indigo_error("%s: download failed: %s\n", transfer->key.toUtf8().constData(), reply->errorString().toUtf8().constData());
+		abort(transfer);
+		return;
+	}
+
+	if (!read_data(transfer)) return;
+	if (transfer->buffer == nullptr || transfer->received == 0) {
+		indigo_error("%s: no data received\n", transfer->key.toUtf8().constData());
+		abort(transfer);
+		return;
+	}
+
+	indigo_item *blob_item = transfer->item;
+	blob_item->blob.value = transfer->buffer;
+	blob_item->blob.size = transfer->received;
+	emit(blob_progress(transfer->device, transfer->name, transfer->received, transfer->received));
+	if (transfer->trace_start) pipe_trace_add(PIPE_TRACE_DOWNLOAD, transfer->trace_start, pipe_trace_now());
+	indigo_debug("%s: %ld bytes received\n", transfer->key.toUtf8().constData(), blob_item->blob.size);
+
+	if (SessionRecorder::instance().is_recording()) {
+		SessionRecorder::instance().record_blob(transfer->device.toUtf8().constData(), transfer->name.toUtf8().constData(), blob_item);
+	}
+
+	// in the video file and not due for the preview, the buffer is reused for the next frame
+	indigo_property *property = blob_property(transfer->device, transfer->name);
+	if (VideoCapture::instance().capture(property, blob_item)) {
+		abort(transfer);
+		return;
+	}
+
+	// buffer and item now belong to the receiver, it recycles the buffer when done
+	transfer->buffer = nullptr;
+	transfer->item = nullptr;
+	emit(blob_fetched(property, blob_item));
+	release(transfer);
+}
+
+void BlobFetcher::abort(blob_transfer *transfer) {
+	if (transfer->buffer) {
+		release_buffer(transfer->buffer, transfer->buffer_size);
+		transfer->buffer = nullptr;
+	}
+	if (transfer->item) {
+		free(transfer->item);
+		transfer->item = nullptr;
+	}
+	release(transfer);
+}
+
+void BlobFetcher::release(blob_transfer *transfer) {
+	if (m_transfers.value(transfer->key, nullptr) == transfer) {
+		m_transfers.remove(transfer->key);
+	}
+	QNetworkReply *reply = transfer->reply;
+	reply->disconnect(this);
+	if (reply->isRunning()) reply->abort();
+	reply->deleteLater();
+	delete transfer;
+}
+
+/* Buffers of canceled or failed downloads and the ones recycled by the receivers
+   are kept and reused. */
+char *BlobFetcher::acquire_buffer(qint64 size, qint64 *buffer_size) {
+	QMutexLocker lock(&m_pool_mutex);
+	int best = -1;
+	for (int i = 0; i < m_buffer_pool.size(); i++) {
+		if (m_buffer_pool[i].second >= size && (best < 0 || m_buffer_pool[i].second < m_buffer_pool[best].second)) {
+			best = i;
+		}
+	}
+	if (best >= 0) {
+		QPair<char*, qint64> buffer = m_buffer_pool.takeAt(best);
+		*buffer_size = buffer.second;
+		return buffer.first;
+	}
+	if (!m_buffer_pool.isEmpty()) {
+		QPair<char*, qint64> buffer = m_buffer_pool.takeLast();
+		char *data = (char *)realloc(buffer.first, size);
+		if (data == nullptr) {
+			free(buffer.first);
+			return nullptr;
+		}
+		*buffer_size = size;
+		return data;
+	}
+	char *data = (char *)malloc(size);
+	*buffer_size = data ? size : 0;
+	return data;
+}
+
+void BlobFetcher::release_buffer(char *buffer, qint64 buffer_size) {
+	QMutexLocker lock(&m_pool_mutex);
+	if (m_buffer_pool.size() < BLOB_POOL_SIZE) {
+		m_buffer_pool.append(QPair<char*, qint64>(buffer, buffer_size));
+	} else {
+		free(buffer);
+	}
+}
@@ -0,0 +1,111 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _BLOBFETCHER_H
+#define _BLOBFETCHER_H
+
+#include <QObject>
+#include <QThread>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <indigo/indigo_bus.h>
+
+#define BLOB_POOL_SIZE 4
+#define BLOB_PROGRESS_STEP (1024 * 1024)
+
+class QNetworkAccessManager;
+class QNetworkReply;
+
+typedef struct {
+	QString key;
+	QString device;
+	QString name;
+	indigo_item *item;
+	QNetworkReply *reply;
+	char *buffer;
+	qint64 buffer_size;
+	qint64 received;
+	qint64 reported;
+	int64_t trace_start;
+} blob_transfer;
+
+/* Fetches BLOB URLs on a dedicated I/O thread so that the INDIGO client thread
+   is never blocked by large image transfers. Only HTTP is used, so any plain
+   HTTP server can stand in for the INDIGO server. */
+class BlobFetcher : public QObject {
+	Q_OBJECT
+public:
+	static BlobFetcher& instance();
+
+	BlobFetcher();
+	~BlobFetcher();
+
+	void start();
+	void stop();
+
+	/* Takes ownership of blob_item, a download of the same item still in progress is canceled.
+	   Thread safe - can be called from the INDIGO client thread. Only the device and property
+	   names are used, the property may be deleted right after the call. */
+	void fetch(indigo_property *property, indigo_item *blob_item);
+	void cancel(indigo_property *property);
+	/* Thread safe, returns a malloc()ed buffer to the pool, e.g. the blob of a fetched
+	   item the receiver is done with. */
+	void recycle(void *buffer, qint64 size);
+
+signals:
+	/* blob_item_copy->blob.value is malloc()ed and must be freed or recycled by the receiver,
+	   property is a copy without items owned by the fetcher, valid for the lifetime of the application */
+	void blob_fetched(indigo_property *property, indigo_item *blob_item_copy);
+	void blob_progress(QString device, QString property, qint64 received, qint64 total);
+
+	void fetch_requested(QString device, QString property, indigo_item *blob_item);
+	void cancel_requested(QString device, QString property);
+
+private slots:
+	void on_started();
+	void on_fetch(QString device, QString property, indigo_item *blob_item);
+	void on_cancel(QString device, QString property);
+	void on_stop();
+
+private:
+	QThread m_thread;
+	QNetworkAccessManager *m_manager;
+	QHash<QString, blob_transfer*> m_transfers;
+	QHash<QString, indigo_property*> m_properties;
+	QMutex m_pool_mutex;
+	QList<QPair<char*, qint64>> m_buffer_pool;
+
+	QString create_key(const QString &device, const QString &property, indigo_item *item);
+	indigo_property *blob_property(const QString &device, const QString &property);
+	bool read_data(blob_transfer *transfer);
+	void finish(blob_transfer *transfer);
+	void abort(blob_transfer *transfer);
+	void release(blob_transfer *transfer);
+
+	char *acquire_buffer(qint64 size, qint64 *buffer_size);
+	void release_buffer(char *buffer, qint64 buffer_size);
+};
+
+inline BlobFetcher& BlobFetcher::instance() {
+	static BlobFetcher* me = nullptr;
+	if (!me) me = new BlobFetcher();
+	return *me;
+}
+
+#endif /* _BLOBFETCHER_H */
@@ -16,8 +16,11 @@
 // NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <unistd.h>
+#include <QScreen>
 #include "imagerwindow.h"
 #include "propertycache.h"
+#include "videocapture.h"
 #include <libgen.h>
 #include <conf.h>
 #include <utils.h>
@@ -435,6 +438,16 @@ void ImagerWindow::create_imager_tab(QFrame *capture_frame) {
 	remote_files_frame_layout->addWidget(m_keep_image_on_server_cbox, remote_files_row, 0, 1, 4);
 	connect(m_keep_image_on_server_cbox, &QPushButton::clicked, this, &ImagerWindow::on_keep_image_on_server);
 
+	remote_files_row++;
+	label = new QLabel("Images in flight:");
+	remote_files_frame_layout->addWidget(label, remote_files_row, 0, 1, 2);
+	m_download_in_flight = new QSpinBox();
+	m_download_in_flight->setToolTip("Number of downloaded images being verified and saved while the next one is transferred");
+	m_download_in_flight->setRange(1, AIN_DOWNLOAD_MAX_IN_FLIGHT);
+	m_download_in_flight->setValue(conf.download_in_flight);
+	remote_files_frame_layout->addWidget(m_download_in_flight, remote_files_row, 2, 1, 2);
+	connect(m_download_in_flight, QOverload<int>::of(&QSpinBox::valueChanged), this, &ImagerWindow::on_download_in_flight_changed);
+
 	remote_files_row++;
 	spacer = new QSpacerItem(1, 10, QSizePolicy::Expanding, QSizePolicy::Maximum);
 	remote_files_frame_layout->addItem(spacer, remote_files_row, 0, 1, 4);
@@ -464,9 +477,96 @@ void ImagerWindow::create_imager_tab(QFrame *capture_frame) {
 	m_download_progress->setMaximum(1);
 	m_download_progress->setValue(0);
 	m_download_progress->setFormat("Download progress");
+
+	// Video
+	QFrame *video_frame = new QFrame();
+	capture_tabbar->addTab(video_frame, "Video");
+
+	QGridLayout *video_frame_layout = new QGridLayout();
+	video_frame_layout->setAlignment(Qt::AlignTop);
+	video_frame->setLayout(video_frame_layout);
+	video_frame->setFrameShape(QFrame::StyledPanel);
+	video_frame->setContentsMargins(0, 0, 0, 0);
+
+	int video_row = 0;
+	m_video_capture_cbox = new QCheckBox("Capture RAW frames to a SER video");
+	m_video_capture_cbox->setToolTip("Expose appends the frames to one SER file instead of saving each of them,\nthe preview is updated at the display refresh rate");
+	m_video_capture_cbox->setChecked(false);
+	video_frame_layout->addWidget(m_video_capture_cbox, video_row, 0, 1, 4);
+	connect(m_video_capture_cbox, &QCheckBox::stateChanged, this, &ImagerWindow::on_video_capture_changed);
+
+	video_row++;
+	label = new QLabel("Buffer (MB):");
+	video_frame_layout->addWidget(label, video_row, 0, 1, 2);
+	m_video_buffer_size = new QSpinBox();
+	m_video_buffer_size->setToolTip("Memory for the frames waiting to be written, allocated when the capture starts");
+	m_video_buffer_size->setRange(AIN_VIDEO_BUFFER_MIN, AIN_VIDEO_BUFFER_MAX);
+	m_video_buffer_size->setSingleStep(AIN_VIDEO_BUFFER_MIN);
+	m_video_buffer_size->setValue(conf.video_buffer_size);
+	video_frame_layout->addWidget(m_video_buffer_size, video_row, 2, 1, 2);
+	connect(m_video_buffer_size, QOverload<int>::of(&QSpinBox::valueChanged), this, &ImagerWindow::on_video_buffer_size_changed);
+
+	video_row++;
+	label = new QLabel("Keep sharpest (%):");
+	video_frame_layout->addWidget(label, video_row, 0, 1, 2);
+	m_video_keep_best = new QSpinBox();
+	m_video_keep_best->setToolTip("Lucky imaging: only this percentage of the sharpest frames of each second is written\nand the preview shows the sharpest frame of the last second, 100% writes all frames");
+	m_video_keep_best->setRange(1, AIN_VIDEO_KEEP_ALL);
+	m_video_keep_best->setValue(conf.video_keep_best);
+	video_frame_layout->addWidget(m_video_keep_best, video_row, 2, 1, 2);
+	connect(m_video_keep_best, QOverload<int>::of(&QSpinBox::valueChanged), this, &ImagerWindow::on_video_keep_best_changed);
+
+	video_row++;
+	m_video_capture_label = new QLabel("Video: Idle");
+	video_frame_layout->addWidget(m_video_capture_label, video_row, 0, 1, 4);
+	connect(&VideoCapture::instance(), &VideoCapture::capture_progress, this, &ImagerWindow::on_video_capture_progress, Qt::QueuedConnection);
+
+	// Live stack
+	QFrame *stack_frame = new QFrame();
+	capture_tabbar->addTab(stack_frame, "Live stack");
+
+	QGridLayout *stack_frame_layout = new QGridLayout();
+	stack_frame_layout->setAlignment(Qt::AlignTop);
+	stack_frame->setLayout(stack_frame_layout);
+	stack_frame->setFrameShape(QFrame::StyledPanel);
+	stack_frame->setContentsMargins(0, 0, 0, 0);
+
+	int stack_row = 0;
+	m_live_stack_cbox = new QCheckBox("Stack the preview frames");
+	m_live_stack_cbox->setToolTip("The frames are aligned on the stars of the first one and added to the stack,\nthe preview shows the stack instead of the last frame");
+	m_live_stack_cbox->setChecked(false);
+	stack_frame_layout->addWidget(m_live_stack_cbox, stack_row, 0, 1, 4);
+	connect(m_live_stack_cbox, &QCheckBox::stateChanged, this, &ImagerWindow::on_live_stack_changed);
+
+	stack_row++;
+	label = new QLabel("Combine:");
+	stack_frame_layout->addWidget(label, stack_row, 0, 1, 2);
+	m_live_stack_mode_select = new QComboBox();
+	m_live_stack_mode_select->setToolTip("Kappa-sigma rejects satellite trails and other outliers, it needs twice the memory of the mean");
+	m_live_stack_mode_select->addItem("Mean");
+	m_live_stack_mode_select->addItem("Kappa-sigma mean");
+	m_live_stack_mode_select->setCurrentIndex(conf.live_stack_mode);
+	stack_frame_layout->addWidget(m_live_stack_mode_select, stack_row, 2, 1, 2);
+	connect(m_live_stack_mode_select, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &ImagerWindow::on_live_stack_mode_changed);
+
+	stack_row++;
+	m_live_stack_reset_button = new QPushButton("Reset");
+	m_live_stack_reset_button->setToolTip("Start a new stack with the next frame as the reference");
+	m_live_stack_reset_button->setStyleSheet("min-width: 30px");
+	stack_frame_layout->addWidget(m_live_stack_reset_button, stack_row, 0, 1, 2);
+	connect(m_live_stack_reset_button, &QPushButton::clicked, this, &ImagerWindow::on_live_stack_reset);
+
+	stack_row++;
+	m_live_stack_label = new QLabel("Stack: Idle");
+	stack_frame_layout->addWidget(m_live_stack_label, stack_row, 0, 1, 4);
 }
 
 void ImagerWindow::exposure_start_stop(bool clicked, bool is_sequence) {
+	char selected_agent[INDIGO_NAME_SIZE];
+	if (!is_sequence && m_video_capture_cbox->isChecked() && !VideoCapture::instance().isRunning() && get_selected_imager_agent(selected_agent)) {
+		indigo_property *agent_start_process = properties.get(selected_agent, AGENT_START_PROCESS_PROPERTY_NAME);
+		if (agent_start_process && agent_start_process->state != INDIGO_BUSY_STATE && !start_video_capture()) return;
+	}
 	QtConcurrent::run([=]() {
 		indigo_debug("CALLED: %s\n", __FUNCTION__);
 		static char selected_agent[INDIGO_NAME_SIZE];
@@ -809,6 +909,145 @@ void ImagerWindow::on_keep_image_on_server(int state) {
 	indigo_debug("%s\n", __FUNCTION__);
 }
 
+void ImagerWindow::on_download_in_flight_changed(int value) {
+	conf.download_in_flight = value;
+	write_conf();
+	indigo_debug("%s\n", __FUNCTION__);
+	request_next_download();
+}
+
+void ImagerWindow::on_video_capture_changed(int state) {
+	indigo_debug("%s\n", __FUNCTION__);
+	if (state == Qt::Unchecked) stop_video_capture();
+}
+
+void ImagerWindow::on_video_buffer_size_changed(int value) {
+	conf.video_buffer_size = value;
+	write_conf();
+	indigo_debug("%s\n", __FUNCTION__);
+}
+
+void ImagerWindow::on_video_keep_best_changed(int value) {
+	conf.video_keep_best = (char)value;
+	write_conf();
+	indigo_debug("%s\n", __FUNCTION__);
+}
+
+void ImagerWindow::on_video_capture_progress() {
+	if (!VideoCapture::instance().isRunning()) return;
+	if (!VideoCapture::instance().is_capturing()) {
+		// the file could not be written
+		stop_video_capture();
+		return;
+	}
+	video_capture_stats stats = VideoCapture::instance().stats();
+	QString text = QString("Video: %1 frames, %2 fps, %3 MB/s, buffer %4/%5, %6 dropped, %7 lost")
+		.arg(stats.frames)
+		.arg(stats.fps, 0, 'f', 1)
+		.arg(stats.mb_per_s, 0, 'f', 1)
+		.arg(stats.buffered)
+		.arg(stats.buffer_slots)
+		.arg(stats.dropped)
+		.arg(stats.lost);
+	if (stats.discarded) text += QString(", %1 not sharp").arg(stats.discarded);
+	m_video_capture_label->setText(text);
+}
+
+void ImagerWindow::on_live_stack_changed(int state) {
+	indigo_debug("%s\n", __FUNCTION__);
+	// a new stack each time it is enabled
+	m_live_stack->reset();
+	m_live_stack->set_enabled(state == Qt::Checked);
+	m_live_stack_label->setText(state == Qt::Checked ? "Stack: Waiting for frames..." : "Stack: Idle");
+}
+
+void ImagerWindow::on_live_stack_mode_changed(int index) {
+	conf.live_stack_mode = (char)index;
+	write_conf();
+	m_live_stack->set_mode((live_stack_mode)index);
+	if (m_live_stack->is_enabled()) m_live_stack_label->setText("Stack: Waiting for frames...");
+	indigo_debug("%s\n", __FUNCTION__);
+}
+
+void ImagerWindow::on_live_stack_reset(bool clicked) {
+	Q_UNUSED(clicked);
+	m_live_stack->reset();
+	if (m_live_stack->is_enabled()) m_live_stack_label->setText("Stack: Waiting for frames...");
+	indigo_debug("%s\n", __FUNCTION__);
+}
+
+void ImagerWindow::update_live_stack_label() {
+	static const char *results[] = { "added", "reference", "too few stars", "not aligned", "stack full", "unsupported format" };
+	live_stack_stats stats = m_live_stack->stats();
+	m_live_stack_label->setText(
+		QString("Stack: %1 frames, %2 rejected, last %3\n%4 stars, %5 matched, shift %6, %7 px, rotation %8°, %9 ms")
+		.arg(stats.stacked)
+		.arg(stats.rejected)
+		.arg(results[stats.last_result])
+		.arg(stats.last_stars)
+		.arg(stats.last_matches)
+		.arg(stats.last_dx, 0, 'f', 1)
+		.arg(stats.last_dy, 0, 'f', 1)
+		.arg(stats.last_rotation, 0, 'f', 2)
+		.arg(stats.last_ms, 0, 'f', 0)
+	);
+}
+
+/* The frames of the selected imager agent go to the video file until the exposure process ends. */
+bool ImagerWindow::start_video_capture() {
+	char selected_agent[INDIGO_NAME_SIZE];
+	char location[PATH_LEN];
+	char file_name[PATH_LEN] = {0};
+	char message[PATH_LEN + 100];
+	if (!get_selected_imager_agent(selected_agent)) return false;
+
+	m_object_name_str = m_object_name->text().trimmed();
+	if ((m_object_name_str == DEFAULT_OBJECT_NAME || m_object_name_str.isEmpty()) && !conf.save_noname_images) {
+		snprintf(message, sizeof(message), "Warning: video not captured, provide object name");
+		window_log(message, INDIGO_BUSY_STATE);
+		return false;
+	}
+	get_current_output_dir(location, conf.data_dir_prefix);
+	int fd = open_file_with_prefix(location, VIDEO_EXTENSION, file_name);
+	if (fd < 0) {
+		snprintf(message, sizeof(message), "Error: can not create '%s'", file_name);
+		window_log(message, INDIGO_ALERT_STATE);
+		return false;
+	}
+	QScreen *screen = QGuiApplication::primaryScreen();
+	double preview_rate = screen ? screen->refreshRate() : 60;
+	QString instrument = m_camera_select->currentText();
+	if (!VideoCapture::instance().start(fd, file_name, selected_agent, (size_t)conf.video_buffer_size * 1024 * 1024, preview_rate, instrument.toUtf8().constData(), conf.video_keep_best)) {
+		snprintf(message, sizeof(message), "Error: can not start video capture to '%s'", file_name);
+		window_log(message, INDIGO_ALERT_STATE);
+		unlink(file_name);
+		return false;
+	}
+	m_video_process_started = false;
+	m_video_capture_label->setText("Video: Waiting for frames...");
+	snprintf(message, sizeof(message), "Video capture to '%s' started", file_name);
+	window_log(message);
+	return true;
+}
+
+void ImagerWindow::stop_video_capture() {
+	char message[PATH_LEN + 200];
+	m_video_process_started = false;
+	if (!VideoCapture::instance().isRunning()) return;
+	video_capture_stats stats = VideoCapture::instance().stop();
+	snprintf(message, sizeof(message), "Video saved to '%s': %d frames in %.1f s, %.1f fps, %.1f MB/s, %d dropped, %d lost, %d not captured, %d not sharp",
+		VideoCapture::instance().file_name(), stats.frames, stats.elapsed, stats.fps, stats.mb_per_s, stats.dropped, stats.lost, stats.rejected, stats.discarded);
+	window_log(message, (stats.dropped || stats.lost || stats.rejected) ? INDIGO_BUSY_STATE : INDIGO_OK_STATE);
+	m_video_capture_label->setText(
+		QString("Video: %1 frames, %2 fps, %3 MB/s, %4 dropped, %5 lost")
+		.arg(stats.frames)
+		.arg(stats.fps, 0, 'f', 1)
+		.arg(stats.mb_per_s, 0, 'f', 1)
+		.arg(stats.dropped)
+		.arg(stats.lost)
+	);
+}
+
 void ImagerWindow::on_sync_remote_files(bool clicked) {
 	if (!conf.keep_images_on_server) {
 		remove_synced_remote_files();
@@ -831,11 +1070,17 @@ void ImagerWindow::sync_remote_files() {
 
 
 	if (!m_files_to_download.empty()) {
+		m_download_canceled = true;
 		m_download_progress->setFormat("Download canceled %v of %m");
 		m_files_to_download.clear();
 		return;
 	}
 
+	if (m_downloads_in_flight > 0) {
+		window_log("Error: Previous download is still being saved");
+		return;
+	}
+
 	m_download_progress->setFormat("Preparing download...");
 	QCoreApplication::processEvents();
 
@@ -862,16 +1107,18 @@ void ImagerWindow::sync_remote_files() {
 
 	if (!m_files_to_download.empty()) {
 		snprintf(message, sizeof(message), "Downloading %d images from server", m_files_to_download.length());
+		m_download_retries.clear();
+		m_downloaded_bytes = 0;
+		m_downloaded_files = 0;
+		m_download_failed = 0;
+		m_download_requested = false;
+		m_download_canceled = false;
+		m_download_timer.start();
 		m_download_progress->setRange(0, m_files_to_download.length());
 		m_download_progress->setValue(0);
 		m_download_progress->setFormat("Downloading %v of %m images...");
 		window_log(message, INDIGO_OK_STATE);
-		QtConcurrent::run([=]() {
-			char agent[INDIGO_VALUE_SIZE];
-			get_selected_imager_agent(agent);
-			QString next_file = m_files_to_download.at(0);
-			request_file_download(agent, next_file.toUtf8().constData());
-		});
+		request_next_download();
 	} else {
 		m_download_progress->setRange(0, 1);
 		m_download_progress->setValue(0);
@@ -880,6 +1127,91 @@ void ImagerWindow::sync_remote_files() {
 	}
 }
 
+/* The agent serves one file at a time, so the next file is requested as soon as the
+   previous one is received while up to conf.download_in_flight images are verified
+   and saved in the background. */
+void ImagerWindow::request_next_download() {
+	if (m_files_to_download.empty() || m_download_requested || m_downloads_in_flight >= conf.download_in_flight) {
+		return;
+	}
+	m_download_requested = true;
+	QString next_file = m_files_to_download.at(0);
+	QtConcurrent::run([=]() {
+		char agent[INDIGO_VALUE_SIZE];
+		get_selected_imager_agent(agent);
+		request_file_download(agent, next_file.toUtf8().constData());
+	});
+}
+
+void ImagerWindow::update_download_progress() {
+	double rate = 0;
+	qint64 elapsed = m_download_timer.elapsed();
+	if (elapsed > 0) {
+		rate = m_downloaded_bytes / 1048576.0 / (elapsed / 1000.0);
+	}
+	m_download_progress->setValue(m_downloaded_files + m_download_failed);
+
+	if (!m_files_to_download.empty() || m_downloads_in_flight > 0) {
+		if (m_download_canceled) {
+			return;
+		}
+		m_sync_files_button->setText("Cancel download");
+		set_widget_state(m_sync_files_button, INDIGO_BUSY_STATE);
+		m_download_progress->setFormat(QString("Downloading %v of %m images (%1 MB/s)...").arg(rate, 0, 'f', 1));
+		return;
+	}
+
+	m_sync_files_button->setText("Download images");
+	set_widget_state(m_sync_files_button, INDIGO_OK_STATE);
+	if (m_download_canceled) {
+		return;
+	}
+	char message[PATH_LEN];
+	if (m_download_failed) {
+		m_download_progress->setFormat(QString("Downloaded %1 images, %2 failed (%3 MB/s)").arg(m_downloaded_files).arg(m_download_failed).arg(rate, 0, 'f', 1));
+		snprintf(message, sizeof(message), "Download complete, %d images failed", m_download_failed);
+		window_log(message, INDIGO_ALERT_STATE);
+	} else {
+		m_download_progress->setFormat(QString("Downloaded %v images (%1 MB/s)").arg(rate, 0, 'f', 1));
+		window_log("Download complete");
+	}
+}
+
+void ImagerWindow::on_download_saved(QString remote_file, QString local_file, int status) {
+	char message[PATH_LEN+100];
+	m_downloads_in_flight--;
+
+	if (status == DOWNLOAD_SAVED) {
+		m_downloaded_files++;
+		if (!conf.keep_images_on_server) {
+			snprintf(message, sizeof(message), "Image saved to '%s' and removed remotely", local_file.toUtf8().constData());
+			QtConcurrent::run([=]() {
+				char agent[INDIGO_VALUE_SIZE];
+				get_selected_imager_agent(agent);
+				request_file_remove(agent, remote_file.toUtf8().constData());
+			});
+		} else {
+			snprintf(message, sizeof(message), "Image saved to '%s' and kept remotely", local_file.toUtf8().constData());
+		}
+		window_log(message);
+	} else {
+		int retries = m_download_retries.value(remote_file, 0) + 1;
+		m_download_retries.insert(remote_file, retries);
+		const char *reason = (status == DOWNLOAD_BAD_DIGEST) ? "digest mismatch" : "can not save";
+		if (retries <= AIN_DOWNLOAD_RETRIES && !m_download_canceled) {
+			snprintf(message, sizeof(message), "Warning: '%s' %s, retrying (%d of %d)", remote_file.toUtf8().constData(), reason, retries, AIN_DOWNLOAD_RETRIES);
+			window_log(message, INDIGO_BUSY_STATE);
+			m_files_to_download.append(remote_file);
+		} else {
+			m_download_failed++;
+			snprintf(message, sizeof(message), "Error: '%s' %s", remote_file.toUtf8().constData(), reason);
+			window_log(message, INDIGO_ALERT_STATE);
+		}
+	}
+	request_next_download();
+	update_download_progress();
+}
+
 void ImagerWindow::remove_synced_remote_files() {
 	char message[PATH_LEN];
 	char work_dir[PATH_LEN];
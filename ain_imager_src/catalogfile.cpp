@@ -0,0 +1,131 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <string.h>
+#include <algorithm>
+#include <QByteArray>
+#include <indigo/indigo_bus.h>
+#include "catalogfile.h"
+
+CatalogFile::CatalogFile() {
+	m_data = nullptr;
+	m_size = 0;
+	m_header = nullptr;
+	m_records = nullptr;
+	m_zones = nullptr;
+	m_names = nullptr;
+	m_strings = nullptr;
+}
+
+CatalogFile::~CatalogFile() {
+	close();
+}
+
+bool CatalogFile::check_section(uint32_t offset, qint64 size) const {
+	return offset >= sizeof(catalog_file_header) && offset + size <= m_size;
+}
+
+bool CatalogFile::open(const QString &path) {
+	close();
+	m_file.setFileName(path);
+	if (!m_file.open(QIODevice::ReadOnly)) {
+		indigo_error("%s: can not open catalog: %s\n", path.toUtf8().constData(), m_file.errorString().toUtf8().constData());
+		return false;
+	}
+	m_size = m_file.size();
+	if (m_size < (qint64)sizeof(catalog_file_header) || (m_data = m_file.map(0, m_size)) == nullptr) {
+		indigo_error("%s: can not map catalog\n", path.toUtf8().constData());
+		close();
+		return false;
+	}
+
+	const catalog_file_header *header = (const catalog_file_header *)m_data;
+	if (
+		memcmp(header->magic, CATALOG_FILE_MAGIC, sizeof(header->magic)) ||
+		!check_section(header->record_offset, (qint64)header->record_count * sizeof(catalog_file_record)) ||
+		!check_section(header->zone_offset, (CATALOG_FILE_ZONES + 1) * sizeof(uint32_t)) ||
+		!check_section(header->name_offset, (qint64)header->name_count * sizeof(catalog_file_name)) ||
+		!check_section(header->string_offset, header->string_size) ||
+		header->string_size == 0 ||
+		header->record_offset % sizeof(double) ||
+		header->zone_offset % sizeof(uint32_t) ||
+		header->name_offset % sizeof(uint32_t)
+	) {
+		indigo_error("%s: not a valid catalog\n", path.toUtf8().constData());
+		close();
+		return false;
+	}
+	m_records = (const catalog_file_record *)(m_data + header->record_offset);
+	m_zones = (const uint32_t *)(m_data + header->zone_offset);
+	m_names = (const catalog_file_name *)(m_data + header->name_offset);
+	m_strings = (const char *)(m_data + header->string_offset);
+	if (m_strings[header->string_size - 1] != '\0' || m_zones[CATALOG_FILE_ZONES] > header->record_count) {
+		indigo_error("%s: not a valid catalog\n", path.toUtf8().constData());
+		close();
+		return false;
+	}
+	m_header = header;
+	indigo_debug("%s: %u objects, %u names\n", path.toUtf8().constData(), m_header->record_count, m_header->name_count);
+	return true;
+}
+
+void CatalogFile::close() {
+	if (m_data) {
+		m_file.unmap(m_data);
+		m_data = nullptr;
+	}
+	m_file.close();
+	m_size = 0;
+	m_header = nullptr;
+	m_records = nullptr;
+	m_zones = nullptr;
+	m_names = nullptr;
+	m_strings = nullptr;
+}
+
+void CatalogFile::zone_records(int zone, double ra_min, double ra_max, QVector<int> &records) const {
+	if (m_header == nullptr || zone < 0 || zone >= CATALOG_FILE_ZONES) return;
+	uint32_t begin = m_zones[zone];
+	uint32_t end = m_zones[zone + 1];
+	if (begin >= end || end > m_header->record_count) return;
+
+	// only the pages of the binary search path and of the RA window are read
+	const catalog_file_record *first = std::lower_bound(m_records + begin, m_records + end, ra_min, [](const catalog_file_record &record, double ra) {
+		return record.ra < ra;
+	});
+	for (const catalog_file_record *record = first; record < m_records + end && record->ra <= ra_max; record++) {
+		records.append(record - m_records);
+	}
+}
+
+int CatalogFile::find(const QString &name) const {
+	if (m_header == nullptr) return -1;
+	// keys are lower case in ASCII only, as generated by perl lc()
+	QByteArray key = name.trimmed().toUtf8();
+	for (int i = 0; i < key.size(); i++) {
+		if (key[i] >= 'A' && key[i] <= 'Z') key[i] = key[i] - 'A' + 'a';
+	}
+	const catalog_file_name *end = m_names + m_header->name_count;
+	const catalog_file_name *found = std::lower_bound(m_names, end, key.constData(), [this](const catalog_file_name &entry, const char *key) {
+		return strcmp(string(entry.key), key) < 0;
+	});
+	if (found == end || strcmp(string(found->key), key.constData()) || found->record >= m_header->record_count) {
+		return -1;
+	}
+	return found->record;
+}
@@ -0,0 +1,109 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _CATALOGFILE_H
+#define _CATALOGFILE_H
+
+#include <stdint.h>
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+#define CATALOG_FILE_MAGIC "AINCAT01"
+#define CATALOG_FILE_EXTENSION "aincat"
+#define CATALOG_FILE_ZONES 180       /* 1 degree declination zones */
+#define CATALOG_FILE_STAR 255        /* type of star records, DSOs use indigo_dso_type */
+
+/* Binary catalog written by object_data/bin_catalog_generate.pl, all values are
+   little endian. Only the catalogs in <config path>/catalogs are loaded from such
+   files, the built in one is still compiled in from object_data/indigo_cat_data.c
+   and its objects are skipped in the files. The records are sorted by declination
+   zone and by RA within the zone, the zone table holds the first record of each
+   zone and the end of the last one. The name index is sorted by the lower case
+   keys. */
+typedef struct {
+	char magic[8];
+	uint32_t record_count;
+	uint32_t record_offset;
+	uint32_t zone_offset;        /* CATALOG_FILE_ZONES + 1 record indexes */
+	uint32_t name_count;
+	uint32_t name_offset;
+	uint32_t string_offset;
+	uint32_t string_size;
+	float max_r1;                /* the largest major axis in arcmin, 0 for stars only */
+} catalog_file_header;
+
+typedef struct {
+	double ra;                   /* degrees */
+	double dec;                  /* degrees */
+	float mag;
+	float r1, r2;                /* axes in arcmin, 0 for stars */
+	float angle;
+	uint32_t id;                 /* string pool offsets */
+	uint32_t names;              /* comma separated aliases */
+	int32_t hip;                 /* 0 if not a HIP star */
+	uint8_t type;
+	uint8_t reserved[3];
+} catalog_file_record;
+
+typedef struct {
+	uint32_t key;                /* string pool offset of the lower case name */
+	uint32_t record;
+} catalog_file_name;
+
+/* Memory mapped catalog, opening it costs only the header check and the pages
+   are read by the system when they are touched, so catalogs of millions of
+   stars need no loading time. */
+class CatalogFile {
+public:
+	CatalogFile();
+	~CatalogFile();
+
+	bool open(const QString &path);
+	void close();
+	bool is_open() const { return m_header != nullptr; }
+	QString path() const { return m_file.fileName(); }
+
+	int count() const { return m_header ? m_header->record_count : 0; }
+	/* of the largest object, degrees */
+	double max_radius() const { return m_header ? m_header->max_r1 / 120.0 : 0; }
+	const catalog_file_record *record(int index) const { return &m_records[index]; }
+	const char *string(uint32_t offset) const {
+		return offset < m_header->string_size ? m_strings + offset : m_strings;
+	}
+
+	/* records in the RA range of a zone, ra_min and ra_max in degrees */
+	void zone_records(int zone, double ra_min, double ra_max, QVector<int> &records) const;
+
+	/* record with the name or id, case insensitive, -1 if not found */
+	int find(const QString &name) const;
+
+private:
+	QFile m_file;
+	uchar *m_data;
+	qint64 m_size;
+	const catalog_file_header *m_header;
+	const catalog_file_record *m_records;
+	const uint32_t *m_zones;
+	const catalog_file_name *m_names;
+	const char *m_strings;
+
+	bool check_section(uint32_t offset, qint64 size) const;
+};
+
+#endif /* _CATALOGFILE_H */
@@ -0,0 +1,243 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <QDir>
+#include <indigo_cat_data.h>
+#include <indigo/indigo_bus.h>
+#include "catalogindex.h"
+
+#define DEG2RAD (M_PI / 180)
+
+static int dec_zone(double dec) {
+	int zone = (int)floor(dec + 90);
+	if (zone < 0) return 0;
+	if (zone >= CATALOG_INDEX_ZONES) return CATALOG_INDEX_ZONES - 1;
+	return zone;
+}
+
+static double angular_distance(double ra1, double dec1, double ra2, double dec2) {
+	double cos_d = sin(dec1 * DEG2RAD) * sin(dec2 * DEG2RAD) + cos(dec1 * DEG2RAD) * cos(dec2 * DEG2RAD) * cos((ra1 - ra2) * DEG2RAD);
+	if (cos_d > 1) cos_d = 1;
+	if (cos_d < -1) cos_d = -1;
+	return acos(cos_d) / DEG2RAD;
+}
+
+CatalogIndex::CatalogIndex() {
+	m_ready = false;
+	m_dso_count = 0;
+	m_max_radius = 0;
+}
+
+void CatalogIndex::add_entry(double ra, double dec, float mag, float radius, int object) {
+	catalog_index_entry entry;
+	entry.ra = ra;
+	entry.dec = dec;
+	entry.mag = mag;
+	entry.radius = radius;
+	entry.catalog = -1;
+	entry.object = object;
+	m_zones[dec_zone(dec)].append(entry);
+	if (radius > m_max_radius) m_max_radius = radius;
+}
+
+void CatalogIndex::build() {
+	int object = 0;
+	for (indigo_dso_entry *dso = &indigo_dso_data[0]; dso->id; dso++, object++) {
+		// r1 is the major axis in arcmin, unknown magnitudes are 0 and are ranked last
+		add_entry(dso->ra * 15, dso->dec, dso->mag == 0 ? CATALOG_INDEX_UNKNOWN_MAG : dso->mag, dso->r1 / 120.0, object);
+	}
+	m_dso_count = object;
+	for (indigo_star_entry *star = &indigo_star_data[0]; star->hip; star++, object++) {
+		add_entry(star->ra * 15, star->dec, star->mag, 0, object);
+	}
+	for (int zone = 0; zone < CATALOG_INDEX_ZONES; zone++) {
+		std::sort(m_zones[zone].begin(), m_zones[zone].end(), [](const catalog_index_entry &a, const catalog_index_entry &b) {
+			return a.ra < b.ra;
+		});
+	}
+	m_ready = true;
+	indigo_debug("Catalog index: %d objects in %d zones\n", object, CATALOG_INDEX_ZONES);
+}
+
+void CatalogIndex::query_zone(int zone, double ra_min, double ra_max, int catalog, QVector<catalog_index_entry> &found) {
+	if (catalog < 0) {
+		const QVector<catalog_index_entry> &entries = m_zones[zone];
+		auto begin = std::lower_bound(entries.begin(), entries.end(), ra_min, [](const catalog_index_entry &entry, double ra) {
+			return entry.ra < ra;
+		});
+		for (auto entry = begin; entry != entries.end() && entry->ra <= ra_max; ++entry) {
+			found.append(*entry);
+		}
+	} else {
+		QVector<int> records;
+		m_catalogs[catalog]->zone_records(zone, ra_min, ra_max, records);
+		for (int index : records) {
+			const catalog_file_record *record = m_catalogs[catalog]->record(index);
+			if (is_built_in(m_catalogs[catalog], record)) continue;
+			catalog_index_entry entry;
+			entry.ra = record->ra;
+			entry.dec = record->dec;
+			entry.mag = (record->mag == 0 && record->type != CATALOG_FILE_STAR) ? CATALOG_INDEX_UNKNOWN_MAG : record->mag;
+			entry.radius = record->r1 / 120.0;
+			entry.catalog = catalog;
+			entry.object = index;
+			found.append(entry);
+		}
+	}
+}
+
+/* entries with the centre within window of ra, dec, approximated by the zones and their RA ranges */
+void CatalogIndex::query_window(double ra, double dec, double window, int catalog, QVector<catalog_index_entry> &found) {
+	double dec_min = dec - window;
+	double dec_max = dec + window;
+	double max_abs_dec = fmax(fabs(dec_min), fabs(dec_max));
+
+	// RA half width of the window at the declination farthest from the equator
+	double dra = 180;
+	if (max_abs_dec < 90) {
+		double s = sin(window * DEG2RAD) / cos(max_abs_dec * DEG2RAD);
+		if (s < 1) dra = asin(s) / DEG2RAD;
+	}
+
+	for (int zone = dec_zone(dec_min); zone <= dec_zone(dec_max); zone++) {
+		if (dra >= 180) {
+			query_zone(zone, 0, 360, catalog, found);
+			continue;
+		}
+		double ra_min = ra - dra;
+		double ra_max = ra + dra;
+		if (ra_min < 0) {
+			query_zone(zone, ra_min + 360, 360, catalog, found);
+			query_zone(zone, 0, ra_max, catalog, found);
+		} else if (ra_max >= 360) {
+			query_zone(zone, ra_min, 360, catalog, found);
+			query_zone(zone, 0, ra_max - 360, catalog, found);
+		} else {
+			query_zone(zone, ra_min, ra_max, catalog, found);
+		}
+	}
+}
+
+bool CatalogIndex::is_built_in(const CatalogFile *catalog, const catalog_file_record *record) const {
+	if (record->type == CATALOG_FILE_STAR) {
+		return record->hip > 0 && m_built_in_hips.contains(record->hip);
+	}
+	const char *id = catalog->string(record->id);
+	return m_built_in_ids.contains(QByteArray::fromRawData(id, strlen(id)));
+}
+
+int CatalogIndex::load_catalogs(const QString &dir) {
+	QMutexLocker lock(&m_mutex);
+	QStringList files = QDir(dir).entryList(QStringList() << "*." CATALOG_FILE_EXTENSION, QDir::Files, QDir::Name);
+	if (!files.isEmpty() && m_built_in_hips.isEmpty()) {
+		// a catalog file made from object_data/indigo_cat_data.c repeats all of them
+		for (indigo_dso_entry *dso = &indigo_dso_data[0]; dso->id; dso++) {
+			m_built_in_ids.insert(QByteArray(dso->id));
+		}
+		for (indigo_star_entry *star = &indigo_star_data[0]; star->hip; star++) {
+			m_built_in_hips.insert(star->hip);
+		}
+	}
+	for (const QString &file : files) {
+		CatalogFile *catalog = new CatalogFile();
+		if (catalog->open(QDir(dir).filePath(file))) {
+			m_catalogs.append(catalog);
+		} else {
+			delete catalog;
+		}
+	}
+	return m_catalogs.size();
+}
+
+bool CatalogIndex::find(const QString &name, catalog_object &object) {
+	QMutexLocker lock(&m_mutex);
+	for (CatalogFile *catalog : m_catalogs) {
+		int index = catalog->find(name);
+		if (index < 0) continue;
+		const catalog_file_record *record = catalog->record(index);
+		// the search lists the built in objects already
+		if (is_built_in(catalog, record)) continue;
+		object.id = QString::fromUtf8(catalog->string(record->id));
+		object.names = QString::fromUtf8(catalog->string(record->names));
+		object.ra = record->ra / 15;
+		object.dec = record->dec;
+		object.mag = record->mag;
+		return true;
+	}
+	return false;
+}
+
+QString CatalogIndex::label(const catalog_index_entry &entry) {
+	if (entry.catalog >= 0) {
+		const CatalogFile *catalog = m_catalogs[entry.catalog];
+		const catalog_file_record *record = catalog->record(entry.object);
+		if (record->type == CATALOG_FILE_STAR && catalog->string(record->names)[0]) {
+			return QString::fromUtf8(catalog->string(record->names)).section(",", 0, 0);
+		}
+		return QString::fromUtf8(catalog->string(record->id));
+	}
+	int object = entry.object;
+	if (object < m_dso_count) {
+		return QString(indigo_dso_data[object].id);
+	}
+	indigo_star_entry *star = &indigo_star_data[object - m_dso_count];
+	if (star->name && star->name[0]) {
+		return QString(star->name).section(",", 0, 0);
+	}
+	return QString("HIP %1").arg(star->hip);
+}
+
+void CatalogIndex::objectsInField(double ra, double dec, double radius, QVector<image_object> &objects) {
+	QMutexLocker lock(&m_mutex);
+	if (!m_ready) build();
+
+	// objects centred outside of the field may reach into it, each is clipped by its own radius below
+	QVector<catalog_index_entry> found;
+	query_window(ra, dec, radius + m_max_radius, -1, found);
+	for (int catalog = 0; catalog < m_catalogs.size(); catalog++) {
+		query_window(ra, dec, radius + m_catalogs[catalog]->max_radius(), catalog, found);
+	}
+
+	QVector<catalog_index_entry> in_field;
+	for (const catalog_index_entry &entry : found) {
+		if (angular_distance(ra, dec, entry.ra, entry.dec) <= radius + entry.radius) {
+			in_field.append(entry);
+		}
+	}
+	std::sort(in_field.begin(), in_field.end(), [](const catalog_index_entry &a, const catalog_index_entry &b) {
+		return a.mag < b.mag;
+	});
+	if (in_field.size() > CATALOG_INDEX_MAX_OBJECTS) {
+		in_field.resize(CATALOG_INDEX_MAX_OBJECTS);
+	}
+
+	objects.clear();
+	objects.reserve(in_field.size());
+	for (const catalog_index_entry &entry : in_field) {
+		image_object obj;
+		obj.ra = entry.ra;
+		obj.dec = entry.dec;
+		obj.radius = entry.radius;
+		obj.label = label(entry);
+		objects.append(obj);
+	}
+	indigo_debug("Catalog index: %d of %d objects in the field\n", objects.size(), found.size());
+}
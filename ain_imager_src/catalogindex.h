@@ -0,0 +1,102 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _CATALOGINDEX_H
+#define _CATALOGINDEX_H
+
+#include <QMutex>
+#include <QVector>
+#include <QList>
+#include <QSet>
+#include <QByteArray>
+#include <imageviewer.h>
+#include "catalogfile.h"
+
+#define CATALOG_INDEX_ZONES 180          /* 1 degree declination zones */
+#define CATALOG_INDEX_MAX_OBJECTS 300
+#define CATALOG_INDEX_UNKNOWN_MAG 99
+#define CATALOG_INDEX_DIR "catalogs"     /* in config_path */
+
+typedef struct {
+	double ra;      /* degrees */
+	double dec;     /* degrees */
+	float mag;
+	float radius;   /* degrees */
+	int catalog;    /* index of the catalog file, -1 for the built in catalogs */
+	int object;
+} catalog_index_entry;
+
+typedef struct {
+	QString id;
+	QString names;
+	double ra;      /* hours */
+	double dec;     /* degrees */
+	float mag;
+} catalog_object;
+
+/* Spatial index of the built in DSO and star catalogs for the objects overlay of
+   plate solved images. The sky is split in declination zones with the entries of
+   each zone sorted by RA, so a field query reads only the RA window of the zones
+   it touches. The window of each catalog is widened by its largest object radius,
+   so objects centred outside of the field but reaching into it are found too.
+   Object numbers are indexes to indigo_dso_data followed by indexes
+   to indigo_star_data. Additional catalogs are binary catalog files, they are
+   memory mapped and use the same zones, so they need no index of their own.
+   Their records of built in objects, matched by the HIP number or the DSO id,
+   are skipped, so they are not listed twice. */
+class CatalogIndex : public ImageObjectSource {
+public:
+	static CatalogIndex& instance();
+
+	/* the brightest objects in the field, the index is built on the first call */
+	void objectsInField(double ra, double dec, double radius, QVector<image_object> &objects) override;
+
+	/* maps all catalog files in dir, returns the number of catalogs loaded */
+	int load_catalogs(const QString &dir);
+
+	/* object with the id or name in the catalog files, case insensitive, built in objects are not found */
+	bool find(const QString &name, catalog_object &object);
+
+private:
+	CatalogIndex();
+	void build();
+	void add_entry(double ra, double dec, float mag, float radius, int object);
+	/* catalog is an index to m_catalogs, -1 for the built in catalogs */
+	void query_zone(int zone, double ra_min, double ra_max, int catalog, QVector<catalog_index_entry> &found);
+	void query_window(double ra, double dec, double window, int catalog, QVector<catalog_index_entry> &found);
+	QString label(const catalog_index_entry &entry);
+	bool is_built_in(const CatalogFile *catalog, const catalog_file_record *record) const;
+
+	QMutex m_mutex;
+	bool m_ready;
+	int m_dso_count;
+	double m_max_radius;    /* of the built in objects, degrees */
+	QVector<catalog_index_entry> m_zones[CATALOG_INDEX_ZONES];
+	QList<CatalogFile*> m_catalogs;
+	/* the built in objects, filled when a catalog file is loaded */
+	QSet<int> m_built_in_hips;
+	QSet<QByteArray> m_built_in_ids;
+};
+
+inline CatalogIndex& CatalogIndex::instance() {
+	static CatalogIndex* me = nullptr;
+	if (!me) me = new CatalogIndex();
+	return *me;
+}
+
+#endif /* _CATALOGINDEX_H */
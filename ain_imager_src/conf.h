@@ -35,9 +35,21 @@
 
 #define CONFIG_FILENAME "indigo_imager.conf"
 #define AIN_GUIDER_LOG_NAME_FORMAT "ain_guiding_%s.log"
+#define AIN_GUIDER_HISTORY_NAME_FORMAT "ain_guiding_%s.hist"
+#define AIN_LOG_MAX_LINES 5000
+#define AIN_LOG_UPDATE_INTERVAL 200
 #define AIN_INDIGO_LOG_NAME_FORMAT "ain_indigo_%s.log"
 #define DEFAULT_OBJECT_NAME "noname"
 
+#define AIN_DOWNLOAD_RETRIES 3
+#define AIN_DOWNLOAD_IN_FLIGHT 2
+#define AIN_DOWNLOAD_MAX_IN_FLIGHT 8
+
+#define AIN_VIDEO_BUFFER_SIZE 512 /* MB */
+#define AIN_VIDEO_BUFFER_MIN 64
+#define AIN_VIDEO_BUFFER_MAX 16384
+#define AIN_VIDEO_KEEP_ALL 100
+
 typedef enum {
 	STRETCH_NONE = 0,
 	STRETCH_SLIGHT = 1,
@@ -70,6 +82,12 @@ typedef enum {
 	AIN_OK_STATE = 100
 } object_alt_state;
 
+typedef enum {
+	OBJECT_SORT_RELEVANCE = 0,
+	OBJECT_SORT_ALTITUDE = 1,
+	OBJECT_SORT_MAGNITUDE = 2,
+} object_sort_order;
+
 typedef enum {
 	AIN_NO_SOUND = 0,
 	AIN_ALERT_SOUND,
@@ -113,7 +131,17 @@ typedef struct {
 	bool statistics_enabled;
 	uint32_t preview_bayer_pattern; /* BAYER_PAT_XXXX from image_preview_lut.h */
 	bool require_confirmation;
-	char unused[100];
+	int download_in_flight;
+	bool imager_show_objects;
+	bool object_visible_only;
+	char object_sort;
+	bool imager_show_grid;
+	int video_buffer_size; /* MB */
+	char live_stack_mode; /* live_stack_mode from livestack.h */
+	bool calibrate_previews;
+	bool remove_hot_pixels;
+	char video_keep_best; /* % of the sharpest frames written to the video */
+	char unused[84];
 } conf_t;
 
 extern conf_t conf;
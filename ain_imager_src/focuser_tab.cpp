@@ -190,7 +190,7 @@ void ImagerWindow::create_focuser_tab(QFrame *focuser_frame) {
 
 	stats_row++;
 	m_focus_graph = new FocusGraph();
-	m_focus_graph->redraw_data(m_focus_fwhm_data);
+	m_focus_graph->show_series(&m_focus_fwhm_data);
 	m_focus_graph->setMinimumHeight(230);
 	stats_frame_layout->addWidget(m_focus_graph, stats_row, 0);
 
@@ -502,6 +502,7 @@ void ImagerWindow::select_focuser_data(focuser_display_data show) {
 		default:
 			m_focus_display_data = nullptr;
 	}
+	m_focus_graph->show_series(m_focus_display_data);
 }
 
 void ImagerWindow::on_focuser_selected(int index) {
@@ -6,6 +6,17 @@ FocusGraph::FocusGraph(QWidget *parent) : QCustomPlot(parent) {
     graph(0)->setPen(QPen(Qt::red));
 	addGraph();
 	graph(1)->setPen(QPen(QColor(3,172,240)));
+	// min/max envelopes of the history mode
+	for (int i = 0; i < FOCUSGRAPH_SERIES; i++) {
+		QColor color = graph(i)->pen().color();
+		color.setAlpha(60);
+		addGraph();
+		graph(2 + 2 * i)->setPen(Qt::NoPen);
+		addGraph();
+		graph(3 + 2 * i)->setPen(Qt::NoPen);
+		graph(3 + 2 * i)->setBrush(QBrush(color));
+		graph(3 + 2 * i)->setChannelFillGraph(graph(2 + 2 * i));
+	}
 	setBackground(QBrush(QColor(0,0,0,0)));
 
     xAxis2->setVisible(true);
@@ -37,35 +48,126 @@ FocusGraph::FocusGraph(QWidget *parent) : QCustomPlot(parent) {
     // make left and bottom axes always transfer their ranges to right and top axes:
     connect(xAxis, SIGNAL(rangeChanged(QCPRange)), xAxis2, SLOT(setRange(QCPRange)));
     connect(yAxis, SIGNAL(rangeChanged(QCPRange)), yAxis2, SLOT(setRange(QCPRange)));
+
+	for (int i = 0; i < FOCUSGRAPH_SERIES; i++) {
+		m_series[i] = nullptr;
+		m_synced_key[i] = 0;
+		m_synced_generation[i] = 0;
+	}
+	m_history_mode = false;
+	connect(xAxis, SIGNAL(rangeChanged(QCPRange)), this, SLOT(on_xaxis_range_changed(QCPRange)));
+	m_replot_timer.setSingleShot(true);
+	connect(&m_replot_timer, &QTimer::timeout, this, &FocusGraph::on_replot_timeout);
+	m_last_replot.start();
 }
 
 void FocusGraph::set_yaxis_range(double min, double max) {
 	yAxis->setRange(min, max);
 }
 
-void FocusGraph::redraw_data(QVector<double> data) {
-    QVector<double> x(data.size());
-    for (int i=0; i< x.size(); ++i)
-    {
-        x[i] = i;
-    }
-    graph(0)->setData(x, data);
-    graph(0)->rescaleKeyAxis();
+void FocusGraph::show_series(const RingSeries *series1, const RingSeries *series2) {
+	m_series[0] = series1;
+	m_series[1] = series2;
+	if (m_history_mode) return;
+	for (int i = 0; i < FOCUSGRAPH_SERIES; i++) {
+		sync_graph(i, true);
+	}
+	request_replot();
+}
+
+void FocusGraph::update_series() {
+	if (m_history_mode) return;
+	for (int i = 0; i < FOCUSGRAPH_SERIES; i++) {
+		sync_graph(i, false);
+	}
+	request_replot();
+}
+
+void FocusGraph::set_history_mode(bool enabled) {
+	if (m_history_mode == enabled) return;
+	m_history_mode = enabled;
+	for (int i = FOCUSGRAPH_SERIES; i < graphCount(); i++) {
+		graph(i)->clearData();
+	}
+	if (enabled) {
+		setInteractions(QCP::iRangeDrag | QCP::iRangeZoom);
+		axisRect()->setRangeDrag(Qt::Horizontal);
+		axisRect()->setRangeZoom(Qt::Horizontal);
+		xAxis->setTickLabelType(QCPAxis::ltDateTime);
+		xAxis->setDateTimeFormat("hh:mm");
+		xAxis->setDateTimeSpec(Qt::LocalTime);
+		for (int i = 0; i < FOCUSGRAPH_SERIES; i++) {
+			graph(i)->clearData();
+		}
+	} else {
+		setInteractions(QCP::Interactions());
+		xAxis->setTickLabelType(QCPAxis::ltNumber);
+		for (int i = 0; i < FOCUSGRAPH_SERIES; i++) {
+			sync_graph(i, true);
+		}
+	}
+	request_replot();
+}
+
+void FocusGraph::set_history_range(double start, double end) {
+	if (end <= start) end = start + 1;
+	xAxis->setRange(start, end);
+}
+
+void FocusGraph::show_history(const history_points &points1, const history_points &points2) {
+	if (!m_history_mode) return;
+	const history_points *points[FOCUSGRAPH_SERIES] = { &points1, &points2 };
+	for (int i = 0; i < FOCUSGRAPH_SERIES; i++) {
+		graph(i)->setData(points[i]->time, points[i]->mean);
+		graph(2 + 2 * i)->setData(points[i]->time, points[i]->min);
+		graph(3 + 2 * i)->setData(points[i]->time, points[i]->max);
+	}
+	request_replot();
+}
+
+void FocusGraph::on_xaxis_range_changed(const QCPRange &range) {
+	if (m_history_mode) emit(history_range_changed(range.lower, range.upper));
+}
+
+void FocusGraph::sync_graph(int index, bool rebuild) {
+	const RingSeries *series = m_series[index];
+	QCPGraph *plot_graph = graph(index);
+	if (series == nullptr) {
+		plot_graph->clearData();
+		m_synced_key[index] = 0;
+		return;
+	}
+
+	qint64 first_key = series->first_key();
+	qint64 next_key = series->next_key();
+	qint64 key = m_synced_key[index];
+	if (rebuild || m_synced_generation[index] != series->generation() || key < first_key || key > next_key) {
+		plot_graph->clearData();
+		key = first_key;
+	}
+	for (; key < next_key; key++) {
+		plot_graph->addData(key, series->at(key - first_key));
+	}
+	plot_graph->removeDataBefore(first_key);
+	m_synced_key[index] = next_key;
+	m_synced_generation[index] = series->generation();
+
+	if (index == 0 && !m_history_mode) {
+		if (next_key - first_key > 1) {
+			xAxis->setRange(first_key, next_key - 1);
+		} else {
+			xAxis->setRange(first_key, first_key + 1);
+		}
+	}
+}
 
-    replot();
+void FocusGraph::request_replot() {
+	if (m_replot_timer.isActive()) return;
+	qint64 wait = FOCUSGRAPH_REPLOT_INTERVAL - m_last_replot.elapsed();
+	m_replot_timer.start(wait > 0 ? wait : 0);
 }
 
-void FocusGraph::redraw_data2(QVector<double> data1, QVector<double> data2) {
-	if (data1.size() != data2.size()) return;
-    QVector<double> x(data1.size());
-    for (int i=0; i< x.size(); ++i)
-    {
-        x[i] = i;
-    }
-    graph(0)->setData(x, data1);
-    graph(0)->rescaleKeyAxis();
-	graph(1)->setData(x, data2);
-    graph(1)->rescaleKeyAxis();
-
-    replot();
+void FocusGraph::on_replot_timeout() {
+	m_last_replot.restart();
+	replot(QCustomPlot::rpQueued);
 }
@@ -2,7 +2,15 @@
 #define FOCUSGRAPH_H
 
 #include <QMainWindow>
+#include <QTimer>
+#include <QElapsedTimer>
 #include <qcustomplot/qcustomplot.h>
+#include "ringseries.h"
+#include "guidehistory.h"
+
+/* at most 20 replots per second, the telemetry may come much faster */
+#define FOCUSGRAPH_REPLOT_INTERVAL 50
+#define FOCUSGRAPH_SERIES 2
 
 class FocusGraph : public QCustomPlot
 {
@@ -10,12 +18,39 @@ class FocusGraph : public QCustomPlot
 public:
     explicit FocusGraph(QWidget *parent = 0);
 
+	bool is_history_mode() const { return m_history_mode; }
+
 signals:
+	/* the user dragged or zoomed the time axis in history mode */
+	void history_range_changed(double start, double end);
 
 public slots:
      void set_yaxis_range(double min, double max);
-     void redraw_data(QVector<double> data);
-	 void redraw_data2(QVector<double> data1, QVector<double> data2);
+	/* series2 may be nullptr, the series must outlive the graph or be replaced */
+	void show_series(const RingSeries *series1, const RingSeries *series2 = nullptr);
+	/* adds the samples appended since the last call and drops the overwritten ones */
+	void update_series();
+
+	/* history mode shows downsampled data on a time axis that can be dragged and zoomed,
+	   the series are not drawn until it is turned off */
+	void set_history_mode(bool enabled);
+	void set_history_range(double start, double end);
+	void show_history(const history_points &points1, const history_points &points2);
+
+private slots:
+	void on_replot_timeout();
+	void on_xaxis_range_changed(const QCPRange &range);
+
+private:
+	const RingSeries *m_series[FOCUSGRAPH_SERIES];
+	qint64 m_synced_key[FOCUSGRAPH_SERIES];
+	unsigned int m_synced_generation[FOCUSGRAPH_SERIES];
+	QTimer m_replot_timer;
+	QElapsedTimer m_last_replot;
+	bool m_history_mode;
+
+	void sync_graph(int index, bool rebuild);
+	void request_replot();
 };
 
 #endif // FOCUSGRAPH_H
@@ -0,0 +1,226 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <math.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <stdint.h>
+#include <float.h>
+#include <indigo/indigo_bus.h>
+#include "guidehistory.h"
+
+GuideHistory::GuideHistory() {
+	for (int level = 0; level < HISTORY_LEVELS; level++) {
+		m_levels[level].resize(history_level_size[level]);
+	}
+	m_file = nullptr;
+	clear();
+}
+
+GuideHistory::~GuideHistory() {
+	close();
+}
+
+/* The file is a header (magic, channel count, level count and bucket lengths as int32)
+   followed by records of int32 level and history_bucket in the native byte order. */
+bool GuideHistory::open(const char *file_name) {
+	close();
+	m_file = fopen(file_name, "ab");
+	if (m_file == nullptr) {
+		indigo_error("Can not open guiding history '%s': %s\n", file_name, strerror(errno));
+		return false;
+	}
+	if (ftell(m_file) == 0) {
+		int32_t header[2 + HISTORY_LEVELS] = { HISTORY_CHANNELS, HISTORY_LEVELS };
+		for (int level = 0; level < HISTORY_LEVELS; level++) {
+			header[2 + level] = history_bucket_seconds[level];
+		}
+		fwrite(HISTORY_FILE_MAGIC, strlen(HISTORY_FILE_MAGIC), 1, m_file);
+		fwrite(header, sizeof(header), 1, m_file);
+	}
+	indigo_debug("Guiding history '%s' opened\n", file_name);
+	return true;
+}
+
+void GuideHistory::close() {
+	if (m_file == nullptr) return;
+	for (int level = 0; level < HISTORY_LEVELS; level++) {
+		if (m_has_open[level]) close_bucket(level);
+	}
+	fclose(m_file);
+	m_file = nullptr;
+}
+
+void GuideHistory::clear() {
+	for (int level = 0; level < HISTORY_LEVELS; level++) {
+		m_head[level] = 0;
+		m_size[level] = 0;
+		m_has_open[level] = false;
+	}
+}
+
+void GuideHistory::append(int channel, double time, double value) {
+	if (channel < 0 || channel >= HISTORY_CHANNELS || isnan(value)) return;
+
+	// keep the buckets ordered if the clock goes back
+	if (m_has_open[0] && time < m_open[0].time) time = m_open[0].time;
+
+	double start = floor(time / history_bucket_seconds[0]) * history_bucket_seconds[0];
+	if (m_has_open[0] && m_open[0].time != start) close_bucket(0);
+	if (!m_has_open[0]) start_bucket(0, start);
+	add_to_bucket(0, channel, value, value, value, 1);
+}
+
+void GuideHistory::start_bucket(int level, double time) {
+	history_bucket *bucket = &m_open[level];
+	memset(bucket, 0, sizeof(history_bucket));
+	bucket->time = time;
+	for (int channel = 0; channel < HISTORY_CHANNELS; channel++) {
+		m_sum[level][channel] = 0;
+	}
+	m_has_open[level] = true;
+}
+
+void GuideHistory::add_to_bucket(int level, int channel, double min, double max, double sum, int count) {
+	history_bucket *bucket = &m_open[level];
+	if (bucket->count[channel] == 0) {
+		bucket->min[channel] = min;
+		bucket->max[channel] = max;
+	} else {
+		if (min < bucket->min[channel]) bucket->min[channel] = min;
+		if (max > bucket->max[channel]) bucket->max[channel] = max;
+	}
+	if (bucket->count[channel] + count > USHRT_MAX) return;
+	bucket->count[channel] += count;
+	m_sum[level][channel] += sum;
+}
+
+void GuideHistory::close_bucket(int level) {
+	history_bucket *bucket = &m_open[level];
+	for (int channel = 0; channel < HISTORY_CHANNELS; channel++) {
+		if (bucket->count[channel]) bucket->mean[channel] = m_sum[level][channel] / bucket->count[channel];
+	}
+	m_has_open[level] = false;
+
+	int size = m_levels[level].size();
+	if (m_size[level] < size) {
+		m_levels[level][(m_head[level] + m_size[level]) % size] = *bucket;
+		m_size[level]++;
+	} else {
+		m_levels[level][m_head[level]] = *bucket;
+		m_head[level] = (m_head[level] + 1) % size;
+	}
+
+	if (m_file) {
+		int32_t file_level = level;
+		fwrite(&file_level, sizeof(file_level), 1, m_file);
+		fwrite(bucket, sizeof(history_bucket), 1, m_file);
+	}
+
+	if (level + 1 < HISTORY_LEVELS) feed(level + 1, *bucket);
+}
+
+void GuideHistory::feed(int level, const history_bucket &bucket) {
+	double start = floor(bucket.time / history_bucket_seconds[level]) * history_bucket_seconds[level];
+	if (m_has_open[level] && m_open[level].time != start) close_bucket(level);
+	if (!m_has_open[level]) start_bucket(level, start);
+	for (int channel = 0; channel < HISTORY_CHANNELS; channel++) {
+		int count = bucket.count[channel];
+		if (count) add_to_bucket(level, channel, bucket.min[channel], bucket.max[channel], (double)bucket.mean[channel] * count, count);
+	}
+}
+
+static double level_first_time(const QVector<history_bucket> &buckets, int head, int size, const history_bucket &open, bool has_open) {
+	if (size > 0) return buckets[head].time;
+	if (has_open) return open.time;
+	return DBL_MAX;
+}
+
+double GuideHistory::first_time() const {
+	double first = DBL_MAX;
+	for (int level = 0; level < HISTORY_LEVELS; level++) {
+		double time = level_first_time(m_levels[level], m_head[level], m_size[level], m_open[level], m_has_open[level]);
+		if (time < first) first = time;
+	}
+	return first == DBL_MAX ? 0 : first;
+}
+
+double GuideHistory::last_time() const {
+	if (m_has_open[0]) return m_open[0].time + history_bucket_seconds[0];
+	if (m_size[0] > 0) return bucket_at(0, m_size[0] - 1).time + history_bucket_seconds[0];
+	return 0;
+}
+
+int GuideHistory::lower_bound(int level, double time) const {
+	int low = 0, high = m_size[level];
+	while (low < high) {
+		int middle = (low + high) / 2;
+		if (bucket_at(level, middle).time < time) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return low;
+}
+
+void GuideHistory::add_points(const history_bucket &bucket, int channel, history_points &points) const {
+	if (bucket.count[channel] == 0) return;
+	points.time.append(bucket.time);
+	points.min.append(bucket.min[channel]);
+	points.max.append(bucket.max[channel]);
+	points.mean.append(bucket.mean[channel]);
+}
+
+int GuideHistory::query(int channel, double start, double end, int max_points, history_points &points) const {
+	points.time.clear();
+	points.min.clear();
+	points.max.clear();
+	points.mean.clear();
+	if (channel < 0 || channel >= HISTORY_CHANNELS || end < start) return -1;
+
+	double first = first_time();
+	if (first == 0) return -1;
+	if (start < first) start = first;
+	if (max_points < 1) max_points = 1;
+
+	// the finest level with few enough buckets that still remembers the start of the range
+	int level = HISTORY_LEVELS - 1;
+	for (int l = 0; l < HISTORY_LEVELS; l++) {
+		bool fits = (end - start) / history_bucket_seconds[l] <= max_points;
+		bool covers = level_first_time(m_levels[l], m_head[l], m_size[l], m_open[l], m_has_open[l]) <= start;
+		if (fits && covers) {
+			level = l;
+			break;
+		}
+	}
+
+	int seconds = history_bucket_seconds[level];
+	for (int i = lower_bound(level, start - seconds); i < m_size[level]; i++) {
+		const history_bucket &bucket = bucket_at(level, i);
+		if (bucket.time > end) break;
+		add_points(bucket, channel, points);
+	}
+	if (m_has_open[level] && m_open[level].time <= end) {
+		history_bucket bucket = m_open[level];
+		if (bucket.count[channel]) bucket.mean[channel] = m_sum[level][channel] / bucket.count[channel];
+		add_points(bucket, channel, points);
+	}
+	return level;
+}
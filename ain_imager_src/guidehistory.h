@@ -0,0 +1,108 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _GUIDEHISTORY_H
+#define _GUIDEHISTORY_H
+
+#include <stdio.h>
+#include <QVector>
+
+#define HISTORY_LEVELS 3
+#define HISTORY_FILE_MAGIC "AINGHIST"
+
+typedef enum {
+	HISTORY_DRIFT_RA = 0,
+	HISTORY_DRIFT_DEC,
+	HISTORY_DRIFT_RA_S,
+	HISTORY_DRIFT_DEC_S,
+	HISTORY_DRIFT_X,
+	HISTORY_DRIFT_Y,
+	HISTORY_CORR_RA,
+	HISTORY_CORR_DEC,
+	HISTORY_SNR,
+	HISTORY_HFD,
+	HISTORY_FWHM,
+	HISTORY_CHANNELS
+} history_channel;
+
+/* bucket length in seconds and number of buckets kept in memory for each level:
+   4 hours of 1s buckets, 12 hours of 10s buckets and 48 hours of 1min buckets */
+static const int history_bucket_seconds[HISTORY_LEVELS] = { 1, 10, 60 };
+static const int history_level_size[HISTORY_LEVELS] = { 4 * 3600, 12 * 360, 48 * 60 };
+
+typedef struct {
+	double time;  /* bucket start, seconds since the epoch */
+	float min[HISTORY_CHANNELS];
+	float max[HISTORY_CHANNELS];
+	float mean[HISTORY_CHANNELS];
+	unsigned short count[HISTORY_CHANNELS];
+} history_bucket;
+
+typedef struct {
+	QVector<double> time;
+	QVector<double> min;
+	QVector<double> max;
+	QVector<double> mean;
+} history_points;
+
+/* Guiding telemetry of the whole session, downsampled to min/max/mean buckets
+   of several lengths. Every 1s bucket feeds the 10s bucket which feeds the 1min
+   one, so appending a sample is O(1) and the memory used is fixed. Closed
+   buckets are also appended to a binary file if one is open. */
+class GuideHistory {
+public:
+	GuideHistory();
+	~GuideHistory();
+
+	bool open(const char *file_name);
+	void close();
+	bool is_open() const { return m_file != nullptr; }
+
+	void append(int channel, double time, double value);
+	void clear();
+
+	/* oldest and newest time available, 0 if empty */
+	double first_time() const;
+	double last_time() const;
+
+	/* Fills points with the buckets of the finest level that covers start..end with
+	   at most max_points buckets and returns the level used, -1 if there is no data. */
+	int query(int channel, double start, double end, int max_points, history_points &points) const;
+
+private:
+	QVector<history_bucket> m_levels[HISTORY_LEVELS];
+	int m_head[HISTORY_LEVELS];
+	int m_size[HISTORY_LEVELS];
+	history_bucket m_open[HISTORY_LEVELS];
+	double m_sum[HISTORY_LEVELS][HISTORY_CHANNELS];
+	bool m_has_open[HISTORY_LEVELS];
+	FILE *m_file;
+
+	void start_bucket(int level, double time);
+	void add_to_bucket(int level, int channel, double min, double max, double sum, int count);
+	void close_bucket(int level);
+	void feed(int level, const history_bucket &bucket);
+
+	const history_bucket &bucket_at(int level, int i) const {
+		return m_levels[level][(m_head[level] + i) % m_levels[level].size()];
+	}
+	int lower_bound(int level, double time) const;
+	void add_points(const history_bucket &bucket, int channel, history_points &points) const;
+};
+
+#endif /* _GUIDEHISTORY_H */
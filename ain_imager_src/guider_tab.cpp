@@ -121,6 +121,7 @@ void ImagerWindow::create_guider_tab(QFrame *guider_frame) {
 	m_guider_graph = new FocusGraph();
 	m_guider_graph->set_yaxis_range(-6, 6);
 	m_guider_graph->setMinimumHeight(250);
+	connect(m_guider_graph, &FocusGraph::history_range_changed, this, &ImagerWindow::on_guider_history_range_changed);
 	stats_frame_layout->addWidget(m_guider_graph, stats_row, 0, 1, 2);
 
 	stats_row++;
@@ -620,6 +621,48 @@ void ImagerWindow::select_guider_data(guider_display_data show) {
 			m_guider_data_1 = nullptr;
 			m_guider_data_2 = nullptr;
 	}
+	m_guider_graph->show_series(m_guider_data_1, m_guider_data_2);
+	refresh_guider_history();
+}
+
+void ImagerWindow::refresh_guider_history() {
+	if (!m_guider_graph->is_history_mode()) return;
+
+	int channel_1 = -1, channel_2 = -1;
+	if (m_guider_data_1 == &m_drift_data_ra) {
+		channel_1 = HISTORY_DRIFT_RA;
+		channel_2 = HISTORY_DRIFT_DEC;
+	} else if (m_guider_data_1 == &m_drift_data_ra_s) {
+		channel_1 = HISTORY_DRIFT_RA_S;
+		channel_2 = HISTORY_DRIFT_DEC_S;
+	} else if (m_guider_data_1 == &m_pulse_data_ra) {
+		channel_1 = HISTORY_CORR_RA;
+		channel_2 = HISTORY_CORR_DEC;
+	} else if (m_guider_data_1 == &m_drift_data_x) {
+		channel_1 = HISTORY_DRIFT_X;
+		channel_2 = HISTORY_DRIFT_Y;
+	}
+
+	// about one bucket per pixel is enough
+	QCPRange range = m_guider_graph->xAxis->range();
+	int max_points = m_guider_graph->width();
+	history_points points_1, points_2;
+	m_guide_history.query(channel_1, range.lower, range.upper, max_points, points_1);
+	m_guide_history.query(channel_2, range.lower, range.upper, max_points, points_2);
+	m_guider_graph->show_history(points_1, points_2);
+}
+
+/* keep the newest samples in view if the end of the history was visible */
+void ImagerWindow::follow_guider_history(double previous_last_time) {
+	if (!m_guider_graph->is_history_mode()) return;
+	QCPRange range = m_guider_graph->xAxis->range();
+	double last_time = m_guide_history.last_time();
+	if (previous_last_time > 0 && range.upper >= previous_last_time && last_time > previous_last_time) {
+		double shift = last_time - previous_last_time;
+		m_guider_graph->set_history_range(range.lower + shift, range.upper + shift);
+	} else {
+		refresh_guider_history();
+	}
 }
 
 void ImagerWindow::on_guider_agent_selected(int index) {
@@ -20,6 +20,7 @@
 #include "imagerwindow.h"
 #include "indigoclient.h"
 #include "propertycache.h"
+#include "videocapture.h"
 #include "conf.h"
 #include "widget_state.h"
 
@@ -281,6 +282,7 @@ void update_mount_lst(ImagerWindow *w, indigo_property *property) {
 	for (int i = 0; i < property->count; i++) {
 		if (client_match_item(&property->items[i], MOUNT_LST_TIME_ITEM_NAME)) {
 			lst_str = QString(indigo_dtos(property->items[i].number.value, "%02d:%02d:%02d"));
+			w->m_visibility->set_lst(property->items[i].number.value);
 		}
 	}
 	w->set_text(w->m_mount_lst_label, lst_str);
@@ -543,6 +545,8 @@ void update_mount_lon_lat(ImagerWindow *w, indigo_property *property) {
 	w->set_text(w->m_mount_latitude, lat_str);
 	w->set_widget_state(w->m_mount_latitude, property->state);
 	w->set_lineedit_text(w->m_mount_lat_input, indigo_dtos(target_lat, "%d:%02d:%04.1f"));
+
+	if (property->state == INDIGO_OK_STATE) w->m_visibility->set_site(lat, lon);
 }
 
 void update_mount_gps_utc(ImagerWindow *w, indigo_property *property) {
@@ -1207,7 +1211,7 @@ void update_focus_estimator_property(ImagerWindow *w, indigo_property *property)
 				w->m_focus_hfd_data.clear();
 				w->show_widget(w->m_contrast_stats_frame, false);
 				w->show_widget(w->m_hfd_stats_frame, true);
-				w->m_focus_graph->redraw_data(*(w->m_focus_display_data));
+				w->m_focus_graph->update_series();
 			}
 
 		} else if (client_match_item(&property->items[i], AGENT_IMAGER_FOCUS_ESTIMATOR_RMS_CONTRAST_ITEM_NAME)) {
@@ -1216,7 +1220,7 @@ void update_focus_estimator_property(ImagerWindow *w, indigo_property *property)
 				w->m_focus_contrast_data.clear();
 				w->show_widget(w->m_hfd_stats_frame, false);
 				w->show_widget(w->m_contrast_stats_frame, true);
-				w->m_focus_graph->redraw_data(*(w->m_focus_display_data));
+				w->m_focus_graph->update_series();
 			}
 		}
 	}
@@ -1324,6 +1328,15 @@ void update_agent_imager_stats_property(ImagerWindow *w, indigo_property *proper
 
 	if (stats_p == nullptr || start_p == nullptr) return;
 
+	// the video file is finished with the exposure process it was started for
+	if (VideoCapture::instance().isRunning() && !strcmp(property->device, VideoCapture::instance().device())) {
+		if (start_p->state == INDIGO_BUSY_STATE) {
+			w->m_video_process_started = true;
+		} else if (w->m_video_process_started) {
+			w->stop_video_capture();
+		}
+	}
+
 	if (start_p && start_p->state == INDIGO_BUSY_STATE ) {
 		bool sequence_item = false;
 		for (int i = 0; i < start_p->count; i++) {
@@ -1408,6 +1421,14 @@ void update_agent_imager_stats_property(ImagerWindow *w, indigo_property *proper
 			has_phase = true;
 		}
 	}
+	static int history_frame = -1;
+	if (frames_complete != history_frame && (HFD > 0 || FWHM > 0)) {
+		double now = QDateTime::currentMSecsSinceEpoch() / 1000.0;
+		if (HFD > 0) w->m_guide_history.append(HISTORY_HFD, now, HFD);
+		if (FWHM > 0) w->m_guide_history.append(HISTORY_FWHM, now, FWHM);
+		history_frame = frames_complete;
+	}
+
 	char drift_str[50];
 	snprintf(drift_str, 50, "%+.2f, %+.2f", drift_x, drift_y);
 	w->set_text(w->m_drift_label, drift_str);
@@ -1524,25 +1545,22 @@ void update_agent_imager_stats_property(ImagerWindow *w, indigo_property *proper
 				best_contrast = 0;
 			}
 			if (FWHM != 0) w->m_focus_fwhm_data.append(FWHM);
-			if (w->m_focus_fwhm_data.size() > 100) w->m_focus_fwhm_data.removeFirst();
 			if (HFD != 0) {
 				w->m_focus_hfd_data.append(HFD);
 				if (HFD < best_hfd || best_hfd == 0) best_hfd = HFD;
 			}
-			if (w->m_focus_hfd_data.size() > 100) w->m_focus_hfd_data.removeFirst();
 			if (contrast != 0) {
 				w->m_focus_contrast_data.append(contrast * 100);
 				if (contrast > best_contrast) best_contrast = contrast;
 			}
-			if (w->m_focus_contrast_data.size() > 100) w->m_focus_contrast_data.removeFirst();
 
 			//w->m_focus_display_data = &w->m_focus_contrast_data;
 			if (w->m_focus_display_data) {
-				double max = *std::max_element(w->m_focus_display_data->constBegin(), w->m_focus_display_data->constEnd());
-				double min = *std::min_element(w->m_focus_display_data->constBegin(), w->m_focus_display_data->constEnd());
+				double max = w->m_focus_display_data->max();
+				double min = w->m_focus_display_data->min();
 				double margin = (max - min) * 0.05;
 				w->m_focus_graph->set_yaxis_range(min - margin, max + margin);
-				w->m_focus_graph->redraw_data(*(w->m_focus_display_data));
+				w->m_focus_graph->update_series();
 			}
 			prev_frame = frames_complete;
 		}
@@ -1687,6 +1705,7 @@ void update_guider_stats(ImagerWindow *w, indigo_property *property) {
 	double rmse_ra = 0, rmse_dec = 0, dither_rmse = 0;
 	double rmse_ra_s = 0, rmse_dec_s = 0;
 	double d_x = 0, d_y = 0;
+	double snr = 0;
 	int size = 0, frame_count = -1;
 	bool is_guiding_process_on = false;
 	bool is_dithering = false;
@@ -1724,6 +1743,8 @@ void update_guider_stats(ImagerWindow *w, indigo_property *property) {
 			cor_dec = property->items[i].number.value;
 		} else if (client_match_item(&property->items[i], AGENT_GUIDER_STATS_DITHERING_ITEM_NAME)) {
 			dither_rmse = property->items[i].number.value;
+		} else if (client_match_item(&property->items[i], AGENT_GUIDER_STATS_SNR_ITEM_NAME)) {
+			snr = property->items[i].number.value;
 		}
 	}
 
@@ -1732,11 +1753,9 @@ void update_guider_stats(ImagerWindow *w, indigo_property *property) {
 		if (focal_length <= 0 && w->m_guider_data_1 == &w->m_drift_data_ra_s) {
 			indigo_log("Guider focal length not set will use pixels");
 			w->select_guider_data(SHOW_RA_DEC_DRIFT);
-			if (w->m_guider_data_1 && w->m_guider_data_2) w->m_guider_graph->redraw_data2(*(w->m_guider_data_1), *(w->m_guider_data_2));
 		} else if (focal_length > 0 && w->m_guider_data_1 != &w->m_drift_data_ra_s) {
 			indigo_log("Focal length set will use arcseconds");
 			w->select_guider_data(SHOW_RA_DEC_S_DRIFT);
-			if (w->m_guider_data_1 && w->m_guider_data_2) w->m_guider_graph->redraw_data2(*(w->m_guider_data_1), *(w->m_guider_data_2));
 		}
 	}
 
@@ -1761,7 +1780,7 @@ void update_guider_stats(ImagerWindow *w, indigo_property *property) {
 					w->m_pulse_data_dec.clear();
 					w->m_drift_data_x.clear();
 					w->m_drift_data_y.clear();
-					w->m_guider_graph->redraw_data2(*(w->m_guider_data_1), *(w->m_guider_data_2));
+					w->m_guider_graph->update_series();
 				} else if (frame_count > 0) {
 					w->m_drift_data_ra.append(d_ra);
 					w->m_drift_data_dec.append(d_dec);
@@ -1771,29 +1790,30 @@ void update_guider_stats(ImagerWindow *w, indigo_property *property) {
 					w->m_pulse_data_dec.append(cor_dec);
 					w->m_drift_data_x.append(d_x);
 					w->m_drift_data_y.append(d_y);
-
-					if (w->m_drift_data_dec.size() > 120) {
-						w->m_drift_data_dec.removeFirst();
-						w->m_drift_data_ra.removeFirst();
-						w->m_drift_data_dec_s.removeFirst();
-						w->m_drift_data_ra_s.removeFirst();
-						w->m_pulse_data_ra.removeFirst();
-						w->m_pulse_data_dec.removeFirst();
-						w->m_drift_data_x.removeFirst();
-						w->m_drift_data_y.removeFirst();
-					}
-					w->m_guider_graph->redraw_data2(*(w->m_guider_data_1), *(w->m_guider_data_2));
+					w->m_guider_graph->update_series();
+
+					double now = QDateTime::currentMSecsSinceEpoch() / 1000.0;
+					double previous_last_time = w->m_guide_history.last_time();
+					w->m_guide_history.append(HISTORY_DRIFT_RA, now, d_ra);
+					w->m_guide_history.append(HISTORY_DRIFT_DEC, now, d_dec);
+					w->m_guide_history.append(HISTORY_DRIFT_RA_S, now, d_ra_s);
+					w->m_guide_history.append(HISTORY_DRIFT_DEC_S, now, d_dec_s);
+					w->m_guide_history.append(HISTORY_DRIFT_X, now, d_x);
+					w->m_guide_history.append(HISTORY_DRIFT_Y, now, d_y);
+					w->m_guide_history.append(HISTORY_CORR_RA, now, cor_ra);
+					w->m_guide_history.append(HISTORY_CORR_DEC, now, cor_dec);
+					if (snr > 0) w->m_guide_history.append(HISTORY_SNR, now, snr);
+					w->follow_guider_history(previous_last_time);
 				}
 				break;
 			}
 		}
 		if (p->state == INDIGO_BUSY_STATE) {
 			w->move_guider_reference(ref_x, ref_y);
-			if (w->m_guider_process && w->m_guide_log && conf.guider_save_log && frame_count > 1) {
+			if (w->m_guider_process && w->m_guide_log.is_open() && conf.guider_save_log && frame_count > 1) {
 				char time_str[255];
 				get_timestamp(time_str);
-				fprintf(
-					w->m_guide_log,
+				w->m_guide_log.print(
 					"\"%s\", %.3f, %.3f, %.3f, %.3f, %.3f, %.3f, %.3f, %.3f, %.3f, %.3f, %.3f, %.3f, %d\n",
 					time_str,
 					d_x, d_y,
@@ -1804,7 +1824,6 @@ void update_guider_stats(ImagerWindow *w, indigo_property *property) {
 					cor_ra, cor_dec,
 					is_dithering
 				);
-				fflush(w->m_guide_log);
 			}
 		} else {
 			w->move_guider_reference(0, 0);
@@ -1903,10 +1922,10 @@ void update_guider_apply_dec_backlash(ImagerWindow *w, indigo_property *property
 
 void log_guide_header(ImagerWindow *w, char *device_name) {
 	char time_str[255];
-	if (w->m_guide_log == nullptr || device_name == nullptr) return;
+	if (!w->m_guide_log.is_open() || device_name == nullptr) return;
 
 	get_timestamp(time_str);
-	fprintf(w->m_guide_log, "\nGuiding started at %s\n", time_str);
+	w->m_guide_log.print("\nGuiding started at %s\n", time_str);
 	indigo_property *p = properties.get(device_name, AGENT_GUIDER_DETECTION_MODE_PROPERTY_NAME);
 	if (p) {
 		char method[INDIGO_VALUE_SIZE] = {0};
@@ -1930,7 +1949,7 @@ void log_guide_header(ImagerWindow *w, char *device_name) {
 					edge_clipping = (int)p->items[i].number.value;
 				}
 			}
-			fprintf(w->m_guide_log, "Method: '%s', Parameters: Radius = %d px, Star count = %d, Edge clipping = %d px\n", method, radius, star_count, edge_clipping);
+			w->m_guide_log.print("Method: '%s', Parameters: Radius = %d px, Star count = %d, Edge clipping = %d px\n", method, radius, star_count, edge_clipping);
 		}
 
 		p = properties.get(device_name, AGENT_GUIDER_SETTINGS_PROPERTY_NAME);
@@ -1967,8 +1986,7 @@ void log_guide_header(ImagerWindow *w, char *device_name) {
 				stack = p->items[i].number.value;
 			}
 		}
-		fprintf(
-			w->m_guide_log,
+		w->m_guide_log.print(
 			"Guider Settings: Exp = %.3f s, Delay = %.3f s, Min Error = %.3f px, Min Pulse = %.3f s, Max Pulse = %.3f s\n",
 			exposure,
 			delay,
@@ -1976,8 +1994,7 @@ void log_guide_header(ImagerWindow *w, char *device_name) {
 			min_pulse,
 			max_pulse
 		);
-		fprintf(
-			w->m_guide_log,
+		w->m_guide_log.print(
 			"PI Settings: RA Aggr = %.3f %%, Dec Aggr = %.3f %%, RA I Gain = %.3f, Dec I Gain = %.3f, Stack = %.0f\n",
 			ra_aggr,
 			dec_aggr,
@@ -1986,8 +2003,7 @@ void log_guide_header(ImagerWindow *w, char *device_name) {
 			stack
 		);
 	}
-	fprintf(w->m_guide_log, "Timestamp, X Dif, Y Dif, RA Dif, Dec Dif, RA Dif(\"), Dec Dif(\"), RMSE RA, RMSE Dec, RMSE RA(\"), RMSE Dec(\"), Ra Correction, Dec Correction, Dithering\n");
-	fflush(w->m_guide_log);
+	w->m_guide_log.print("Timestamp, X Dif, Y Dif, RA Dif, Dec Dif, RA Dif(\"), Dec Dif(\"), RMSE RA, RMSE Dec, RMSE RA(\"), RMSE Dec(\"), Ra Correction, Dec Correction, Dithering\n");
 }
 
 void agent_guider_start_process_change(ImagerWindow *w, indigo_property *property) {
@@ -2011,7 +2027,7 @@ void agent_guider_start_process_change(ImagerWindow *w, indigo_property *propert
 				w->set_enabled(w->m_guider_calibrate_button, false);
 				w->set_enabled(w->m_guider_guide_button, true);
 				w->set_enabled(w->m_guider_preview_button, false);
-				if (w->m_guide_log && conf.guider_save_log && w->m_guider_process == 0) {
+				if (w->m_guide_log.is_open() && conf.guider_save_log && w->m_guider_process == 0) {
 					w->m_guider_process = 1;
 					log_guide_header(w, property->device);
 				}
@@ -2031,19 +2047,17 @@ void agent_guider_start_process_change(ImagerWindow *w, indigo_property *propert
 		w->set_widget_state(w->m_guider_guide_button, property->state);
 		if (property->state == INDIGO_ALERT_STATE) {
 			w->set_guider_label(INDIGO_ALERT_STATE, " Process failed ");
-			if (w->m_guide_log && conf.guider_save_log && w->m_guider_process) {
+			if (w->m_guide_log.is_open() && conf.guider_save_log && w->m_guider_process) {
 				w->m_guider_process = 0;
 				get_timestamp(time_str);
-				fprintf(w->m_guide_log, "Process failed at %s\n", time_str);
-				fflush(w->m_guide_log);
+				w->m_guide_log.print("Process failed at %s\n", time_str);
 			}
 		} else {
 			w->set_guider_label(INDIGO_IDLE_STATE, " Stopped ");
-			if (w->m_guide_log && conf.guider_save_log && w->m_guider_process == 1) {
+			if (w->m_guide_log.is_open() && conf.guider_save_log && w->m_guider_process == 1) {
 				w->m_guider_process = 0;
 				get_timestamp(time_str);
-				fprintf(w->m_guide_log, "Guiding finished at %s\n", time_str);
-				fflush(w->m_guide_log);
+				w->m_guide_log.print("Guiding finished at %s\n", time_str);
 			}
 		}
 		w->set_enabled(w->m_guider_preview_button, true);
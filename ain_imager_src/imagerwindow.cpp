@@ -23,19 +23,27 @@
 #include <libgen.h>
 
 #include <utils.h>
+#include <indigo/indigo_md5.h>
 #include "imagerwindow.h"
 #include "qservicemodel.h"
 #include "indigoclient.h"
+#include "blobfetcher.h"
+#include "videocapture.h"
 #include "propertycache.h"
 #include "qindigoservers.h"
 #include "blobpreview.h"
+#include "catalogindex.h"
 #include "logger.h"
 #include "conf.h"
 #include "version.h"
 #include <imageviewer.h>
 #include <image_stats.h>
+#include <pipetrace.h>
+#include <calibration.h>
+#include <defectmap.h>
 #include <QSound>
 #include <QFileInfo>
+#include <QInputDialog>
 
 void write_conf();
 
@@ -61,12 +69,34 @@ ImagerWindow::ImagerWindow(QWidget *parent) : QMainWindow(parent) {
 	mIndigoServers = new QIndigoServers(this);
 	m_config_dialog = new QConfigDialog(this);
 	m_add_object_dialog = new QAddCustomObject(this);
+	m_object_search = new ObjectSearch(this);
+	m_object_search->build();
+	m_object_search_done = true;
+	m_object_search_enter = false;
+	m_visibility = new Visibility(this);
+	CatalogIndex::instance().load_catalogs(QString(config_path) + "/" + CATALOG_INDEX_DIR);
 
 	m_save_blob = false;
+	m_video_process_started = false;
+	m_live_stack = new LiveStack();
+	m_live_stack->set_mode((live_stack_mode)conf.live_stack_mode);
+	m_calibration_dir[0] = '\0';
+	// the singleton is created here, the preview lanes only use it
+	CalibrationLibrary::instance();
+	if (conf.calibrate_previews) scan_calibration_masters();
+	DefectMap::instance().set_enabled(conf.remove_hot_pixels);
 	m_is_sequence = false;
 	m_indigo_item = nullptr;
-	m_guide_log = nullptr;
+	m_session_replayer = nullptr;
+	m_quit_after_replay = false;
 	m_guider_process = 0;
+	m_pending_log_dropped = 0;
+	m_downloaded_bytes = 0;
+	m_downloaded_files = 0;
+	m_download_failed = 0;
+	m_downloads_in_flight = 0;
+	m_download_requested = false;
+	m_download_canceled = false;
 	m_stderr = dup(STDERR_FILENO);
 
 	//  Set central widget of window
@@ -83,6 +113,11 @@ ImagerWindow::ImagerWindow(QWidget *parent) : QMainWindow(parent) {
 	//  Create log viewer
 	mLog = new QTextEdit;
 	mLog->setReadOnly(true);
+	mLog->document()->setMaximumBlockCount(AIN_LOG_MAX_LINES);
+	m_log_timer.setSingleShot(true);
+	m_log_timer.setInterval(AIN_LOG_UPDATE_INTERVAL);
+	connect(&m_log_timer, &QTimer::timeout, this, &ImagerWindow::on_flush_window_log);
+	connect(&m_guide_log, &LogWriter::lines_dropped, this, &ImagerWindow::on_guide_log_dropped);
 
 	on_indigo_save_log(conf.indigo_save_log);
 	on_guider_save_log(conf.guider_save_log);
@@ -129,6 +164,15 @@ ImagerWindow::ImagerWindow(QWidget *parent) : QMainWindow(parent) {
 
 	menu->addSeparator();
 
+	m_session_record_act = menu->addAction(tr("&Record INDIGO Session..."));
+	m_session_record_act->setCheckable(true);
+	connect(m_session_record_act, &QAction::toggled, this, &ImagerWindow::on_session_record_act);
+
+	act = menu->addAction(tr("Re&play INDIGO Session..."));
+	connect(act, &QAction::triggered, this, &ImagerWindow::on_session_replay_act);
+
+	menu->addSeparator();
+
 	act = menu->addAction(tr("&Exit"));
 	connect(act, &QAction::triggered, this, &ImagerWindow::on_exit_act);
 
@@ -176,6 +220,16 @@ ImagerWindow::ImagerWindow(QWidget *parent) : QMainWindow(parent) {
 	act->setChecked(conf.use_system_locale);
 	connect(act, &QAction::toggled, this, &ImagerWindow::on_use_system_locale_changed);
 
+	act = menu->addAction(tr("Calibrate previews with &master frames"));
+	act->setCheckable(true);
+	act->setChecked(conf.calibrate_previews);
+	connect(act, &QAction::toggled, this, &ImagerWindow::on_calibrate_previews_changed);
+
+	act = menu->addAction(tr("Remove &hot pixels from previews"));
+	act->setCheckable(true);
+	act->setChecked(conf.remove_hot_pixels);
+	connect(act, &QAction::toggled, this, &ImagerWindow::on_remove_hot_pixels_changed);
+
 	menu->addSeparator();
 
 	QActionGroup *sound_group = new QActionGroup(this);
@@ -211,6 +265,16 @@ ImagerWindow::ImagerWindow(QWidget *parent) : QMainWindow(parent) {
 	act->setChecked(conf.imager_show_reference);
 	connect(act, &QAction::toggled, this, &ImagerWindow::on_imager_show_reference);
 
+	act = menu->addAction(tr("Show catalog &objects"));
+	act->setCheckable(true);
+	act->setChecked(conf.imager_show_objects);
+	connect(act, &QAction::toggled, this, &ImagerWindow::on_imager_show_objects);
+
+	act = menu->addAction(tr("Show coordinate &grid"));
+	act->setCheckable(true);
+	act->setChecked(conf.imager_show_grid);
+	connect(act, &QAction::toggled, this, &ImagerWindow::on_imager_show_grid);
+
 	act = menu->addAction(tr("Enable image &antialiasing"));
 	act->setCheckable(true);
 	act->setChecked(conf.antialiasing_enabled);
@@ -269,6 +333,12 @@ ImagerWindow::ImagerWindow(QWidget *parent) : QMainWindow(parent) {
 	connect(act, &QAction::triggered, this, &ImagerWindow::on_guide_show_xy_drift);
 	graph_group->addAction(act);
 
+	sub_menu->addSeparator();
+
+	act = sub_menu->addAction("Whole &Session (drag to pan, scroll to zoom)");
+	act->setCheckable(true);
+	connect(act, &QAction::toggled, this, &ImagerWindow::on_guide_show_history);
+
 	menu->addSeparator();
 
 	act = menu->addAction(tr("&Save Guiding Log"));
@@ -320,6 +390,19 @@ ImagerWindow::ImagerWindow(QWidget *parent) : QMainWindow(parent) {
 
 	menu->addSeparator();
 
+	act = menu->addAction(tr("Preview &Latency..."));
+	connect(act, &QAction::triggered, this, &ImagerWindow::on_preview_lane_stats_act);
+
+	act = menu->addAction(tr("Enable Pipeline &Tracing"));
+	act->setCheckable(true);
+	act->setChecked(pipe_trace_enabled());
+	connect(act, &QAction::toggled, this, &ImagerWindow::on_pipe_trace_act);
+
+	act = menu->addAction(tr("Pipeline &Statistics..."));
+	connect(act, &QAction::triggered, this, &ImagerWindow::on_pipe_trace_stats_act);
+
+	menu->addSeparator();
+
 	act = menu->addAction(tr("&About"));
 	connect(act, &QAction::triggered, this, &ImagerWindow::on_about_act);
 	menu_bar->addMenu(menu);
@@ -462,6 +545,8 @@ ImagerWindow::ImagerWindow(QWidget *parent) : QMainWindow(parent) {
 	connect(this, &ImagerWindow::set_checkbox_checked, this, &ImagerWindow::on_set_checkbox_checked);
 	connect(this, &ImagerWindow::set_checkbox_state, this, &ImagerWindow::on_set_checkbox_state);
 
+	connect(this, &ImagerWindow::download_saved, this, &ImagerWindow::on_download_saved);
+
 	connect(mServiceModel, &QServiceModel::serviceAdded, mIndigoServers, &QIndigoServers::onAddService);
 	connect(mServiceModel, &QServiceModel::serviceRemoved, mIndigoServers, &QIndigoServers::onRemoveService);
 	connect(mServiceModel, &QServiceModel::serviceConnectionChange, mIndigoServers, &QIndigoServers::onConnectionChange);
@@ -491,6 +576,16 @@ ImagerWindow::ImagerWindow(QWidget *parent) : QMainWindow(parent) {
 
 	// in some cases Qt::BlockingQueuedConnection causes app to hang, use of Qt::QueuedConnection is safe as blob is cached
 	connect(&IndigoClient::instance(), &IndigoClient::create_preview, this, &ImagerWindow::on_create_preview, Qt::QueuedConnection);
+	connect(&BlobFetcher::instance(), &BlobFetcher::blob_progress, this, &ImagerWindow::on_blob_progress, Qt::QueuedConnection);
+
+	m_preview_lanes[GUIDER_LANE] = new PreviewLane(GUIDER_LANE, true, true);
+	m_preview_lanes[IMAGER_LANE] = new PreviewLane(IMAGER_LANE, false, false);
+	m_preview_lanes[IMAGER_LANE]->set_live_stack(m_live_stack);
+	for (int lane = 0; lane < PREVIEW_LANES; lane++) {
+		connect(m_preview_lanes[lane], &PreviewLane::preview_ready, this, &ImagerWindow::on_preview_ready, Qt::QueuedConnection);
+	}
+	m_preview_lanes[GUIDER_LANE]->start(QThread::HighPriority);
+	m_preview_lanes[IMAGER_LANE]->start(QThread::LowPriority);
 	//connect(&IndigoClient::instance(), &IndigoClient::obsolete_preview, this, &ImagerWindow::on_obsolete_preview, Qt::BlockingQueuedConnection);
 	connect(&IndigoClient::instance(), &IndigoClient::remove_preview, this, &ImagerWindow::on_remove_preview, Qt::BlockingQueuedConnection);
 
@@ -510,6 +605,12 @@ ImagerWindow::ImagerWindow(QWidget *parent) : QMainWindow(parent) {
 	select_guider_data(conf.guider_display);
 	m_imager_viewer->enableAntialiasing(conf.antialiasing_enabled);
 	m_imager_viewer->showReference(conf.imager_show_reference);
+	m_imager_viewer->setObjectSource(&CatalogIndex::instance());
+	m_imager_viewer->showObjects(conf.imager_show_objects);
+	m_seq_imager_viewer->setObjectSource(&CatalogIndex::instance());
+	m_seq_imager_viewer->showObjects(conf.imager_show_objects);
+	m_imager_viewer->showGrid(conf.imager_show_grid);
+	m_seq_imager_viewer->showGrid(conf.imager_show_grid);
 	m_guider_viewer->enableAntialiasing(conf.guider_antialiasing_enabled);
 
 	//  Start up the client
@@ -529,10 +630,22 @@ ImagerWindow::~ImagerWindow () {
 	conf.window_width = wsize.width();
 	conf.window_height = wsize.height();
 	write_conf();
+	stop_video_capture();
 	QtConcurrent::run([=]() {
 		IndigoClient::instance().stop();
 	});
 	indigo_usleep(0.5 * ONE_SECOND_DELAY);
+	SessionRecorder::instance().stop();
+	if (m_session_replayer) {
+		// the replayer may be blocked in a property handler running on this thread
+		m_session_replayer->stop();
+		while (!m_session_replayer->wait(10)) QCoreApplication::processEvents();
+		delete m_session_replayer;
+	}
+	for (int lane = 0; lane < PREVIEW_LANES; lane++) {
+		delete m_preview_lanes[lane];
+	}
+	delete m_live_stack;
 	delete m_imager_viewer;
 	if (m_indigo_item) {
 		if (m_indigo_item->blob.value) {
@@ -558,13 +671,14 @@ void ImagerWindow::window_log(char *message, int state) {
 	get_time(timestamp);
 
 	QString msg(message);
+	QColor color = Qt::white;
 	switch (state) {
 	case INDIGO_ALERT_STATE:
-		mLog->setTextColor(QColor::fromRgb(224, 0, 0));
+		color = QColor::fromRgb(224, 0, 0);
 		play_sound(AIN_ALERT_SOUND);
 		break;
 	case INDIGO_BUSY_STATE:
-		mLog->setTextColor(QColor::fromRgb(255, 165, 0));
+		color = QColor::fromRgb(255, 165, 0);
 		if (msg.contains("warn", Qt::CaseInsensitive)) {
 			play_sound(AIN_WARNING_SOUND);
 		}
@@ -579,10 +693,10 @@ void ImagerWindow::window_log(char *message, int state) {
 					!msg.contains("adjustment knob", Qt::CaseInsensitive)
 				)
 			) {
-				mLog->setTextColor(QColor::fromRgb(224, 0, 0));
+				color = QColor::fromRgb(224, 0, 0);
 				play_sound(AIN_ALERT_SOUND);
 			} else if (msg.contains("warn", Qt::CaseInsensitive)) {
-				mLog->setTextColor(QColor::fromRgb(255, 165, 0));
+				color = QColor::fromRgb(255, 165, 0);
 				play_sound(AIN_WARNING_SOUND);
 			} else {
 				if (
@@ -591,17 +705,50 @@ void ImagerWindow::window_log(char *message, int state) {
 				) {
 					play_sound(AIN_OK_SOUND);
 				}
-				mLog->setTextColor(Qt::white);
+				color = Qt::white;
 			}
 			break;
 		}
 	}
 	snprintf(log_line, 512, "%s %s", timestamp, message);
 	indigo_log("[message] %s\n", log_line);
-	mLog->append(log_line);
+
+	// the widget is updated in batches, lines that would scroll out anyway are not kept
+	m_pending_log.append(QPair<QString, QColor>(QString(log_line), color));
+	if (m_pending_log.size() > AIN_LOG_MAX_LINES) {
+		m_pending_log.removeFirst();
+		m_pending_log_dropped++;
+	}
+	if (!m_log_timer.isActive()) m_log_timer.start();
+}
+
+void ImagerWindow::on_flush_window_log() {
+	if (m_pending_log.isEmpty()) return;
+
+	QTextCursor cursor(mLog->document());
+	cursor.movePosition(QTextCursor::End);
+	cursor.beginEditBlock();
+	if (m_pending_log_dropped) {
+		m_pending_log.prepend(QPair<QString, QColor>(QString("%1 messages not shown").arg(m_pending_log_dropped), QColor::fromRgb(255, 165, 0)));
+		m_pending_log_dropped = 0;
+	}
+	for (auto &line : m_pending_log) {
+		if (!mLog->document()->isEmpty()) cursor.insertBlock();
+		QTextCharFormat format;
+		format.setForeground(line.second);
+		cursor.insertText(line.first, format);
+	}
+	cursor.endEditBlock();
+	m_pending_log.clear();
 	mLog->verticalScrollBar()->setValue(mLog->verticalScrollBar()->maximum());
 }
 
+void ImagerWindow::on_guide_log_dropped(unsigned int count) {
+	char message[100];
+	snprintf(message, sizeof(message), "Warning: Guiding log can not keep up, %u lines dropped", count);
+	window_log(message, INDIGO_BUSY_STATE);
+}
+
 bool ImagerWindow::show_preview_in_imager_viewer(QString &key) {
 	preview_image *image = preview_cache.get(key);
 	if (image) {
@@ -731,47 +878,36 @@ void ImagerWindow::on_create_preview(indigo_property *property, indigo_item *ite
 		get_selected_imager_agent(selected_agent) &&
 		client_match_device_property(property, selected_agent, CCD_IMAGE_PROPERTY_NAME)
 	) {
-		if (m_indigo_item) {
-			if (m_indigo_item->blob.value) {
-				free(m_indigo_item->blob.value);
-			}
-			free(m_indigo_item);
-			m_indigo_item = nullptr;
-		}
-		m_indigo_item = item;
+		// save right away, file name depends on the current object and filter
+		if (m_save_blob && strcasecmp(".raw", item->blob.format)) save_blob_item(item);
 		const stretch_config_t sconfig = {(uint8_t)conf.preview_stretch_level, (uint8_t)conf.preview_color_balance, conf.preview_bayer_pattern};
-		preview_cache.create(property, m_indigo_item, sconfig);
-		QString key = preview_cache.create_key(property, m_indigo_item);
-		//preview_image *image = preview_cache.get(m_image_key);
-		if (show_preview_in_imager_viewer(key)) {
-			indigo_debug("m_imager_viewer = %p", m_imager_viewer);
-			m_imager_viewer->setText(QString("Unsaved") + QString(m_indigo_item->blob.format));
-			m_imager_viewer->setToolTip(QString("Unsaved") + QString(m_indigo_item->blob.format));
-		}
-		if (m_save_blob && strcasecmp(".raw", m_indigo_item->blob.format)) save_blob_item(m_indigo_item);
+		m_preview_lanes[IMAGER_LANE]->submit(property, item, sconfig, property->state == INDIGO_OK_STATE);
 	} else if (
 		get_selected_imager_agent(selected_agent) &&
 		client_match_device_property(property, selected_agent, AGENT_IMAGER_DOWNLOAD_IMAGE_PROPERTY_NAME)
 	) {
 		if (m_files_to_download.empty()) {
-			m_sync_files_button->setText("Download images");
-			set_widget_state(m_sync_files_button, INDIGO_OK_STATE);
+			m_download_requested = false;
+			if (m_downloads_in_flight == 0) {
+				m_sync_files_button->setText("Download images");
+				set_widget_state(m_sync_files_button, INDIGO_OK_STATE);
+			}
 		} else {
 			char file_name[PATH_LEN] = {0};
-			static char file_name_static[PATH_LEN];
-			char message[PATH_LEN+100];
 			char location[PATH_LEN];
 			indigo_property *p = properties.get(selected_agent, AGENT_IMAGER_DOWNLOAD_FILE_PROPERTY_NAME);
 			if (p) {
 				for (int i = 0; i < p->count; i++) {
 					strcpy(file_name, p->items[i].text.value);
-					strcpy(file_name_static, p->items[i].text.value);
 					break;
 				}
 			}
 			indigo_debug("Received: %s", file_name);
 			if (m_files_to_download.contains(file_name)) {
-				m_files_to_download.removeAll(file_name);
+				QString remote_file(file_name);
+				m_download_requested = false;
+				m_files_to_download.removeAll(remote_file);
+				m_downloaded_bytes += item->blob.size;
 				get_current_output_dir(location, conf.data_dir_prefix);
 				char *c = strrchr(file_name, '.');
 				if (c) {
@@ -781,42 +917,31 @@ void ImagerWindow::on_create_preview(indigo_property *property, indigo_item *ite
 				if (c && strlen(c+1) == 32) {
 					*c = '\0';
 					strcat(location, file_name);
-					if (save_blob_item_with_prefix(item, location, file_name, false)) {
-						if (!conf.keep_images_on_server) {
-							snprintf(message, sizeof(message), "Image saved to '%s' and removed remotely", file_name);
-							QtConcurrent::run([=]() {
-								QString next_file = file_name_static;
-								char agent[INDIGO_VALUE_SIZE];
-								get_selected_imager_agent(agent);
-								request_file_remove(agent, next_file.toUtf8().constData());
-							});
-						} else {
-							snprintf(message, sizeof(message), "Image saved to '%s' and kept remotely", file_name);
-						}
-						window_log(message);
-					} else {
-						snprintf(message, sizeof(message), "Error: can not save '%s'", file_name);
-						window_log(message, INDIGO_ALERT_STATE);
-					}
-				}
-				if (!m_files_to_download.empty()) {
-					m_sync_files_button->setText("Cancel download");
-					set_widget_state(m_sync_files_button, INDIGO_BUSY_STATE);
-					m_download_progress->setValue(m_download_progress->value() + 1);
-					m_download_progress->setFormat("Downloading %v of %m images...");
+					QString prefix(location);
+					QString remote_digest(c+1);
+					// verify and save on a worker thread, the agent can serve the next file meanwhile
+					m_downloads_in_flight++;
 					QtConcurrent::run([=]() {
-						char agent[INDIGO_VALUE_SIZE];
-						get_selected_imager_agent(agent);
-						QString next_file = m_files_to_download.at(0);
-						request_file_download(agent, next_file.toUtf8().constData());
+						char digest[33] = {0};
+						char saved_file[PATH_LEN] = {0};
+						int status = DOWNLOAD_SAVED;
+						indigo_md5_partial(digest, item->blob.value, item->blob.size, INDIGO_PARTIAL_MD5_LEN);
+						if (remote_digest.compare(digest, Qt::CaseInsensitive)) {
+							indigo_error("%s: digest mismatch %s != %s", remote_file.toUtf8().constData(), digest, remote_digest.toUtf8().constData());
+							status = DOWNLOAD_BAD_DIGEST;
+						} else if (!save_blob_item_with_prefix(item, prefix.toUtf8().constData(), saved_file, false)) {
+							status = DOWNLOAD_SAVE_FAILED;
+						}
+						free(item->blob.value);
+						free(item);
+						emit download_saved(remote_file, QString(saved_file), status);
 					});
-				} else {
-					m_sync_files_button->setText("Download images");
-					set_widget_state(m_sync_files_button, INDIGO_OK_STATE);
-					m_download_progress->setValue(m_download_progress->value() + 1);
-					m_download_progress->setFormat("Downloaded %v images");
-					window_log("Download complete");
+					request_next_download();
+					update_download_progress();
+					return;
 				}
+				request_next_download();
+				update_download_progress();
 			}
 		}
 		free(item->blob.value);
@@ -826,13 +951,8 @@ void ImagerWindow::on_create_preview(indigo_property *property, indigo_item *ite
 		if ((client_match_device_property(property, selected_agent, CCD_IMAGE_PROPERTY_NAME) && conf.guider_save_bandwidth == 0) ||
 			(client_match_device_property(property, selected_agent, CCD_PREVIEW_IMAGE_PROPERTY_NAME) && conf.guider_save_bandwidth > 0)) {
 			const stretch_config_t sconfig = {(uint8_t)conf.guider_stretch_level, (uint8_t)conf.guider_color_balance, BAYER_PAT_AUTO};
-			preview_cache.create(property, item, sconfig);
-			QString key = preview_cache.create_key(property, item);
-			//preview_image *image = preview_cache.get(key);
-			if (show_preview_in_guider_viewer(key)) {
-				indigo_debug("m_guider_viewer = %p", m_guider_viewer);
-				//m_guider_viewer->setText(QString("Guider: image") + QString(item->blob.format));
-			}
+			m_preview_lanes[GUIDER_LANE]->submit(property, item, sconfig, property->state == INDIGO_OK_STATE);
+			return;
 		} else {
 			preview_cache.remove(property, item);
 		}
@@ -847,6 +967,149 @@ void ImagerWindow::on_create_preview(indigo_property *property, indigo_item *ite
 }
 
 
+void ImagerWindow::on_preview_ready(indigo_property *property, indigo_item *item, preview_image *preview, int lane) {
+	QString key = preview_cache.create_key(property, item);
+	preview_cache.add(key, preview);
+
+	if (lane == IMAGER_LANE) {
+		if (m_indigo_item) {
+			// the next download goes to the same buffer
+			BlobFetcher::instance().recycle(m_indigo_item->blob.value, m_indigo_item->blob.size);
+			free(m_indigo_item);
+			m_indigo_item = nullptr;
+		}
+		m_indigo_item = item;
+		QString saved_file = m_saved_image_files.take(item);
+		if (show_preview_in_imager_viewer(key)) {
+			indigo_debug("m_imager_viewer = %p", m_imager_viewer);
+			if (m_live_stack->is_enabled()) {
+				update_live_stack_label();
+				QString stack_text = QString("Live stack: %1 frames").arg(m_live_stack->stats().stacked);
+				m_imager_viewer->setText(stack_text);
+				m_imager_viewer->setToolTip(saved_file.isEmpty() ? stack_text : saved_file);
+			} else if (saved_file.isEmpty()) {
+				m_imager_viewer->setText(QString("Unsaved") + QString(m_indigo_item->blob.format));
+				m_imager_viewer->setToolTip(QString("Unsaved") + QString(m_indigo_item->blob.format));
+			} else {
+				m_imager_viewer->setText(QFileInfo(saved_file).fileName());
+				m_imager_viewer->setToolTip(saved_file);
+			}
+		}
+	} else {
+		if (show_preview_in_guider_viewer(key)) {
+			indigo_debug("m_guider_viewer = %p", m_guider_viewer);
+			//m_guider_viewer->setText(QString("Guider: image") + QString(item->blob.format));
+		}
+		BlobFetcher::instance().recycle(item->blob.value, item->blob.size);
+		item->blob.value = nullptr;
+		free(item);
+	}
+}
+
+void ImagerWindow::on_preview_lane_stats_act() {
+	static const char *lane_names[PREVIEW_LANES] = { "Guider", "Imager" };
+	QString stats_str = "<b>Preview processing latency</b><br><br><table cellspacing=4>";
+	stats_str += "<tr><td></td>";
+	for (int bin = 0; bin < LANE_HISTOGRAM_BINS; bin++) {
+		if (lane_histogram_limits[bin] < 0) {
+			stats_str += "<td align=right><b>&ge;" + QString::number(lane_histogram_limits[bin - 1]) + "ms</b></td>";
+		} else {
+			stats_str += "<td align=right><b>&lt;" + QString::number(lane_histogram_limits[bin]) + "ms</b></td>";
+		}
+	}
+	stats_str += "<td align=right><b>Max</b></td><td align=right><b>Dropped</b></td></tr>";
+	for (int lane = 0; lane < PREVIEW_LANES; lane++) {
+		preview_lane_stats stats = m_preview_lanes[lane]->stats();
+		stats_str += "<tr><td><b>" + QString(lane_names[lane]) + "</b></td>";
+		for (int bin = 0; bin < LANE_HISTOGRAM_BINS; bin++) {
+			stats_str += "<td align=right>" + QString::number(stats.histogram[bin]) + "</td>";
+		}
+		stats_str += "<td align=right>" + QString::number(stats.max_latency, 'f', 0) + "ms</td>";
+		stats_str += "<td align=right>" + QString::number(stats.dropped) + "</td></tr>";
+	}
+	stats_str += "</table>";
+
+	QMessageBox msgBox(this);
+	msgBox.setWindowTitle("Preview Latency");
+	msgBox.setTextFormat(Qt::RichText);
+	msgBox.setText(stats_str);
+	msgBox.exec();
+	indigo_debug("%s\n", __FUNCTION__);
+}
+
+void ImagerWindow::on_pipe_trace_act(bool enabled) {
+	pipe_trace_enable(enabled);
+	window_log(enabled ? (char *)"Pipeline tracing enabled" : (char *)"Pipeline tracing disabled");
+	indigo_debug("%s\n", __FUNCTION__);
+}
+
+void ImagerWindow::on_pipe_trace_stats_act() {
+	QVector<pipe_trace_stats> summary = pipe_trace_summary();
+	QString stats_str = "<b>Image pipeline stages</b><br><br>";
+	if (summary.isEmpty()) {
+		stats_str += pipe_trace_enabled() ? "No frames traced yet." : "Pipeline tracing is not enabled.";
+	} else {
+		stats_str += "<table cellspacing=4><tr><td></td><td align=right><b>Count</b></td><td align=right><b>p50</b></td><td align=right><b>p95</b></td><td align=right><b>Max</b></td></tr>";
+		for (const pipe_trace_stats &stats : summary) {
+			stats_str += "<tr><td><b>" + QString(stats.stage) + "</b></td>";
+			stats_str += "<td align=right>" + QString::number(stats.count) + "</td>";
+			stats_str += "<td align=right>" + QString::number(stats.p50, 'f', 1) + "ms</td>";
+			stats_str += "<td align=right>" + QString::number(stats.p95, 'f', 1) + "ms</td>";
+			stats_str += "<td align=right>" + QString::number(stats.max, 'f', 1) + "ms</td></tr>";
+		}
+		stats_str += "</table><br>Statistics of the last " + QString::number(PIPE_TRACE_RECENT) + " events of each stage.";
+	}
+
+	QMessageBox msgBox(this);
+	msgBox.setWindowTitle("Pipeline Statistics");
+	msgBox.setTextFormat(Qt::RichText);
+	msgBox.setText(stats_str);
+	QPushButton *export_button = msgBox.addButton(tr("Export Trace..."), QMessageBox::ActionRole);
+	QPushButton *clear_button = msgBox.addButton(tr("Clear"), QMessageBox::ResetRole);
+	msgBox.addButton(QMessageBox::Close);
+	export_button->setEnabled(!summary.isEmpty());
+	msgBox.exec();
+
+	if (msgBox.clickedButton() == clear_button) {
+		pipe_trace_clear();
+	} else if (msgBox.clickedButton() == export_button) {
+		QString filter = "Chrome Trace (*.json);; All files (*)";
+		QString qlocation = QDir::toNativeSeparators(QDir::homePath() + "/ain_pipeline_trace.json");
+		QString file_name = QFileDialog::getSaveFileName(this, "Export Pipeline Trace As...", qlocation, filter);
+		if (!file_name.isNull()) {
+			if (!file_name.endsWith(".json", Qt::CaseInsensitive)) file_name += ".json";
+			char fname[PATH_MAX];
+			strncpy(fname, file_name.toUtf8().constData(), PATH_MAX - 1);
+			fname[PATH_MAX - 1] = '\0';
+			char message[PATH_MAX + 100];
+			if (pipe_trace_export(fname)) {
+				snprintf(message, sizeof(message), "Pipeline trace exported as '%s'", fname);
+				window_log(message);
+			} else {
+				snprintf(message, sizeof(message), "Can not export pipeline trace as '%s'", fname);
+				window_log(message, INDIGO_ALERT_STATE);
+			}
+		}
+	}
+	indigo_debug("%s\n", __FUNCTION__);
+}
+
+void ImagerWindow::on_blob_progress(QString device, QString property, qint64 received, qint64 total) {
+	char selected_agent[INDIGO_VALUE_SIZE];
+	if (!get_selected_imager_agent(selected_agent) || device != selected_agent || property != CCD_IMAGE_PROPERTY_NAME) {
+		return;
+	}
+	if (total <= 0 || received >= total) {
+		m_exposure_progress->setRange(0, 100);
+		m_exposure_progress->setValue(100);
+		m_exposure_progress->setFormat("Image download: Complete");
+	} else {
+		m_exposure_progress->setRange(0, 100);
+		m_exposure_progress->setValue((int)(100 * received / total));
+		m_exposure_progress->setFormat(QString("Image download: %1 of %2 MB...").arg(received / 1048576.0, 0, 'f', 1).arg(total / 1048576.0, 0, 'f', 1));
+	}
+}
+
 void ImagerWindow::on_obsolete_preview(indigo_property *property, indigo_item *item){
 	preview_cache.obsolete(property, item);
 }
@@ -873,8 +1136,8 @@ void ImagerWindow::save_blob_item(indigo_item *item) {
 		}
 		get_current_output_dir(location, conf.data_dir_prefix);
 		if (save_blob_item_with_prefix(item, location, file_name)) {
-			m_imager_viewer->setText(basename(file_name));
-			m_imager_viewer->setToolTip(file_name);
+			// shown in the viewer when the preview is ready
+			m_saved_image_files.insert(item, QString(file_name));
 			snprintf(message, sizeof(message), "Image saved to '%s'", file_name);
 			window_log(message);
 		} else {
@@ -889,7 +1152,23 @@ void close_fd(int fd) {
 	close(fd);
 }
 
-bool ImagerWindow::save_blob_item_with_prefix(indigo_item *item, const char *prefix, char *file_name, bool auto_construct) {
+/* write in chunks so that short writes and errors are not silently ignored */
+static bool write_blob_data(int fd, const char *data, long size) {
+	const long chunk_size = 1024 * 1024;
+	while (size > 0) {
+		ssize_t written = write(fd, data, (size > chunk_size) ? chunk_size : size);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+/* Creates the next free <prefix><object>_<date>_<frame>_<filter>_<flag><number><extension>, returns its fd. */
+int ImagerWindow::open_file_with_prefix(const char *prefix, const char *extension, char *file_name, bool auto_construct) {
 	int fd;
 	int file_no = 1;
 
@@ -920,24 +1199,33 @@ bool ImagerWindow::save_blob_item_with_prefix(indigo_item *item, const char *pre
 	}
 
 	do {
-		sprintf(file_name, "%s%s_%c%03d%s", prefix, object_name.toUtf8().constData(), time_flag, file_no++, item->blob.format);
+		sprintf(file_name, "%s%s_%c%03d%s", prefix, object_name.toUtf8().constData(), time_flag, file_no++, extension);
 #if defined(INDIGO_WINDOWS)
 		fd = open(file_name, O_CREAT | O_WRONLY | O_EXCL | O_BINARY, S_IRUSR | S_IWUSR);
 #else
 		fd = open(file_name, O_CREAT | O_WRONLY | O_EXCL, S_IRUSR | S_IWUSR);
 #endif
 	} while ((fd < 0) && (errno == EEXIST));
+	return fd;
+}
 
+bool ImagerWindow::save_blob_item_with_prefix(indigo_item *item, const char *prefix, char *file_name, bool auto_construct) {
+	int fd = open_file_with_prefix(prefix, item->blob.format, file_name, auto_construct);
 	if (fd < 0) {
 		return false;
-	} else {
-		write(fd, item->blob.value, item->blob.size);
-		close_fd(fd);
 	}
-	return true;
+	bool success = write_blob_data(fd, (const char *)item->blob.value, item->blob.size);
+	int write_errno = errno;
+	close_fd(fd);
+	if (!success) {
+		indigo_error("%s: write failed: %s", file_name, strerror(write_errno));
+		unlink(file_name);
+	}
+	return success;
 }
 
 bool ImagerWindow::save_blob_item(indigo_item *item, char *file_name) {
+	PIPE_TRACE(PIPE_TRACE_SAVE);
 	int fd;
 
 #if defined(INDIGO_WINDOWS)
@@ -947,11 +1235,10 @@ bool ImagerWindow::save_blob_item(indigo_item *item, char *file_name) {
 #endif
 	if (fd < 0) {
 		return false;
-	} else {
-		write(fd, item->blob.value, item->blob.size);
-		close_fd(fd);
 	}
-	return true;
+	bool success = write_blob_data(fd, (const char *)item->blob.value, item->blob.size);
+	close_fd(fd);
+	return success;
 }
 
 
@@ -1115,6 +1402,11 @@ void ImagerWindow::on_data_directory_prefix_act() {
 	strncpy(conf.data_dir_prefix, dir.toUtf8().data(), PATH_LEN);
 	snprintf(message, sizeof(message), "Data will be saved to: '%s'", conf.data_dir_prefix);
 	window_log(message);
+	if (conf.calibrate_previews) {
+		int count = scan_calibration_masters();
+		snprintf(message, sizeof(message), "%d calibration masters found in '%s'", count, m_calibration_dir);
+		window_log(message);
+	}
 	write_conf();
 }
 
@@ -1165,7 +1457,7 @@ void ImagerWindow::on_restore_window_size_changed(bool status) {
 
 void ImagerWindow::on_bonjour_changed(bool status) {
 	conf.auto_connect = status;
-	mServiceModel->enable_auto_connect(conf.auto_connect);
+	if (m_session_replayer == nullptr) mServiceModel->enable_auto_connect(conf.auto_connect);
 	write_conf();
 	indigo_debug("%s\n", __FUNCTION__);
 }
@@ -1203,6 +1495,40 @@ void ImagerWindow::on_use_system_locale_changed(bool status) {
 	indigo_debug("%s\n", __FUNCTION__);
 }
 
+void ImagerWindow::on_calibrate_previews_changed(bool status) {
+	conf.calibrate_previews = status;
+	write_conf();
+	if (conf.calibrate_previews) {
+		char message[PATH_LEN + 100];
+		int count = scan_calibration_masters();
+		snprintf(message, sizeof(message), "Previews will be calibrated, %d masters found in '%s'", count, m_calibration_dir);
+		window_log(message);
+	} else {
+		CalibrationLibrary::instance().set_enabled(false);
+		window_log("Previews will not be calibrated");
+	}
+	indigo_debug("%s\n", __FUNCTION__);
+}
+
+void ImagerWindow::on_remove_hot_pixels_changed(bool status) {
+	conf.remove_hot_pixels = status;
+	write_conf();
+	DefectMap::instance().set_enabled(status);
+	if (status) {
+		window_log("Hot pixels will be removed from the previews");
+	} else {
+		window_log("Hot pixels will not be removed from the previews");
+	}
+	indigo_debug("%s\n", __FUNCTION__);
+}
+
+int ImagerWindow::scan_calibration_masters() {
+	get_calibration_dir(m_calibration_dir, conf.data_dir_prefix);
+	int count = CalibrationLibrary::instance().scan(m_calibration_dir);
+	CalibrationLibrary::instance().set_enabled(true);
+	return count;
+}
+
 void ImagerWindow::on_imager_stretch_changed(int level) {
 	conf.preview_stretch_level = (preview_stretch)level;
 	const stretch_config_t sc = {(uint8_t)conf.preview_stretch_level, (uint8_t)conf.preview_color_balance, conf.preview_bayer_pattern};
@@ -1268,6 +1594,22 @@ void ImagerWindow::on_imager_show_reference(bool status) {
 	indigo_debug("%s\n", __FUNCTION__);
 }
 
+void ImagerWindow::on_imager_show_objects(bool status) {
+	conf.imager_show_objects = status;
+	m_imager_viewer->showObjects(status);
+	m_seq_imager_viewer->showObjects(status);
+	write_conf();
+	indigo_debug("%s\n", __FUNCTION__);
+}
+
+void ImagerWindow::on_imager_show_grid(bool status) {
+	conf.imager_show_grid = status;
+	m_imager_viewer->showGrid(status);
+	m_seq_imager_viewer->showGrid(status);
+	write_conf();
+	indigo_debug("%s\n", __FUNCTION__);
+}
+
 void ImagerWindow::on_statistics_show(bool enabled) {
 	conf.statistics_enabled = enabled;
 	preview_image *image = preview_cache.get(m_image_key);
@@ -1292,7 +1634,6 @@ void ImagerWindow::on_focus_show_fwhm() {
 	conf.focuser_display = SHOW_FWHM;
 	if (m_focus_display_data != &m_focus_contrast_data) {
 		select_focuser_data(conf.focuser_display);
-		if (m_focus_display_data) m_focus_graph->redraw_data(*m_focus_display_data);
 	}
 	write_conf();
 	indigo_debug("%s\n", __FUNCTION__);
@@ -1302,7 +1643,6 @@ void ImagerWindow::on_focus_show_hfd() {
 	conf.focuser_display = SHOW_HFD;
 	if (m_focus_display_data != &m_focus_contrast_data) {
 		select_focuser_data(conf.focuser_display);
-		if (m_focus_display_data) m_focus_graph->redraw_data(*m_focus_display_data);
 	}
 	write_conf();
 	indigo_debug("%s\n", __FUNCTION__);
@@ -1311,7 +1651,6 @@ void ImagerWindow::on_focus_show_hfd() {
 void ImagerWindow::on_guide_show_rd_drift() {
 	conf.guider_display = SHOW_RA_DEC_DRIFT;
 	select_guider_data(conf.guider_display);
-	if (m_guider_data_1 && m_guider_data_2) m_guider_graph->redraw_data2(*m_guider_data_1, *m_guider_data_2);
 	write_conf();
 	indigo_debug("%s\n", __FUNCTION__);
 }
@@ -1322,7 +1661,6 @@ void ImagerWindow::on_guide_show_rd_s_drift() {
 	}
 	conf.guider_display = SHOW_RA_DEC_S_DRIFT;
 	select_guider_data(conf.guider_display);
-	if (m_guider_data_1 && m_guider_data_2) m_guider_graph->redraw_data2(*m_guider_data_1, *m_guider_data_2);
 	write_conf();
 	indigo_debug("%s\n", __FUNCTION__);
 }
@@ -1330,7 +1668,6 @@ void ImagerWindow::on_guide_show_rd_s_drift() {
 void ImagerWindow::on_guide_show_rd_pulse() {
 	conf.guider_display = SHOW_RA_DEC_PULSE;
 	select_guider_data(conf.guider_display);
-	if (m_guider_data_1 && m_guider_data_2) m_guider_graph->redraw_data2(*m_guider_data_1, *m_guider_data_2);
 	write_conf();
 	indigo_debug("%s\n", __FUNCTION__);
 }
@@ -1338,38 +1675,66 @@ void ImagerWindow::on_guide_show_rd_pulse() {
 void ImagerWindow::on_guide_show_xy_drift() {
 	conf.guider_display = SHOW_X_Y_DRIFT;
 	select_guider_data(conf.guider_display);
-	if (m_guider_data_1 && m_guider_data_2) m_guider_graph->redraw_data2(*m_guider_data_1, *m_guider_data_2);
 	write_conf();
 	indigo_debug("%s\n", __FUNCTION__);
 }
 
+void ImagerWindow::on_guide_show_history(bool status) {
+	m_guider_graph->set_history_mode(status);
+	if (status) {
+		double end = m_guide_history.last_time();
+		double start = m_guide_history.first_time();
+		if (end == 0) {
+			end = QDateTime::currentMSecsSinceEpoch() / 1000.0;
+			start = end - 600;
+		}
+		m_guider_graph->set_history_range(start, end);
+		refresh_guider_history();
+	}
+	indigo_debug("%s\n", __FUNCTION__);
+}
+
+void ImagerWindow::on_guider_history_range_changed(double start, double end) {
+	Q_UNUSED(start);
+	Q_UNUSED(end);
+	refresh_guider_history();
+}
+
 void ImagerWindow::on_guider_save_log(bool status) {
 	conf.guider_save_log = status;
 	write_conf();
 	char time_str[255];
 	if (conf.guider_save_log) {
-		if (m_guide_log == nullptr) {
+		if (!m_guide_log.is_open()) {
 			char file_name[255];
 			char path[PATH_LEN];
 			get_date_jd(time_str);
 			get_current_output_dir(path, conf.data_dir_prefix);
 			snprintf(file_name, sizeof(file_name), "%s" AIN_GUIDER_LOG_NAME_FORMAT, path, time_str);
-			m_guide_log = fopen(file_name, "a+");
-			if (m_guide_log) {
+			if (m_guide_log.open(file_name)) {
 				get_timestamp(time_str);
-				fprintf(m_guide_log, "\nLog started at %s\n", time_str);
-				fflush(m_guide_log);
+				m_guide_log.print("\nLog started at %s\n", time_str);
 			} else {
 				window_log("Can not open guider log file.", INDIGO_ALERT_STATE);
 			}
 		}
+		if (!m_guide_history.is_open()) {
+			char file_name[255];
+			char path[PATH_LEN];
+			get_date_jd(time_str);
+			get_current_output_dir(path, conf.data_dir_prefix);
+			snprintf(file_name, sizeof(file_name), "%s" AIN_GUIDER_HISTORY_NAME_FORMAT, path, time_str);
+			if (!m_guide_history.open(file_name)) {
+				window_log("Can not open guiding history file.", INDIGO_ALERT_STATE);
+			}
+		}
 	} else {
-		if (m_guide_log) {
+		if (m_guide_log.is_open()) {
 			get_timestamp(time_str);
-			fprintf(m_guide_log, "Log finished at %s\n", time_str);
-			fclose(m_guide_log);
-			m_guide_log = nullptr;
+			m_guide_log.print("Log finished at %s\n", time_str);
+			m_guide_log.close();
 		}
+		m_guide_history.close();
 	}
 	indigo_debug("%s\n", __FUNCTION__);
 }
@@ -1484,6 +1849,96 @@ void ImagerWindow::on_acl_clear_act() {
 	indigo_debug("%s\n", __FUNCTION__);
 }
 
+void ImagerWindow::on_session_record_act(bool enabled) {
+	if (!enabled) {
+		SessionRecorder::instance().stop();
+		window_log((char *)"INDIGO session recording stopped");
+		return;
+	}
+	QString filter = "AIN Session Recording (*" SESSION_EXTENSION ");; All files (*)";
+	QString file_name = QFileDialog::getSaveFileName(this, "Record INDIGO Session...", QDir::currentPath(), filter);
+	char message[PATH_MAX];
+	if (file_name.isNull()) {
+		m_session_record_act->setChecked(false);
+		return;
+	}
+	if (!file_name.endsWith(SESSION_EXTENSION, Qt::CaseInsensitive)) file_name += SESSION_EXTENSION;
+	if (SessionRecorder::instance().start(file_name.toUtf8().constData())) {
+		snprintf(message, PATH_MAX, "Recording INDIGO session to '%s'", file_name.toUtf8().constData());
+		window_log(message);
+	} else {
+		snprintf(message, PATH_MAX, "Can not record INDIGO session to '%s'", file_name.toUtf8().constData());
+		window_log(message, INDIGO_ALERT_STATE);
+		m_session_record_act->setChecked(false);
+	}
+	indigo_debug("%s\n", __FUNCTION__);
+}
+
+void ImagerWindow::on_session_replay_act() {
+	if (m_session_replayer) {
+		window_log((char *)"INDIGO session replay is already running", INDIGO_ALERT_STATE);
+		return;
+	}
+	QString filter = "AIN Session Recording (*" SESSION_EXTENSION ");; All files (*)";
+	QString file_name = QFileDialog::getOpenFileName(this, "Replay INDIGO Session...", QDir::currentPath(), filter);
+	if (file_name.isNull()) return;
+
+	QStringList speeds = { "Real time", "10x", "100x", "Maximum speed" };
+	bool ok;
+	QString speed = QInputDialog::getItem(this, "Replay INDIGO Session", "Replay speed:", speeds, 0, false, &ok);
+	if (!ok) return;
+	double factor = 0;
+	if (speed == speeds[0]) factor = 1;
+	else if (speed == speeds[1]) factor = 10;
+	else if (speed == speeds[2]) factor = 100;
+	start_session_replay(file_name.toUtf8().constData(), factor);
+	indigo_debug("%s\n", __FUNCTION__);
+}
+
+void ImagerWindow::start_session_replay(const char *file_name, double speed, bool quit) {
+	if (m_session_replayer) return;
+	// the replayed devices would mix with the live ones in the property cache
+	if (mServiceModel->hasActiveServices()) {
+		window_log((char *)"INDIGO session can not be replayed while connected, disconnect the services first", INDIGO_ALERT_STATE);
+		if (quit) QTimer::singleShot(0, [] { QApplication::exit(1); });
+		return;
+	}
+	mServiceModel->enable_auto_connect(false);
+	char message[PATH_MAX];
+	if (speed > 0) {
+		snprintf(message, PATH_MAX, "Replaying INDIGO session '%s' at %gx", file_name, speed);
+	} else {
+		snprintf(message, PATH_MAX, "Replaying INDIGO session '%s' at maximum speed", file_name);
+	}
+	window_log(message);
+	m_quit_after_replay = quit;
+	m_session_replayer = new SessionReplayer(file_name, speed);
+	connect(m_session_replayer, &SessionReplayer::replay_finished, this, &ImagerWindow::on_session_replay_finished, Qt::QueuedConnection);
+	m_session_replayer->start();
+}
+
+void ImagerWindow::on_session_replay_finished(bool success) {
+	if (m_session_replayer == nullptr) return;
+	m_session_replayer->wait();
+	session_replay_stats stats = m_session_replayer->stats();
+	delete m_session_replayer;
+	m_session_replayer = nullptr;
+	mServiceModel->enable_auto_connect(conf.auto_connect);
+
+	char message[PATH_MAX];
+	snprintf(message, PATH_MAX,
+		"Replayed %d events (%d BLOBs, %.1f MB) in %.2f s, %.0f events/s, handler mean %.3f ms, max %.3f ms",
+		stats.events, stats.blobs, stats.blob_bytes / 1048576.0, stats.elapsed,
+		stats.elapsed > 0 ? stats.events / stats.elapsed : 0, stats.handler_mean, stats.handler_max
+	);
+	window_log(message, success ? INDIGO_OK_STATE : INDIGO_ALERT_STATE);
+	if (!success) window_log((char *)"INDIGO session replay stopped on a damaged record", INDIGO_ALERT_STATE);
+	if (m_quit_after_replay) {
+		indigo_log("%s\n", message);
+		QApplication::quit();
+	}
+}
+
 void ImagerWindow::on_user_guide_act() {
   QDesktopServices::openUrl(QUrl("https://github.com/indigo-astronomy/indigo_imager/blob/master/ain_users_guide/ain_users_guide.md", QUrl::TolerantMode));
 }
@@ -60,12 +60,31 @@ class QIndigoServers;
 #include <QThread>
 #include <QtConcurrentRun>
 #include <QProcess>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QTextCursor>
+#include <QTextDocument>
 #include "focusgraph.h"
 #include "sequence_editor.h"
 #include "syncutils.h"
 #include "customobjectmodel.h"
 #include "qaddcustomobject.h"
 #include "qconfigdialog.h"
+#include "previewlane.h"
+#include "sessionrecorder.h"
+#include "guidehistory.h"
+#include "logwriter.h"
+#include "objectsearch.h"
+#include "visibility.h"
+
+#define GUIDER_GRAPH_POINTS 120
+#define FOCUS_GRAPH_POINTS 100
+
+typedef enum {
+	DOWNLOAD_SAVED = 0,
+	DOWNLOAD_BAD_DIGEST,
+	DOWNLOAD_SAVE_FAILED
+} download_status;
 
 class ImagerWindow : public QMainWindow {
 	Q_OBJECT
@@ -110,6 +129,9 @@ public:
 
 	void play_sound(int alarm);
 
+	/* speed 0 replays as fast as possible, quit exits when done (for profiling runs) */
+	void start_session_replay(const char *file_name, double speed, bool quit = false);
+
 	void property_delete(indigo_property* property, char *message);
 	void property_define(indigo_property* property, char *message);
 
@@ -208,6 +230,8 @@ signals:
 	void show_guider_edge_clipping(bool show);
 	void resize_guider_edge_clipping(double edge_clipping);
 
+	void download_saved(QString remote_file, QString local_file, int status);
+
 public slots:
 	void on_exposure_start_stop(bool clicked);
 	void on_sequence_start_stop(bool clicked);
@@ -215,6 +239,8 @@ public slots:
 	void on_abort(bool clicked);
 	void on_pause(bool clicked);
 	void on_window_log(indigo_property* property, char *message);
+	void on_flush_window_log();
+	void on_guide_log_dropped(unsigned int count);
 	void on_property_define(indigo_property* property, char *message);
 	void on_property_change(indigo_property* property, char *message);
 	void on_property_delete(indigo_property* property, char *message);
@@ -227,6 +253,8 @@ public slots:
 	void on_use_suffix_changed(bool status);
 	void on_use_state_icons_changed(bool status);
 	void on_use_system_locale_changed(bool status);
+	void on_calibrate_previews_changed(bool status);
+	void on_remove_hot_pixels_changed(bool status);
 	void on_sound_notifications_nosound();
 	void on_sound_notifications_warning();
 	void on_sound_notifications_all();
@@ -242,6 +270,9 @@ public slots:
 	void on_acl_append_act();
 	void on_acl_save_act();
 	void on_acl_clear_act();
+	void on_session_record_act(bool enabled);
+	void on_session_replay_act();
+	void on_session_replay_finished(bool success);
 	void on_servers_act();
 	void on_exit_act();
 	void on_about_act();
@@ -263,10 +294,17 @@ public slots:
 	void on_antialias_view(bool status);
 	void on_statistics_show(bool enabled);
 	void on_imager_show_reference(bool status);
+	void on_imager_show_objects(bool status);
+	void on_imager_show_grid(bool status);
 	void on_antialias_guide_view(bool status);
 	void on_create_preview(indigo_property *property, indigo_item *item);
 	void on_obsolete_preview(indigo_property *property, indigo_item *item);
 	void on_remove_preview(indigo_property *property, indigo_item *item);
+	void on_blob_progress(QString device, QString property, qint64 received, qint64 total);
+	void on_preview_ready(indigo_property *property, indigo_item *item, preview_image *preview, int lane);
+	void on_preview_lane_stats_act();
+	void on_pipe_trace_act(bool enabled);
+	void on_pipe_trace_stats_act();
 
 	void on_agent_selected(int index);
 	void on_wheel_selected(int index);
@@ -290,6 +328,15 @@ public slots:
 	void on_keep_image_on_server(int state);
 	void on_sync_remote_files(bool clicked);
 	void on_remove_synced_remote_files(bool clicked);
+	void on_download_in_flight_changed(int value);
+	void on_video_capture_changed(int state);
+	void on_video_buffer_size_changed(int value);
+	void on_video_keep_best_changed(int value);
+	void on_video_capture_progress();
+	void on_live_stack_changed(int state);
+	void on_live_stack_mode_changed(int index);
+	void on_live_stack_reset(bool clicked);
+	void on_download_saved(QString remote_file, QString local_file, int status);
 
 	void on_focus_start_stop(bool clicked);
 	void on_focus_preview_start_stop(bool clicked);
@@ -344,6 +391,8 @@ public slots:
 	void on_guide_show_rd_s_drift();
 	void on_guide_show_rd_pulse();
 	void on_guide_show_xy_drift();
+	void on_guide_show_history(bool status);
+	void on_guider_history_range_changed(double start, double end);
 	void on_guider_save_log(bool status);
 	void on_indigo_save_log(bool status);
 
@@ -393,6 +442,10 @@ public slots:
 	void on_object_clicked(QListWidgetItem *item);
 	void on_object_search_changed(const QString &obj_name);
 	void on_object_search_entered();
+	void on_object_search_results(int generation, QVector<int> objects, bool finished);
+	void on_object_visible_only(bool clicked);
+	void on_object_sort_selected(int index);
+	void on_visibility_updated();
 	void on_custom_object_add();
 	void on_custom_object_added(CustomObject object);
 	void on_custom_object_remove();
@@ -558,6 +611,9 @@ public slots:
 	};
 private:
 	QTextEdit* mLog;
+	QTimer m_log_timer;
+	QList<QPair<QString, QColor>> m_pending_log;
+	int m_pending_log_dropped;
 	QTabWidget *m_tools_tabbar;
 
 	bool is_control_panel_running;
@@ -599,9 +655,29 @@ private:
 	QPushButton *m_sync_files_button;
 	QPushButton *m_remove_synced_files_button;
 	QProgressBar *m_download_progress;
+	QSpinBox *m_download_in_flight;
+	QCheckBox *m_video_capture_cbox;
+	QSpinBox *m_video_buffer_size;
+	QSpinBox *m_video_keep_best;
+	QLabel *m_video_capture_label;
+	bool m_video_process_started;
+	QCheckBox *m_live_stack_cbox;
+	QComboBox *m_live_stack_mode_select;
+	QPushButton *m_live_stack_reset_button;
+	QLabel *m_live_stack_label;
+	LiveStack *m_live_stack;
+	char m_calibration_dir[PATH_LEN];
 	QString m_object_name_str;
 	QStringList m_files_to_download;
 	QStringList m_files_to_remove;
+	QHash<QString, int> m_download_retries;
+	QElapsedTimer m_download_timer;
+	qint64 m_downloaded_bytes;
+	int m_downloaded_files;
+	int m_download_failed;
+	int m_downloads_in_flight;
+	bool m_download_requested;
+	bool m_download_canceled;
 
 	// Sequence tabbar
 	QProgressBar *m_seq_exposure_progress;
@@ -646,10 +722,10 @@ private:
 	QLabel     *m_focus_graph_label;
 	QFrame     *m_hfd_stats_frame;
 	QFrame     *m_contrast_stats_frame;
-	QVector<double> m_focus_fwhm_data;
-	QVector<double> m_focus_hfd_data;
-	QVector<double> m_focus_contrast_data;
-	QVector<double> *m_focus_display_data;
+	RingSeries m_focus_fwhm_data{FOCUS_GRAPH_POINTS};
+	RingSeries m_focus_hfd_data{FOCUS_GRAPH_POINTS};
+	RingSeries m_focus_contrast_data{FOCUS_GRAPH_POINTS};
+	RingSeries *m_focus_display_data;
 	QLineEdit *m_focuser_temperature;
 	QCheckBox *m_temperature_compensation_cbox;
 	QFrame    *m_temperature_compensation_frame;
@@ -691,16 +767,16 @@ private:
 	QDoubleSpinBox  *m_guide_i_gain_dec;
 	QSpinBox  *m_guide_is;
 	FocusGraph *m_guider_graph;
-	QVector<double> m_drift_data_ra;
-	QVector<double> m_drift_data_dec;
-	QVector<double> m_drift_data_dec_s;
-	QVector<double> m_drift_data_ra_s;
-	QVector<double> m_pulse_data_ra;
-	QVector<double> m_pulse_data_dec;
-	QVector<double> m_drift_data_x;
-	QVector<double> m_drift_data_y;
-	QVector<double> *m_guider_data_1;
-	QVector<double> *m_guider_data_2;
+	RingSeries m_drift_data_ra{GUIDER_GRAPH_POINTS};
+	RingSeries m_drift_data_dec{GUIDER_GRAPH_POINTS};
+	RingSeries m_drift_data_dec_s{GUIDER_GRAPH_POINTS};
+	RingSeries m_drift_data_ra_s{GUIDER_GRAPH_POINTS};
+	RingSeries m_pulse_data_ra{GUIDER_GRAPH_POINTS};
+	RingSeries m_pulse_data_dec{GUIDER_GRAPH_POINTS};
+	RingSeries m_drift_data_x{GUIDER_GRAPH_POINTS};
+	RingSeries m_drift_data_y{GUIDER_GRAPH_POINTS};
+	RingSeries *m_guider_data_1;
+	RingSeries *m_guider_data_2;
 	QLabel *m_guider_graph_label;
 	QLabel *m_guider_rd_drift_label;
 	QLabel *m_guider_xy_drift_label;
@@ -713,7 +789,8 @@ private:
 	QComboBox *m_detection_mode_select;
 	QComboBox *m_dec_guiding_select;
 
-	FILE *m_guide_log;
+	LogWriter m_guide_log;
+	GuideHistory m_guide_history;
 	int m_guider_process;
 
 	// Telescope tab
@@ -757,6 +834,12 @@ private:
 	QLabel *m_gps_status;
 	QListWidget *m_object_list;
 	QLineEdit *m_object_search_line;
+	ObjectSearch *m_object_search;
+	bool m_object_search_done;
+	bool m_object_search_enter;
+	Visibility *m_visibility;
+	QCheckBox *m_object_visible_cbox;
+	QComboBox *m_object_sort_select;
 	QToolButton *m_add_object_button;
 	QToolButton *m_remove_object_button;
 
@@ -821,6 +904,11 @@ private:
 	ImageViewer *m_seq_imager_viewer;
 
 	indigo_item *m_indigo_item;
+	QHash<indigo_item*, QString> m_saved_image_files;
+	PreviewLane *m_preview_lanes[PREVIEW_LANES];
+	SessionReplayer *m_session_replayer;
+	QAction *m_session_record_act;
+	bool m_quit_after_replay;
 
 	SequenceEditor *m_sequence_editor;
 
@@ -958,6 +1046,8 @@ private:
 	void change_imager_agent_sequence(const char *agent, QString sequence, QList<QString> batches) const;
 
 	void select_guider_data(guider_display_data show);
+	void refresh_guider_history();
+	void follow_guider_history(double previous_last_time);
 
 	void setup_preview(const char *agent);
 	bool open_image(QString file_name, int *image_size, unsigned char **image_data);
@@ -965,11 +1055,18 @@ private:
 	bool show_preview_in_imager_viewer(QString &key);
 	bool show_preview_in_guider_viewer(QString &key);
 	void show_selected_preview_in_solver_tab(QString &solver_source);
+	int open_file_with_prefix(const char *prefix, const char *extension, char *file_name, bool auto_construct = true);
 	bool save_blob_item_with_prefix(indigo_item *item, const char *prefix, char *file_name, bool auto_construct = true);
 	bool save_blob_item(indigo_item *item, char *file_name);
 	void save_blob_item(indigo_item *item);
+	bool start_video_capture();
+	void stop_video_capture();
+	void update_live_stack_label();
+	int scan_calibration_masters();
 
 	void sync_remote_files();
+	void request_next_download();
+	void update_download_progress();
 	void remove_synced_remote_files();
 
 	void show_message(const char *title, const char *message, QMessageBox::Icon icon = QMessageBox::Warning) {
@@ -19,6 +19,11 @@
 
 #include <indigo/indigo_client.h>
 #include "indigoclient.h"
+#include "blobfetcher.h"
+#include "sessionrecorder.h"
+#include "localdrivers.h"
+#include "videocapture.h"
+#include <pipetrace.h>
 #include "conf.h"
 
 bool processed_device(char *device) {
@@ -73,6 +78,7 @@ static indigo_result client_attach(indigo_client *client) {
 
 
 static void handle_blob_property(indigo_property *property) {
+	PIPE_TRACE(PIPE_TRACE_BLOB);
 	if (property->state == INDIGO_OK_STATE && property->perm != INDIGO_WO_PERM) {
 		if (!strncmp(property->device, "Guider Agent", 12)) {
 			if ((!strncmp(property->name, CCD_PREVIEW_IMAGE_PROPERTY_NAME, INDIGO_NAME_SIZE)) && (conf.guider_save_bandwidth == 0)) {
@@ -87,12 +93,28 @@ static void handle_blob_property(indigo_property *property) {
 			indigo_item *blob_item = (indigo_item*)malloc(sizeof(indigo_item));
 			memcpy(blob_item, &property->items[row], sizeof(indigo_item));
 			blob_item->blob.value = nullptr;
-			if (*property->items[row].blob.url && indigo_populate_http_blob_item(blob_item)) {
-				property->items[row].blob.value = nullptr;
+			if (*property->items[row].blob.url && !IndigoClient::instance().is_replaying()) {
 				indigo_debug("Image %s.%s URL received (%s, %ld bytes)...\n", property->device, property->name, blob_item->blob.url, blob_item->blob.size);
+				// downloaded on the fetcher thread, create_preview() is emitted when done
+				BlobFetcher::instance().fetch(property, blob_item);
+			} else if (property->items[row].blob.value && property->items[row].blob.size > 0) {
+				// a local driver on the same bus, the data is in its buffer which is reused for the next frame
+				indigo_debug("Image %s.%s received in process (%ld bytes)\n", property->device, property->name, blob_item->blob.size);
+				blob_item->blob.value = malloc(blob_item->blob.size);
+				if (blob_item->blob.value == nullptr) {
+					free(blob_item);
+					continue;
+				}
+				memcpy(blob_item->blob.value, property->items[row].blob.value, blob_item->blob.size);
+				SessionRecorder::instance().record_blob(property->device, property->name, blob_item);
+				if (VideoCapture::instance().capture(property, blob_item)) {
+					free(blob_item->blob.value);
+					free(blob_item);
+					continue;
+				}
 				emit(IndigoClient::instance().create_preview(property, blob_item));
 			} else {
-				if (blob_item->blob.value) free(blob_item->blob.value);
+				// on replay the recorded data arrives with its own record
 				free(blob_item);
 			}
 		}
@@ -112,11 +134,12 @@ static indigo_result client_define_property(indigo_client *client, indigo_device
 	Q_UNUSED(device);
 
 	if (!processed_device(property->device)) return INDIGO_OK;
+	SessionRecorder::instance().record_property(SESSION_DEFINE, property, message);
 
 	if (property->type == INDIGO_BLOB_VECTOR) {
 		if (device->version < INDIGO_VERSION_2_0)
 			IndigoClient::instance().m_logger->log(property, "BLOB can be used in INDI legacy mode");
-		if (IndigoClient::instance().blobs_enabled()) { // Enagle blob and let adapter decide URL or ALSO
+		if (IndigoClient::instance().blobs_enabled() && !IndigoClient::instance().is_replaying()) { // Enagle blob and let adapter decide URL or ALSO
 				indigo_enable_blob(client, property, INDIGO_ENABLE_BLOB);
 		}
 		handle_blob_property(property);
@@ -139,6 +162,7 @@ static indigo_result client_update_property(indigo_client *client, indigo_device
 	Q_UNUSED(device);
 
 	if (!processed_device(property->device)) return INDIGO_OK;
+	SessionRecorder::instance().record_property(SESSION_UPDATE, property, message);
 
 	if (property->type == INDIGO_BLOB_VECTOR) {
 		handle_blob_property(property);
@@ -162,8 +186,10 @@ static indigo_result client_delete_property(indigo_client *client, indigo_device
 	indigo_debug("Deleting property [%s] on device [%s]\n", property->name, property->device);
 
 	if (!processed_device(property->device)) return INDIGO_OK;
+	SessionRecorder::instance().record_property(SESSION_DELETE, property, message);
 
 	if (property->type == INDIGO_BLOB_VECTOR) {
+		BlobFetcher::instance().cancel(property);
 		for (int row = 0; row < property->count; row++) {
 			emit(IndigoClient::instance().remove_preview(property, &property->items[row]));
 		}
@@ -189,6 +215,7 @@ static indigo_result client_send_message(indigo_client *client, indigo_device *d
 	Q_UNUSED(client);
 
 	if (!message) return INDIGO_OK;
+	SessionRecorder::instance().record_message(device ? device->name : nullptr, message);
 
 	char *message_copy;
 	message_copy = (char*)malloc(INDIGO_VALUE_SIZE);
@@ -221,6 +248,8 @@ indigo_client client = {
 };
 
 void IndigoClient::start(char *name) {
+	connect(&BlobFetcher::instance(), &BlobFetcher::blob_fetched, this, &IndigoClient::create_preview, Qt::UniqueConnection);
+	BlobFetcher::instance().start();
 	indigo_start();
 	strncpy(client.name, name, INDIGO_NAME_SIZE);
 	indigo_attach_client(&client);
@@ -228,6 +257,24 @@ void IndigoClient::start(char *name) {
 
 void IndigoClient::stop() {
 	indigo_debug("Shutting down client...\n");
+	LocalDrivers::instance().unload();
 	indigo_detach_client(&client);
 	indigo_stop();
+	BlobFetcher::instance().stop();
+}
+
+indigo_result IndigoClient::replay_define_property(indigo_device *device, indigo_property *property, const char *message) {
+	return client_define_property(&client, device, property, message);
+}
+
+indigo_result IndigoClient::replay_update_property(indigo_device *device, indigo_property *property, const char *message) {
+	return client_update_property(&client, device, property, message);
+}
+
+indigo_result IndigoClient::replay_delete_property(indigo_device *device, indigo_property *property, const char *message) {
+	return client_delete_property(&client, device, property, message);
+}
+
+indigo_result IndigoClient::replay_send_message(indigo_device *device, const char *message) {
+	return client_send_message(&client, device, message);
 }
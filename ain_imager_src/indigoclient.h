@@ -21,6 +21,7 @@
 #define INDIGOCLIENT_H
 
 #include <QObject>
+#include <atomic>
 #include <indigo/indigo_bus.h>
 #include "logger.h"
 
@@ -39,6 +40,7 @@ public:
 	IndigoClient() {
 		m_logger = &Logger::instance();
 		m_blobs_enabled = false;
+		m_replaying = false;
 	}
 
 	~IndigoClient() {
@@ -53,9 +55,26 @@ public:
 		return m_blobs_enabled;
 	};
 
+	/* while a recorded session is replayed BLOB URLs are not fetched */
+	void set_replaying(bool replaying) {
+		m_replaying = replaying;
+	};
+
+	bool is_replaying() {
+		return m_replaying;
+	};
+
 	void start(char *name);
 	void stop();
+
+	/* Feed a recorded session through the same callbacks the bus calls. */
+	indigo_result replay_define_property(indigo_device *device, indigo_property *property, const char *message);
+	indigo_result replay_update_property(indigo_device *device, indigo_property *property, const char *message);
+	indigo_result replay_delete_property(indigo_device *device, indigo_property *property, const char *message);
+	indigo_result replay_send_message(indigo_device *device, const char *message);
+
 	Logger* m_logger;
+	std::atomic<bool> m_replaying;
 signals:
 	/* No copy of the property will be made with this signals.
 	   Do not free().
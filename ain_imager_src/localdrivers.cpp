@@ -0,0 +1,109 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdio.h>
+#include <string.h>
+#include "localdrivers.h"
+#include "conf.h"
+
+LocalDrivers::LocalDrivers() {
+	read_driver_names();
+}
+
+LocalDrivers::~LocalDrivers() {
+	unload();
+}
+
+void LocalDrivers::read_driver_names() {
+	char filename[PATH_LEN];
+	snprintf(filename, PATH_LEN, "%s/%s", config_path, LOCAL_DRIVERS_FILENAME);
+	FILE *file = fopen(filename, "r");
+	if (file == nullptr) {
+		// first use, write the defaults for the user to edit
+		m_names = QStringList(LOCAL_DEFAULT_DRIVERS);
+		file = fopen(filename, "w");
+		if (file != nullptr) {
+			for (const QString &name : m_names) fprintf(file, "%s\n", name.toUtf8().constData());
+			fclose(file);
+		}
+		return;
+	}
+	char line[PATH_LEN];
+	while (fgets(line, sizeof(line), file)) {
+		QString name = QString(line).trimmed();
+		if (name.isEmpty() || name.startsWith('#')) continue;
+		m_names.append(name);
+	}
+	fclose(file);
+	indigo_debug("Local drivers: %s\n", m_names.join(", ").toUtf8().constData());
+}
+
+void LocalDrivers::set_driver_names(QStringList names) {
+	QMutexLocker lock(&m_mutex);
+	m_names = names;
+}
+
+QStringList LocalDrivers::driver_names() {
+	QMutexLocker lock(&m_mutex);
+	return m_names;
+}
+
+bool LocalDrivers::load() {
+#ifdef INDIGO_WINDOWS
+	indigo_error("Local drivers are not supported on Windows\n");
+	return false;
+#else
+	QMutexLocker lock(&m_mutex);
+	if (!m_drivers.isEmpty()) return true;
+	for (const QString &name : m_names) {
+		indigo_driver_entry *driver = nullptr;
+		if (indigo_load_driver(name.toUtf8().constData(), true, &driver) == INDIGO_OK && driver != nullptr) {
+			m_drivers.append(driver);
+			indigo_log("Local driver %s loaded\n", name.toUtf8().constData());
+		} else {
+			indigo_error("Local driver %s failed to load\n", name.toUtf8().constData());
+		}
+	}
+	return !m_drivers.isEmpty();
+#endif
+}
+
+bool LocalDrivers::unload() {
+#ifdef INDIGO_WINDOWS
+	return false;
+#else
+	QMutexLocker lock(&m_mutex);
+	if (m_drivers.isEmpty()) return false;
+	// agents first, they use the devices of the other drivers
+	while (!m_drivers.isEmpty()) {
+		indigo_driver_entry *driver = m_drivers.takeLast();
+		indigo_debug("Local driver %s unloaded\n", driver->name);
+		indigo_remove_driver(driver);
+	}
+	return true;
+#endif
+}
+
+bool LocalDrivers::is_loaded() {
+#ifdef INDIGO_WINDOWS
+	return false;
+#else
+	QMutexLocker lock(&m_mutex);
+	return !m_drivers.isEmpty();
+#endif
+}
@@ -0,0 +1,79 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _LOCALDRIVERS_H
+#define _LOCALDRIVERS_H
+
+#include <QList>
+#include <QStringList>
+#include <QMutex>
+#include <indigo/indigo_bus.h>
+#include <indigo/indigo_client.h>
+
+/* The local service runs drivers and agents inside Ain on the same bus as the
+   client, so no server socket is involved and BLOBs arrive as pointers to the
+   driver buffers instead of URLs. Such a service is added with the host
+   LOCAL_SERVICE_HOST, the drivers are listed one per line in
+   <config path>/LOCAL_DRIVERS_FILENAME. Not supported on Windows, where INDIGO
+   can not load drivers, load() fails there. */
+
+#define LOCAL_SERVICE_NAME "Local"
+#define LOCAL_SERVICE_HOST "in-process"
+#define LOCAL_DRIVERS_FILENAME "indigo_imager.drivers"
+
+#define LOCAL_DEFAULT_DRIVERS { \
+	"indigo_ccd_simulator", \
+	"indigo_mount_simulator", \
+	"indigo_agent_imager", \
+	"indigo_agent_guider", \
+	"indigo_agent_mount" \
+}
+
+class LocalDrivers {
+public:
+	static LocalDrivers& instance();
+
+	LocalDrivers();
+	~LocalDrivers();
+
+	/* replaces the list read from the drivers file, e.g. from the command line */
+	void set_driver_names(QStringList names);
+	QStringList driver_names();
+
+	bool load();
+	bool unload();
+	bool is_loaded();
+
+private:
+	QMutex m_mutex;
+	QStringList m_names;
+#ifndef INDIGO_WINDOWS
+	/* indigo_client.h declares the driver entries on Linux and macOS only */
+	QList<indigo_driver_entry*> m_drivers;
+#endif
+
+	void read_driver_names();
+};
+
+inline LocalDrivers& LocalDrivers::instance() {
+	static LocalDrivers* me = nullptr;
+	if (!me) me = new LocalDrivers();
+	return *me;
+}
+
+#endif /* _LOCALDRIVERS_H */
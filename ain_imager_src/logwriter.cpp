@@ -0,0 +1,165 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdarg.h>
+#include <errno.h>
+#include <string.h>
+#include <QElapsedTimer>
+#if defined(INDIGO_WINDOWS)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include <indigo/indigo_bus.h>
+#include "logwriter.h"
+
+LogWriter::LogWriter() {
+	m_slots = new log_slot[LOG_WRITER_SLOTS];
+	m_enqueue_pos = 0;
+	m_dequeue_pos = 0;
+	m_dropped = 0;
+	m_dropped_total = 0;
+	m_stop = false;
+	m_file = nullptr;
+}
+
+LogWriter::~LogWriter() {
+	close();
+	delete[] m_slots;
+}
+
+bool LogWriter::open(const char *file_name) {
+	close();
+	m_file = fopen(file_name, "a+");
+	if (m_file == nullptr) {
+		indigo_error("Can not open log '%s': %s\n", file_name, strerror(errno));
+		return false;
+	}
+	setvbuf(m_file, nullptr, _IOFBF, LOG_WRITER_FLUSH_SIZE);
+	for (size_t i = 0; i < LOG_WRITER_SLOTS; i++) {
+		m_slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+	m_enqueue_pos = 0;
+	m_dequeue_pos = 0;
+	m_dropped = 0;
+	m_stop = false;
+	start(QThread::LowPriority);
+	return true;
+}
+
+void LogWriter::close() {
+	if (m_file == nullptr) return;
+	m_stop = true;
+	wait();
+	fclose(m_file);
+	m_file = nullptr;
+	if (m_dropped_total) indigo_debug("Log closed, %u lines dropped\n", (unsigned int)m_dropped_total);
+}
+
+bool LogWriter::print(const char *format, ...) {
+	if (m_file == nullptr) return false;
+
+	log_slot *slot;
+	size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+	while (true) {
+		slot = &m_slots[pos & (LOG_WRITER_SLOTS - 1)];
+		size_t sequence = slot->sequence.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+		if (diff == 0) {
+			if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+		} else if (diff < 0) {
+			// the writer is behind, never wait for it
+			m_dropped++;
+			m_dropped_total++;
+			return false;
+		} else {
+			pos = m_enqueue_pos.load(std::memory_order_relaxed);
+		}
+	}
+
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(slot->line, LOG_WRITER_LINE_SIZE, format, args);
+	va_end(args);
+	if (length >= LOG_WRITER_LINE_SIZE) {
+		slot->line[LOG_WRITER_LINE_SIZE - 2] = '\n';
+	}
+	slot->sequence.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+int LogWriter::drain(size_t *written) {
+	int lines = 0;
+	while (true) {
+		log_slot *slot = &m_slots[m_dequeue_pos & (LOG_WRITER_SLOTS - 1)];
+		size_t sequence = slot->sequence.load(std::memory_order_acquire);
+		if (sequence != m_dequeue_pos + 1) break;
+		size_t length = strnlen(slot->line, LOG_WRITER_LINE_SIZE);
+		fwrite(slot->line, length, 1, m_file);
+		*written += length;
+		slot->sequence.store(m_dequeue_pos + LOG_WRITER_SLOTS, std::memory_order_release);
+		m_dequeue_pos++;
+		lines++;
+	}
+	return lines;
+}
+
+void LogWriter::sync() {
+	fflush(m_file);
+#if defined(INDIGO_WINDOWS)
+	_commit(_fileno(m_file));
+#else
+	fsync(fileno(m_file));
+#endif
+}
+
+void LogWriter::run() {
+	size_t pending = 0;
+	QElapsedTimer flush_timer, sync_timer;
+	flush_timer.start();
+	sync_timer.start();
+	bool unsynced = false;
+
+	while (true) {
+		bool stop = m_stop;
+		drain(&pending);
+
+		unsigned int dropped = m_dropped.exchange(0);
+		if (dropped) {
+			char line[100];
+			int length = snprintf(line, sizeof(line), "[%u log lines dropped]\n", dropped);
+			fwrite(line, length, 1, m_file);
+			pending += length;
+			emit(lines_dropped(dropped));
+		}
+
+		if (pending && (pending >= LOG_WRITER_FLUSH_SIZE || flush_timer.elapsed() >= LOG_WRITER_FLUSH_INTERVAL || stop)) {
+			fflush(m_file);
+			pending = 0;
+			unsynced = true;
+			flush_timer.restart();
+		}
+		if (unsynced && (sync_timer.elapsed() >= LOG_WRITER_SYNC_INTERVAL || stop)) {
+			sync();
+			unsynced = false;
+			sync_timer.restart();
+		}
+		if (stop) break;
+		msleep(LOG_WRITER_POLL_INTERVAL);
+	}
+}
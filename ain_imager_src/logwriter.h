@@ -0,0 +1,75 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _LOGWRITER_H
+#define _LOGWRITER_H
+
+#include <stdio.h>
+#include <atomic>
+#include <QThread>
+
+#define LOG_WRITER_SLOTS 1024                 /* must be a power of 2 */
+#define LOG_WRITER_LINE_SIZE 512
+#define LOG_WRITER_POLL_INTERVAL 100          /* ms */
+#define LOG_WRITER_FLUSH_INTERVAL 1000        /* ms */
+#define LOG_WRITER_FLUSH_SIZE (64 * 1024)     /* bytes */
+#define LOG_WRITER_SYNC_INTERVAL 30000        /* ms */
+
+typedef struct {
+	std::atomic<size_t> sequence;
+	char line[LOG_WRITER_LINE_SIZE];
+} log_slot;
+
+/* Appends text lines to a file on a background thread. Producers only format
+   into a slot of a lock-free ring and never wait for the disk, when the ring is
+   full the line is dropped and counted. The writer flushes when enough data is
+   pending or after LOG_WRITER_FLUSH_INTERVAL and syncs the file periodically. */
+class LogWriter : public QThread {
+	Q_OBJECT
+public:
+	LogWriter();
+	~LogWriter();
+
+	bool open(const char *file_name);
+	void close();
+	bool is_open() const { return m_file != nullptr; }
+
+	/* thread safe, returns false if the line was dropped */
+	bool print(const char *format, ...) __attribute__((format(printf, 2, 3)));
+	unsigned int dropped() const { return m_dropped_total; }
+
+signals:
+	void lines_dropped(unsigned int count);
+
+protected:
+	void run() override;
+
+private:
+	log_slot *m_slots;
+	std::atomic<size_t> m_enqueue_pos;
+	size_t m_dequeue_pos;
+	std::atomic<unsigned int> m_dropped;
+	std::atomic<unsigned int> m_dropped_total;
+	std::atomic<bool> m_stop;
+	FILE *m_file;
+
+	int drain(size_t *written);
+	void sync();
+};
+
+#endif /* _LOGWRITER_H */
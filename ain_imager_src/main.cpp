@@ -23,6 +23,8 @@
 #include <QTextStream>
 #include <QVersionNumber>
 #include "imagerwindow.h"
+#include "qservicemodel.h"
+#include "localdrivers.h"
 #include <conf.h>
 
 conf_t conf;
@@ -91,8 +93,32 @@ int main(int argc, char *argv[]) {
 	conf.statistics_enabled = false;
 	conf.preview_bayer_pattern = 0;
 	conf.require_confirmation = false;
+	conf.download_in_flight = AIN_DOWNLOAD_IN_FLIGHT;
+	conf.imager_show_objects = false;
+	conf.imager_show_grid = false;
+	conf.video_buffer_size = AIN_VIDEO_BUFFER_SIZE;
+	conf.live_stack_mode = LIVE_STACK_MEAN;
+	conf.calibrate_previews = false;
+	conf.remove_hot_pixels = false;
+	conf.video_keep_best = AIN_VIDEO_KEEP_ALL;
+	conf.object_visible_only = false;
+	conf.object_sort = OBJECT_SORT_RELEVANCE;
 	read_conf();
 
+	/* not present in configs saved by older versions */
+	if (conf.download_in_flight < 1 || conf.download_in_flight > AIN_DOWNLOAD_MAX_IN_FLIGHT) {
+		conf.download_in_flight = AIN_DOWNLOAD_IN_FLIGHT;
+	}
+	if (conf.video_buffer_size < AIN_VIDEO_BUFFER_MIN || conf.video_buffer_size > AIN_VIDEO_BUFFER_MAX) {
+		conf.video_buffer_size = AIN_VIDEO_BUFFER_SIZE;
+	}
+	if (conf.video_keep_best < 1 || conf.video_keep_best > AIN_VIDEO_KEEP_ALL) {
+		conf.video_keep_best = AIN_VIDEO_KEEP_ALL;
+	}
+	if (conf.live_stack_mode != LIVE_STACK_MEAN && conf.live_stack_mode != LIVE_STACK_KAPPA_SIGMA) {
+		conf.live_stack_mode = LIVE_STACK_MEAN;
+	}
+
 	if (!conf.use_system_locale) qunsetenv("LC_NUMERIC");
 
 #ifndef INDIGO_WINDOWS
@@ -109,6 +135,10 @@ int main(int argc, char *argv[]) {
 	/* This shall be set only before connecting */
 	indigo_use_host_suffix = conf.indigo_use_host_suffix;
 
+	const char *replay_file = nullptr;
+	double replay_speed = 1;
+	bool replay_quit = false;
+	const char *local_drivers = nullptr;
 	for (int i = 1; i < argc; i++) {
 		if ((!strcmp(argv[i], "-T") || !strcmp(argv[i], "--master-token")) && i < argc - 1) {
 			indigo_set_master_token(indigo_string_to_token(argv[i + 1]));
@@ -116,6 +146,19 @@ int main(int argc, char *argv[]) {
 		} else if ((!strcmp(argv[i], "-a") || !strcmp(argv[i], "--acl-file")) && i < argc - 1) {
 			indigo_load_device_tokens_from_file(argv[i + 1]);
 			i++;
+		} else if (!strcmp(argv[i], "--replay") && i < argc - 1) {
+			replay_file = argv[i + 1];
+			i++;
+		} else if (!strcmp(argv[i], "--replay-speed") && i < argc - 1) {
+			replay_speed = atof(argv[i + 1]);
+			i++;
+		} else if (!strcmp(argv[i], "--replay-quit")) {
+			replay_quit = true;
+#ifndef INDIGO_WINDOWS
+		} else if (!strcmp(argv[i], "--local-drivers") && i < argc - 1) {
+			local_drivers = argv[i + 1];
+			i++;
+#endif
 		}
 	}
 
@@ -140,8 +183,16 @@ int main(int argc, char *argv[]) {
 	app.setStyleSheet(ts.readAll());
 	f.close();
 
+	if (local_drivers) {
+		LocalDrivers::instance().set_driver_names(QString(local_drivers).split(',', QString::SkipEmptyParts));
+	}
+
 	ImagerWindow imager_window;
 	imager_window.show();
+	if (local_drivers) {
+		QServiceModel::instance().addService(LOCAL_SERVICE_NAME, LOCAL_SERVICE_HOST, 0, true, true);
+	}
+	if (replay_file) imager_window.start_session_replay(replay_file, replay_speed, replay_quit);
 
 	return app.exec();
 }
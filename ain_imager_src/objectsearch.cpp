@@ -0,0 +1,192 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <QElapsedTimer>
+#include <QtConcurrentRun>
+#include <QStringList>
+#include <indigo/indigo_bus.h>
+#include "objectsearch.h"
+
+static inline quint32 trigram(const char *text) {
+	return ((quint32)(unsigned char)text[0] << 16) | ((quint32)(unsigned char)text[1] << 8) | (unsigned char)text[2];
+}
+
+ObjectSearch::ObjectSearch(QObject *parent) : QObject(parent) {
+	m_dso_count = 0;
+	m_ready = false;
+	m_generation = 0;
+	m_debounce.setSingleShot(true);
+	m_debounce.setInterval(OBJECT_SEARCH_DEBOUNCE);
+	connect(&m_debounce, &QTimer::timeout, this, &ObjectSearch::on_debounce_timeout);
+	qRegisterMetaType<QVector<int>>("QVector<int>");
+}
+
+QByteArray ObjectSearch::normalize(const QString &text) {
+	QString normalized;
+	normalized.reserve(text.size());
+	for (QChar c : text) {
+		if (c.isLetterOrNumber()) normalized.append(c.toLower());
+	}
+	return normalized.toUtf8();
+}
+
+void ObjectSearch::add_key(const QString &text, int object, bool hip) {
+	search_key key;
+	key.text = normalize(text);
+	if (key.text.isEmpty()) return;
+	key.object = object;
+	key.hip = hip;
+	m_keys.append(key);
+}
+
+void ObjectSearch::build() {
+	QtConcurrent::run([=]() {
+		build_index();
+	});
+}
+
+void ObjectSearch::build_index() {
+	QElapsedTimer timer;
+	timer.start();
+
+	int object = 0;
+	for (indigo_dso_entry *dso = &indigo_dso_data[0]; dso->id; dso++, object++) {
+		add_key(dso->id, object, false);
+		for (const QString &name : QString(dso->name).split(',', QString::SkipEmptyParts)) {
+			add_key(name, object, false);
+		}
+	}
+	m_dso_count = object;
+	for (indigo_star_entry *star = &indigo_star_data[0]; star->hip; star++, object++) {
+		add_key("HIP" + QString::number(star->hip), object, true);
+		if (star->name == nullptr) continue;
+		for (const QString &name : QString(star->name).split(',', QString::SkipEmptyParts)) {
+			add_key(name, object, false);
+		}
+	}
+
+	m_sorted_keys.resize(m_keys.size());
+	for (int i = 0; i < m_keys.size(); i++) {
+		m_sorted_keys[i] = i;
+		const QByteArray &text = m_keys[i].text;
+		for (int p = 0; p + 3 <= text.size(); p++) {
+			QVector<int> &postings = m_trigrams[trigram(text.constData() + p)];
+			if (postings.isEmpty() || postings.last() != i) postings.append(i);
+		}
+	}
+	std::sort(m_sorted_keys.begin(), m_sorted_keys.end(), [this](int a, int b) {
+		return m_keys[a].text < m_keys[b].text;
+	});
+
+	m_ready = true;
+	indigo_debug("Object search index: %d objects, %d keys, %d trigrams built in %lld ms\n", object, m_keys.size(), m_trigrams.size(), timer.elapsed());
+}
+
+void ObjectSearch::search(const QString &query) {
+	m_generation++;
+	m_query = query;
+	if (query.isEmpty()) {
+		m_debounce.stop();
+		return;
+	}
+	m_debounce.start();
+}
+
+void ObjectSearch::on_debounce_timeout() {
+	if (!m_ready) {
+		m_debounce.start();
+		return;
+	}
+	QByteArray query = normalize(m_query);
+	int generation = m_generation;
+	if (query.isEmpty()) {
+		emit(results_ready(generation, QVector<int>(), true));
+		return;
+	}
+	QtConcurrent::run([=]() {
+		run_query(query, generation);
+	});
+}
+
+/* rank 0 - whole key, 1 - key prefix, 2 - substring */
+void ObjectSearch::run_query(QByteArray query, int generation) {
+	QHash<int, int> ranks;
+	bool hip_query = query.startsWith("hip");
+	int checked = 0;
+
+	auto match = [&](int key_index) {
+		const search_key &key = m_keys[key_index];
+		if (key.hip && !hip_query) return;
+		int position = key.text.indexOf(query);
+		if (position < 0) return;
+		int rank = position > 0 ? 2 : (key.text.size() == query.size() ? 0 : 1);
+		auto i = ranks.find(key.object);
+		if (i == ranks.end()) {
+			ranks.insert(key.object, rank);
+		} else if (rank < i.value()) {
+			i.value() = rank;
+		}
+	};
+
+	if (query.size() < 3) {
+		auto first = std::lower_bound(m_sorted_keys.constBegin(), m_sorted_keys.constEnd(), query, [this](int a, const QByteArray &text) {
+			return m_keys[a].text < text;
+		});
+		for (auto i = first; i != m_sorted_keys.constEnd() && m_keys[*i].text.startsWith(query); i++) {
+			match(*i);
+			if ((++checked & 0x3FF) == 0 && generation != m_generation) return;
+		}
+	} else {
+		const QVector<int> *rarest = nullptr;
+		for (int p = 0; p + 3 <= query.size(); p++) {
+			auto postings = m_trigrams.constFind(trigram(query.constData() + p));
+			if (postings == m_trigrams.constEnd()) {
+				rarest = nullptr;
+				break;
+			}
+			if (rarest == nullptr || postings.value().size() < rarest->size()) rarest = &postings.value();
+		}
+		if (rarest) {
+			for (int key_index : *rarest) {
+				match(key_index);
+				if ((++checked & 0x3FF) == 0 && generation != m_generation) return;
+			}
+		}
+	}
+
+	QVector<QPair<int, int>> results;
+	results.reserve(ranks.size());
+	for (auto i = ranks.constBegin(); i != ranks.constEnd(); i++) {
+		results.append(QPair<int, int>(i.value(), i.key()));
+	}
+	std::sort(results.begin(), results.end());
+	if (results.size() > OBJECT_SEARCH_MAX_RESULTS) results.resize(OBJECT_SEARCH_MAX_RESULTS);
+
+	QVector<int> chunk;
+	for (int i = 0; i < results.size(); i++) {
+		if (generation != m_generation) return;
+		chunk.append(results[i].second);
+		if (chunk.size() == OBJECT_SEARCH_CHUNK) {
+			emit(results_ready(generation, chunk, false));
+			chunk.clear();
+		}
+	}
+	emit(results_ready(generation, chunk, true));
+	indigo_debug("Object search '%s': %d matches, %d keys checked\n", query.constData(), ranks.size(), checked);
+}
@@ -0,0 +1,88 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _OBJECTSEARCH_H
+#define _OBJECTSEARCH_H
+
+#include <atomic>
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+#include <QHash>
+#include <QByteArray>
+#include <indigo_cat_data.h>
+
+#define OBJECT_SEARCH_DEBOUNCE 150       /* ms */
+#define OBJECT_SEARCH_CHUNK 100
+#define OBJECT_SEARCH_MAX_RESULTS 1000
+
+typedef struct {
+	QByteArray text;   /* normalized: lower case letters and digits only */
+	int object;
+	bool hip;          /* HIP numbers match only queries starting with "HIP" */
+} search_key;
+
+/* Name index of the built in DSO and star catalogs. Every id and alias is a key
+   and keys are indexed by trigrams, so substring queries verify only the keys of
+   the rarest trigram of the query. Queries shorter than a trigram match key
+   prefixes in the sorted key array. Object numbers are indexes to
+   indigo_dso_data followed by indexes to indigo_star_data. */
+class ObjectSearch : public QObject {
+	Q_OBJECT
+public:
+	ObjectSearch(QObject *parent = nullptr);
+
+	/* builds the index on a worker thread */
+	void build();
+
+	/* debounced, a newer query or an empty one cancels the running one */
+	void search(const QString &query);
+	bool is_current(int generation) const { return generation == m_generation; }
+
+	const indigo_dso_entry *dso(int object) const {
+		return object < m_dso_count ? &indigo_dso_data[object] : nullptr;
+	}
+	const indigo_star_entry *star(int object) const {
+		return object >= m_dso_count ? &indigo_star_data[object - m_dso_count] : nullptr;
+	}
+
+	static QByteArray normalize(const QString &text);
+
+signals:
+	/* results are streamed in chunks ordered by match quality, finished is set on the last one */
+	void results_ready(int generation, QVector<int> objects, bool finished);
+
+private slots:
+	void on_debounce_timeout();
+
+private:
+	QVector<search_key> m_keys;
+	QVector<int> m_sorted_keys;
+	QHash<quint32, QVector<int>> m_trigrams;
+	int m_dso_count;
+	std::atomic<bool> m_ready;
+	std::atomic<int> m_generation;
+	QString m_query;
+	QTimer m_debounce;
+
+	void add_key(const QString &text, int object, bool hip);
+	void build_index();
+	void run_query(QByteArray query, int generation);
+};
+
+#endif /* _OBJECTSEARCH_H */
@@ -0,0 +1,132 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <string.h>
+#include <utils.h>
+#include "previewlane.h"
+
+PreviewLane::PreviewLane(int lane, bool priority, bool latest_only) {
+	m_lane = lane;
+	m_priority = priority;
+	m_latest_only = latest_only;
+	m_stop = false;
+	m_live_stack = nullptr;
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+PreviewLane::~PreviewLane() {
+	stop();
+}
+
+void PreviewLane::submit(indigo_property *property, indigo_item *item, const stretch_config_t sconfig, bool decode) {
+	preview_job job;
+	job.property = property;
+	job.item = item;
+	job.sconfig = sconfig;
+	job.decode = decode;
+	job.queued.start();
+
+	QMutexLocker lock(&m_mutex);
+	if (m_latest_only) {
+		// frames not started yet are obsolete, a newer one is available
+		QList<preview_job>::iterator i = m_queue.begin();
+		while (i != m_queue.end()) {
+			if (i->property == property && !strncmp(i->item->name, item->name, INDIGO_NAME_SIZE)) {
+				free(i->item->blob.value);
+				free(i->item);
+				m_stats.dropped++;
+				i = m_queue.erase(i);
+			} else {
+				++i;
+			}
+		}
+	}
+	m_queue.append(job);
+	m_condition.wakeOne();
+}
+
+void PreviewLane::stop() {
+	if (!isRunning()) return;
+	m_mutex.lock();
+	m_stop = true;
+	m_condition.wakeOne();
+	m_mutex.unlock();
+	wait();
+	while (!m_queue.isEmpty()) {
+		preview_job job = m_queue.takeFirst();
+		free(job.item->blob.value);
+		free(job.item);
+	}
+}
+
+preview_lane_stats PreviewLane::stats() {
+	QMutexLocker lock(&m_mutex);
+	return m_stats;
+}
+
+void PreviewLane::add_latency(double latency) {
+	int bin = LANE_HISTOGRAM_BINS - 1;
+	for (int i = 0; i < LANE_HISTOGRAM_BINS - 1; i++) {
+		if (latency < lane_histogram_limits[i]) {
+			bin = i;
+			break;
+		}
+	}
+	QMutexLocker lock(&m_mutex);
+	m_stats.histogram[bin]++;
+	m_stats.processed++;
+	m_stats.last_latency = latency;
+	if (latency > m_stats.max_latency) m_stats.max_latency = latency;
+}
+
+void PreviewLane::run() {
+	set_priority_thread(m_priority);
+	set_lane_thread_pool(&m_pool);
+	while (true) {
+		m_mutex.lock();
+		while (m_queue.isEmpty() && !m_stop) {
+			m_condition.wait(&m_mutex);
+		}
+		if (m_stop) {
+			m_mutex.unlock();
+			break;
+		}
+		preview_job job = m_queue.takeFirst();
+		m_mutex.unlock();
+
+		if (m_priority) begin_priority_work();
+		preview_image *preview = nullptr;
+		if (job.decode) {
+			preview = create_preview(job.item, job.sconfig);
+		}
+		if (m_priority) end_priority_work();
+		if (preview && m_live_stack && m_live_stack->is_enabled()) {
+			m_live_stack->add(preview);
+			preview_image *stacked = m_live_stack->create_preview(job.sconfig);
+			if (stacked) {
+				delete preview;
+				preview = stacked;
+			}
+		}
+
+		double latency = job.queued.nsecsElapsed() / 1e6;
+		add_latency(latency);
+		indigo_debug("Lane %d: %s processed in %.1f ms\n", m_lane, job.item->name, latency);
+		emit(preview_ready(job.property, job.item, preview, m_lane));
+	}
+}
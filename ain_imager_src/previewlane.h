@@ -0,0 +1,98 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _PREVIEWLANE_H
+#define _PREVIEWLANE_H
+
+#include <QThread>
+#include <QThreadPool>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QList>
+#include <imagepreview.h>
+#include <livestack.h>
+#include <indigo/indigo_bus.h>
+
+typedef enum {
+	GUIDER_LANE = 0,
+	IMAGER_LANE,
+	PREVIEW_LANES
+} preview_lane_id;
+
+#define LANE_HISTOGRAM_BINS 8
+
+/* upper limits of the latency histogram bins in ms, the last bin is open */
+static const int lane_histogram_limits[LANE_HISTOGRAM_BINS] = { 10, 20, 50, 100, 200, 500, 1000, -1 };
+
+typedef struct {
+	indigo_property *property;
+	indigo_item *item;
+	stretch_config_t sconfig;
+	bool decode;
+	QElapsedTimer queued;
+} preview_job;
+
+typedef struct {
+	unsigned int histogram[LANE_HISTOGRAM_BINS];
+	unsigned int processed;
+	unsigned int dropped;
+	double max_latency;
+	double last_latency;
+} preview_lane_stats;
+
+/* Decodes and stretches BLOBs of one agent type on a dedicated thread and its
+   own thread pool. The priority lane pauses the normal priority lanes at row
+   boundaries while busy, a lane that keeps only the latest frame drops the
+   frames it could not start. */
+class PreviewLane : public QThread {
+	Q_OBJECT
+public:
+	PreviewLane(int lane, bool priority, bool latest_only);
+	~PreviewLane();
+
+	/* takes ownership of item, it is passed back with preview_ready() */
+	void submit(indigo_property *property, indigo_item *item, const stretch_config_t sconfig, bool decode = true);
+	void stop();
+	preview_lane_stats stats();
+	/* the enabled stack gets the decoded frames, its preview is passed on instead of the frame */
+	void set_live_stack(LiveStack *stack) { m_live_stack = stack; }
+
+signals:
+	/* preview may be nullptr, item must be freed by the receiver */
+	void preview_ready(indigo_property *property, indigo_item *item, preview_image *preview, int lane);
+
+protected:
+	void run() override;
+
+private:
+	int m_lane;
+	bool m_priority;
+	bool m_latest_only;
+	bool m_stop;
+	QMutex m_mutex;
+	QWaitCondition m_condition;
+	QList<preview_job> m_queue;
+	preview_lane_stats m_stats;
+	LiveStack *m_live_stack;
+	QThreadPool m_pool;
+
+	void add_latency(double latency);
+};
+
+#endif /* _PREVIEWLANE_H */
@@ -18,6 +18,7 @@
 
 
 #include "qindigoservers.h"
+#include "localdrivers.h"
 #include <QRegularExpressionValidator>;
 
 QIndigoServers::QIndigoServers(QWidget *parent): QDialog(parent)
@@ -40,6 +41,17 @@ QIndigoServers::QIndigoServers(QWidget *parent): QDialog(parent)
 	//m_add_button = m_button_box->addButton(tr("Add service"), QDialogButtonBox::ActionRole);
 	m_add_button = new QPushButton(" &Add ");
 	m_add_button->setDefault(true);
+#ifndef INDIGO_WINDOWS
+	m_add_local_button = m_button_box->addButton(tr("Add local"), QDialogButtonBox::ActionRole);
+	m_add_local_button->setToolTip(
+		"Run drivers and agents inside Ain without INDIGO server,\n"
+		"images are passed in memory instead of being downloaded.\n"
+		"The drivers are listed in " LOCAL_DRIVERS_FILENAME " in the config folder."
+	);
+#else
+	// INDIGO does not load drivers on Windows
+	m_add_local_button = nullptr;
+#endif
 	m_remove_button = m_button_box->addButton(tr("Remove selected"), QDialogButtonBox::ActionRole);
 	m_remove_button->setToolTip(
 		"Remove highlighted service.\n"
@@ -72,6 +84,9 @@ QIndigoServers::QIndigoServers(QWidget *parent): QDialog(parent)
 
 	QObject::connect(m_server_list, SIGNAL(itemChanged(QListWidgetItem*)), this, SLOT(highlightChecked(QListWidgetItem*)));
 	QObject::connect(m_add_button, SIGNAL(clicked()), this, SLOT(onAddManualService()));
+#ifndef INDIGO_WINDOWS
+	QObject::connect(m_add_local_button, SIGNAL(clicked()), this, SLOT(onAddLocalService()));
+#endif
 	QObject::connect(m_remove_button, SIGNAL(clicked()), this, SLOT(onRemoveManualService()));
 	QObject::connect(m_close_button, SIGNAL(clicked()), this, SLOT(onClose()));
 }
@@ -175,6 +190,13 @@ void QIndigoServers::onAddManualService() {
 }
 
 
+void QIndigoServers::onAddLocalService() {
+	QIndigoService indigo_service(LOCAL_SERVICE_NAME, LOCAL_SERVICE_HOST, 0);
+	emit(requestAddManualService(indigo_service));
+	indigo_debug("ADD: Local service\n");
+}
+
+
 void QIndigoServers::onRemoveService(QString service_name) {
 	QListWidgetItem* item = 0;
 	for(int i = 0; i < m_server_list->count(); ++i){
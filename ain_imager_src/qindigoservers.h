@@ -55,6 +55,7 @@ public slots:
 	void highlightChecked(QListWidgetItem* item);
 	void onConnectionChange(QString service_name, bool is_connected);
 	void onAddManualService();
+	void onAddLocalService();
 	void onRemoveManualService();
 
 private:
@@ -64,6 +65,7 @@ private:
 	QWidget* m_add_service_box;
 	QLineEdit* m_service_line;
 	QPushButton* m_add_button;
+	QPushButton* m_add_local_button;
 	QPushButton* m_remove_button;
 	QPushButton* m_close_button;
 };
@@ -18,6 +18,7 @@
 
 
 #include "qindigoservice.h"
+#include "localdrivers.h"
 
 QIndigoService::QIndigoService(QByteArray name, QByteArray host, int port) :
 	m_name(name),
@@ -44,9 +45,18 @@ QIndigoService::~QIndigoService() {
 }
 
 
+bool QIndigoService::is_local() const {
+	return m_host == LOCAL_SERVICE_HOST;
+}
+
+
 bool QIndigoService::connect() {
 	int i = 5; /* 0.5 seconds */
 	prev_socket = -1;
+	if (is_local()) {
+		indigo_debug("%s(): %s loading local drivers\n",__FUNCTION__, m_name.constData());
+		return LocalDrivers::instance().load();
+	}
 	indigo_debug("%s(): %s %s %d\n",__FUNCTION__, m_name.constData(), m_host.constData(), m_port);
 	indigo_result res = indigo_connect_server(m_name.constData(), m_host.constData(), m_port, &m_server_entry);
 	indigo_debug("%s(): %s %s %d server_entry=%p\n",__FUNCTION__, m_name.constData(), m_host.constData(), m_port, m_server_entry);
@@ -60,6 +70,9 @@ bool QIndigoService::connect() {
 
 
 bool QIndigoService::connected() const {
+	if (is_local()) {
+		return LocalDrivers::instance().is_loaded();
+	}
 	if (m_server_entry) {
 		return indigo_connection_status(m_server_entry, NULL);
 	}
@@ -70,6 +83,9 @@ bool QIndigoService::connected() const {
 
 bool QIndigoService::disconnect() {
 	indigo_debug("%s(): called m_server_entry= %p\n",__FUNCTION__, m_server_entry);
+	if (is_local()) {
+		return LocalDrivers::instance().unload();
+	}
 	if (m_server_entry) {
 		indigo_debug("%s(): %s %s %d\n",__FUNCTION__, m_name.constData(), m_host.constData(), m_port);
 		bool res = (indigo_disconnect_server(m_server_entry) == INDIGO_OK);
@@ -39,6 +39,8 @@ public:
 	QByteArray host() const { return m_host; }
 	int port() const { return m_port; }
 	void setHost(QByteArray host) { m_host = host; }
+	/* drivers loaded in process instead of a server, see localdrivers.h */
+	bool is_local() const;
 
 	QByteArray m_name;
 	QByteArray m_host;
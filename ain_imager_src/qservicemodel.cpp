@@ -242,6 +242,15 @@ bool QServiceModel::disconnectService(QByteArray name) {
 }
 
 
+/* connected services and the ones that connect when discovered */
+bool QServiceModel::hasActiveServices() const {
+	for (QIndigoService *indigo_service : m_services) {
+		if (indigo_service->connected() || indigo_service->auto_connect) return true;
+	}
+	return false;
+}
+
+
 QVariant QServiceModel::data(const QModelIndex &index, int role) const {
 	// Ensure the index points to a valid row
 	if (!index.isValid() || index.row() < 0 || index.row() >= m_services.count()) {
@@ -51,6 +51,7 @@ public:
 	void enable_auto_connect(bool enable) {
 		m_auto_connect = enable;
 	};
+	bool hasActiveServices() const;
 	void addServicePreferLocalhost(QByteArray service_name, uint32_t interface_index, QByteArray host, int port);
 	void removeServiceKeepLocalhost(QByteArray service_name, uint32_t interface_index);
 	virtual QVariant data(const QModelIndex &index, int role) const;
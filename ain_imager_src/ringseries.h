@@ -0,0 +1,96 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _RINGSERIES_H
+#define _RINGSERIES_H
+
+#include <QVector>
+
+/* Fixed capacity series of telemetry samples. Appending is O(1), when full the
+   oldest sample is overwritten. Every sample gets a monotonic key, so that
+   plots can add the new samples and drop the old ones without a full rebuild.
+   clear() starts a new generation and the keys start from 0 again. */
+class RingSeries {
+public:
+	explicit RingSeries(int capacity) : m_data(capacity), m_head(0), m_size(0), m_next_key(0), m_generation(0) {
+	}
+
+	void append(double value) {
+		int capacity = m_data.size();
+		if (m_size < capacity) {
+			m_data[(m_head + m_size) % capacity] = value;
+			m_size++;
+		} else {
+			m_data[m_head] = value;
+			m_head = (m_head + 1) % capacity;
+		}
+		m_next_key++;
+	}
+
+	void clear() {
+		m_head = 0;
+		m_size = 0;
+		m_next_key = 0;
+		m_generation++;
+	}
+
+	/* i = 0 is the oldest sample */
+	double at(int i) const {
+		return m_data[(m_head + i) % m_data.size()];
+	}
+
+	double last() const {
+		return at(m_size - 1);
+	}
+
+	double min() const {
+		double min = 0;
+		for (int i = 0; i < m_size; i++) {
+			double value = at(i);
+			if (i == 0 || value < min) min = value;
+		}
+		return min;
+	}
+
+	double max() const {
+		double max = 0;
+		for (int i = 0; i < m_size; i++) {
+			double value = at(i);
+			if (i == 0 || value > max) max = value;
+		}
+		return max;
+	}
+
+	int size() const { return m_size; }
+	int capacity() const { return m_data.size(); }
+	bool is_empty() const { return m_size == 0; }
+
+	/* key of the oldest sample and the key the next sample will get */
+	qint64 first_key() const { return m_next_key - m_size; }
+	qint64 next_key() const { return m_next_key; }
+	unsigned int generation() const { return m_generation; }
+
+private:
+	QVector<double> m_data;
+	int m_head;
+	int m_size;
+	qint64 m_next_key;
+	unsigned int m_generation;
+};
+
+#endif /* _RINGSERIES_H */
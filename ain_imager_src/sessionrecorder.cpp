@@ -0,0 +1,512 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <string.h>
+#include <limits.h>
+#include <QSet>
+#include <QFileInfo>
+#include "sessionrecorder.h"
+#include "indigoclient.h"
+#include "propertycache.h"
+#include "videocapture.h"
+
+#define SESSION_HEADER_SIZE 13   /* type, time, payload size */
+
+typedef struct {
+	uint8_t type;
+	uint64_t time;
+	uint32_t size;
+} session_record_header;
+
+static bool write_header(FILE *file, session_record_header *header) {
+	char buffer[SESSION_HEADER_SIZE];
+	buffer[0] = header->type;
+	memcpy(buffer + 1, &header->time, sizeof(header->time));
+	memcpy(buffer + 9, &header->size, sizeof(header->size));
+	return fwrite(buffer, 1, SESSION_HEADER_SIZE, file) == SESSION_HEADER_SIZE;
+}
+
+static bool read_header(FILE *file, session_record_header *header) {
+	char buffer[SESSION_HEADER_SIZE];
+	if (fread(buffer, 1, SESSION_HEADER_SIZE, file) != SESSION_HEADER_SIZE) return false;
+	header->type = buffer[0];
+	memcpy(&header->time, buffer + 1, sizeof(header->time));
+	memcpy(&header->size, buffer + 9, sizeof(header->size));
+	return true;
+}
+
+static void put_string(QByteArray &buffer, const char *str) {
+	uint16_t length = str ? strnlen(str, INDIGO_VALUE_SIZE) : 0;
+	buffer.append((const char *)&length, sizeof(length));
+	buffer.append(str, length);
+}
+
+template <typename T> static void put_value(QByteArray &buffer, T value) {
+	buffer.append((const char *)&value, sizeof(T));
+}
+
+/* bounds checked reader of a record payload */
+class session_reader {
+public:
+	session_reader(const char *data, int size): m_data(data), m_size(size), m_pos(0), m_ok(true) {}
+
+	bool ok() const { return m_ok; }
+	const char *rest() const { return m_data + m_pos; }
+	int rest_size() const { return m_size - m_pos; }
+
+	void get_string(char *str, int str_size) {
+		uint16_t length = get<uint16_t>();
+		if (!m_ok || m_pos + length > m_size) {
+			m_ok = false;
+			str[0] = '\0';
+			return;
+		}
+		int copy = length < str_size ? length : str_size - 1;
+		memcpy(str, m_data + m_pos, copy);
+		str[copy] = '\0';
+		m_pos += length;
+	}
+
+	template <typename T> T get() {
+		T value = 0;
+		if (m_pos + (int)sizeof(T) > m_size) {
+			m_ok = false;
+			return value;
+		}
+		memcpy(&value, m_data + m_pos, sizeof(T));
+		m_pos += sizeof(T);
+		return value;
+	}
+
+private:
+	const char *m_data;
+	int m_size;
+	int m_pos;
+	bool m_ok;
+};
+
+SessionRecorder::SessionRecorder() {
+	m_recording = false;
+	m_file = nullptr;
+	m_records = 0;
+	m_bytes = 0;
+}
+
+SessionRecorder::~SessionRecorder() {
+	stop();
+}
+
+bool SessionRecorder::start(const char *file_name) {
+	stop();
+	QMutexLocker lock(&m_mutex);
+	m_file = fopen(file_name, "wb");
+	if (m_file == nullptr) {
+		indigo_error("Session recorder: can not create '%s'\n", file_name);
+		return false;
+	}
+	fwrite(SESSION_MAGIC, 1, strlen(SESSION_MAGIC), m_file);
+	m_records = 0;
+	m_bytes = strlen(SESSION_MAGIC);
+	m_timer.start();
+	// the records of the client thread wait for the lock, so none falls between the cache and them
+	m_recording = true;
+	for (indigo_property *property : properties) {
+		append_record(SESSION_DEFINE, property_payload(property, nullptr));
+		if (m_file == nullptr) return false;
+	}
+	indigo_debug("Session recorder: recording to '%s'\n", file_name);
+	return true;
+}
+
+void SessionRecorder::stop() {
+	m_recording = false;
+	QMutexLocker lock(&m_mutex);
+	if (m_file == nullptr) return;
+	fclose(m_file);
+	m_file = nullptr;
+	indigo_debug("Session recorder: %d records, %lld bytes\n", m_records, m_bytes);
+}
+
+void SessionRecorder::write_record(session_record_type type, const QByteArray &payload, const char *data, qint64 data_size) {
+	QMutexLocker lock(&m_mutex);
+	append_record(type, payload, data, data_size);
+}
+
+/* m_mutex is held by the caller */
+void SessionRecorder::append_record(session_record_type type, const QByteArray &payload, const char *data, qint64 data_size) {
+	if (m_file == nullptr) return;
+	if (data_size < 0 || payload.size() + data_size > INT_MAX) {
+		indigo_error("Session recorder: %lld bytes record skipped\n", payload.size() + data_size);
+		return;
+	}
+	session_record_header header;
+	header.type = type;
+	header.time = m_timer.nsecsElapsed();
+	header.size = payload.size() + data_size;
+	bool ok = write_header(m_file, &header);
+	ok = ok && fwrite(payload.constData(), 1, payload.size(), m_file) == (size_t)payload.size();
+	if (data_size > 0) ok = ok && fwrite(data, 1, data_size, m_file) == (size_t)data_size;
+	if (!ok) {
+		indigo_error("Session recorder: write failed, recording stopped\n");
+		m_recording = false;
+		fclose(m_file);
+		m_file = nullptr;
+		return;
+	}
+	m_records++;
+	m_bytes += SESSION_HEADER_SIZE + header.size;
+}
+
+QByteArray SessionRecorder::property_payload(indigo_property *property, const char *message) {
+	QByteArray payload;
+	put_string(payload, property->device);
+	put_string(payload, property->name);
+	put_string(payload, property->group);
+	put_string(payload, property->label);
+	put_value<uint8_t>(payload, property->type);
+	put_value<uint8_t>(payload, property->state);
+	put_value<uint8_t>(payload, property->perm);
+	put_value<uint8_t>(payload, property->rule);
+	put_value<uint16_t>(payload, property->count);
+	put_string(payload, message);
+	for (int i = 0; i < property->count; i++) {
+		indigo_item *item = &property->items[i];
+		put_string(payload, item->name);
+		put_string(payload, item->label);
+		switch (property->type) {
+			case INDIGO_TEXT_VECTOR:
+				put_string(payload, item->text.value);
+				break;
+			case INDIGO_NUMBER_VECTOR:
+				put_string(payload, item->number.format);
+				put_value<double>(payload, item->number.min);
+				put_value<double>(payload, item->number.max);
+				put_value<double>(payload, item->number.step);
+				put_value<double>(payload, item->number.value);
+				put_value<double>(payload, item->number.target);
+				break;
+			case INDIGO_SWITCH_VECTOR:
+				put_value<uint8_t>(payload, item->sw.value);
+				break;
+			case INDIGO_LIGHT_VECTOR:
+				put_value<uint8_t>(payload, item->light.value);
+				break;
+			case INDIGO_BLOB_VECTOR:
+				put_string(payload, item->blob.format);
+				put_string(payload, item->blob.url);
+				put_value<int64_t>(payload, item->blob.size);
+				break;
+		}
+	}
+	return payload;
+}
+
+void SessionRecorder::record_property(session_record_type type, indigo_property *property, const char *message) {
+	if (!is_recording()) return;
+	write_record(type, property_payload(property, message));
+}
+
+void SessionRecorder::record_message(const char *device, const char *message) {
+	if (!is_recording()) return;
+	QByteArray payload;
+	put_string(payload, device);
+	put_string(payload, message);
+	write_record(SESSION_MESSAGE, payload);
+}
+
+void SessionRecorder::record_blob(const char *device, const char *property, indigo_item *item) {
+	if (!is_recording() || item->blob.value == nullptr) return;
+	QByteArray payload;
+	put_string(payload, device);
+	put_string(payload, property);
+	put_string(payload, item->name);
+	put_string(payload, item->blob.format);
+	put_value<int64_t>(payload, item->blob.size);
+	write_record(SESSION_BLOB, payload, (const char *)item->blob.value, item->blob.size);
+}
+
+SessionReplayer::SessionReplayer(const char *file_name, double speed) {
+	m_file_name = file_name;
+	m_speed = speed;
+	m_stop = false;
+	memset(&m_stats, 0, sizeof(m_stats));
+	memset(&m_device, 0, sizeof(m_device));
+	m_device.version = INDIGO_VERSION_CURRENT;
+}
+
+SessionReplayer::~SessionReplayer() {
+	stop();
+	wait();
+	for (indigo_property *property : m_properties) free(property);
+}
+
+/* Properties live in one buffer per device and name like in the client adapter of the bus,
+   so that the pointers kept by the property cache stay valid between updates. */
+indigo_property *SessionReplayer::replay_property(session_record_type type, const char *payload, int size, QByteArray &message) {
+	Q_UNUSED(type);
+	char device[INDIGO_NAME_SIZE], name[INDIGO_NAME_SIZE], group[INDIGO_NAME_SIZE], label[INDIGO_VALUE_SIZE];
+	char text[INDIGO_VALUE_SIZE];
+	session_reader reader(payload, size);
+	reader.get_string(device, sizeof(device));
+	reader.get_string(name, sizeof(name));
+	reader.get_string(group, sizeof(group));
+	reader.get_string(label, sizeof(label));
+	uint8_t property_type = reader.get<uint8_t>();
+	uint8_t state = reader.get<uint8_t>();
+	uint8_t perm = reader.get<uint8_t>();
+	uint8_t rule = reader.get<uint8_t>();
+	int count = reader.get<uint16_t>();
+	reader.get_string(text, sizeof(text));
+	if (!reader.ok()) return nullptr;
+	message = text;
+
+	QString key = QString(device) + "." + QString(name);
+	indigo_property *property = m_properties.value(key, nullptr);
+	if (property == nullptr || m_capacity.value(key) < count) {
+		int capacity = count > 0 ? count : 1;
+		indigo_property *grown = (indigo_property *)malloc(sizeof(indigo_property) + capacity * sizeof(indigo_item));
+		if (grown == nullptr) return nullptr;
+		if (property != nullptr) {
+			// the client and the UI hold the defined buffer, it is deleted before it is replaced
+			strncpy(m_device.name, property->device, INDIGO_NAME_SIZE);
+			IndigoClient::instance().replay_delete_property(&m_device, property, nullptr);
+			free(property);
+		}
+		property = grown;
+		m_properties.insert(key, property);
+		m_capacity.insert(key, capacity);
+	}
+	memset(property, 0, sizeof(indigo_property) + count * sizeof(indigo_item));
+	strncpy(property->device, device, INDIGO_NAME_SIZE);
+	strncpy(property->name, name, INDIGO_NAME_SIZE);
+	strncpy(property->group, group, INDIGO_NAME_SIZE);
+	strncpy(property->label, label, INDIGO_VALUE_SIZE);
+	property->type = (indigo_property_type)property_type;
+	property->state = (indigo_property_state)state;
+	property->perm = (indigo_property_perm)perm;
+	property->rule = (indigo_rule)rule;
+	property->count = count;
+
+	for (int i = 0; i < count; i++) {
+		indigo_item *item = &property->items[i];
+		reader.get_string(item->name, INDIGO_NAME_SIZE);
+		reader.get_string(item->label, INDIGO_VALUE_SIZE);
+		switch (property_type) {
+			case INDIGO_TEXT_VECTOR:
+				reader.get_string(item->text.value, INDIGO_VALUE_SIZE);
+				break;
+			case INDIGO_NUMBER_VECTOR:
+				reader.get_string(item->number.format, INDIGO_VALUE_SIZE);
+				item->number.min = reader.get<double>();
+				item->number.max = reader.get<double>();
+				item->number.step = reader.get<double>();
+				item->number.value = reader.get<double>();
+				item->number.target = reader.get<double>();
+				break;
+			case INDIGO_SWITCH_VECTOR:
+				item->sw.value = reader.get<uint8_t>();
+				break;
+			case INDIGO_LIGHT_VECTOR:
+				item->light.value = (indigo_property_state)reader.get<uint8_t>();
+				break;
+			case INDIGO_BLOB_VECTOR:
+				reader.get_string(item->blob.format, INDIGO_NAME_SIZE);
+				reader.get_string(item->blob.url, INDIGO_VALUE_SIZE);
+				item->blob.size = reader.get<int64_t>();
+				break;
+		}
+	}
+	if (!reader.ok()) {
+		property->count = 0;
+		return nullptr;
+	}
+	return property;
+}
+
+bool SessionReplayer::replay_blob(const char *payload, int size) {
+	char device[INDIGO_NAME_SIZE], name[INDIGO_NAME_SIZE], item_name[INDIGO_NAME_SIZE], format[INDIGO_NAME_SIZE];
+	session_reader reader(payload, size);
+	reader.get_string(device, sizeof(device));
+	reader.get_string(name, sizeof(name));
+	reader.get_string(item_name, sizeof(item_name));
+	reader.get_string(format, sizeof(format));
+	int64_t blob_size = reader.get<int64_t>();
+	if (!reader.ok() || blob_size != reader.rest_size()) return false;
+
+	indigo_property *property = m_properties.value(QString(device) + "." + QString(name), nullptr);
+	if (property == nullptr) return false;
+	for (int i = 0; i < property->count; i++) {
+		if (strncmp(property->items[i].name, item_name, INDIGO_NAME_SIZE)) continue;
+		// the same ownership as with BlobFetcher::blob_fetched()
+		indigo_item *blob_item = (indigo_item *)malloc(sizeof(indigo_item));
+		memcpy(blob_item, &property->items[i], sizeof(indigo_item));
+		blob_item->blob.value = malloc(blob_size);
+		if (blob_item->blob.value == nullptr) {
+			free(blob_item);
+			return false;
+		}
+		memcpy(blob_item->blob.value, reader.rest(), blob_size);
+		blob_item->blob.size = blob_size;
+		strncpy(blob_item->blob.format, format, INDIGO_NAME_SIZE);
+		m_stats.blobs++;
+		m_stats.blob_bytes += blob_size;
+		if (VideoCapture::instance().capture(property, blob_item)) {
+			free(blob_item->blob.value);
+			free(blob_item);
+			return true;
+		}
+		emit(IndigoClient::instance().create_preview(property, blob_item));
+		return true;
+	}
+	return false;
+}
+
+/* Frees the buffers of the deleted properties, all of the device for an empty name. */
+void SessionReplayer::delete_properties(const char *device) {
+	QString prefix = QString(device) + ".";
+	QHash<QString, indigo_property*>::iterator i = m_properties.begin();
+	while (i != m_properties.end()) {
+		if (i.key().startsWith(prefix)) {
+			free(i.value());
+			m_capacity.remove(i.key());
+			i = m_properties.erase(i);
+		} else {
+			++i;
+		}
+	}
+}
+
+void SessionReplayer::run() {
+	memset(&m_stats, 0, sizeof(m_stats));
+	FILE *file = fopen(m_file_name.constData(), "rb");
+	if (file == nullptr) {
+		indigo_error("Session replay: can not open '%s'\n", m_file_name.constData());
+		emit(replay_finished(false));
+		return;
+	}
+	char magic[8];
+	if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || strncmp(magic, SESSION_MAGIC, sizeof(magic))) {
+		indigo_error("Session replay: '%s' is not a session recording\n", m_file_name.constData());
+		fclose(file);
+		emit(replay_finished(false));
+		return;
+	}
+
+	qint64 file_size = QFileInfo(QString::fromUtf8(m_file_name)).size();
+	qint64 position = sizeof(magic);
+	IndigoClient::instance().set_replaying(true);
+	bool success = true;
+	double handler_total = 0;
+	QByteArray payload;
+	QByteArray message;
+	QElapsedTimer timer;
+	QElapsedTimer handler_timer;
+	timer.start();
+	session_record_header header;
+	while (!m_stop && read_header(file, &header)) {
+		position += SESSION_HEADER_SIZE;
+		if (header.size > INT_MAX || header.size > file_size - position) {
+			indigo_error("Session replay: damaged record of %u bytes at %lld\n", header.size, position - SESSION_HEADER_SIZE);
+			success = false;
+			break;
+		}
+		position += header.size;
+		payload.resize(header.size);
+		if (fread(payload.data(), 1, header.size, file) != header.size) {
+			success = false;
+			break;
+		}
+		if (m_speed > 0) {
+			qint64 due = header.time / m_speed;
+			qint64 now;
+			while (!m_stop && (now = timer.nsecsElapsed()) < due) {
+				qint64 wait = (due - now) / 1000;
+				indigo_usleep(wait < 50000 ? wait : 50000);
+			}
+		}
+
+		handler_timer.start();
+		if (header.type == SESSION_DEFINE || header.type == SESSION_UPDATE || header.type == SESSION_DELETE) {
+			indigo_property *property = replay_property((session_record_type)header.type, payload.constData(), payload.size(), message);
+			if (property == nullptr) {
+				success = false;
+				break;
+			}
+			strncpy(m_device.name, property->device, INDIGO_NAME_SIZE);
+			const char *msg = message.isEmpty() ? nullptr : message.constData();
+			if (header.type == SESSION_DEFINE) {
+				IndigoClient::instance().replay_define_property(&m_device, property, msg);
+			} else if (header.type == SESSION_UPDATE) {
+				IndigoClient::instance().replay_update_property(&m_device, property, msg);
+			} else {
+				IndigoClient::instance().replay_delete_property(&m_device, property, msg);
+				if (property->name[0] == '\0') {
+					delete_properties(property->device);
+				} else {
+					QString key = QString(property->device) + "." + QString(property->name);
+					m_properties.remove(key);
+					m_capacity.remove(key);
+					free(property);
+				}
+			}
+		} else if (header.type == SESSION_MESSAGE) {
+			char device[INDIGO_NAME_SIZE], text[INDIGO_VALUE_SIZE];
+			session_reader reader(payload.constData(), payload.size());
+			reader.get_string(device, sizeof(device));
+			reader.get_string(text, sizeof(text));
+			if (!reader.ok()) {
+				success = false;
+				break;
+			}
+			strncpy(m_device.name, device, INDIGO_NAME_SIZE);
+			IndigoClient::instance().replay_send_message(device[0] ? &m_device : nullptr, text);
+		} else if (header.type == SESSION_BLOB) {
+			if (!replay_blob(payload.constData(), payload.size())) {
+				indigo_debug("Session replay: BLOB of an unknown property skipped\n");
+			}
+			continue;
+		} else {
+			indigo_error("Session replay: unknown record type %d\n", header.type);
+			success = false;
+			break;
+		}
+		double handler_time = handler_timer.nsecsElapsed() / 1e6;
+		handler_total += handler_time;
+		if (handler_time > m_stats.handler_max) m_stats.handler_max = handler_time;
+		m_stats.events++;
+	}
+	fclose(file);
+
+	// the session ends as if the server was disconnected
+	QSet<QString> devices;
+	for (indigo_property *property : m_properties) devices.insert(property->device);
+	for (const QString &device : devices) {
+		indigo_property *property = (indigo_property *)calloc(1, sizeof(indigo_property));
+		strncpy(property->device, device.toUtf8().constData(), INDIGO_NAME_SIZE);
+		strncpy(m_device.name, property->device, INDIGO_NAME_SIZE);
+		IndigoClient::instance().replay_delete_property(&m_device, property, nullptr);
+		delete_properties(property->device);
+		free(property);
+	}
+	IndigoClient::instance().set_replaying(false);
+
+	m_stats.elapsed = timer.nsecsElapsed() / 1e9;
+	m_stats.handler_mean = m_stats.events ? handler_total / m_stats.events : 0;
+	indigo_debug("Session replay: %d events, %d BLOBs in %.2f s\n", m_stats.events, m_stats.blobs, m_stats.elapsed);
+	emit(replay_finished(success));
+}
@@ -0,0 +1,133 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _SESSIONRECORDER_H
+#define _SESSIONRECORDER_H
+
+#include <stdio.h>
+#include <atomic>
+#include <QThread>
+#include <QMutex>
+#include <QHash>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <indigo/indigo_bus.h>
+
+/* Session file: "AINREC01" followed by records of
+     uint8 type, uint64 time in ns from the start, uint32 payload size, payload
+   Strings are uint16 length and the bytes. Property payload is device, name, group, label,
+   uint8 type, state, perm, rule, uint16 count, message and the items: name, label and
+     text: value
+     number: format, double min, max, step, value, target
+     switch, light: uint8 value
+     BLOB: format, url, int64 size
+   Message payload is device and message, BLOB payload is device, property, item, format,
+   int64 size and the data. Records are native endian, the file is meant for the machine
+   it was recorded on. */
+
+#define SESSION_MAGIC "AINREC01"
+#define SESSION_EXTENSION ".ainrec"
+
+typedef enum {
+	SESSION_DEFINE = 1,
+	SESSION_UPDATE,
+	SESSION_DELETE,
+	SESSION_MESSAGE,
+	SESSION_BLOB
+} session_record_type;
+
+/* Records what IndigoClient receives from the bus and the downloaded BLOBs. */
+class SessionRecorder {
+public:
+	static SessionRecorder& instance();
+
+	SessionRecorder();
+	~SessionRecorder();
+
+	/* GUI thread, the properties already in the cache are written as defined */
+	bool start(const char *file_name);
+	void stop();
+	bool is_recording() const { return m_recording.load(std::memory_order_relaxed); }
+
+	/* thread safe, called on the INDIGO client and BLOB fetcher threads */
+	void record_property(session_record_type type, indigo_property *property, const char *message);
+	void record_message(const char *device, const char *message);
+	void record_blob(const char *device, const char *property, indigo_item *item);
+
+private:
+	std::atomic<bool> m_recording;
+	QMutex m_mutex;
+	FILE *m_file;
+	QElapsedTimer m_timer;
+	int m_records;
+	qint64 m_bytes;
+
+	static QByteArray property_payload(indigo_property *property, const char *message);
+	void write_record(session_record_type type, const QByteArray &payload, const char *data = nullptr, qint64 data_size = 0);
+	void append_record(session_record_type type, const QByteArray &payload, const char *data = nullptr, qint64 data_size = 0);
+};
+
+inline SessionRecorder& SessionRecorder::instance() {
+	static SessionRecorder* me = nullptr;
+	if (!me) me = new SessionRecorder();
+	return *me;
+}
+
+typedef struct {
+	int events;
+	int blobs;
+	qint64 blob_bytes;
+	double elapsed;          /* s */
+	double handler_mean;     /* ms, time the client callbacks and the blocking GUI handlers took */
+	double handler_max;
+} session_replay_stats;
+
+/* Feeds a recorded session through IndigoClient as if it came from the bus. The time
+   between the records is divided by speed, 0 replays as fast as the handlers allow. */
+class SessionReplayer : public QThread {
+	Q_OBJECT
+public:
+	SessionReplayer(const char *file_name, double speed);
+	~SessionReplayer();
+
+	/* does not wait, the handlers of the running record may need the GUI thread */
+	void stop() { m_stop = true; }
+	/* valid after replay_finished() */
+	session_replay_stats stats() const { return m_stats; }
+
+signals:
+	void replay_finished(bool success);
+
+protected:
+	void run() override;
+
+private:
+	QByteArray m_file_name;
+	double m_speed;
+	std::atomic<bool> m_stop;
+	session_replay_stats m_stats;
+	QHash<QString, indigo_property*> m_properties;
+	QHash<QString, int> m_capacity;
+	indigo_device m_device;
+
+	indigo_property *replay_property(session_record_type type, const char *payload, int size, QByteArray &message);
+	bool replay_blob(const char *payload, int size);
+	void delete_properties(const char *device);
+};
+
+#endif /* _SESSIONRECORDER_H */
@@ -21,6 +21,8 @@
 #include <indigoclient.h>
 #include <conf.h>
 #include <indigo_cat_data.h>
+#include <catalogindex.h>
+#include <cmath>
 #include <QLCDNumber>
 #include <qaddcustomobject.h>
 
@@ -317,6 +319,7 @@ void ImagerWindow::create_telescope_tab(QFrame *telescope_frame) {
 	obj_frame_layout->addWidget(m_object_search_line, obj_row, 1, 1, 2);
 	connect(m_object_search_line, &QLineEdit::textEdited, this, &ImagerWindow::on_object_search_changed);
 	connect(m_object_search_line, &QLineEdit::returnPressed, this, &ImagerWindow::on_object_search_entered);
+	connect(m_object_search, &ObjectSearch::results_ready, this, &ImagerWindow::on_object_search_results);
 
 	m_add_object_button = new QToolButton(this);
 	m_add_object_button->setToolTip(tr("Add object to custom database"));
@@ -330,6 +333,23 @@ void ImagerWindow::create_telescope_tab(QFrame *telescope_frame) {
 	obj_frame_layout->addWidget(m_remove_object_button, obj_row, 4);
 	connect(m_remove_object_button, &QToolButton::clicked, this, &ImagerWindow::on_custom_object_remove);
 
+	obj_row++;
+	m_object_visible_cbox = new QCheckBox("Visible only");
+	m_object_visible_cbox->setToolTip(QString("Show only objects higher than %1° above the horizon, all visible objects are listed if nothing is searched").arg(VISIBILITY_MIN_ALTITUDE));
+	m_object_visible_cbox->setChecked(conf.object_visible_only);
+	set_ok(m_object_visible_cbox);
+	obj_frame_layout->addWidget(m_object_visible_cbox, obj_row, 0, 1, 2);
+	connect(m_object_visible_cbox, &QCheckBox::clicked, this, &ImagerWindow::on_object_visible_only);
+
+	m_object_sort_select = new QComboBox();
+	m_object_sort_select->addItem("Sort by relevance");
+	m_object_sort_select->addItem("Sort by altitude");
+	m_object_sort_select->addItem("Sort by magnitude");
+	m_object_sort_select->setCurrentIndex(conf.object_sort);
+	obj_frame_layout->addWidget(m_object_sort_select, obj_row, 2, 1, 3);
+	connect(m_object_sort_select, QOverload<int>::of(&QComboBox::activated), this, &ImagerWindow::on_object_sort_selected);
+	connect(m_visibility, &Visibility::updated, this, &ImagerWindow::on_visibility_updated);
+
 	obj_row++;
 	m_object_list = new QListWidget();
 	m_object_list->setStyleSheet("QListWidget {border: 1px solid #404040;}");
@@ -1007,21 +1027,119 @@ void ImagerWindow::on_image_source3_selected(int index) {
 	write_conf();
 }
 
-void ImagerWindow::on_object_search_changed(const QString &obj_name) {
-	QString data;
+#define OBJECT_SORT_KEY_ROLE (Qt::UserRole + 1)
+
+/* list items are sorted by OBJECT_SORT_KEY_ROLE, items without a key stay on top */
+class ObjectListItem : public QListWidgetItem {
+public:
+	ObjectListItem(const QString &text) : QListWidgetItem(text) {
+		setData(OBJECT_SORT_KEY_ROLE, -HUGE_VAL);
+	}
+
+	bool operator<(const QListWidgetItem &other) const override {
+		return data(OBJECT_SORT_KEY_ROLE).toDouble() < other.data(OBJECT_SORT_KEY_ROLE).toDouble();
+	}
+};
+
+static void set_object_visibility(QListWidgetItem *item, Visibility *visibility, int object, float mag) {
+	char tooltip_c[INDIGO_VALUE_SIZE];
+	double altitude = visibility->altitude(object);
+	if (conf.object_sort == OBJECT_SORT_MAGNITUDE) {
+		// unknown magnitudes are 0
+		item->setData(OBJECT_SORT_KEY_ROLE, mag == 0 ? 99.0 : mag);
+	}
+	if (std::isnan(altitude)) return;
+	if (conf.object_sort == OBJECT_SORT_ALTITUDE) {
+		item->setData(OBJECT_SORT_KEY_ROLE, -altitude);
+	}
+	snprintf(
+		tooltip_c,
+		INDIGO_VALUE_SIZE,
+		"<p>Altitude: %.1f°<br>Azimuth: %.1f°<br>Transit in: %s</p>",
+		altitude,
+		visibility->azimuth(object),
+		indigo_dtos(visibility->transit_in(object), "%02d:%02d")
+	);
+	item->setToolTip(item->toolTip() + tooltip_c);
+}
+
+static QListWidgetItem *create_dso_item(const indigo_dso_entry *dso) {
+	char tooltip_c[INDIGO_VALUE_SIZE];
 	QString name;
+	if (dso->name[0] == '\0') {
+		name = QString(dso->id);
+	} else {
+		name = QString(dso->id) + ", " + dso->name;
+	}
+	QListWidgetItem *item = new ObjectListItem(name);
+	snprintf(
+		tooltip_c,
+		INDIGO_VALUE_SIZE,
+		"<b>%s</b> (%s)<p>α: %s<br>δ: %s<br>Apparent size: %.1f' x %.1f'<br>Apparent magnitude: %.1f<sup>m</sup><br><nobr>Names: %s</nobr></p>\n",
+		dso->id,
+		indigo_dso_type_description[dso->type],
+		indigo_dtos(dso->ra, "%d:%02d:%04.1f"),
+		indigo_dtos(dso->dec, "+%d:%02d:%04.1f"),
+		dso->r1, dso->r2,
+		dso->mag,
+		dso->name
+	);
+	item->setToolTip(tooltip_c);
+	item->setData(Qt::UserRole, QString(dso->id));
+	return item;
+}
+
+static QListWidgetItem *create_star_item(const indigo_star_entry *star) {
+	char tooltip_c[INDIGO_VALUE_SIZE];
+	QString name;
+	QString star_name = "HIP" + QString::number(star->hip);
+	if (star->name == nullptr || star->name[0] == '\0') {
+		name = star_name;
+	} else {
+		name = star_name + ", " + star->name;
+	}
+	QListWidgetItem *item = new ObjectListItem(name);
+	snprintf(
+		tooltip_c,
+		INDIGO_VALUE_SIZE,
+		"<b>HIP%d</b> (Star)<p>α: %s<br>δ: %s<br>Apparent magnitude: %.1f<sup>m</sup><br><nobr>Names: %s</nobr></p>\n",
+		star->hip,
+		indigo_dtos(star->ra, "%d:%02d:%04.1f"),
+		indigo_dtos(star->dec, "+%d:%02d:%04.1f"),
+		star->mag,
+		star->name ? star->name : ""
+	);
+	item->setToolTip(tooltip_c);
+	item->setData(Qt::UserRole, star_name);
+	return item;
+}
+
+void ImagerWindow::on_object_search_changed(const QString &obj_name) {
 	char obj_name_c[INDIGO_VALUE_SIZE];
 	char tooltip_c[INDIGO_VALUE_SIZE];
 	m_object_list->clear();
 	strncpy(obj_name_c, obj_name.toUtf8().data(), INDIGO_VALUE_SIZE);
 
-	if (obj_name_c[0] == '\0') return;
+	// the catalogs are searched in the background, results are added by on_object_search_results()
+	m_object_search->search(obj_name);
+	m_object_search_done = false;
+	m_object_search_enter = false;
+	if (obj_name_c[0] == '\0') {
+		// what is up now
+		if (conf.object_visible_only && m_visibility->is_valid()) {
+			QVector<int> objects;
+			m_visibility->visible_objects(VISIBILITY_MIN_ALTITUDE, OBJECT_SEARCH_MAX_RESULTS, objects);
+			on_object_search_results(-1, objects, true);
+		}
+		m_object_search_done = true;
+		return;
+	}
 
 	auto objects = m_custom_object_model->m_objects;
 	for (auto i = objects.constBegin(); i != objects.constEnd(); ++i) {
 		auto object = *i;
 		if (object->matchObject(obj_name_c)) {
-			QListWidgetItem *item = new QListWidgetItem(object->m_name);
+			QListWidgetItem *item = new ObjectListItem(object->m_name);
 			snprintf(
 				tooltip_c,
 				INDIGO_VALUE_SIZE,
@@ -1039,76 +1157,84 @@ void ImagerWindow::on_object_search_changed(const QString &obj_name) {
 		}
 	}
 
-	indigo_dso_entry *dso = &indigo_dso_data[0];
-	while (dso->id) {
-		if (
-			QString(dso->id).contains(obj_name_c, Qt::CaseInsensitive) ||
-			QString(dso->name).contains(obj_name_c, Qt::CaseInsensitive)
-		) {
-			data = QString(dso->id);
-			if (dso->name[0] == '\0') {
-				name = QString(dso->id);
-			} else {
-				name = QString(dso->id) + ", " + dso->name;
-			}
-			QListWidgetItem *item = new QListWidgetItem(name);
-			snprintf(
-				tooltip_c,
-				INDIGO_VALUE_SIZE,
-				"<b>%s</b> (%s)<p>α: %s<br>δ: %s<br>Apparent size: %.1f' x %.1f'<br>Apparent magnitude: %.1f<sup>m</sup><br><nobr>Names: %s</nobr></p>\n",
-				dso->id,
-				indigo_dso_type_description[dso->type],
-				indigo_dtos(dso->ra, "%d:%02d:%04.1f"),
-				indigo_dtos(dso->dec, "+%d:%02d:%04.1f"),
-				dso->r1, dso->r2,
-				dso->mag,
-				dso->name
-			);
-			item->setToolTip(tooltip_c);
-			item->setData(Qt::UserRole, data);
-			m_object_list->addItem(item);
-			//indigo_debug("%s -> %s = %s\n", __FUNCTION__, obj_name_c, name.toUtf8().constData());
-		}
-		dso++;
+	// catalog files are matched by the exact name, they may be too large to search
+	catalog_object found;
+	if (CatalogIndex::instance().find(obj_name, found)) {
+		QListWidgetItem *item = new ObjectListItem(found.names.isEmpty() ? found.id : found.id + ", " + found.names);
+		snprintf(
+			tooltip_c,
+			INDIGO_VALUE_SIZE,
+			"<b>%s</b> (Catalog file object)<p>α: %s<br>δ: %s<br>Apparent magnitude: %.1f<sup>m</sup><br><nobr>Names: %s</nobr></p>\n",
+			found.id.toUtf8().constData(),
+			indigo_dtos(found.ra, "%d:%02d:%04.1f"),
+			indigo_dtos(found.dec, "+%d:%02d:%04.1f"),
+			found.mag,
+			found.names.toUtf8().constData()
+		);
+		item->setToolTip(tooltip_c);
+		item->setData(Qt::UserRole, found.id);
+		m_object_list->addItem(item);
 	}
+	indigo_debug("%s -> %s\n", __FUNCTION__, obj_name.toUtf8().constData());
+}
 
-	indigo_star_entry *star = &indigo_star_data[0];
-	QRegExp hip_re("HIP\\d+");
-	hip_re.setCaseSensitivity(Qt::CaseInsensitive);
-	while (star->hip) {
-		QString star_name = "HIP" + QString::number(star->hip);
-		if (
-			(star->name && QString(star->name).contains(obj_name_c, Qt::CaseInsensitive)) ||
-			(hip_re.exactMatch(obj_name) && star_name.contains(obj_name_c, Qt::CaseInsensitive))
-		) {
-			data = star_name;
-			if (star->name == nullptr || star->name[0] == '\0') {
-				name = star_name;
-			} else {
-				name = star_name + ", " + star->name;
-			}
-			QListWidgetItem *item = new QListWidgetItem(name);
-			snprintf(
-				tooltip_c,
-				INDIGO_VALUE_SIZE,
-				"<b>HIP%d</b> (Star)<p>α: %s<br>δ: %s<br>Apparent magnitude: %.1f<sup>m</sup><br><nobr>Names: %s</nobr></p>\n",
-				star->hip,
-				indigo_dtos(star->ra, "%d:%02d:%04.1f"),
-				indigo_dtos(star->dec, "+%d:%02d:%04.1f"),
-				star->mag,
-				star->name ? star->name : ""
-			);
-			item->setToolTip(tooltip_c);
-			item->setData(Qt::UserRole, data);
-			m_object_list->addItem(item);
-			//indigo_debug("%s -> %s = %s\n", __FUNCTION__, obj_name_c, name.toUtf8().constData());
+/* generation -1 is the list of visible objects */
+void ImagerWindow::on_object_search_results(int generation, QVector<int> objects, bool finished) {
+	if (generation >= 0 && !m_object_search->is_current(generation)) return;
+	m_object_list->setUpdatesEnabled(false);
+	for (int object : objects) {
+		if (conf.object_visible_only && !m_visibility->is_visible(object)) continue;
+		QListWidgetItem *item;
+		const indigo_dso_entry *dso = m_object_search->dso(object);
+		if (dso) {
+			item = create_dso_item(dso);
+			set_object_visibility(item, m_visibility, object, dso->mag);
+		} else {
+			const indigo_star_entry *star = m_object_search->star(object);
+			item = create_star_item(star);
+			set_object_visibility(item, m_visibility, object, star->mag);
 		}
-		star++;
+		m_object_list->addItem(item);
+	}
+	if (conf.object_sort != OBJECT_SORT_RELEVANCE) m_object_list->sortItems();
+	m_object_list->setUpdatesEnabled(true);
+	if (finished) {
+		indigo_debug("%s -> %d objects listed\n", __FUNCTION__, m_object_list->count());
+		m_object_search_done = true;
+		// Enter was pressed before the results of the current text arrived
+		if (m_object_search_enter) {
+			m_object_search_enter = false;
+			on_object_search_entered();
+		}
+	}
+}
+
+void ImagerWindow::on_object_visible_only(bool clicked) {
+	conf.object_visible_only = clicked;
+	write_conf();
+	on_object_search_changed(m_object_search_line->text());
+	indigo_debug("%s -> %d\n", __FUNCTION__, clicked);
+}
+
+void ImagerWindow::on_object_sort_selected(int index) {
+	conf.object_sort = (char)index;
+	write_conf();
+	on_object_search_changed(m_object_search_line->text());
+	indigo_debug("%s -> %d\n", __FUNCTION__, index);
+}
+
+/* the list of visible objects follows the sky, search results are kept until the next search */
+void ImagerWindow::on_visibility_updated() {
+	if (conf.object_visible_only && m_object_search_line->text().isEmpty()) {
+		on_object_search_changed(QString());
 	}
-	indigo_debug("%s -> %s\n", __FUNCTION__, obj_name.toUtf8().constData());
 }
 
 void ImagerWindow::on_object_search_entered() {
+	if (!m_object_search_done) {
+		m_object_search_enter = true;
+		return;
+	}
 	if (m_object_list->count() == 0) return;
 	m_object_list->setCurrentRow(0);
 	m_object_list->setFocus();
@@ -1154,6 +1280,11 @@ void ImagerWindow::on_object_selected() {
 		}
 		star++;
 	}
+	catalog_object found;
+	if (CatalogIndex::instance().find(object_id, found)) {
+		set_text(m_mount_ra_input, indigo_dtos(found.ra, "%d:%02d:%04.1f"));
+		set_text(m_mount_dec_input, indigo_dtos(found.dec, "%d:%02d:%04.1f"));
+	}
 
 	indigo_debug("%s -> %s = %s\n", __FUNCTION__, object->text().toUtf8().constData(), object_id.toUtf8().constData());
 }
@@ -0,0 +1,409 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <chrono>
+#include <QDateTime>
+#include <pixelformat.h>
+#include "videocapture.h"
+
+static int64_t unix_time_us() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+VideoCapture::VideoCapture() :
+	m_capturing(false),
+	m_stop(false),
+	m_fd(-1),
+	m_write_failed(false),
+	m_buffer(nullptr),
+	m_buffer_size(0),
+	m_frame_size(0),
+	m_slots(0),
+	m_head(0),
+	m_tail(0),
+	m_count(0),
+	m_preview_interval(0),
+	m_last_preview(0),
+	m_first_time(0),
+	m_last_time(0),
+	m_keep_best(100),
+	m_pix_format(0),
+	m_ranking(VIDEO_LUCKY_WINDOW),
+	m_best_blob(nullptr),
+	m_best_size(0),
+	m_best_capacity(0),
+	m_best_sharpness(-1) {
+	m_file_name[0] = '\0';
+	m_device[0] = '\0';
+	memset(&m_header, 0, sizeof(m_header));
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+VideoCapture::~VideoCapture() {
+	if (isRunning()) stop();
+}
+
+bool VideoCapture::start(int fd, const char *file_name, const char *device, size_t buffer_size, double preview_rate, const char *instrument, int keep_best) {
+	if (isRunning()) {
+		close(fd);
+		return false;
+	}
+	m_buffer = (uint8_t *)malloc(buffer_size);
+	if (m_buffer == nullptr) {
+		indigo_error("Video: can not allocate %zu bytes buffer\n", buffer_size);
+		close(fd);
+		return false;
+	}
+	// touch the pages now, not with the first frames
+	memset(m_buffer, 0, buffer_size);
+	m_buffer_size = buffer_size;
+
+	// the header is written when the frame count is known
+	uint8_t header[SER_HEADER_SIZE] = {0};
+	m_fd = fd;
+	m_write_failed = false;
+	if (!write_data(header, SER_HEADER_SIZE)) {
+		indigo_error("Video: %s: write failed: %s\n", file_name, strerror(errno));
+		close(m_fd);
+		m_fd = -1;
+		free(m_buffer);
+		m_buffer = nullptr;
+		return false;
+	}
+
+	strncpy(m_file_name, file_name, sizeof(m_file_name) - 1);
+	m_file_name[sizeof(m_file_name) - 1] = '\0';
+	strncpy(m_device, device, INDIGO_NAME_SIZE - 1);
+	m_device[INDIGO_NAME_SIZE - 1] = '\0';
+	memset(&m_header, 0, sizeof(m_header));
+	strncpy(m_header.instrument, instrument ? instrument : "", SER_STRING_SIZE);
+	strncpy(m_header.observer, "Ain INDIGO Imager", SER_STRING_SIZE);
+	memset(&m_stats, 0, sizeof(m_stats));
+	m_frame_size = 0;
+	m_slots = 0;
+	m_head = m_tail = m_count = 0;
+	m_timestamps.clear();
+	m_preview_interval = (preview_rate > 0) ? (int64_t)(1000000 / preview_rate) : 0;
+	m_last_preview = 0;
+	m_keep_best = qBound(1, keep_best, 100);
+	if (m_keep_best < 100) {
+		// the sharpest frame of each second is shown
+		m_preview_interval = qMax(m_preview_interval, (int64_t)VIDEO_LUCKY_WINDOW);
+	}
+	m_pix_format = 0;
+	m_ranking.reset();
+	m_best_sharpness = -1;
+	m_first_time = m_last_time = 0;
+	m_stop = false;
+
+	QThread::start(QThread::HighPriority);
+	m_capturing = true;
+	indigo_debug("Video: capturing %s to %s, %zu MB buffer, keeping %d%% of the frames\n", m_device, m_file_name, buffer_size / 1024 / 1024, m_keep_best);
+	return true;
+}
+
+video_capture_stats VideoCapture::stop() {
+	m_capturing = false;
+	// wait for a frame being copied
+	m_push_mutex.lock();
+	m_mutex.lock();
+	m_stop = true;
+	m_condition.wakeAll();
+	m_mutex.unlock();
+	m_push_mutex.unlock();
+	wait();
+
+	finish_file();
+	free(m_buffer);
+	m_buffer = nullptr;
+	free(m_best_blob);
+	m_best_blob = nullptr;
+	m_best_capacity = 0;
+	m_buffer_size = 0;
+	m_timestamps.clear();
+	m_timestamps.squeeze();
+	return stats();
+}
+
+video_capture_stats VideoCapture::stats() {
+	QMutexLocker lock(&m_mutex);
+	video_capture_stats stats = m_stats;
+	stats.buffered = m_count;
+	stats.buffer_slots = m_slots;
+	stats.elapsed = (m_last_time - m_first_time) / 1e6;
+	if (stats.elapsed > 0) {
+		// the first frame opens the interval
+		stats.fps = (stats.frames - 1) / stats.elapsed;
+		stats.mb_per_s = stats.bytes / stats.elapsed / (1024 * 1024);
+	}
+	return stats;
+}
+
+bool VideoCapture::is_captured(indigo_property *property) const {
+	return !strncmp(property->device, m_device, INDIGO_NAME_SIZE) && !strncmp(property->name, CCD_IMAGE_PROPERTY_NAME, INDIGO_NAME_SIZE);
+}
+
+void VideoCapture::frame_lost(indigo_property *property) {
+	if (!is_capturing() || !is_captured(property)) return;
+	QMutexLocker lock(&m_mutex);
+	m_stats.lost++;
+}
+
+/* Called with the first frame, all the following must be the same. */
+bool VideoCapture::setup_frames(const indigo_item *item) {
+	const indigo_raw_header *raw = (const indigo_raw_header *)item->blob.value;
+	int planes, depth;
+	switch (raw->signature) {
+		case INDIGO_RAW_MONO8:
+			planes = 1; depth = 8;
+			break;
+		case INDIGO_RAW_MONO16:
+			planes = 1; depth = 16;
+			break;
+		case INDIGO_RAW_RGB24:
+			planes = 3; depth = 8;
+			break;
+		case INDIGO_RAW_RGB48:
+			planes = 3; depth = 16;
+			break;
+		default:
+			return false;
+	}
+	size_t frame_size = (size_t)raw->width * raw->height * planes * depth / 8;
+	if (frame_size == 0 || sizeof(indigo_raw_header) + frame_size > (size_t)item->blob.size) return false;
+	int slots = m_buffer_size / frame_size;
+	if (slots < VIDEO_BUFFER_MIN_SLOTS) {
+		indigo_error("Video: %zu MB buffer holds only %d frames of %dx%d\n", m_buffer_size / 1024 / 1024, slots, raw->width, raw->height);
+		return false;
+	}
+
+	int color_id = (planes == 3) ? SER_RGB : SER_MONO;
+	if (planes == 1) {
+		// bayer pattern from the FITS keywords after the data
+		size_t extension_size = item->blob.size - sizeof(indigo_raw_header) - frame_size;
+		if (extension_size > 9) {
+			char extension[1024];
+			if (extension_size >= sizeof(extension)) extension_size = sizeof(extension) - 1;
+			memcpy(extension, (const char *)item->blob.value + sizeof(indigo_raw_header) + frame_size, extension_size);
+			extension[extension_size] = '\0';
+			const char *bayerpat = strstr(extension, "BAYERPAT='");
+			if (bayerpat) color_id = ser_color_id_from_bayer(bayerpat + 10);
+		}
+	}
+
+	QMutexLocker lock(&m_mutex);
+	m_header.color_id = color_id;
+	m_header.little_endian = 0;
+	m_header.width = raw->width;
+	m_header.height = raw->height;
+	m_header.pixel_depth = depth;
+	m_frame_size = frame_size;
+	m_slots = slots;
+	if (planes == 3) {
+		m_pix_format = (depth == 8) ? PIX_FMT_RGB24 : PIX_FMT_RGB48;
+	} else if (color_id == SER_MONO) {
+		m_pix_format = (depth == 8) ? PIX_FMT_Y8 : PIX_FMT_Y16;
+	} else {
+		// only the CFA matters for the sharpness, not the pattern
+		m_pix_format = (depth == 8) ? PIX_FMT_SRGGB8 : PIX_FMT_SRGGB16;
+	}
+	m_slot_time.resize(slots);
+	indigo_debug("Video: %dx%d %d bit, %d planes, %d frames buffered\n", raw->width, raw->height, depth, planes, slots);
+	return true;
+}
+
+bool VideoCapture::capture(indigo_property *property, indigo_item *item) {
+	if (!is_capturing() || item == nullptr || item->blob.value == nullptr || !is_captured(property)) return false;
+	int64_t now = unix_time_us();
+	QMutexLocker push_lock(&m_push_mutex);
+	if (!is_capturing()) return false;
+
+	const indigo_raw_header *raw = (const indigo_raw_header *)item->blob.value;
+	bool accepted = !strcasecmp(item->blob.format, ".raw") && (size_t)item->blob.size > sizeof(indigo_raw_header);
+	if (accepted && m_frame_size == 0) {
+		accepted = setup_frames(item);
+	} else if (accepted) {
+		accepted =
+			(uint32_t)raw->width == (uint32_t)m_header.width &&
+			(uint32_t)raw->height == (uint32_t)m_header.height &&
+			sizeof(indigo_raw_header) + m_frame_size <= (size_t)item->blob.size;
+	}
+	if (!accepted) {
+		QMutexLocker lock(&m_mutex);
+		if (m_stats.rejected++ == 0) {
+			indigo_error("Video: %s frame not captured, only RAW frames of the same size can be\n", item->blob.format);
+		}
+		return false;
+	}
+
+	const bool keep = (m_keep_best >= 100) || rank_frame(now, item);
+
+	m_mutex.lock();
+	if (m_first_time == 0) m_first_time = now;
+	m_last_time = now;
+	if (!keep) {
+		m_stats.discarded++;
+		m_mutex.unlock();
+	} else if (m_count == m_slots) {
+		m_stats.dropped++;
+		m_mutex.unlock();
+	} else {
+		int slot = m_head;
+		m_mutex.unlock();
+		// the slot is not visible to the writer until the head moves
+		memcpy(m_buffer + slot * m_frame_size, (const uint8_t *)item->blob.value + sizeof(indigo_raw_header), m_frame_size);
+		m_mutex.lock();
+		m_slot_time[slot] = now;
+		m_head = (m_head + 1) % m_slots;
+		m_count++;
+		m_condition.wakeOne();
+		m_mutex.unlock();
+	}
+
+	if (now - m_last_preview >= m_preview_interval) {
+		m_last_preview = now;
+		if (m_keep_best < 100) preview_sharpest(item);
+		QMutexLocker lock(&m_mutex);
+		m_stats.previewed++;
+		return false;
+	}
+	return true;
+}
+
+/* True if the frame is among the m_keep_best percent of the sharpest of the window,
+   the sharpest frame since the last preview is copied for the next one. */
+bool VideoCapture::rank_frame(int64_t now, const indigo_item *item) {
+	const indigo_raw_header *raw = (const indigo_raw_header *)item->blob.value;
+	const double sharpness = frame_sharpness((const uint8_t *)item->blob.value + sizeof(indigo_raw_header), raw->width, raw->height, m_pix_format);
+	const double rank = m_ranking.add(now, sharpness);
+	if (sharpness > m_best_sharpness) {
+		if (m_best_capacity < item->blob.size) {
+			void *blob = realloc(m_best_blob, item->blob.size);
+			if (blob == nullptr) return rank * 100 < m_keep_best;
+			m_best_blob = blob;
+			m_best_capacity = item->blob.size;
+		}
+		memcpy(m_best_blob, item->blob.value, item->blob.size);
+		m_best_size = item->blob.size;
+		m_best_sharpness = sharpness;
+	}
+	return rank * 100 < m_keep_best;
+}
+
+/* The blobs are exchanged, the buffer of the frame is reused for the next copy. */
+void VideoCapture::preview_sharpest(indigo_item *item) {
+	if (m_best_sharpness < 0) return;
+	void *value = item->blob.value;
+	long capacity = item->blob.size;
+	item->blob.value = m_best_blob;
+	item->blob.size = m_best_size;
+	m_best_blob = value;
+	m_best_capacity = capacity;
+	m_best_size = 0;
+	m_best_sharpness = -1;
+}
+
+bool VideoCapture::write_data(const uint8_t *data, size_t size) {
+	while (size > 0) {
+		ssize_t written = write(m_fd, data, size);
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+void VideoCapture::run() {
+	QElapsedTimer progress_timer;
+	progress_timer.start();
+	m_mutex.lock();
+	while (true) {
+		while (m_count == 0 && !m_stop) {
+			m_condition.wait(&m_mutex, VIDEO_PROGRESS_INTERVAL);
+			if (progress_timer.elapsed() >= VIDEO_PROGRESS_INTERVAL) {
+				progress_timer.restart();
+				m_mutex.unlock();
+				emit(capture_progress());
+				m_mutex.lock();
+			}
+		}
+		if (m_count == 0) break;
+		// the frames up to the end of the buffer go with one write
+		int tail = m_tail;
+		int count = qMin(m_count, m_slots - tail);
+		m_mutex.unlock();
+
+		bool written = m_write_failed || write_data(m_buffer + tail * m_frame_size, count * m_frame_size);
+		if (!written) {
+			indigo_error("Video: %s: write failed: %s\n", m_file_name, strerror(errno));
+			m_write_failed = true;
+			m_capturing = false;
+		}
+
+		m_mutex.lock();
+		if (!m_write_failed) {
+			for (int i = 0; i < count; i++) m_timestamps.append(m_slot_time[tail + i]);
+			m_stats.frames += count;
+			m_stats.bytes += count * m_frame_size;
+		}
+		m_tail = (m_tail + count) % m_slots;
+		m_count -= count;
+		if (progress_timer.elapsed() >= VIDEO_PROGRESS_INTERVAL) {
+			progress_timer.restart();
+			m_mutex.unlock();
+			emit(capture_progress());
+			m_mutex.lock();
+		}
+	}
+	m_mutex.unlock();
+}
+
+/* Frame timestamps go to the trailer, the header is rewritten with the frame count. */
+void VideoCapture::finish_file() {
+	if (m_fd < 0) return;
+	if (!m_write_failed && !m_timestamps.isEmpty()) {
+		QVector<uint8_t> trailer(m_timestamps.size() * 8);
+		for (int i = 0; i < (int)m_timestamps.size(); i++) {
+			ser_put_int64(trailer.data() + i * 8, ser_ticks_from_unix_us(m_timestamps[i]));
+		}
+		if (!write_data(trailer.data(), trailer.size())) {
+			indigo_error("Video: %s: write failed: %s\n", m_file_name, strerror(errno));
+		}
+	}
+	m_header.frame_count = m_stats.frames;
+	if (!m_timestamps.isEmpty()) {
+		m_header.date_time_utc = ser_ticks_from_unix_us(m_timestamps.first());
+		int64_t offset = QDateTime::fromMSecsSinceEpoch(m_timestamps.first() / 1000).offsetFromUtc();
+		m_header.date_time = m_header.date_time_utc + offset * 10000000LL;
+	}
+	uint8_t header[SER_HEADER_SIZE];
+	ser_write_header(&m_header, header);
+	if (lseek(m_fd, 0, SEEK_SET) != 0 || !write_data(header, SER_HEADER_SIZE)) {
+		indigo_error("Video: %s: header write failed: %s\n", m_file_name, strerror(errno));
+	}
+	close(m_fd);
+	m_fd = -1;
+	indigo_log("Video: %s finished, %d frames\n", m_file_name, m_stats.frames);
+}
@@ -0,0 +1,139 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _VIDEOCAPTURE_H
+#define _VIDEOCAPTURE_H
+
+#include <atomic>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QVector>
+#include <indigo/indigo_bus.h>
+#include <ser.h>
+#include <sharpness.h>
+#include "conf.h"
+
+#define VIDEO_EXTENSION ".ser"
+#define VIDEO_BUFFER_MIN_SLOTS 4
+#define VIDEO_PROGRESS_INTERVAL 1000 /* ms */
+#define VIDEO_LUCKY_WINDOW 1000000    /* us, frames are ranked among the ones of the last second */
+
+typedef struct {
+	int frames;         /* written to the file */
+	int dropped;        /* the ring buffer was full */
+	int lost;           /* superseded downloads, never received */
+	int rejected;       /* not RAW or a different frame size */
+	int discarded;      /* not among the sharpest of the last second */
+	int previewed;
+	int buffered;
+	int buffer_slots;
+	qint64 bytes;
+	double elapsed;     /* s from the first to the last frame */
+	double fps;
+	double mb_per_s;
+} video_capture_stats;
+
+/* Appends the RAW frames of one device to a SER file. The frames are copied
+   into a ring buffer preallocated at start() on the thread they arrive on and
+   written by this thread, so the file system does not stall the transfer. Only
+   the frames due at the preview rate continue to the preview.
+   For lucky imaging only the keep_best percent of the sharpest frames of the
+   last second are written and the preview shows the sharpest frame of each
+   second, see frame_sharpness(). */
+class VideoCapture : public QThread {
+	Q_OBJECT
+public:
+	static VideoCapture& instance();
+
+	VideoCapture();
+	~VideoCapture();
+
+	/* takes ownership of fd, an empty file, keep_best 100 writes all frames */
+	bool start(int fd, const char *file_name, const char *device, size_t buffer_size, double preview_rate, const char *instrument, int keep_best = 100);
+	/* writes the buffered frames and finishes the file */
+	video_capture_stats stop();
+	bool is_capturing() const { return m_capturing.load(std::memory_order_relaxed); }
+	const char *file_name() const { return m_file_name; }
+	const char *device() const { return m_device; }
+	video_capture_stats stats();
+
+	/* thread safe, true if the frame was taken and is not due for the preview, the caller still owns item,
+	   for lucky imaging the blob of a frame due for the preview may be exchanged for the sharpest one, both are malloc()-ed */
+	bool capture(indigo_property *property, indigo_item *item);
+	void frame_lost(indigo_property *property);
+
+signals:
+	void capture_progress();
+
+protected:
+	void run() override;
+
+private:
+	std::atomic<bool> m_capturing;
+	QMutex m_push_mutex;
+	QMutex m_mutex;
+	QWaitCondition m_condition;
+	bool m_stop;
+	int m_fd;
+	bool m_write_failed;
+	char m_file_name[PATH_LEN];
+	char m_device[INDIGO_NAME_SIZE];
+	ser_header m_header;
+
+	uint8_t *m_buffer;
+	size_t m_buffer_size;
+	size_t m_frame_size;
+	int m_slots;
+	int m_head;
+	int m_tail;
+	int m_count;
+	QVector<int64_t> m_slot_time;
+	QVector<int64_t> m_timestamps;
+
+	int64_t m_preview_interval;
+	int64_t m_last_preview;
+	int64_t m_first_time;
+	int64_t m_last_time;
+	video_capture_stats m_stats;
+
+	/* lucky imaging, used with m_push_mutex held */
+	int m_keep_best;
+	uint32_t m_pix_format;
+	SharpnessRanking m_ranking;
+	void *m_best_blob;          /* the sharpest frame since the last preview */
+	long m_best_size;
+	long m_best_capacity;
+	double m_best_sharpness;    /* < 0 if there is none */
+
+	bool is_captured(indigo_property *property) const;
+	bool setup_frames(const indigo_item *item);
+	bool rank_frame(int64_t now, const indigo_item *item);
+	void preview_sharpest(indigo_item *item);
+	bool write_data(const uint8_t *data, size_t size);
+	void finish_file();
+};
+
+inline VideoCapture& VideoCapture::instance() {
+	static VideoCapture* me = nullptr;
+	if (!me) me = new VideoCapture();
+	return *me;
+}
+
+#endif /* _VIDEOCAPTURE_H */
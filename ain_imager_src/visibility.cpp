@@ -0,0 +1,188 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <QtConcurrentRun>
+#include <indigo_cat_data.h>
+#include <indigo/indigo_bus.h>
+#include "visibility.h"
+
+#define DEG2RAD (M_PI / 180)
+
+Visibility::Visibility(QObject *parent) : QObject(parent) {
+	m_latitude = 0;
+	m_longitude = 0;
+	m_has_site = false;
+	m_lst = 0;
+	m_data.lst = 0;
+	m_data.latitude = 0;
+
+	auto add_object = [this](double ra, double dec, float mag) {
+		m_ra.append(ra);
+		m_sin_ra.append(sin(ra * 15 * DEG2RAD));
+		m_cos_ra.append(cos(ra * 15 * DEG2RAD));
+		m_sin_dec.append(sin(dec * DEG2RAD));
+		m_cos_dec.append(cos(dec * DEG2RAD));
+		m_mag.append(mag);
+	};
+	int object = 0;
+	for (indigo_dso_entry *dso = &indigo_dso_data[0]; dso->id; dso++, object++) {
+		add_object(dso->ra, dso->dec, dso->mag);
+		// unknown magnitudes are 0
+		if (dso->mag != 0) m_by_magnitude.append(object);
+	}
+	m_dso_count = object;
+	for (indigo_star_entry *star = &indigo_star_data[0]; star->hip; star++) {
+		add_object(star->ra, star->dec, star->mag);
+	}
+	std::sort(m_by_magnitude.begin(), m_by_magnitude.end(), [this](int a, int b) {
+		return m_mag[a] < m_mag[b];
+	});
+
+	m_timer.setInterval(VISIBILITY_UPDATE_INTERVAL);
+	connect(&m_timer, &QTimer::timeout, this, &Visibility::on_update);
+	connect(&m_watcher, &QFutureWatcher<visibility_data*>::finished, this, &Visibility::on_update_finished);
+}
+
+void Visibility::set_site(double latitude, double longitude) {
+	if (m_has_site && latitude == m_latitude && longitude == m_longitude) return;
+	m_latitude = latitude;
+	m_longitude = longitude;
+	m_has_site = true;
+	indigo_debug("Visibility: site changed to %.4f %.4f\n", latitude, longitude);
+	on_update();
+	m_timer.start();
+}
+
+void Visibility::set_lst(double lst) {
+	m_lst = lst;
+	m_lst_time.start();
+}
+
+/* The LST of the mount is preferred as the mount may not use the system clock,
+   it is extrapolated between the updates of the property. */
+double Visibility::current_lst() {
+	double lst;
+	if (m_lst_time.isValid()) {
+		lst = m_lst + m_lst_time.elapsed() / 3600000.0 * SIDEREAL_RATE;
+	} else {
+		double jd = time(nullptr) / 86400.0 + 2440587.5;
+		lst = 18.697374558 + 24.06570982441908 * (jd - 2451545.0) + m_longitude / 15;
+	}
+	lst = fmod(lst, 24);
+	if (lst < 0) lst += 24;
+	return lst;
+}
+
+void Visibility::on_update() {
+	if (!m_has_site || m_watcher.isRunning()) return;
+	double lst = current_lst();
+	double latitude = m_latitude;
+	m_watcher.setFuture(QtConcurrent::run([=]() {
+		return compute(lst, latitude);
+	}));
+}
+
+void Visibility::on_update_finished() {
+	visibility_data *data = m_watcher.result();
+	m_data.lst = data->lst;
+	m_data.latitude = data->latitude;
+	m_data.sin_alt.swap(data->sin_alt);
+	m_data.cos_ha.swap(data->cos_ha);
+	m_data.sin_ha.swap(data->sin_ha);
+	delete data;
+	emit(updated());
+}
+
+visibility_data *Visibility::compute(double lst, double latitude) const {
+	QElapsedTimer timer;
+	timer.start();
+	int count = m_ra.size();
+	visibility_data *data = new visibility_data;
+	data->lst = lst;
+	data->latitude = latitude;
+	data->sin_alt.resize(count);
+	data->cos_ha.resize(count);
+	data->sin_ha.resize(count);
+
+	const float sin_lst = sin(lst * 15 * DEG2RAD);
+	const float cos_lst = cos(lst * 15 * DEG2RAD);
+	const float sin_lat = sin(latitude * DEG2RAD);
+	const float cos_lat = cos(latitude * DEG2RAD);
+	const float *sin_ra = m_sin_ra.constData();
+	const float *cos_ra = m_cos_ra.constData();
+	const float *sin_dec = m_sin_dec.constData();
+	const float *cos_dec = m_cos_dec.constData();
+	float *sin_alt = data->sin_alt.data();
+	float *cos_ha = data->cos_ha.data();
+	float *sin_ha = data->sin_ha.data();
+
+	// hour angle = lst - ra, straight line code on separate arrays for the vectorizer
+	for (int i = 0; i < count; i++) {
+		float c = cos_lst * cos_ra[i] + sin_lst * sin_ra[i];
+		cos_ha[i] = c;
+		sin_ha[i] = sin_lst * cos_ra[i] - cos_lst * sin_ra[i];
+		sin_alt[i] = sin_lat * sin_dec[i] + cos_lat * cos_dec[i] * c;
+	}
+	indigo_debug("Visibility: %d objects updated in %.2f ms\n", count, timer.nsecsElapsed() / 1e6);
+	return data;
+}
+
+bool Visibility::is_valid() {
+	return !m_data.sin_alt.isEmpty();
+}
+
+bool Visibility::is_visible(int object, double min_altitude) {
+	if (!is_valid() || object < 0 || object >= m_data.sin_alt.size()) return true;
+	return m_data.sin_alt[object] >= sin(min_altitude * DEG2RAD);
+}
+
+double Visibility::altitude(int object) {
+	if (!is_valid() || object < 0 || object >= m_data.sin_alt.size()) return NAN;
+	return asin(m_data.sin_alt[object]) / DEG2RAD;
+}
+
+double Visibility::azimuth(int object) {
+	if (!is_valid() || object < 0 || object >= m_data.sin_alt.size()) return NAN;
+	double lat = m_data.latitude * DEG2RAD;
+	double az = atan2(
+		-m_cos_dec[object] * m_data.sin_ha[object],
+		m_sin_dec[object] * cos(lat) - m_cos_dec[object] * m_data.cos_ha[object] * sin(lat)
+	) / DEG2RAD;
+	return az < 0 ? az + 360 : az;
+}
+
+double Visibility::transit_in(int object) {
+	if (!is_valid() || object < 0 || object >= m_ra.size()) return NAN;
+	double hours = fmod(m_ra[object] - current_lst(), 24);
+	if (hours < 0) hours += 24;
+	return hours / SIDEREAL_RATE;
+}
+
+void Visibility::visible_objects(double min_altitude, int max_count, QVector<int> &objects) {
+	objects.clear();
+	if (!is_valid()) return;
+	float min_sin_alt = sin(min_altitude * DEG2RAD);
+	for (int object : m_by_magnitude) {
+		if (m_data.sin_alt[object] < min_sin_alt) continue;
+		objects.append(object);
+		if (objects.size() >= max_count) break;
+	}
+}
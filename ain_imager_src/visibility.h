@@ -0,0 +1,95 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _VISIBILITY_H
+#define _VISIBILITY_H
+
+#include <QObject>
+#include <QTimer>
+#include <QVector>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+
+#define VISIBILITY_UPDATE_INTERVAL 60000     /* ms */
+#define VISIBILITY_MIN_ALTITUDE 15           /* degrees */
+#define SIDEREAL_RATE 1.00273790935
+
+typedef struct {
+	double lst;                /* hours */
+	double latitude;           /* degrees */
+	QVector<float> sin_alt;
+	QVector<float> cos_ha;
+	QVector<float> sin_ha;
+} visibility_data;
+
+/* Altitude, azimuth and transit time of the built in catalog objects for the
+   site of the mount agent. The catalog is kept as arrays of sin and cos of the
+   coordinates, so an update is a few multiplications per object without any
+   trigonometric calls in a loop the compiler can vectorize. The update runs
+   once a minute on a worker thread, object numbers are the ones of ObjectSearch. */
+class Visibility : public QObject {
+	Q_OBJECT
+public:
+	Visibility(QObject *parent = nullptr);
+
+	/* latitude and longitude in degrees, east positive */
+	void set_site(double latitude, double longitude);
+	/* local sidereal time reported by the mount in hours */
+	void set_lst(double lst);
+
+	bool is_valid();
+	bool is_visible(int object, double min_altitude = VISIBILITY_MIN_ALTITUDE);
+	double altitude(int object);
+	double azimuth(int object);
+	/* hours to the next transit */
+	double transit_in(int object);
+
+	/* objects higher than min_altitude ordered by magnitude, DSOs with known magnitude only */
+	void visible_objects(double min_altitude, int max_count, QVector<int> &objects);
+
+signals:
+	void updated();
+
+private slots:
+	void on_update();
+	void on_update_finished();
+
+private:
+	QVector<float> m_ra;       /* hours */
+	QVector<float> m_sin_ra;
+	QVector<float> m_cos_ra;
+	QVector<float> m_sin_dec;
+	QVector<float> m_cos_dec;
+	QVector<float> m_mag;
+	QVector<int> m_by_magnitude;
+	int m_dso_count;
+
+	double m_latitude;
+	double m_longitude;
+	bool m_has_site;
+	double m_lst;
+	QElapsedTimer m_lst_time;
+	visibility_data m_data;
+	QTimer m_timer;
+	QFutureWatcher<visibility_data*> m_watcher;
+
+	double current_lst();
+	visibility_data *compute(double lst, double latitude) const;
+};
+
+#endif /* _VISIBILITY_H */
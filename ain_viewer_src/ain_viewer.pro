@@ -27,6 +27,9 @@ SOURCES += \
 	main.cpp \
 	textdialog.cpp \
 	viewerwindow.cpp \
+	serplayer.cpp \
+	subframeanalyzer.cpp \
+	subframedialog.cpp \
 	../common_src/coordconv.c \
 	../common_src/utils.cpp \
 	../common_src/imagepreview.cpp \
@@ -35,9 +38,18 @@ SOURCES += \
 	../common_src/fits.c \
 	../common_src/raw_to_fits.c \
 	../common_src/xisf.c \
+	../common_src/ser.c \
+	../common_src/serfile.cpp \
 	../common_src/xml.c \
 	../common_src/dslr_raw.c \
-	../common_src/stretcher.cpp
+	../common_src/stretcher.cpp \
+	../common_src/pipetrace.cpp \
+	../common_src/pixel_kernels.cpp \
+	../common_src/calibration.cpp \
+	../common_src/defectmap.cpp \
+	../common_src/stardetector.cpp \
+	../common_src/masterbuilder.cpp \
+	../external/qcustomplot/qcustomplot.cpp
 
 RESOURCES += \
 	../qdarkstyle/style.qrc \
@@ -45,6 +57,8 @@ RESOURCES += \
 	../resource/ain_viewer.png \
 	../resource/previous.png \
 	../resource/next.png \
+	../resource/play.png \
+	../resource/pause.png \
 	../resource/indigo_logo.png \
 	../resource/zoom-fit-best.png \
 	../resource/zoom-original.png \
@@ -69,7 +83,10 @@ else: unix:!android: target.path = /usr/bin
 
 HEADERS += \
 	viewerwindow.h \
+	serplayer.h \
 	textdialog.h \
+	subframeanalyzer.h \
+	subframedialog.h \
 	conf.h \
 	../common_src/version.h \
 	../common_src/utils.h \
@@ -80,11 +97,22 @@ HEADERS += \
 	../common_src/fits.h \
 	../common_src/raw_to_fits.h \
 	../common_src/xisf.h \
+	../common_src/ser.h \
+	../common_src/serfile.h \
 	../common_src/xml.h \
 	../common_src/pixelformat.h \
 	../common_src/coordconv.h \
 	../common_src/dslr_raw.h \
-	../common_src/stretcher.h
+	../common_src/stretcher.h \
+	../common_src/pipetrace.h \
+	../common_src/pixel_kernels.h \
+	../common_src/pixel_kernels_impl.h \
+	../common_src/pixel_kernels_reference.h \
+	../common_src/calibration.h \
+	../common_src/defectmap.h \
+	../common_src/stardetector.h \
+	../common_src/masterbuilder.h \
+	../external/qcustomplot/qcustomplot.h
 
 #unix:!mac {
 #    CONFIG += link_pkgconfig
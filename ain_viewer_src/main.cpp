@@ -68,6 +68,7 @@ int main(int argc, char *argv[]) {
 	conf.statistics_enabled = false;
 	conf.preview_bayer_pattern = 0;
 	conf.show_reference = false;
+	conf.detect_stars = false;
 	read_conf();
 
 	if (!conf.reopen_file_at_start) {
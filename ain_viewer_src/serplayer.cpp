@@ -0,0 +1,134 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <QtConcurrentRun>
+#include <serplayer.h>
+
+SerPlayer::SerPlayer(QObject *parent) :
+	QObject(parent),
+	m_current_frame(0),
+	m_generation(0) {
+	m_sconfig = {0, 0, 0};
+	connect(&m_timer, &QTimer::timeout, this, &SerPlayer::on_timer);
+}
+
+SerPlayer::~SerPlayer() {
+	close();
+}
+
+bool SerPlayer::open(const char *file_name) {
+	close();
+	if (!m_file.open(file_name)) return false;
+	m_current_frame = 0;
+	double interval = m_file.frame_interval() * 1000;
+	if (interval <= 0) interval = SER_DEFAULT_FRAME_INTERVAL;
+	if (interval < SER_MIN_FRAME_INTERVAL) interval = SER_MIN_FRAME_INTERVAL;
+	m_timer.setInterval((int)interval);
+	return true;
+}
+
+void SerPlayer::close() {
+	pause();
+	m_generation++;
+	m_prefetch.waitForFinished();
+	drop_cache(0, -1);
+	m_file.close();
+}
+
+void SerPlayer::set_stretch_config(const stretch_config_t sconfig) {
+	m_sconfig = sconfig;
+	m_generation++;
+	m_prefetch.waitForFinished();
+	drop_cache(0, -1);
+}
+
+/* Deletes the cached frames outside of keep_from to keep_to. */
+void SerPlayer::drop_cache(int keep_from, int keep_to) {
+	QMutexLocker lock(&m_cache_mutex);
+	for (auto i = m_cache.begin(); i != m_cache.end();) {
+		if (i.key() < keep_from || i.key() > keep_to) {
+			delete i.value();
+			i = m_cache.erase(i);
+		} else {
+			++i;
+		}
+	}
+}
+
+preview_image *SerPlayer::frame_preview(int frame) {
+	if (!is_open() || frame < 0 || frame >= m_file.frame_count()) return nullptr;
+	m_current_frame = frame;
+	preview_image *preview = nullptr;
+	m_cache_mutex.lock();
+	preview = m_cache.take(frame);
+	m_cache_mutex.unlock();
+	drop_cache(frame + 1, frame + SER_PREFETCH_FRAMES);
+	if (preview == nullptr) {
+		preview = m_file.create_frame_preview(frame, m_sconfig);
+	}
+	if (is_playing()) prefetch(frame + 1);
+	return preview;
+}
+
+void SerPlayer::prefetch(int first_frame) {
+	// the running one will be restarted with the next frame
+	if (!m_prefetch.isFinished()) return;
+	const int generation = m_generation;
+	const stretch_config_t sconfig = m_sconfig;
+	const int last_frame = qMin(first_frame + SER_PREFETCH_FRAMES, m_file.frame_count()) - 1;
+	m_prefetch = QtConcurrent::run([this, first_frame, last_frame, generation, sconfig]() {
+		for (int frame = first_frame; frame <= last_frame && generation == m_generation; frame++) {
+			m_cache_mutex.lock();
+			bool cached = m_cache.contains(frame);
+			m_cache_mutex.unlock();
+			if (cached) continue;
+			preview_image *preview = m_file.create_frame_preview(frame, sconfig);
+			if (preview == nullptr) break;
+			QMutexLocker lock(&m_cache_mutex);
+			if (generation == m_generation && frame > m_current_frame) {
+				m_cache.insert(frame, preview);
+			} else {
+				delete preview;
+			}
+		}
+	});
+}
+
+void SerPlayer::play() {
+	if (!is_open() || is_playing()) return;
+	if (m_current_frame >= m_file.frame_count() - 1) m_current_frame = -1;
+	m_timer.start();
+	prefetch(m_current_frame + 1);
+	emit(playing_changed(true));
+}
+
+void SerPlayer::pause() {
+	if (!is_playing()) return;
+	m_timer.stop();
+	emit(playing_changed(false));
+}
+
+void SerPlayer::on_timer() {
+	int frame = m_current_frame + 1;
+	if (frame >= m_file.frame_count()) {
+		pause();
+		return;
+	}
+	preview_image *preview = frame_preview(frame);
+	if (preview) emit(frame_ready(preview, frame));
+}
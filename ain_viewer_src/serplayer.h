@@ -0,0 +1,79 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _SERPLAYER_H
+#define _SERPLAYER_H
+
+#include <atomic>
+#include <QObject>
+#include <QTimer>
+#include <QMutex>
+#include <QMap>
+#include <QFuture>
+#include <serfile.h>
+
+#define SER_PREFETCH_FRAMES 4
+#define SER_DEFAULT_FRAME_INTERVAL 40 /* ms */
+#define SER_MIN_FRAME_INTERVAL 10 /* ms */
+
+/* Plays a SER file. Only the requested frame is decoded on the caller thread,
+   while playing the next SER_PREFETCH_FRAMES are decoded on a worker. */
+class SerPlayer : public QObject {
+	Q_OBJECT
+public:
+	SerPlayer(QObject *parent = nullptr);
+	~SerPlayer();
+
+	bool open(const char *file_name);
+	void close();
+	bool is_open() const { return m_file.is_open(); }
+	SerFile &file() { return m_file; }
+	int current_frame() const { return m_current_frame; }
+
+	/* the prefetched frames are decoded again */
+	void set_stretch_config(const stretch_config_t sconfig);
+	/* the caller owns the returned preview */
+	preview_image *frame_preview(int frame);
+
+	bool is_playing() const { return m_timer.isActive(); }
+	void play();
+	void pause();
+
+signals:
+	void frame_ready(preview_image *preview, int frame);
+	void playing_changed(bool playing);
+
+private slots:
+	void on_timer();
+
+private:
+	SerFile m_file;
+	QTimer m_timer;
+	std::atomic<int> m_current_frame;
+	stretch_config_t m_sconfig;
+
+	QMutex m_cache_mutex;
+	QMap<int, preview_image *> m_cache;
+	QFuture<void> m_prefetch;
+	std::atomic<int> m_generation;
+
+	void prefetch(int first_frame);
+	void drop_cache(int keep_from, int keep_to);
+};
+
+#endif /* _SERPLAYER_H */
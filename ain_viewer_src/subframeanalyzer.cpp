@@ -0,0 +1,368 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdio.h>
+#include <math.h>
+#include <limits.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <indigo/indigo_bus.h>
+#include <fits.h>
+#include <xisf.h>
+#include <pixelformat.h>
+#include <stardetector.h>
+#include <utils.h>
+#include "subframeanalyzer.h"
+
+#define CACHE_HEADER "# Ain subframe analysis: file, size, modified, status, rejected, stars, HFD, FWHM, eccentricity, background, noise"
+
+static const QStringList frame_filters = { "*.fits", "*.fit", "*.fts", "*.xisf" };
+
+static int mono_pix_format(int bitpix) {
+	switch (bitpix) {
+		case 8: return PIX_FMT_Y8;
+		case 16: return PIX_FMT_Y16;
+		case 32: return PIX_FMT_Y32;
+		case -32: return PIX_FMT_F32;
+	}
+	return 0;
+}
+
+static int rgb_pix_format(int bitpix) {
+	switch (bitpix) {
+		case 8: return PIX_FMT_RGB24;
+		case 16: return PIX_FMT_RGB48;
+		case 32: return PIX_FMT_RGB96;
+		case -32: return PIX_FMT_RGBF;
+	}
+	return 0;
+}
+
+/* 2x2 binned CFA or the mean of the RGB planes */
+template <typename T> static void luminance(const T *data, int width, int height, int planes, bool cfa, float *output) {
+	if (cfa) {
+		const int out_width = width / 2;
+		for (int y = 0; y < height / 2; y++) {
+			const T *row0 = data + (size_t)(2 * y) * width;
+			const T *row1 = row0 + width;
+			float *out = output + (size_t)y * out_width;
+			for (int x = 0; x < out_width; x++) {
+				out[x] = ((float)row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1]) / 4;
+			}
+		}
+	} else {
+		const size_t count = (size_t)width * height;
+		for (size_t i = 0; i < count; i++) {
+			float sum = 0;
+			for (int plane = 0; plane < planes; plane++) {
+				sum += data[plane * count + i];
+			}
+			output[i] = sum / planes;
+		}
+	}
+}
+
+static bool measure_pixels(const void *data, int width, int height, int bitpix, int channels, bool interleaved, bool cfa, subframe_quality *quality) {
+	star_detection detection;
+	double scale = 1;
+	int count;
+	if (channels == 1 && !cfa) {
+		count = detect_stars(data, width, height, mono_pix_format(bitpix), &detection, INT_MAX, 1);
+	} else if (channels == 3 && interleaved) {
+		count = detect_stars(data, width, height, rgb_pix_format(bitpix), &detection, INT_MAX, 1);
+	} else {
+		const int out_width = cfa ? width / 2 : width;
+		const int out_height = cfa ? height / 2 : height;
+		std::vector<float> buffer((size_t)out_width * out_height);
+		switch (bitpix) {
+			case 8:
+				luminance((const uint8_t *)data, width, height, channels, cfa, buffer.data());
+				break;
+			case 16:
+				luminance((const uint16_t *)data, width, height, channels, cfa, buffer.data());
+				break;
+			case 32:
+				luminance((const uint32_t *)data, width, height, channels, cfa, buffer.data());
+				break;
+			case -32:
+				luminance((const float *)data, width, height, channels, cfa, buffer.data());
+				break;
+			default:
+				return false;
+		}
+		count = detect_stars(buffer.data(), out_width, out_height, PIX_FMT_F32, &detection, INT_MAX, 1);
+		if (cfa) scale = 2;
+	}
+	if (count < 0) return false;
+	quality->stars = count;
+	quality->hfd = detection.hfd * scale;
+	quality->fwhm = detection.fwhm * scale;
+	quality->eccentricity = detection.eccentricity;
+	quality->background = detection.background;
+	quality->noise = detection.noise;
+	return true;
+}
+
+bool SubframeAnalyzer::measure(const QString &file_name, subframe_quality *quality) {
+	QFile file(file_name);
+	if (!file.open(QIODevice::ReadOnly)) {
+		indigo_error("Subframes: Can not open '%s'\n", file_name.toUtf8().constData());
+		return false;
+	}
+	const qint64 size = file.size();
+	uint8_t *data = (size > 0 && size < INT_MAX) ? (uint8_t *)file.map(0, size) : nullptr;
+	if (data == nullptr) {
+		indigo_error("Subframes: Can not map '%s'\n", file_name.toUtf8().constData());
+		return false;
+	}
+
+	bool success = false;
+	if (file_name.endsWith(".xisf", Qt::CaseInsensitive)) {
+		xisf_metadata header;
+		if (xisf_read_metadata(data, (int)size, &header) != XISF_OK) {
+			indigo_error("Subframes: '%s' is not a supported XISF file\n", file_name.toUtf8().constData());
+		} else if (header.compression[0] == '\0') {
+			if (header.data_offset + (qint64)header.data_size <= size) {
+				success = measure_pixels(data + header.data_offset, header.width, header.height, header.bitpix, header.channels, header.normal_pixel_storage, header.channels == 1 && header.bayer_pattern[0] != '\0', quality);
+			}
+		} else {
+			uint8_t *pixels = (uint8_t *)malloc(header.uncompressed_data_size);
+			if (pixels && xisf_decompress(data, &header, pixels) == XISF_OK) {
+				success = measure_pixels(pixels, header.width, header.height, header.bitpix, header.channels, header.normal_pixel_storage, header.channels == 1 && header.bayer_pattern[0] != '\0', quality);
+			}
+			free(pixels);
+		}
+	} else {
+		fits_header header;
+		if (fits_read_header(data, (int)size, &header) != FITS_OK || header.naxis < 2 || header.naxis > 3 || (header.naxis == 3 && header.naxisn[2] != 3)) {
+			indigo_error("Subframes: '%s' is not a supported FITS file\n", file_name.toUtf8().constData());
+		} else {
+			char *pixels = (char *)malloc(fits_get_buffer_size(&header));
+			if (pixels && fits_process_data(data, (int)size, &header, pixels) == FITS_OK) {
+				const int channels = header.naxis == 3 ? 3 : 1;
+				success = measure_pixels(pixels, header.naxisn[0], header.naxisn[1], header.bitpix, channels, false, channels == 1 && header.bayerpat[0] != '\0', quality);
+			}
+			free(pixels);
+		}
+	}
+	file.unmap(data);
+	return success;
+}
+
+SubframeAnalyzer::SubframeAnalyzer(const QString &directory) {
+	m_directory = directory;
+}
+
+void SubframeAnalyzer::load_cache(QHash<QString, subframe_quality> &cache) {
+	QString cache_name = m_directory + "/" + SUBFRAME_CACHE_FILENAME;
+	FILE *file = fopen(cache_name.toUtf8().constData(), "r");
+	if (file == nullptr) return;
+	char line[PATH_LEN + 256];
+	char name[PATH_LEN];
+	// the name is limited to its buffer, a damaged line must not overflow it
+	char format[128];
+	snprintf(format, sizeof(format), "\"%%%d[^\"]\", %%lld, %%lld, %%d, %%d, %%d, %%lf, %%lf, %%lf, %%lf, %%lf", PATH_LEN - 1);
+	while (fgets(line, sizeof(line), file)) {
+		if (line[0] == '#' || line[0] == '\n') continue;
+		subframe_quality quality;
+		long long size, modified;
+		int status, rejected;
+		int parsed = sscanf(line, format, name, &size, &modified, &status, &rejected, &quality.stars, &quality.hfd, &quality.fwhm, &quality.eccentricity, &quality.background, &quality.noise);
+		if (parsed != 11 || status == SUBFRAME_PENDING) {
+			indigo_error("Subframes: Parse error in '%s'\n", cache_name.toUtf8().constData());
+			continue;
+		}
+		quality.file_name = QString::fromUtf8(name);
+		quality.size = size;
+		quality.modified = modified;
+		quality.status = (subframe_status)status;
+		quality.rejected = rejected != 0;
+		cache.insert(quality.file_name, quality);
+	}
+	fclose(file);
+}
+
+bool SubframeAnalyzer::save_cache() {
+	QString cache_name = m_directory + "/" + SUBFRAME_CACHE_FILENAME;
+	FILE *file = fopen(cache_name.toUtf8().constData(), "w");
+	if (file == nullptr) {
+		indigo_error("Subframes: Can not write '%s'\n", cache_name.toUtf8().constData());
+		return false;
+	}
+	fprintf(file, "%s\n", CACHE_HEADER);
+	for (const subframe_quality &quality : m_frames) {
+		if (quality.status == SUBFRAME_PENDING) continue;
+		// names are not escaped, a frame that can not be read back is analyzed again next time
+		if (quality.file_name.contains('"') || quality.file_name.contains('\n')) continue;
+		fprintf(file, "\"%s\", %lld, %lld, %d, %d, %d, %.3f, %.3f, %.3f, %.3f, %.3f\n", quality.file_name.toUtf8().constData(), (long long)quality.size, (long long)quality.modified, quality.status, quality.rejected ? 1 : 0, quality.stars, quality.hfd, quality.fwhm, quality.eccentricity, quality.background, quality.noise);
+	}
+	fclose(file);
+	return true;
+}
+
+int SubframeAnalyzer::scan() {
+	QHash<QString, subframe_quality> cache;
+	load_cache(cache);
+	m_frames.clear();
+	int pending = 0;
+	QDir directory(m_directory);
+	const QFileInfoList files = directory.entryInfoList(frame_filters, QDir::Files, QDir::Name);
+	for (const QFileInfo &info : files) {
+		subframe_quality quality = {};
+		quality.file_name = info.fileName();
+		quality.size = info.size();
+		quality.modified = info.lastModified().toMSecsSinceEpoch();
+		auto cached = cache.constFind(quality.file_name);
+		if (cached != cache.constEnd() && cached->size == quality.size && cached->modified == quality.modified) {
+			quality = *cached;
+		} else {
+			quality.status = SUBFRAME_PENDING;
+			pending++;
+		}
+		m_frames.append(quality);
+	}
+	indigo_debug("Subframes: %d frames in '%s', %d to measure\n", m_frames.size(), m_directory.toUtf8().constData(), pending);
+	return pending;
+}
+
+bool SubframeAnalyzer::analyze(std::function<bool(int done, int total)> progress) {
+	std::vector<int> pending;
+	for (int i = 0; i < m_frames.size(); i++) {
+		if (m_frames[i].status == SUBFRAME_PENDING) pending.push_back(i);
+	}
+	const int total = (int)pending.size();
+	if (total == 0) return true;
+
+	int max_threads = get_number_of_cores();
+	max_threads = (max_threads > 0) ? max_threads : AIN_DEFAULT_THREADS;
+	max_threads = std::min(std::min(max_threads, SUBFRAME_MAX_THREADS), total);
+
+	// the workers write to distinct elements, the vector must not detach meanwhile
+	subframe_quality *frames = m_frames.data();
+	std::atomic<int> next(0);
+	std::atomic<bool> canceled(false);
+	std::mutex mutex;
+	std::condition_variable measured;
+	int done = 0;
+	std::vector<std::thread> threads;
+	for (int t = 0; t < max_threads; t++) {
+		threads.emplace_back([&]() {
+			int index;
+			while (!canceled && (index = next++) < total) {
+				subframe_quality *quality = &frames[pending[index]];
+				subframe_quality result = *quality;
+				const bool success = measure(m_directory + "/" + quality->file_name, &result);
+				result.status = success ? SUBFRAME_MEASURED : SUBFRAME_FAILED;
+				std::lock_guard<std::mutex> lock(mutex);
+				*quality = result;
+				done++;
+				measured.notify_one();
+			}
+		});
+	}
+
+	// progress is reported from the calling thread, it may update the UI
+	std::unique_lock<std::mutex> lock(mutex);
+	while (done < total) {
+		measured.wait_for(lock, std::chrono::milliseconds(100));
+		const int reported = done;
+		lock.unlock();
+		if (progress && !progress(reported, total)) canceled = true;
+		lock.lock();
+		if (canceled) break;
+	}
+	lock.unlock();
+	for (auto &thread : threads) {
+		thread.join();
+	}
+	indigo_log("Subframes: %d of %d frames measured in '%s'\n", done, total, m_directory.toUtf8().constData());
+	save_cache();
+	return !canceled;
+}
+
+static void median_mad(std::vector<double> &values, double *median, double *sigma) {
+	const size_t middle = values.size() / 2;
+	std::nth_element(values.begin(), values.begin() + middle, values.end());
+	*median = values[middle];
+	for (double &value : values) {
+		value = fabs(value - *median);
+	}
+	std::nth_element(values.begin(), values.begin() + middle, values.end());
+	*sigma = 1.4826 * values[middle];
+}
+
+int SubframeAnalyzer::reject_outliers(double kappa) {
+	std::vector<double> stars, hfd, fwhm, eccentricity;
+	for (const subframe_quality &quality : m_frames) {
+		if (quality.status != SUBFRAME_MEASURED) continue;
+		stars.push_back(quality.stars);
+		hfd.push_back(quality.hfd);
+		fwhm.push_back(quality.fwhm);
+		eccentricity.push_back(quality.eccentricity);
+	}
+	// too few frames to tell the outliers
+	if (stars.size() < 3) return 0;
+	double stars_median, stars_sigma, hfd_median, hfd_sigma, fwhm_median, fwhm_sigma, ecc_median, ecc_sigma;
+	median_mad(stars, &stars_median, &stars_sigma);
+	median_mad(hfd, &hfd_median, &hfd_sigma);
+	median_mad(fwhm, &fwhm_median, &fwhm_sigma);
+	median_mad(eccentricity, &ecc_median, &ecc_sigma);
+
+	int count = 0;
+	for (subframe_quality &quality : m_frames) {
+		if (quality.status != SUBFRAME_MEASURED || quality.rejected) continue;
+		// a zero MAD means most frames are identical in the measure, it tells nothing
+		if ((stars_sigma > 0 && quality.stars < stars_median - kappa * stars_sigma) ||
+		    (hfd_sigma > 0 && quality.hfd > hfd_median + kappa * hfd_sigma) ||
+		    (fwhm_sigma > 0 && quality.fwhm > fwhm_median + kappa * fwhm_sigma) ||
+		    (ecc_sigma > 0 && quality.eccentricity > ecc_median + kappa * ecc_sigma)) {
+			quality.rejected = true;
+			count++;
+		}
+	}
+	save_cache();
+	return count;
+}
+
+int SubframeAnalyzer::move_rejected() {
+	QDir directory(m_directory);
+	if (!directory.mkpath(SUBFRAME_REJECTED_DIR)) {
+		indigo_error("Subframes: Can not create '%s/%s'\n", m_directory.toUtf8().constData(), SUBFRAME_REJECTED_DIR);
+		return 0;
+	}
+	int count = 0;
+	for (int i = m_frames.size() - 1; i >= 0; i--) {
+		if (!m_frames[i].rejected) continue;
+		const QString &name = m_frames[i].file_name;
+		if (directory.rename(name, QString(SUBFRAME_REJECTED_DIR) + "/" + name)) {
+			m_frames.remove(i);
+			count++;
+		} else {
+			indigo_error("Subframes: Can not move '%s' to '%s'\n", name.toUtf8().constData(), SUBFRAME_REJECTED_DIR);
+		}
+	}
+	save_cache();
+	return count;
+}
@@ -0,0 +1,88 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _SUBFRAMEANALYZER_H
+#define _SUBFRAMEANALYZER_H
+
+#include <functional>
+#include <QString>
+#include <QVector>
+#include <QHash>
+
+/* Measures the frames of a session directory to find the ones to reject.
+   The frames are measured in parallel, one per thread, each with a single
+   threaded star detection. CFA frames are binned 2x2 before the detection
+   and planar RGB frames are averaged, the HFD and FWHM are in sensor pixels
+   in every case. The results are cached in SUBFRAME_CACHE_FILENAME in the
+   directory, a frame is measured again only if its size or modification
+   time changed, so a rescan of an analyzed directory is instant. */
+
+#define SUBFRAME_CACHE_FILENAME "ain_subframes.csv"
+#define SUBFRAME_REJECTED_DIR "rejected"
+#define SUBFRAME_MAX_THREADS 8          /* each thread holds a whole frame in memory */
+#define SUBFRAME_REJECT_KAPPA 3.0       /* MADs from the median */
+
+typedef enum {
+	SUBFRAME_PENDING = 0,
+	SUBFRAME_MEASURED,
+	SUBFRAME_FAILED                     /* not a supported frame, not measured again */
+} subframe_status;
+
+typedef struct {
+	QString file_name;      /* relative to the directory */
+	qint64 size;
+	qint64 modified;        /* ms since the epoch */
+	subframe_status status;
+	bool rejected;
+	int stars;
+	double hfd;
+	double fwhm;
+	double eccentricity;
+	double background;
+	double noise;
+} subframe_quality;
+
+class SubframeAnalyzer {
+public:
+	SubframeAnalyzer(const QString &directory);
+
+	const QString &directory() const { return m_directory; }
+	/* in file name order, which is the acquisition order for the usual names */
+	QVector<subframe_quality> &frames() { return m_frames; }
+
+	/* lists the FITS and XISF files of the directory with the cached results, returns the count of frames to measure */
+	int scan();
+	/* progress is called with the frames measured so far, returning false cancels, the results are cached in both cases */
+	bool analyze(std::function<bool(int done, int total)> progress = nullptr);
+	bool save_cache();
+
+	/* marks the frames with too few stars or too large HFD, FWHM or eccentricity, returns the count newly marked */
+	int reject_outliers(double kappa = SUBFRAME_REJECT_KAPPA);
+	/* moves the rejected frames to SUBFRAME_REJECTED_DIR and drops them from the list, returns the count moved */
+	int move_rejected();
+
+	static bool measure(const QString &file_name, subframe_quality *quality);
+
+private:
+	QString m_directory;
+	QVector<subframe_quality> m_frames;
+
+	void load_cache(QHash<QString, subframe_quality> &cache);
+};
+
+#endif /* _SUBFRAMEANALYZER_H */
@@ -0,0 +1,301 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+#include <QHeaderView>
+#include <QMessageBox>
+#include <QDir>
+#include "subframedialog.h"
+
+enum {
+	COLUMN_FILE = 0,
+	COLUMN_STARS,
+	COLUMN_HFD,
+	COLUMN_FWHM,
+	COLUMN_ECCENTRICITY,
+	COLUMN_BACKGROUND,
+	COLUMN_NOISE,
+	COLUMN_COUNT
+};
+
+static const char *column_names[COLUMN_COUNT] = { "File", "Stars", "HFD", "FWHM", "Eccentricity", "Background", "Noise" };
+
+static double metric_value(const subframe_quality &quality, int column) {
+	switch (column) {
+		case COLUMN_STARS: return quality.stars;
+		case COLUMN_HFD: return quality.hfd;
+		case COLUMN_FWHM: return quality.fwhm;
+		case COLUMN_ECCENTRICITY: return quality.eccentricity;
+		case COLUMN_BACKGROUND: return quality.background;
+		case COLUMN_NOISE: return quality.noise;
+	}
+	return 0;
+}
+
+/* sorted by the value, not by the text */
+class NumberItem : public QTableWidgetItem {
+public:
+	NumberItem(double value, int decimals) : QTableWidgetItem(QString::number(value, 'f', decimals)) {
+		setData(Qt::UserRole, value);
+		setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+		setFlags(flags() & ~Qt::ItemIsEditable);
+	}
+
+	bool operator<(const QTableWidgetItem &other) const {
+		return data(Qt::UserRole).toDouble() < other.data(Qt::UserRole).toDouble();
+	}
+};
+
+SubframeDialog::SubframeDialog(QWidget *parent): QDialog(parent) {
+	setWindowTitle(tr("Subframe Analysis"));
+	m_analyzer = nullptr;
+
+	m_summary = new QLabel;
+
+	m_table = new QTableWidget(0, COLUMN_COUNT);
+	for (int column = 0; column < COLUMN_COUNT; column++) {
+		m_table->setHorizontalHeaderItem(column, new QTableWidgetItem(tr(column_names[column])));
+	}
+	m_table->horizontalHeader()->setSectionResizeMode(COLUMN_FILE, QHeaderView::Stretch);
+	m_table->verticalHeader()->setVisible(false);
+	m_table->setSelectionBehavior(QAbstractItemView::SelectRows);
+	m_table->setSelectionMode(QAbstractItemView::SingleSelection);
+	m_table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+
+	m_metric = new QComboBox;
+	for (int column = COLUMN_STARS; column < COLUMN_COUNT; column++) {
+		m_metric->addItem(tr(column_names[column]), column);
+	}
+	m_metric->setCurrentIndex(COLUMN_HFD - COLUMN_STARS);
+
+	m_plot = new QCustomPlot;
+	m_plot->setMinimumHeight(180);
+	m_plot->setBackground(QBrush(QColor(0, 0, 0, 0)));
+	QPen axis_pen(QColor(150, 150, 150));
+	m_plot->xAxis->setBasePen(axis_pen);
+	m_plot->xAxis->setTickPen(axis_pen);
+	m_plot->xAxis->setSubTickPen(axis_pen);
+	m_plot->yAxis->setBasePen(axis_pen);
+	m_plot->yAxis->setTickPen(axis_pen);
+	m_plot->yAxis->setSubTickPen(axis_pen);
+	m_plot->xAxis->setTickLabelColor(QColor(255, 255, 255));
+	m_plot->yAxis->setTickLabelColor(QColor(255, 255, 255));
+	m_plot->xAxis->setLabelColor(QColor(255, 255, 255));
+	m_plot->xAxis->setLabel(tr("Frame"));
+	// accepted and rejected frames
+	m_plot->addGraph();
+	m_plot->graph(0)->setPen(QPen(QColor(3, 172, 240)));
+	m_plot->graph(0)->setLineStyle(QCPGraph::lsNone);
+	m_plot->graph(0)->setScatterStyle(QCPScatterStyle(QCPScatterStyle::ssDisc, 6));
+	m_plot->addGraph();
+	m_plot->graph(1)->setPen(QPen(Qt::red));
+	m_plot->graph(1)->setLineStyle(QCPGraph::lsNone);
+	m_plot->graph(1)->setScatterStyle(QCPScatterStyle(QCPScatterStyle::ssDisc, 6));
+
+	m_reject_button = new QPushButton(tr("Reject Outliers"));
+	m_reject_button->setToolTip(tr("Mark the frames with too few stars or too large HFD, FWHM or eccentricity"));
+	m_move_button = new QPushButton(tr("Move Rejected"));
+	m_move_button->setToolTip(tr("Move the marked frames to the '%1' subdirectory").arg(SUBFRAME_REJECTED_DIR));
+	m_close_button = new QPushButton(tr("Close"));
+
+	QHBoxLayout *plot_bar = new QHBoxLayout;
+	plot_bar->addWidget(new QLabel(tr("Plot:")));
+	plot_bar->addWidget(m_metric);
+	plot_bar->addStretch();
+
+	QHBoxLayout *button_bar = new QHBoxLayout;
+	button_bar->addWidget(m_reject_button);
+	button_bar->addWidget(m_move_button);
+	button_bar->addStretch();
+	button_bar->addWidget(m_close_button);
+
+	QVBoxLayout *main_layout = new QVBoxLayout;
+	main_layout->setContentsMargins(5, 5, 5, 5);
+	main_layout->addWidget(m_summary);
+	main_layout->addWidget(m_table, 3);
+	main_layout->addLayout(plot_bar);
+	main_layout->addWidget(m_plot, 2);
+	main_layout->addLayout(button_bar);
+	setLayout(main_layout);
+	setMinimumWidth(750);
+	setMinimumHeight(600);
+
+	connect(m_metric, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &SubframeDialog::on_metric_changed);
+	connect(m_table, &QTableWidget::itemChanged, this, &SubframeDialog::on_item_changed);
+	connect(m_table, &QTableWidget::cellDoubleClicked, this, &SubframeDialog::on_cell_double_clicked);
+	connect(m_plot, &QCustomPlot::plottableClick, this, &SubframeDialog::on_plot_clicked);
+	connect(m_reject_button, &QPushButton::clicked, this, &SubframeDialog::on_reject_outliers);
+	connect(m_move_button, &QPushButton::clicked, this, &SubframeDialog::on_move_rejected);
+	connect(m_close_button, &QPushButton::clicked, this, &SubframeDialog::close);
+}
+
+SubframeDialog::~SubframeDialog() {
+	delete m_analyzer;
+}
+
+void SubframeDialog::set_analyzer(SubframeAnalyzer *analyzer) {
+	delete m_analyzer;
+	m_analyzer = analyzer;
+	setWindowTitle(tr("Subframe Analysis: ") + QDir::toNativeSeparators(analyzer->directory()));
+	fill_table();
+	update_plot();
+	update_summary();
+}
+
+void SubframeDialog::fill_table() {
+	QSignalBlocker blocker(m_table);
+	m_table->setSortingEnabled(false);
+	m_table->setRowCount(0);
+	if (m_analyzer == nullptr) return;
+
+	const QVector<subframe_quality> &frames = m_analyzer->frames();
+	m_table->setRowCount(frames.size());
+	for (int i = 0; i < frames.size(); i++) {
+		const subframe_quality &quality = frames[i];
+		QTableWidgetItem *item = new QTableWidgetItem(quality.file_name);
+		item->setData(Qt::UserRole, i);
+		item->setFlags((item->flags() | Qt::ItemIsUserCheckable) & ~Qt::ItemIsEditable);
+		item->setCheckState(quality.rejected ? Qt::Checked : Qt::Unchecked);
+		m_table->setItem(i, COLUMN_FILE, item);
+		for (int column = COLUMN_STARS; column < COLUMN_COUNT; column++) {
+			if (quality.status == SUBFRAME_MEASURED) {
+				m_table->setItem(i, column, new NumberItem(metric_value(quality, column), column == COLUMN_STARS ? 0 : 2));
+			} else {
+				// failed frames sort first
+				NumberItem *failed = new NumberItem(-1, 0);
+				failed->setText("-");
+				m_table->setItem(i, column, failed);
+			}
+		}
+	}
+	m_table->setSortingEnabled(true);
+	m_table->resizeColumnsToContents();
+	m_table->horizontalHeader()->setSectionResizeMode(COLUMN_FILE, QHeaderView::Stretch);
+}
+
+void SubframeDialog::update_plot() {
+	QVector<double> keys[2], values[2];
+	if (m_analyzer) {
+		const int column = m_metric->currentData().toInt();
+		const QVector<subframe_quality> &frames = m_analyzer->frames();
+		for (int i = 0; i < frames.size(); i++) {
+			if (frames[i].status != SUBFRAME_MEASURED) continue;
+			const int graph = frames[i].rejected ? 1 : 0;
+			keys[graph].append(i + 1);
+			values[graph].append(metric_value(frames[i], column));
+		}
+	}
+	m_plot->graph(0)->setData(keys[0], values[0]);
+	m_plot->graph(1)->setData(keys[1], values[1]);
+	m_plot->rescaleAxes();
+	// some space around the points at the edges
+	QCPRange range = m_plot->yAxis->range();
+	const double margin = range.size() > 0 ? range.size() * 0.1 : 1;
+	m_plot->yAxis->setRange(range.lower - margin, range.upper + margin);
+	range = m_plot->xAxis->range();
+	m_plot->xAxis->setRange(range.lower - 1, range.upper + 1);
+	m_plot->replot();
+}
+
+void SubframeDialog::update_summary() {
+	if (m_analyzer == nullptr) {
+		m_summary->clear();
+		return;
+	}
+	int measured = 0, rejected = 0, failed = 0;
+	for (const subframe_quality &quality : m_analyzer->frames()) {
+		if (quality.status == SUBFRAME_MEASURED) measured++;
+		if (quality.status == SUBFRAME_FAILED) failed++;
+		if (quality.rejected) rejected++;
+	}
+	QString summary = tr("%1 frames measured, %2 rejected").arg(measured).arg(rejected);
+	if (failed) summary += tr(", %1 not supported").arg(failed);
+	m_summary->setText(summary);
+	m_move_button->setEnabled(rejected > 0);
+}
+
+void SubframeDialog::on_metric_changed(int index) {
+	Q_UNUSED(index);
+	update_plot();
+}
+
+void SubframeDialog::on_item_changed(QTableWidgetItem *item) {
+	if (m_analyzer == nullptr || item->column() != COLUMN_FILE) return;
+	subframe_quality &quality = m_analyzer->frames()[item->data(Qt::UserRole).toInt()];
+	quality.rejected = item->checkState() == Qt::Checked;
+	m_analyzer->save_cache();
+	update_plot();
+	update_summary();
+}
+
+void SubframeDialog::on_cell_double_clicked(int row, int column) {
+	Q_UNUSED(column);
+	if (m_analyzer == nullptr) return;
+	const int index = m_table->item(row, COLUMN_FILE)->data(Qt::UserRole).toInt();
+	emit open_frame(m_analyzer->directory() + "/" + m_analyzer->frames()[index].file_name);
+}
+
+// the frame of the clicked point is selected in the table and opened
+void SubframeDialog::on_plot_clicked(QCPAbstractPlottable *plottable, QMouseEvent *event) {
+	Q_UNUSED(plottable);
+	if (m_analyzer == nullptr) return;
+	const int index = qRound(m_plot->xAxis->pixelToCoord(event->pos().x())) - 1;
+	if (index < 0 || index >= m_analyzer->frames().size()) return;
+	for (int row = 0; row < m_table->rowCount(); row++) {
+		if (m_table->item(row, COLUMN_FILE)->data(Qt::UserRole).toInt() == index) {
+			m_table->selectRow(row);
+			m_table->scrollToItem(m_table->item(row, COLUMN_FILE));
+			break;
+		}
+	}
+	emit open_frame(m_analyzer->directory() + "/" + m_analyzer->frames()[index].file_name);
+}
+
+void SubframeDialog::on_reject_outliers() {
+	if (m_analyzer == nullptr) return;
+	int count = m_analyzer->reject_outliers();
+	fill_table();
+	update_plot();
+	update_summary();
+	if (count == 0) {
+		QMessageBox::information(this, tr("Reject Outliers"), tr("No outliers found."));
+	}
+}
+
+void SubframeDialog::on_move_rejected() {
+	if (m_analyzer == nullptr) return;
+	QMessageBox::StandardButton answer = QMessageBox::question(
+		this,
+		tr("Move Rejected"),
+		tr("Move the rejected frames to '%1'?").arg(QDir::toNativeSeparators(m_analyzer->directory() + "/" + SUBFRAME_REJECTED_DIR)),
+		QMessageBox::Yes | QMessageBox::No
+	);
+	if (answer != QMessageBox::Yes) return;
+	int rejected = 0;
+	for (const subframe_quality &quality : m_analyzer->frames()) {
+		if (quality.rejected) rejected++;
+	}
+	int moved = m_analyzer->move_rejected();
+	fill_table();
+	update_plot();
+	update_summary();
+	if (moved < rejected) {
+		QMessageBox::warning(this, tr("Move Rejected"), tr("%1 of %2 frames could not be moved.").arg(rejected - moved).arg(rejected));
+	}
+}
@@ -0,0 +1,70 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _SUBFRAMEDIALOG_H
+#define _SUBFRAMEDIALOG_H
+
+#include <QDialog>
+#include <QTableWidget>
+#include <QComboBox>
+#include <QPushButton>
+#include <QLabel>
+#include <qcustomplot/qcustomplot.h>
+#include "subframeanalyzer.h"
+
+/* The results of a SubframeAnalyzer as a sortable table and a plot of one
+   measure in acquisition order. The check box of a frame marks it rejected,
+   the marks are kept in the cache of the directory. */
+
+class SubframeDialog : public QDialog
+{
+	Q_OBJECT
+public:
+	SubframeDialog(QWidget *parent = 0);
+	~SubframeDialog();
+
+	/* takes the ownership of the analyzer */
+	void set_analyzer(SubframeAnalyzer *analyzer);
+
+signals:
+	void open_frame(QString file_name);
+
+private slots:
+	void on_metric_changed(int index);
+	void on_item_changed(QTableWidgetItem *item);
+	void on_cell_double_clicked(int row, int column);
+	void on_plot_clicked(QCPAbstractPlottable *plottable, QMouseEvent *event);
+	void on_reject_outliers();
+	void on_move_rejected();
+
+private:
+	SubframeAnalyzer *m_analyzer;
+	QLabel *m_summary;
+	QTableWidget *m_table;
+	QComboBox *m_metric;
+	QCustomPlot *m_plot;
+	QPushButton *m_reject_button;
+	QPushButton *m_move_button;
+	QPushButton *m_close_button;
+
+	void fill_table();
+	void update_plot();
+	void update_summary();
+};
+
+#endif /* _SUBFRAMEDIALOG_H */
@@ -31,6 +31,11 @@
 #include <dslr_raw.h>
 #include <image_stats.h>
 #include <xisf.h>
+#include <masterbuilder.h>
+#include <stardetector.h>
+#include <calibration.h>
+#include <QInputDialog>
+#include <QFileInfo>
 
 
 void write_conf();
@@ -48,6 +53,8 @@ ViewerWindow::ViewerWindow(QWidget *parent) : QMainWindow(parent) {
 	m_image_formrat = nullptr;
 	m_image_path[0] = '\0';
 	m_preview_image = nullptr;
+	// the singleton is created here, create_preview() only looks it up
+	CalibrationLibrary::instance();
 
 	QIcon icon(":resource/ain_viewer.png");
 	this->setWindowIcon(icon);
@@ -59,6 +66,8 @@ ViewerWindow::ViewerWindow(QWidget *parent) : QMainWindow(parent) {
 	f.close();
 
 	m_image_info_dlg = new TextDialog("Image Info", this);
+	m_subframe_dlg = new SubframeDialog(this);
+	connect(m_subframe_dlg, &SubframeDialog::open_frame, this, &ViewerWindow::open_image);
 
 	//  Set central widget of window
 	QWidget *central = new QWidget;
@@ -110,6 +119,12 @@ ViewerWindow::ViewerWindow(QWidget *parent) : QMainWindow(parent) {
 	//act->setShortcutVisibleInContextMenu(true);
 	connect(act, &QAction::triggered, this, &ViewerWindow::on_image_raw_to_fits);
 
+	act = menu->addAction(tr("Build &Master Frame..."));
+	connect(act, &QAction::triggered, this, &ViewerWindow::on_build_master_act);
+
+	act = menu->addAction(tr("&Analyze Subframes..."));
+	connect(act, &QAction::triggered, this, &ViewerWindow::on_analyze_subframes_act);
+
 	menu->addSeparator();
 
 	act = menu->addAction(tr("&Delete File"));
@@ -147,6 +162,11 @@ ViewerWindow::ViewerWindow(QWidget *parent) : QMainWindow(parent) {
 	act->setChecked(conf.show_reference);
 	connect(act, &QAction::toggled, this, &ViewerWindow::on_viewer_show_reference);
 
+	act = menu->addAction(tr("Detect &stars"));
+	act->setCheckable(true);
+	act->setChecked(conf.detect_stars);
+	connect(act, &QAction::toggled, this, &ViewerWindow::on_detect_stars);
+
 	menu->addSeparator();
 
 	act = menu->addAction(tr("Enable &antialiasing"));
@@ -175,6 +195,42 @@ ViewerWindow::ViewerWindow(QWidget *parent) : QMainWindow(parent) {
 	m_imager_viewer->setToolBarMode(ImageViewer::ToolBarMode::Visible);
 	form_layout->addWidget((QWidget*)m_imager_viewer);
 	m_imager_viewer->setMinimumWidth(PROPERTY_AREA_MIN_WIDTH);
+
+	// SER video controls, shown with videos only
+	m_ser_player = new SerPlayer(this);
+	m_video_bar = new QWidget();
+	QHBoxLayout *video_layout = new QHBoxLayout(m_video_bar);
+	video_layout->setContentsMargins(0, 0, 0, 0);
+	m_play_button = new QPushButton();
+	m_play_button->setIcon(QIcon(":resource/play.png"));
+	m_play_button->setToolTip("Play / pause");
+	video_layout->addWidget(m_play_button);
+	m_frame_slider = new QSlider(Qt::Horizontal);
+	m_frame_slider->setTracking(true);
+	video_layout->addWidget(m_frame_slider, 1);
+	m_frame_label = new QLabel();
+	video_layout->addWidget(m_frame_label);
+	form_layout->addWidget(m_video_bar);
+	m_video_bar->setVisible(false);
+	m_scrub_frame = 0;
+	m_scrub_timer.setSingleShot(true);
+	m_scrub_timer.setInterval(0);
+
+	connect(m_play_button, &QPushButton::clicked, this, &ViewerWindow::on_play_pause);
+	connect(m_frame_slider, &QSlider::valueChanged, this, &ViewerWindow::on_frame_selected);
+	connect(m_ser_player, &SerPlayer::frame_ready, this, &ViewerWindow::on_frame_ready);
+	connect(m_ser_player, &SerPlayer::playing_changed, this, &ViewerWindow::on_playing_changed);
+	// decode only the last of the frames selected while scrubbing
+	connect(&m_scrub_timer, &QTimer::timeout, this, [this]() {
+		preview_image *preview = m_ser_player->frame_preview(m_scrub_frame);
+		if (preview) show_frame_preview(preview, m_scrub_frame);
+	});
+
+	m_master_builder = nullptr;
+	m_master_progress = nullptr;
+	m_master_canceled = false;
+	connect(&m_master_watcher, &QFutureWatcher<bool>::finished, this, &ViewerWindow::on_master_built);
+
 	rootLayout->addWidget(form_panel);
 
 	m_imager_viewer->setStretch(conf.preview_stretch_level);
@@ -198,10 +254,17 @@ ViewerWindow::~ViewerWindow () {
 	conf.window_width = wsize.width();
 	conf.window_height = wsize.height();
 	write_conf();
+	close_video();
+	if (m_master_builder) {
+		m_master_canceled = true;
+		m_master_watcher.waitForFinished();
+		delete m_master_builder;
+	}
 	if (m_image_data) free(m_image_data);
 	delete m_preview_image;
 	delete m_imager_viewer;
 	delete m_image_info_dlg;
+	delete m_subframe_dlg;
 }
 
 /* C++ looks for method close - maybe name collision so... */
@@ -212,6 +275,11 @@ void close_fd(int fd) {
 void ViewerWindow::open_image(QString file_name) {
 	char msg[PATH_LEN];
 	if (file_name == "") return;
+	if (file_name.endsWith(".ser", Qt::CaseInsensitive)) {
+		open_video(file_name);
+		return;
+	}
+	close_video();
 	FILE *file;
 	block_scrolling(true);
 	strncpy(m_image_path, file_name.toUtf8().data(), PATH_LEN);
@@ -264,13 +332,9 @@ void ViewerWindow::open_image(QString file_name) {
 		fwrite(m_preview_image->m_raw_data, m_preview_image->m_width*m_preview_image->m_height*2, 1, file);
 		fclose(file);
 		*/
-	
-		char info[256] = {};
-		int w = m_preview_image->width();
-		int h = m_preview_image->height();
-		sprintf(info, "%s [%d x %d]", basename(m_image_path), w, h);
+
 		setWindowTitle(tr("Ain Viewer - ") + QString(m_image_path));
-		m_imager_viewer->setText(info);
+		show_image_info();
 	} else {
 		block_scrolling(false);
 		snprintf(msg, PATH_LEN, "File: '%s'\nDoes not seem to be a supported image format.", QDir::toNativeSeparators(m_image_path).toUtf8().data());
@@ -282,9 +346,145 @@ void ViewerWindow::open_image(QString file_name) {
 	m_image_list = directory.entryList(QStringList() << pattern, QDir::Files);
 }
 
+void ViewerWindow::open_video(QString file_name) {
+	char msg[PATH_LEN];
+	close_video();
+	block_scrolling(true);
+	strncpy(m_image_path, file_name.toUtf8().data(), PATH_LEN);
+	strncpy(conf.file_open, file_name.toUtf8().data(), PATH_LEN);
+	if (m_image_data) {
+		free(m_image_data);
+		m_image_data = nullptr;
+		m_image_size = 0;
+	}
+	m_image_formrat = strrchr(m_image_path, '.');
+
+	const stretch_config_t sc = {(uint8_t)conf.preview_stretch_level, (uint8_t)conf.preview_color_balance, conf.preview_bayer_pattern};
+	preview_image *preview = nullptr;
+	if (m_ser_player->open(m_image_path)) {
+		m_ser_player->set_stretch_config(sc);
+		preview = m_ser_player->frame_preview(0);
+	}
+	block_scrolling(false);
+	if (preview == nullptr) {
+		m_ser_player->close();
+		snprintf(msg, PATH_LEN, "File: '%s'\nDoes not seem to be a supported SER video.", QDir::toNativeSeparators(m_image_path).toUtf8().data());
+		show_message("Error!", msg);
+	} else {
+		QSignalBlocker blocker(m_frame_slider);
+		m_frame_slider->setRange(0, m_ser_player->file().frame_count() - 1);
+		m_frame_slider->setValue(0);
+		m_video_bar->setVisible(true);
+		show_frame_preview(preview, 0);
+		m_imager_viewer->centerReference();
+		setWindowTitle(tr("Ain Viewer - ") + QString(m_image_path));
+	}
+	QDir directory(dirname(file_name.toUtf8().data()));
+	QString pattern = "*" + QString(m_image_formrat);
+	m_image_list = directory.entryList(QStringList() << pattern, QDir::Files);
+}
+
+void ViewerWindow::close_video() {
+	if (!m_ser_player->is_open()) return;
+	m_scrub_timer.stop();
+	m_ser_player->close();
+	m_video_bar->setVisible(false);
+}
+
+void ViewerWindow::show_frame_preview(preview_image *preview, int frame) {
+	if (m_preview_image) delete m_preview_image;
+	m_preview_image = preview;
+	m_imager_viewer->setImage(*m_preview_image);
+
+	ImageStats stats;
+	if (conf.statistics_enabled) {
+		stats = imageStats((const uint8_t*)(m_preview_image->m_raw_data), m_preview_image->m_width, m_preview_image->m_height, m_preview_image->m_pix_format);
+	}
+	m_imager_viewer->setImageStats(stats);
+	// the video frames change too fast to be measured
+	m_imager_viewer->setStars(std::vector<detected_star>());
+
+	char info[256] = {};
+	sprintf(info, "%s [%d x %d] %d / %d", basename(m_image_path), m_preview_image->width(), m_preview_image->height(), frame + 1, m_ser_player->file().frame_count());
+	m_imager_viewer->setText(info);
+
+	QString label = QString::number(frame + 1) + " / " + QString::number(m_ser_player->file().frame_count());
+	int64_t timestamp = m_ser_player->file().timestamp(frame);
+	if (timestamp > 0) {
+		label += "  " + QDateTime::fromMSecsSinceEpoch(timestamp / 1000, Qt::UTC).toString("hh:mm:ss.zzz") + " UTC";
+	}
+	m_frame_label->setText(label);
+}
+
+void ViewerWindow::on_frame_selected(int frame) {
+	m_ser_player->pause();
+	m_scrub_frame = frame;
+	if (!m_scrub_timer.isActive()) m_scrub_timer.start();
+}
+
+void ViewerWindow::on_frame_ready(preview_image *preview, int frame) {
+	QSignalBlocker blocker(m_frame_slider);
+	m_frame_slider->setValue(frame);
+	show_frame_preview(preview, frame);
+}
+
+void ViewerWindow::on_play_pause(bool clicked) {
+	Q_UNUSED(clicked);
+	if (m_ser_player->is_playing()) {
+		m_ser_player->pause();
+	} else {
+		m_ser_player->play();
+	}
+}
+
+void ViewerWindow::on_playing_changed(bool playing) {
+	m_play_button->setIcon(QIcon(playing ? ":resource/pause.png" : ":resource/play.png"));
+}
+
 void ViewerWindow::on_image_info_act() {
 	char *card = (char*)m_image_data;
 	char *end = card + m_image_size;
+	if (m_ser_player->is_open()) {
+		static const char *color_names[] = { "Mono", "Bayer RGGB", "Bayer GRBG", "Bayer GBRG", "Bayer BGGR", "RGB", "BGR" };
+		const ser_header &header = m_ser_player->file().header();
+		int color_index = 0;
+		if (header.color_id >= SER_BAYER_RGGB && header.color_id <= SER_BAYER_BGGR) color_index = header.color_id - SER_BAYER_RGGB + 1;
+		else if (header.color_id == SER_RGB) color_index = 5;
+		else if (header.color_id == SER_BGR) color_index = 6;
+
+		m_image_info_dlg->setWindowTitle(QString("Video Info: ") + QString(basename(m_image_path)));
+		auto text = m_image_info_dlg->textWidget();
+		text->clear();
+		if (header.instrument[0] != '\0') {
+			text->append(QString("<b>Camera:</b> ") + header.instrument);
+		}
+		if (header.telescope[0] != '\0') {
+			text->append(QString("<b>Telescope:</b> ") + header.telescope);
+		}
+		if (header.observer[0] != '\0') {
+			text->append(QString("<b>Observer:</b> ") + header.observer);
+		}
+		text->append(QString("<b>Frame Dimensions:</b> ") + QString::number(header.width) + " x " + QString::number(header.height));
+		text->append(QString("<b>Color:</b> ") + color_names[color_index]);
+		text->append(QString("<b>Pixel Depth:</b> ") + QString::number(header.pixel_depth) + " bit");
+		text->append(QString("<b>Frames:</b> ") + QString::number(m_ser_player->file().frame_count()));
+		if (header.date_time_utc > 0) {
+			QDateTime start = QDateTime::fromMSecsSinceEpoch(ser_unix_us_from_ticks(header.date_time_utc) / 1000, Qt::UTC);
+			text->append(QString("<b>Start time:</b> ") + start.toString("yyyy-MM-dd hh:mm:ss.zzz") + " UTC");
+		}
+		double interval = m_ser_player->file().frame_interval();
+		if (interval > 0) {
+			text->append(QString("<b>Frame rate:</b> ") + QString::number(1 / interval, 'f', 2) + " fps");
+			text->append(QString("<b>Duration:</b> ") + QString::number(interval * (m_ser_player->file().frame_count() - 1), 'f', 2) + " sec");
+		} else {
+			text->append(QString("<b>Timestamps:</b> None"));
+		}
+		text->append("");
+		text->append(QString("<b>Frame size:</b> ") + QString::number(m_ser_player->file().frame_size()) + " (" + QString::number(m_ser_player->file().frame_size()/(1024.0*1024)) + " MB)");
+		m_image_info_dlg->show();
+		m_image_info_dlg->scrollTop();
+		return;
+	}
 	if (m_image_data == nullptr) return;
 	if (!strncmp(card, "SIMPLE", 6)) {
 		if (m_image_size < 2880) return;
@@ -559,6 +759,7 @@ void ViewerWindow::on_image_prev_act() {
 }
 
 void ViewerWindow::on_image_close_act() {
+	close_video();
 	setWindowTitle(tr("Ain Viewer"));
 	m_imager_viewer->setText("");
 	m_imager_viewer->setToolTip("");
@@ -567,6 +768,7 @@ void ViewerWindow::on_image_close_act() {
 		m_preview_image = nullptr;
 		m_imager_viewer->setImageStats(ImageStats());
 	}
+	m_imager_viewer->setStars(std::vector<detected_star>());
 	preview_image *pi = new preview_image();
 	m_imager_viewer->setImage(*pi);
 	delete pi;
@@ -642,6 +844,120 @@ void ViewerWindow::on_image_raw_to_fits() {
 	}
 }
 
+void ViewerWindow::on_build_master_act() {
+	if (m_master_builder) {
+		m_master_progress->raise();
+		return;
+	}
+	char path[PATH_LEN];
+	strncpy(path, m_image_path, PATH_LEN);
+	QString qlocation(dirname(path));
+	if (m_image_path[0] == '\0') qlocation = QDir::toNativeSeparators(QDir::homePath());
+	QStringList file_names = QFileDialog::getOpenFileNames(
+		this,
+		tr("Select frames to combine..."),
+		qlocation,
+		QString("FITS and XISF (*.fits *.fit *.fts *.FITS *.FIT *.FTS *.xisf *.XISF);;All Files (*)")
+	);
+	if (file_names.isEmpty()) return;
+
+	MasterBuilder *builder = new MasterBuilder();
+	for (const QString &file_name : file_names) {
+		if (!builder->add_file(file_name.toUtf8().constData())) {
+			show_message("Error!", builder->error().toUtf8().constData());
+			delete builder;
+			return;
+		}
+	}
+
+	QStringList methods = { tr("Sigma-clipped mean"), tr("Median") };
+	bool ok = false;
+	QString method = QInputDialog::getItem(this, tr("Build Master Frame"), tr("Combine %1 frames with:").arg(builder->frame_count()), methods, 0, false, &ok);
+	if (!ok) {
+		delete builder;
+		return;
+	}
+	builder->set_combine(method == methods[1] ? MASTER_MEDIAN : MASTER_SIGMA_CLIPPED_MEAN);
+
+	static const char *type_names[] = { "light", "dark", "flat", "bias", "darkflat" };
+	QString default_name = QFileInfo(file_names.first()).absolutePath() + QString("/master_") + type_names[builder->info().type];
+	if (builder->info().type == CALIBRATION_FLAT && builder->info().filter[0] != '\0') {
+		default_name += QString("_") + builder->info().filter;
+	}
+	QString output_name = QFileDialog::getSaveFileName(this, tr("Save Master Frame As..."), default_name + ".fits", QString("FITS (*.fits)"));
+	if (output_name.isEmpty()) {
+		delete builder;
+		return;
+	}
+
+	// the strips are combined on a worker, the progress comes back with master_progress()
+	m_master_builder = builder;
+	m_master_file_name = output_name;
+	m_master_canceled = false;
+	m_master_progress = new QProgressDialog(tr("Combining %1 frames...").arg(builder->frame_count()), "Abort", 0, 100, this);
+	m_master_progress->setMinimumWidth(350);
+	m_master_progress->setMinimumDuration(0);
+	m_master_progress->setAutoReset(false);
+	m_master_progress->setValue(0);
+	connect(m_master_progress, &QProgressDialog::canceled, this, [this]() {
+		m_master_canceled = true;
+	});
+	connect(this, &ViewerWindow::master_progress, m_master_progress, &QProgressDialog::setValue);
+	QByteArray file_name = output_name.toUtf8();
+	m_master_watcher.setFuture(QtConcurrent::run([this, builder, file_name]() {
+		return builder->build(file_name.constData(), [this](int done, int total) {
+			emit(master_progress(100 * done / total));
+			return !m_master_canceled;
+		});
+	}));
+}
+
+void ViewerWindow::on_master_built() {
+	bool success = m_master_watcher.result();
+	delete m_master_progress;
+	m_master_progress = nullptr;
+	if (success) {
+		open_image(m_master_file_name);
+	} else if (!m_master_canceled) {
+		show_message("Error!", m_master_builder->error().toUtf8().constData());
+	}
+	delete m_master_builder;
+	m_master_builder = nullptr;
+}
+
+void ViewerWindow::on_analyze_subframes_act() {
+	char path[PATH_LEN];
+	strncpy(path, m_image_path, PATH_LEN);
+	QString qlocation(dirname(path));
+	if (m_image_path[0] == '\0') qlocation = QDir::toNativeSeparators(QDir::homePath());
+	QString directory = QFileDialog::getExistingDirectory(this, tr("Select session directory..."), qlocation);
+	if (directory.isEmpty()) return;
+
+	SubframeAnalyzer *analyzer = new SubframeAnalyzer(directory);
+	int pending = analyzer->scan();
+	if (analyzer->frames().isEmpty()) {
+		delete analyzer;
+		show_message("Error!", "No FITS or XISF frames in the selected directory.");
+		return;
+	}
+	if (pending > 0) {
+		QProgressDialog progress(tr("Measuring %1 frames...").arg(pending), "Abort", 0, pending, this);
+		progress.setMinimumWidth(350);
+		progress.setMinimumDuration(0);
+		progress.setWindowModality(Qt::WindowModal);
+		progress.setValue(0);
+		analyzer->analyze([&progress](int done, int total) {
+			Q_UNUSED(total);
+			progress.setValue(done);
+			return !progress.wasCanceled();
+		});
+		progress.setValue(pending);
+	}
+	m_subframe_dlg->set_analyzer(analyzer);
+	m_subframe_dlg->show();
+	m_subframe_dlg->raise();
+}
+
 void ViewerWindow::on_exit_act() {
 	QApplication::quit();
 }
@@ -670,6 +986,35 @@ void ViewerWindow::on_viewer_show_reference(bool status) {
 	indigo_debug("%s\n", __FUNCTION__);
 }
 
+void ViewerWindow::on_detect_stars(bool enabled) {
+	conf.detect_stars = enabled;
+	if (m_preview_image && !m_ser_player->is_open()) {
+		block_scrolling(true);
+		show_image_info();
+		block_scrolling(false);
+	}
+	write_conf();
+}
+
+// the name and the size of a still image, with the star measurements if enabled
+void ViewerWindow::show_image_info() {
+	char info[256] = {};
+	int length = snprintf(info, sizeof(info), "%s [%d x %d]", basename(m_image_path), m_preview_image->width(), m_preview_image->height());
+	std::vector<detected_star> stars;
+	if (conf.detect_stars) {
+		star_detection detection;
+		int count = detect_stars(m_preview_image->m_raw_data, m_preview_image->m_width, m_preview_image->m_height, m_preview_image->m_pix_format, &detection);
+		if (count > 0) {
+			snprintf(info + length, sizeof(info) - length, ", %d stars, HFD %.2f, FWHM %.2f, Ecc %.2f", count, detection.hfd, detection.fwhm, detection.eccentricity);
+			stars.swap(detection.stars);
+		} else if (count == 0) {
+			snprintf(info + length, sizeof(info) - length, ", no stars");
+		}
+	}
+	m_imager_viewer->setStars(stars);
+	m_imager_viewer->setText(info);
+}
+
 void ViewerWindow::on_statistics_show(bool enabled) {
 	conf.statistics_enabled = enabled;
 	if (m_preview_image) {
@@ -684,6 +1029,7 @@ void ViewerWindow::on_statistics_show(bool enabled) {
 
 void ViewerWindow::on_stretch_changed(int level) {
 	conf.preview_stretch_level = (preview_stretch)level;
+	m_ser_player->set_stretch_config({(uint8_t)conf.preview_stretch_level, (uint8_t)conf.preview_color_balance, conf.preview_bayer_pattern});
 	if (m_preview_image) {
 		block_scrolling(true);
 		int width = m_preview_image->width();
@@ -703,7 +1049,12 @@ void ViewerWindow::on_stretch_changed(int level) {
 
 void ViewerWindow::on_debayer_changed(uint32_t bayer_pat) {
 	conf.preview_bayer_pattern = bayer_pat;
-	if (m_preview_image) {
+	if (m_ser_player->is_open()) {
+		// the current frame is decoded again with the new pattern
+		m_ser_player->set_stretch_config({(uint8_t)conf.preview_stretch_level, (uint8_t)conf.preview_color_balance, conf.preview_bayer_pattern});
+		preview_image *preview = m_ser_player->frame_preview(m_ser_player->current_frame());
+		if (preview) show_frame_preview(preview, m_ser_player->current_frame());
+	} else if (m_preview_image) {
 		block_scrolling(true);
 		const stretch_config_t sc = {(uint8_t)conf.preview_stretch_level, (uint8_t)conf.preview_color_balance, conf.preview_bayer_pattern};
 		preview_image *new_preview = create_preview(m_image_data, m_image_size, (const char*)m_image_formrat, sc);
@@ -717,6 +1068,7 @@ void ViewerWindow::on_debayer_changed(uint32_t bayer_pat) {
 				stats = imageStats((const uint8_t*)(m_preview_image->m_raw_data), m_preview_image->m_width, m_preview_image->m_height, m_preview_image->m_pix_format);
 			}
 			m_imager_viewer->setImageStats(stats);
+			show_image_info();
 		}
 		block_scrolling(false);
 	}
@@ -725,6 +1077,7 @@ void ViewerWindow::on_debayer_changed(uint32_t bayer_pat) {
 
 void ViewerWindow::on_cb_changed(int balance) {
 	conf.preview_color_balance = (color_balance)balance;
+	m_ser_player->set_stretch_config({(uint8_t)conf.preview_stretch_level, (uint8_t)conf.preview_color_balance, conf.preview_bayer_pattern});
 	if (m_preview_image) {
 		block_scrolling(true);
 		int width = m_preview_image->width();
@@ -21,6 +21,7 @@
 #define VIEWERWINDOW_H
 
 #include <stdio.h>
+#include <atomic>
 #include <QApplication>
 #include <QMainWindow>
 #include <QComboBox>
@@ -28,6 +29,7 @@
 #include <imageviewer.h>
 #include <imagepreview.h>
 #include <textdialog.h>
+#include <subframedialog.h>
 
 #include <conf.h>
 
@@ -39,8 +41,15 @@
 #include <QProgressDialog>
 #include <QThread>
 #include <QtConcurrentRun>
+#include <QFutureWatcher>
 #include <QProgressBar>
+#include <QSlider>
+#include <QPushButton>
+#include <QLabel>
+#include <QDateTime>
+#include <serplayer.h>
 
+class MasterBuilder;
 
 class ViewerWindow : public QMainWindow {
 	Q_OBJECT
@@ -48,6 +57,7 @@ public:
 	explicit ViewerWindow(QWidget *parent = nullptr);
 	virtual ~ViewerWindow();
 	void open_image(QString file_name);
+	void open_video(QString file_name);
 	void show_message(const char *title, const char *message, QMessageBox::Icon icon = QMessageBox::Warning);
 	void block_scrolling(bool blocked) {
 		if (blocked) {
@@ -57,6 +67,10 @@ public:
 		}
 	}
 
+signals:
+	/* from the master build worker */
+	void master_progress(int percent);
+
 public slots:
 	void on_reopen_file_changed(bool status);
 	void on_restore_window_size_changed(bool status);
@@ -66,6 +80,9 @@ public slots:
 	void on_delete_current_image_act();
 	void on_image_close_act();
 	void on_image_raw_to_fits();
+	void on_build_master_act();
+	void on_master_built();
+	void on_analyze_subframes_act();
 	void on_image_info_act();
 	void on_exit_act();
 	void on_about_act();
@@ -76,10 +93,17 @@ public slots:
 	void on_antialias_view(bool status);
 	void on_viewer_show_reference(bool status);
 	void on_statistics_show(bool enabled);
+	void on_detect_stars(bool enabled);
+
+	void on_frame_selected(int frame);
+	void on_frame_ready(preview_image *preview, int frame);
+	void on_play_pause(bool clicked);
+	void on_playing_changed(bool playing);
 
 private:
 	// Image viewer
 	TextDialog *m_image_info_dlg;
+	SubframeDialog *m_subframe_dlg;
 	ImageViewer *m_imager_viewer;
 	preview_image *m_preview_image;
 	unsigned char *m_image_data;
@@ -88,6 +112,26 @@ private:
 	char *m_image_formrat;
 	QString m_selected_filter;
 	QStringList m_image_list;
+
+	// SER video
+	SerPlayer *m_ser_player;
+	QWidget *m_video_bar;
+	QPushButton *m_play_button;
+	QSlider *m_frame_slider;
+	QLabel *m_frame_label;
+	QTimer m_scrub_timer;
+	int m_scrub_frame;
+
+	// Master frame built on a worker, one at a time
+	MasterBuilder *m_master_builder;
+	QProgressDialog *m_master_progress;
+	QFutureWatcher<bool> m_master_watcher;
+	std::atomic<bool> m_master_canceled;
+	QString m_master_file_name;
+
+	void show_frame_preview(preview_image *preview, int frame);
+	void show_image_info();
+	void close_video();
 };
 
 #endif // VIEWERWINDOW_H
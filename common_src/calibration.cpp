@@ -0,0 +1,319 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <math.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <indigo/indigo_bus.h>
+#include <calibration.h>
+#include <pixel_kernels.h>
+#include <utils.h>
+#include <pipetrace.h>
+
+#define MIN_SIZE_TO_PARALLELIZE 0x3FFFF
+
+calibration_frame_type calibration_frame_type_from_string(const char *imagetyp) {
+	QString type = QString(imagetyp).toLower();
+	if (type.contains("dark") && type.contains("flat")) return CALIBRATION_DARK_FLAT;
+	if (type.contains("dark")) return CALIBRATION_DARK;
+	if (type.contains("flat")) return CALIBRATION_FLAT;
+	if (type.contains("bias") || type.contains("offset")) return CALIBRATION_BIAS;
+	return CALIBRATION_LIGHT;
+}
+
+void calibration_frame_info_from_fits(const fits_header *header, calibration_frame_info *info) {
+	info->type = calibration_frame_type_from_string(header->imagetyp);
+	info->width = header->naxis >= 2 ? header->naxisn[0] : 0;
+	info->height = header->naxis >= 2 ? header->naxisn[1] : 0;
+	info->xbinning = header->xbinning;
+	info->ybinning = header->ybinning;
+	info->exposure = header->exposure;
+	info->temperature = header->ccd_temp;
+	info->gain = header->gain;
+	strncpy(info->filter, header->filter, sizeof(info->filter));
+	info->filter[sizeof(info->filter) - 1] = '\0';
+}
+
+static bool same_geometry(const calibration_frame_info *a, const calibration_frame_info *b) {
+	return a->width == b->width && a->height == b->height && a->xbinning == b->xbinning && a->ybinning == b->ybinning;
+}
+
+/* values not present in one of the headers do not prevent a match */
+static bool within(double a, double b, double tolerance) {
+	if (isnan(a) || isnan(b)) return true;
+	return fabs(a - b) <= tolerance;
+}
+
+template <typename T> static void to_float(const T *input, float *output, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		output[i] = input[i];
+	}
+}
+
+CalibrationLibrary::CalibrationLibrary() :
+	m_enabled(false) {
+}
+
+void CalibrationLibrary::set_enabled(bool enabled) {
+	m_enabled = enabled;
+	if (!enabled) DefectMap::instance().clear_dark_defects();
+}
+
+int CalibrationLibrary::scan(const char *directory) {
+	QList<master> masters;
+	QDir dir(QString::fromUtf8(directory));
+	QStringList files = dir.entryList(QStringList() << "*.fits" << "*.fit" << "*.fts" << "*.FITS" << "*.FIT" << "*.FTS", QDir::Files, QDir::Name);
+	for (const QString &name : files) {
+		QFile file(dir.filePath(name));
+		if (!file.open(QIODevice::ReadOnly)) continue;
+		// only the header pages are read
+		uchar *data = file.map(0, file.size());
+		if (data == nullptr) continue;
+		fits_header header;
+		if (fits_read_header(data, file.size(), &header) == FITS_OK && header.naxis == 2) {
+			master m;
+			m.file_name = file.fileName();
+			calibration_frame_info_from_fits(&header, &m.info);
+			m.modified = QFileInfo(file).lastModified().toMSecsSinceEpoch();
+			if (m.info.type != CALIBRATION_LIGHT && m.info.type != CALIBRATION_DARK_FLAT) {
+				indigo_debug("Calibration: %s type %d, %dx%d bin %dx%d, exposure %g, temperature %g, gain %g, filter '%s'\n", name.toUtf8().constData(), m.info.type, m.info.width, m.info.height, m.info.xbinning, m.info.ybinning, m.info.exposure, m.info.temperature, m.info.gain, m.info.filter);
+				masters.append(m);
+			}
+		}
+		file.unmap(data);
+	}
+
+	QMutexLocker lock(&m_mutex);
+	m_masters = masters;
+	m_cache.clear();
+	m_last_dark.clear();
+	m_last_flat.clear();
+	indigo_log("Calibration: %d masters in '%s'\n", m_masters.size(), directory);
+	return m_masters.size();
+}
+
+int CalibrationLibrary::master_count() {
+	QMutexLocker lock(&m_mutex);
+	return m_masters.size();
+}
+
+/* the dark closest in exposure and temperature, a bias if there is none */
+const CalibrationLibrary::master *CalibrationLibrary::find_dark(const calibration_frame_info *info) {
+	const master *best = nullptr;
+	double best_score = INFINITY;
+	for (const master &m : m_masters) {
+		if (m.info.type != CALIBRATION_DARK && m.info.type != CALIBRATION_BIAS) continue;
+		if (!same_geometry(&m.info, info)) continue;
+		if (!within(m.info.gain, info->gain, CALIBRATION_GAIN_TOLERANCE)) continue;
+		if (!within(m.info.temperature, info->temperature, CALIBRATION_TEMPERATURE_TOLERANCE)) continue;
+		double score = 0;
+		if (!isnan(m.info.temperature) && !isnan(info->temperature)) {
+			score += fabs(m.info.temperature - info->temperature) / CALIBRATION_TEMPERATURE_TOLERANCE;
+		}
+		if (m.info.type == CALIBRATION_DARK) {
+			if (isnan(m.info.exposure) || isnan(info->exposure) || info->exposure <= 0) continue;
+			double difference = fabs(m.info.exposure - info->exposure) / info->exposure;
+			if (difference > CALIBRATION_EXPOSURE_TOLERANCE) continue;
+			score += difference / CALIBRATION_EXPOSURE_TOLERANCE;
+		} else {
+			score += 100;
+		}
+		if (score < best_score) {
+			best_score = score;
+			best = &m;
+		}
+	}
+	return best;
+}
+
+/* the newest flat of the filter */
+const CalibrationLibrary::master *CalibrationLibrary::find_flat(const calibration_frame_info *info) {
+	const master *best = nullptr;
+	for (const master &m : m_masters) {
+		if (m.info.type != CALIBRATION_FLAT) continue;
+		if (!same_geometry(&m.info, info)) continue;
+		if (m.info.filter[0] != '\0' && info->filter[0] != '\0' && strcasecmp(m.info.filter, info->filter)) continue;
+		if (best == nullptr || m.modified > best->modified) best = &m;
+	}
+	return best;
+}
+
+std::shared_ptr<calibration_buffer> CalibrationLibrary::load(const master *master) {
+	for (int i = 0; i < m_cache.size(); i++) {
+		if (m_cache[i].first == master->file_name) {
+			if (i > 0) m_cache.move(i, 0);
+			return m_cache.first().second;
+		}
+	}
+
+	QFile file(master->file_name);
+	if (!file.open(QIODevice::ReadOnly)) {
+		indigo_error("Calibration: can not open '%s'\n", master->file_name.toUtf8().constData());
+		return nullptr;
+	}
+	uchar *fits_data = file.map(0, file.size());
+	if (fits_data == nullptr) return nullptr;
+	fits_header header;
+	char *native = nullptr;
+	if (fits_read_header(fits_data, file.size(), &header) == FITS_OK) {
+		native = (char *)malloc(fits_get_buffer_size(&header));
+		if (fits_process_data(fits_data, file.size(), &header, native) != FITS_OK) {
+			free(native);
+			native = nullptr;
+		}
+	}
+	file.unmap(fits_data);
+	if (native == nullptr) {
+		indigo_error("Calibration: can not read '%s'\n", master->file_name.toUtf8().constData());
+		return nullptr;
+	}
+
+	const int width = master->info.width;
+	const int height = master->info.height;
+	const size_t count = (size_t)width * height;
+	float *data = (float *)qMallocAligned(count * sizeof(float), CALIBRATION_ALIGNMENT);
+	switch (header.bitpix) {
+		case 8:
+			to_float((const uint8_t *)native, data, count);
+			break;
+		case 16:
+			to_float((const uint16_t *)native, data, count);
+			break;
+		case 32:
+			to_float((const uint32_t *)native, data, count);
+			break;
+		default:
+			to_float((const float *)native, data, count);
+			break;
+	}
+	free(native);
+
+	if (master->info.type == CALIBRATION_FLAT) {
+		// reciprocal normalized to the mean of each CFA cell, the colour balance is kept
+		double sum[4] = { 0 };
+		size_t samples[4] = { 0 };
+		for (int y = 0; y < height; y++) {
+			const float *row = data + (size_t)y * width;
+			for (int x = 0; x < width; x++) {
+				const int cell = (y & 1) * 2 + (x & 1);
+				sum[cell] += row[x];
+				samples[cell]++;
+			}
+		}
+		float mean[4];
+		for (int cell = 0; cell < 4; cell++) {
+			mean[cell] = samples[cell] ? sum[cell] / samples[cell] : 1;
+		}
+		for (int y = 0; y < height; y++) {
+			float *row = data + (size_t)y * width;
+			for (int x = 0; x < width; x++) {
+				row[x] = row[x] > 0 ? mean[(y & 1) * 2 + (x & 1)] / row[x] : 1;
+			}
+		}
+	}
+
+	std::shared_ptr<calibration_buffer> buffer(new calibration_buffer { data, count, nullptr }, [](calibration_buffer *buffer) {
+		qFreeAligned(buffer->data);
+		delete buffer;
+	});
+	if (master->info.type == CALIBRATION_DARK) {
+		buffer->defects = find_dark_defects(data, width, height);
+	}
+	m_cache.prepend(qMakePair(master->file_name, buffer));
+	while (m_cache.size() > CALIBRATION_CACHED_MASTERS) {
+		// a buffer still in use by a calibrate() call is freed when that call ends
+		m_cache.removeLast();
+	}
+	indigo_debug("Calibration: '%s' loaded\n", master->file_name.toUtf8().constData());
+	return buffer;
+}
+
+bool CalibrationLibrary::calibrate(const calibration_frame_info *info, void *data, int bitpix) {
+	if (!m_enabled || info->type != CALIBRATION_LIGHT) return false;
+
+	pixel_type type;
+	switch (bitpix) {
+		case 8:
+			type = PIXEL_U8;
+			break;
+		case 16:
+			type = PIXEL_U16;
+			break;
+		case 32:
+			type = PIXEL_U32;
+			break;
+		case -32:
+			type = PIXEL_F32;
+			break;
+		default:
+			return false;
+	}
+
+	std::shared_ptr<calibration_buffer> dark, flat;
+	m_mutex.lock();
+	const master *dark_master = find_dark(info);
+	const master *flat_master = find_flat(info);
+	if (dark_master) dark = load(dark_master);
+	if (flat_master) flat = load(flat_master);
+	QString dark_name = dark ? QFileInfo(dark_master->file_name).fileName() : QString();
+	QString flat_name = flat ? QFileInfo(flat_master->file_name).fileName() : QString();
+	if (dark_name != m_last_dark || flat_name != m_last_flat) {
+		indigo_log("Calibration: dark '%s', flat '%s'\n", dark_name.toUtf8().constData(), flat_name.toUtf8().constData());
+		m_last_dark = dark_name;
+		m_last_flat = flat_name;
+	}
+	m_mutex.unlock();
+	DefectMap::instance().set_dark_defects(info->width, info->height, dark ? dark->defects : nullptr);
+	if (!dark && !flat) return false;
+
+	PIPE_TRACE(PIPE_TRACE_CALIBRATE);
+	auto calibrate = pixel_kernels()->calibrate[type];
+	const size_t count = (size_t)info->width * info->height;
+	const size_t sample_size = abs(bitpix) / 8;
+	const float *dark_data = dark ? dark->data : nullptr;
+	const float *flat_data = flat ? flat->data : nullptr;
+	if (count < MIN_SIZE_TO_PARALLELIZE) {
+		calibrate(data, count, dark_data, flat_data);
+		return true;
+	}
+	int max_threads = get_number_of_cores();
+	max_threads = (max_threads > 0) ? max_threads : AIN_DEFAULT_THREADS;
+	// the chunks start on the alignment of the masters
+	const size_t align = CALIBRATION_ALIGNMENT / sizeof(float);
+	const size_t chunk = ((count + max_threads - 1) / max_threads + align - 1) / align * align;
+	std::vector<std::thread> threads;
+	for (size_t start = 0; start < count; start += chunk) {
+		const size_t length = std::min(chunk, count - start);
+		threads.emplace_back([=]() {
+			calibrate(
+				(uint8_t *)data + start * sample_size, (int)length,
+				dark_data ? dark_data + start : nullptr,
+				flat_data ? flat_data + start : nullptr
+			);
+		});
+	}
+	for (auto &thread : threads) {
+		thread.join();
+	}
+	return true;
+}
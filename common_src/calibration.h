@@ -0,0 +1,118 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _CALIBRATION_H
+#define _CALIBRATION_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <QString>
+#include <QList>
+#include <QMutex>
+#include <fits.h>
+#include <defectmap.h>
+
+/* Dark and flat calibration of the previews. The masters are FITS files in one
+   directory, their headers are read by scan(). A light frame is calibrated with
+   the dark (or bias) matching its size, binning, gain, exposure and temperature
+   and the flat matching its size, binning and filter. The masters are converted
+   once to aligned float buffers, the dark as it is and the flat as the reciprocal
+   normalized to the mean of each CFA cell, so the calibration is a single pass of
+   the calibrate pixel kernel. */
+
+#define CALIBRATION_EXPOSURE_TOLERANCE 0.05     /* relative */
+#define CALIBRATION_TEMPERATURE_TOLERANCE 2.0   /* C */
+#define CALIBRATION_GAIN_TOLERANCE 0.5
+#define CALIBRATION_CACHED_MASTERS 4
+#define CALIBRATION_ALIGNMENT 64
+
+typedef enum {
+	CALIBRATION_LIGHT = 0,
+	CALIBRATION_DARK,
+	CALIBRATION_FLAT,
+	CALIBRATION_BIAS,
+	CALIBRATION_DARK_FLAT
+} calibration_frame_type;
+
+typedef struct {
+	calibration_frame_type type;
+	int width;
+	int height;
+	int xbinning;
+	int ybinning;
+	double exposure;      /* s, NAN if not known */
+	double temperature;   /* C, NAN if not known */
+	double gain;          /* NAN if not known */
+	char filter[72];
+} calibration_frame_info;
+
+/* from the IMAGETYP value, e.g. "Dark Frame" or "Master Flat" */
+calibration_frame_type calibration_frame_type_from_string(const char *imagetyp);
+void calibration_frame_info_from_fits(const fits_header *header, calibration_frame_info *info);
+
+typedef struct {
+	float *data;          /* aligned to CALIBRATION_ALIGNMENT */
+	size_t count;
+	std::shared_ptr<const defect_list> defects;   /* hot pixels of a dark */
+} calibration_buffer;
+
+class CalibrationLibrary {
+public:
+	static CalibrationLibrary& instance();
+
+	CalibrationLibrary();
+	~CalibrationLibrary() {}
+
+	void set_enabled(bool enabled);
+	bool is_enabled() const { return m_enabled; }
+
+	/* reads the headers of the masters in directory, returns their count */
+	int scan(const char *directory);
+	int master_count();
+
+	/* native samples of a 2D light frame (BITPIX 8, 16, 32 or -32) in place, true if calibrated */
+	bool calibrate(const calibration_frame_info *info, void *data, int bitpix);
+
+private:
+	typedef struct {
+		QString file_name;
+		calibration_frame_info info;
+		qint64 modified;
+	} master;
+
+	QMutex m_mutex;
+	std::atomic<bool> m_enabled;
+	QList<master> m_masters;
+	/* most recently used first */
+	QList<QPair<QString, std::shared_ptr<calibration_buffer>>> m_cache;
+	QString m_last_dark;
+	QString m_last_flat;
+
+	const master *find_dark(const calibration_frame_info *info);
+	const master *find_flat(const calibration_frame_info *info);
+	std::shared_ptr<calibration_buffer> load(const master *master);
+};
+
+inline CalibrationLibrary& CalibrationLibrary::instance() {
+	static CalibrationLibrary* me = nullptr;
+	if (!me) me = new CalibrationLibrary();
+	return *me;
+}
+
+#endif /* _CALIBRATION_H */
@@ -42,6 +42,26 @@ int derotate_xy(double xr, double yr, double angle, int parity, double *x, doubl
 	return 0;
 }
 
+/* rotate x y back to the image rotated at angle, the inverse of derotate_xy() */
+int rotate_xy(double x, double y, double angle, int parity, double *xr, double *yr) {
+	double angler = angle;
+	if (parity == -1) {
+		angler += 180;
+	} else if (parity == 0) {
+		return -1;
+	}
+
+	angler *= DEG2RAD;
+	double sin_a = sin(angler);
+	double cos_a = cos(angler);
+	*xr = x * cos_a + y * sin_a;
+	*yr = -x * sin_a + y * cos_a;
+	if (parity == -1) {
+		*yr *= -1;
+	}
+	return 0;
+}
+
 // Gnomonic procjection Radius
 double gn_R0(double xy_radius, double pix_scale) {
 	if (xy_radius <= 0 || pix_scale <= 0) {
@@ -88,3 +108,29 @@ void gn_radec2xy(double ra, double dec, double ra0, double dec0, double x0, doub
 	*x = x0 + R0 * (-1 * cos_dec * sin_dra) / (sin_dec * sin_dec0 + cos_dec * cos_dec0 * cos_dra);
 	*y = y0 + R0 * (sin_dec * cos_dec0 - cos_dec * sin_dec0 * cos_dra) / (sin_dec * sin_dec0 + cos_dec * cos_dec0 * cos_dra);
 }
+
+int gn_radec2xy_batch(const double *ra, const double *dec, int count, double ra0, double dec0, double x0, double y0, double R0, double *x, double *y) {
+	double sin_dec0 = sin(dec0 * DEG2RAD);
+	double cos_dec0 = cos(dec0 * DEG2RAD);
+	int visible = 0;
+
+	for (int i = 0; i < count; i++) {
+		double sin_dec = sin(dec[i] * DEG2RAD);
+		double cos_dec = cos(dec[i] * DEG2RAD);
+
+		double dra = (ra[i] - ra0) * DEG2RAD;
+		double sin_dra = sin(dra);
+		double cos_dra = cos(dra);
+
+		double cos_c = sin_dec * sin_dec0 + cos_dec * cos_dec0 * cos_dra;
+		if (cos_c <= 0) {
+			x[i] = NAN;
+			y[i] = NAN;
+			continue;
+		}
+		x[i] = x0 + R0 * (-1 * cos_dec * sin_dra) / cos_c;
+		y[i] = y0 + R0 * (sin_dec * cos_dec0 - cos_dec * sin_dec0 * cos_dra) / cos_c;
+		visible++;
+	}
+	return visible;
+}
@@ -31,6 +31,9 @@ extern "C" {
 /* derotate xr yr on the image rotated at angle */
 int derotate_xy(double xr, double yr, double angle, int parity, double *x, double *y);
 
+/* rotate x y back to the image rotated at angle, the inverse of derotate_xy() */
+int rotate_xy(double x, double y, double angle, int parity, double *xr, double *yr);
+
 // Gnomonic procjection Radius
 double gn_R0(double xy_radius, double pix_scale);
 
@@ -40,6 +43,9 @@ void gn_xy2radec(double x, double y, double x0, double y0, double ra0, double de
 // Gnomomic Ra Dec to X Y
 void gn_radec2xy(double ra, double dec, double ra0, double dec0, double x0, double y0, double R0, double *x, double *y);
 
+// Gnomomic Ra Dec to X Y for count points, points on the far hemisphere are set to NAN, returns the number of visible points
+int gn_radec2xy_batch(const double *ra, const double *dec, int count, double ra0, double dec0, double x0, double y0, double R0, double *x, double *y);
+
 #ifdef __cplusplus
 }
 #endif
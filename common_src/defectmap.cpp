@@ -0,0 +1,287 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+#include <thread>
+#include <type_traits>
+#include <indigo/indigo_bus.h>
+#include <defectmap.h>
+#include <utils.h>
+
+#define SAMPLE_STEP 7   /* every n-th pixel is used for the level and the noise */
+
+typedef std::vector<std::pair<float, uint32_t>> defect_candidates;
+
+/* median and sigma estimated from the median absolute deviation */
+template <typename T> static void level_and_noise(const T *data, size_t count, float *level, float *sigma) {
+	std::vector<float> sample;
+	sample.reserve(count / SAMPLE_STEP + 1);
+	for (size_t i = 0; i < count; i += SAMPLE_STEP) {
+		sample.push_back(data[i]);
+	}
+	const size_t middle = sample.size() / 2;
+	std::nth_element(sample.begin(), sample.begin() + middle, sample.end());
+	*level = sample[middle];
+	for (float &value : sample) {
+		value = fabsf(value - *level);
+	}
+	std::nth_element(sample.begin(), sample.begin() + middle, sample.end());
+	*sigma = 1.4826f * sample[middle];
+	// a clean frame of integers may have no deviation at all
+	const float minimum = std::is_integral<T>::value ? 1.0f : FLT_EPSILON * std::max(1.0f, fabsf(*level));
+	if (*sigma < minimum) *sigma = minimum;
+}
+
+/* the strongest candidates up to DEFECT_MAX_FRACTION of the pixels, as sorted indices */
+static defect_list strongest_defects(defect_candidates &candidates, size_t count) {
+	const size_t max = (size_t)(count * DEFECT_MAX_FRACTION);
+	if (candidates.size() > max) {
+		std::nth_element(candidates.begin(), candidates.begin() + max, candidates.end(), [](const std::pair<float, uint32_t> &a, const std::pair<float, uint32_t> &b) {
+			return a.first > b.first;
+		});
+		candidates.resize(max);
+	}
+	defect_list defects;
+	defects.reserve(candidates.size());
+	for (const auto &candidate : candidates) {
+		defects.push_back(candidate.second);
+	}
+	std::sort(defects.begin(), defects.end());
+	return defects;
+}
+
+std::shared_ptr<const defect_list> find_dark_defects(const float *dark, int width, int height) {
+	const size_t count = (size_t)width * height;
+	float level, sigma;
+	level_and_noise(dark, count, &level, &sigma);
+	const float threshold = level + DEFECT_DARK_SIGMA * sigma;
+	defect_candidates candidates;
+	for (size_t i = 0; i < count; i++) {
+		if (dark[i] > threshold) candidates.push_back(std::make_pair(dark[i] - threshold, (uint32_t)i));
+	}
+	std::shared_ptr<const defect_list> defects = std::make_shared<const defect_list>(strongest_defects(candidates, count));
+	indigo_debug("Hot pixels: %d in dark, level %g sigma %g\n", (int)defects->size(), level, sigma);
+	return defects;
+}
+
+/* pixels far above the level and all their same colour neighbours, with no light in the adjacent pixels */
+template <typename T> static void find_light_candidates(const T *data, int width, int height, bool cfa, defect_candidates &candidates) {
+	const int step = cfa ? 2 : 1;
+	float level, sigma;
+	level_and_noise(data, (size_t)width * height, &level, &sigma);
+	const float threshold = level + DEFECT_LIGHT_SIGMA * sigma;
+	const float contrast = DEFECT_LIGHT_SIGMA * sigma;
+
+	int max_threads = get_number_of_cores();
+	max_threads = (max_threads > 0) ? max_threads : AIN_DEFAULT_THREADS;
+	const int rows = height - 2 * step;
+	if (rows <= 0 || width <= 2 * step) return;
+	const int band = (rows + max_threads - 1) / max_threads;
+	std::vector<defect_candidates> found((rows + band - 1) / band);
+	std::vector<std::thread> threads;
+	for (int band_index = 0; band_index < (int)found.size(); band_index++) {
+		threads.emplace_back([&, band_index]() {
+			const int first = step + band_index * band;
+			const int last = std::min(height - step, first + band);
+			for (int y = first; y < last; y++) {
+				const T *row = data + (size_t)y * width;
+				for (int x = step; x < width - step; x++) {
+					const float value = row[x];
+					if (value <= threshold) continue;
+					const T *above = row - step * width;
+					const T *below = row + step * width;
+					float neighbours = std::max({
+						(float)above[x - step], (float)above[x], (float)above[x + step],
+						(float)row[x - step], (float)row[x + step],
+						(float)below[x - step], (float)below[x], (float)below[x + step]
+					});
+					if (value - neighbours <= contrast) continue;
+					if (cfa) {
+						neighbours = std::max({
+							(float)row[x - width - 1], (float)row[x - width], (float)row[x - width + 1],
+							(float)row[x - 1], (float)row[x + 1],
+							(float)row[x + width - 1], (float)row[x + width], (float)row[x + width + 1]
+						});
+					}
+					if (neighbours - level < DEFECT_LIGHT_SPREAD * (value - level)) {
+						found[band_index].push_back(std::make_pair(value - neighbours, (uint32_t)((size_t)y * width + x)));
+					}
+				}
+			}
+		});
+	}
+	for (auto &thread : threads) {
+		thread.join();
+	}
+	for (const defect_candidates &band_candidates : found) {
+		candidates.insert(candidates.end(), band_candidates.begin(), band_candidates.end());
+	}
+}
+
+template <typename T> static void correct_defects(T *data, int width, int height, bool cfa, const defect_list &defects) {
+	static const int offsets[8][2] = { { -1, -1 }, { 0, -1 }, { 1, -1 }, { -1, 0 }, { 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 } };
+	const int step = cfa ? 2 : 1;
+	const uint32_t count = (uint32_t)width * height;
+	for (uint32_t index : defects) {
+		if (index >= count) break;
+		const int x = index % width;
+		const int y = index / width;
+		T values[8];
+		int n = 0;
+		for (const auto &offset : offsets) {
+			const int nx = x + offset[0] * step;
+			const int ny = y + offset[1] * step;
+			if (nx < 0 || ny < 0 || nx >= width || ny >= height) continue;
+			const uint32_t neighbour = (uint32_t)ny * width + nx;
+			// neighbouring defects do not count
+			if (std::binary_search(defects.begin(), defects.end(), neighbour)) continue;
+			values[n++] = data[neighbour];
+		}
+		if (n == 0) continue;
+		std::nth_element(values, values + n / 2, values + n);
+		data[index] = values[n / 2];
+	}
+}
+
+/* the strongest candidates of a light frame, false for an unknown sample type */
+static bool light_defects(const void *data, int width, int height, pixel_type type, bool cfa, defect_list &defects) {
+	defect_candidates candidates;
+	switch (type) {
+		case PIXEL_U8:
+			find_light_candidates((const uint8_t *)data, width, height, cfa, candidates);
+			break;
+		case PIXEL_U16:
+			find_light_candidates((const uint16_t *)data, width, height, cfa, candidates);
+			break;
+		case PIXEL_U32:
+			find_light_candidates((const uint32_t *)data, width, height, cfa, candidates);
+			break;
+		case PIXEL_F32:
+			find_light_candidates((const float *)data, width, height, cfa, candidates);
+			break;
+		default:
+			return false;
+	}
+	defects = strongest_defects(candidates, (size_t)width * height);
+	return true;
+}
+
+DefectMap::DefectMap() :
+	m_enabled(false),
+	m_uses(0),
+	m_generation(0) {
+}
+
+void DefectMap::set_enabled(bool enabled) {
+	QMutexLocker lock(&m_mutex);
+	m_enabled = enabled;
+	m_learning.clear();
+	m_generation++;
+}
+
+void DefectMap::set_dark_defects(int width, int height, std::shared_ptr<const defect_list> defects) {
+	const uint64_t key = (uint64_t)width << 32 | (uint32_t)height;
+	QMutexLocker lock(&m_mutex);
+	auto found = m_darks.find(key);
+	if (defects == nullptr) {
+		if (found != m_darks.end()) m_darks.erase(found);
+		return;
+	}
+	if (found == m_darks.end() || found->second != defects) {
+		indigo_log("Hot pixels: %d from the dark of %dx%d\n", (int)defects->size(), width, height);
+	}
+	m_darks[key] = defects;
+}
+
+void DefectMap::clear_dark_defects() {
+	QMutexLocker lock(&m_mutex);
+	m_darks.clear();
+}
+
+std::shared_ptr<const defect_list> DefectMap::update(const void *data, int width, int height, pixel_type type, bool cfa) {
+	if (!m_enabled) return nullptr;
+	const uint64_t key = (uint64_t)width << 32 | (uint64_t)height << 1 | (cfa ? 1 : 0);
+	int generation;
+	{
+		QMutexLocker lock(&m_mutex);
+		auto dark = m_darks.find((uint64_t)width << 32 | (uint32_t)height);
+		if (dark != m_darks.end()) {
+			return dark->second->empty() ? nullptr : dark->second;
+		}
+		if (m_learning.find(key) == m_learning.end() && m_learning.size() >= DEFECT_GEOMETRIES) {
+			// the least recently used geometry that is not being scanned
+			auto oldest = m_learning.end();
+			for (auto i = m_learning.begin(); i != m_learning.end(); ++i) {
+				if (i->second.scanned_frames == 0 && (oldest == m_learning.end() || i->second.last_use < oldest->second.last_use)) oldest = i;
+			}
+			if (oldest != m_learning.end()) m_learning.erase(oldest);
+		}
+		learning &state = m_learning[key];
+		state.last_use = ++m_uses;
+		if (state.learned_frames + state.scanned_frames >= DEFECT_LEARN_FRAMES) {
+			return (state.learned != nullptr && !state.learned->empty()) ? state.learned : nullptr;
+		}
+		state.scanned_frames++;
+		generation = m_generation;
+	}
+
+	defect_list defects;
+	const bool scanned = light_defects(data, width, height, type, cfa, defects);
+
+	QMutexLocker lock(&m_mutex);
+	auto found = m_learning.find(key);
+	if (generation != m_generation || found == m_learning.end()) return nullptr;
+	learning &state = found->second;
+	state.scanned_frames--;
+	if (!scanned) return nullptr;
+	for (uint32_t index : defects) {
+		state.hits[index]++;
+	}
+	if (++state.learned_frames == DEFECT_LEARN_FRAMES) {
+		defect_list learned;
+		for (const auto &hit : state.hits) {
+			if (hit.second >= DEFECT_LEARN_HITS) learned.push_back(hit.first);
+		}
+		std::sort(learned.begin(), learned.end());
+		state.hits.clear();
+		state.learned = std::make_shared<const defect_list>(std::move(learned));
+		indigo_log("Hot pixels: %d found in %d frames of %dx%d\n", (int)state.learned->size(), DEFECT_LEARN_FRAMES, width, height);
+	}
+	return (state.learned != nullptr && !state.learned->empty()) ? state.learned : nullptr;
+}
+
+void DefectMap::correct(void *data, int width, int height, pixel_type type, bool cfa, const defect_list &defects) {
+	switch (type) {
+		case PIXEL_U8:
+			correct_defects((uint8_t *)data, width, height, cfa, defects);
+			break;
+		case PIXEL_U16:
+			correct_defects((uint16_t *)data, width, height, cfa, defects);
+			break;
+		case PIXEL_U32:
+			correct_defects((uint32_t *)data, width, height, cfa, defects);
+			break;
+		case PIXEL_F32:
+			correct_defects((float *)data, width, height, cfa, defects);
+			break;
+		default:
+			break;
+	}
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _DEFECTMAP_H
+#define _DEFECTMAP_H
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <QMutex>
+#include <pixel_kernels.h>
+
+/* Hot pixel removal of the mono and CFA previews before they are debayered.
+   The defects are a sorted list of pixel indices, found either in the dark
+   master used by the CalibrationLibrary or, without one, in the first
+   DEFECT_LEARN_FRAMES light frames: a pixel that stands out of its same
+   colour neighbours in almost all of them while the adjacent pixels stay
+   dark is hot, a star spreads its light and usually moves. The defects of
+   the darks and of the lights are kept separately for each frame geometry,
+   so the imager and the guider cameras do not reset each other. A defect is
+   replaced with the median of its same colour neighbours, so the correction
+   takes time proportional to the number of defects, not to the frame size. */
+
+#define DEFECT_DARK_SIGMA 6.0f
+#define DEFECT_LIGHT_SIGMA 8.0f
+#define DEFECT_LIGHT_SPREAD 0.1f     /* max. light in the adjacent pixels, relative to the peak */
+#define DEFECT_LEARN_FRAMES 5
+#define DEFECT_LEARN_HITS 4          /* frames a pixel must stand out in */
+#define DEFECT_MAX_FRACTION 0.002    /* of the pixels, the strongest are kept */
+#define DEFECT_GEOMETRIES 4          /* frame geometries learned at the same time */
+
+typedef std::vector<uint32_t> defect_list;
+
+/* hot pixels of a dark frame */
+std::shared_ptr<const defect_list> find_dark_defects(const float *dark, int width, int height);
+
+class DefectMap {
+public:
+	static DefectMap& instance();
+
+	DefectMap();
+	~DefectMap() {}
+
+	/* enabling starts learning the defects from the lights again */
+	void set_enabled(bool enabled);
+	bool is_enabled() const { return m_enabled; }
+
+	/* the defects of the dark in use for the frame size, nullptr if there is none */
+	void set_dark_defects(int width, int height, std::shared_ptr<const defect_list> defects);
+	void clear_dark_defects();
+
+	/* learns from the frame if needed, returns the defects to correct, nullptr if there are none,
+	   the frame is scanned without the lock held */
+	std::shared_ptr<const defect_list> update(const void *data, int width, int height, pixel_type type, bool cfa);
+
+	/* replaces the defects in place */
+	static void correct(void *data, int width, int height, pixel_type type, bool cfa, const defect_list &defects);
+
+private:
+	typedef struct {
+		int learned_frames;
+		int scanned_frames;     /* being scanned outside the lock */
+		uint64_t last_use;
+		std::unordered_map<uint32_t, uint8_t> hits;
+		std::shared_ptr<const defect_list> learned;
+	} learning;
+
+	QMutex m_mutex;
+	std::atomic<bool> m_enabled;
+	/* by width, height and CFA */
+	std::unordered_map<uint64_t, learning> m_learning;
+	uint64_t m_uses;
+	/* changed by set_enabled(), the scans started before are dropped */
+	int m_generation;
+	/* by width and height, the guider and the imager may use different darks */
+	std::unordered_map<uint64_t, std::shared_ptr<const defect_list>> m_darks;
+};
+
+inline DefectMap& DefectMap::instance() {
+	static DefectMap* me = nullptr;
+	if (!me) me = new DefectMap();
+	return *me;
+}
+
+#endif /* _DEFECTMAP_H */
@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <math.h>
 #include <indigo/indigo_bus.h>
+#include "pixel_kernels.h"
 
 static int fits_header_init(fits_header *header, fits_header_state state) {
 	header->state = state;
@@ -43,9 +44,30 @@ static int fits_header_init(fits_header *header, fits_header_state state) {
 	header->data_max = 0;
 	header->data_max_found = 0;
 	header->data_offset = 0;
+	header->exposure = NAN;
+	header->ccd_temp = NAN;
+	header->gain = NAN;
+	header->xbinning = 1;
+	header->ybinning = 1;
+	header->imagetyp[0] = '\0';
+	header->filter[0] = '\0';
 	return 0;
 }
 
+/* string value without the quotes and the trailing spaces */
+static void fits_string_value(const char *value, char *string, int size) {
+	int length = 0;
+	if (*value == '\'') value++;
+	while (value[length] != '\0' && value[length] != '\'' && length < size - 1) {
+		string[length] = value[length];
+		length++;
+	}
+	while (length > 0 && string[length - 1] == ' ') {
+		length--;
+	}
+	string[length] = '\0';
+}
+
 
 static int read_keyword_value(const uint8_t *ptr8, char *keyword, char *value) {
 	int i;
@@ -190,6 +212,20 @@ static int fits_header_parse_line(fits_header *header, const uint8_t line[80]) {
 			header->xbayeroff = d;
 		} else if (!strcmp(keyword, "YBAYROFF") && sscanf(value, "%lf", &d) == 1) {
 			header->ybayeroff = d;
+		} else if ((!strcmp(keyword, "EXPTIME") || !strcmp(keyword, "EXPOSURE")) && sscanf(value, "%lf", &d) == 1) {
+			header->exposure = d;
+		} else if (!strcmp(keyword, "CCD-TEMP") && sscanf(value, "%lf", &d) == 1) {
+			header->ccd_temp = d;
+		} else if (!strcmp(keyword, "GAIN") && sscanf(value, "%lf", &d) == 1) {
+			header->gain = d;
+		} else if (!strcmp(keyword, "XBINNING") && sscanf(value, "%lf", &d) == 1) {
+			header->xbinning = d;
+		} else if (!strcmp(keyword, "YBINNING") && sscanf(value, "%lf", &d) == 1) {
+			header->ybinning = d;
+		} else if (!strcmp(keyword, "IMAGETYP") || !strcmp(keyword, "FRAME")) {
+			fits_string_value(value, header->imagetyp, sizeof(header->imagetyp));
+		} else if (!strcmp(keyword, "FILTER")) {
+			fits_string_value(value, header->filter, sizeof(header->filter));
 		} else if (!strcmp(keyword, "DATAMIN") && sscanf(value, "%lf", &d) == 1) {
 			header->data_min_found = 1;
 			header->data_min = d;
@@ -273,17 +309,10 @@ int fits_process_data(const uint8_t *fits_data, int fits_size, fits_header *head
 		float *raw = (float *)(fits_data + header->data_offset);
 		float *native = (float *)native_data;
 		if (little_endian) {
+			pixel_kernels()->swap32(native, raw, size);
 			for (int i = 0; i < size; i++) {
-				char *rawc = ( char* ) raw;
-				char *nativec = ( char* ) native;
-				// swap bytes
-				nativec[0] = rawc[3];
-				nativec[1] = rawc[2];
-				nativec[2] = rawc[1];
-				nativec[3] = rawc[0];
 				*native = (*native + header->bzero) * header->bscale;
 				native++;
-				raw++;
 			}
 		} else {
 			for (int i = 0; i < size; i++) {
@@ -295,17 +324,10 @@ int fits_process_data(const uint8_t *fits_data, int fits_size, fits_header *head
 		int32_t *raw = (int32_t *)(fits_data + header->data_offset);
 		int32_t *native = (int32_t *)native_data;
 		if (little_endian) {
+			pixel_kernels()->swap32(native, raw, size);
 			for (int i = 0; i < size; i++) {
-				char *rawc = ( char* ) raw;
-				char *nativec = ( char* ) native;
-				// swap bytes
-				nativec[0] = rawc[3];
-				nativec[1] = rawc[2];
-				nativec[2] = rawc[1];
-				nativec[3] = rawc[0];
 				*native = (uint32_t)(*native + header->bzero) * header->bscale;
 				native++;
-				raw++;
 			}
 		} else {
 			for (int i = 0; i < size; i++) {
@@ -317,11 +339,10 @@ int fits_process_data(const uint8_t *fits_data, int fits_size, fits_header *head
 		short *raw = (short *)(fits_data + header->data_offset);
 		short *native = (short *)native_data;
 		if (little_endian) {
+			pixel_kernels()->swap16(native, raw, size);
 			for (int i = 0; i < size; i++) {
-				*native = (*raw & 0xff) << 8 | (*raw & 0xff00) >> 8;
 				*native = (*native + header->bzero) * header->bscale;
 				native++;
-				raw++;
 			}
 		} else {
 			for (int i = 0; i < size; i++) {
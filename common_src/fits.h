@@ -74,6 +74,14 @@ typedef struct fits_header {
 	int data_max_found;
 	double data_max;
 	int data_offset;
+	/* acquisition, NAN or empty if not present */
+	double exposure;
+	double ccd_temp;
+	double gain;
+	int xbinning;
+	int ybinning;
+	char imagetyp[72];
+	char filter[72];
 } fits_header;
 
 int fits_read_header(const uint8_t *fits_data, int fits_size, fits_header *header);
@@ -22,6 +22,8 @@
 #include <math.h>
 #include <QCoreApplication>
 #include <QtConcurrent>
+#include <pipetrace.h>
+#include <pixel_kernels.h>
 
 #define MAX_THREADS 4
 
@@ -30,13 +32,10 @@ ImageStats imageStatsOneChannel(T const *buffer, int count) {
 	ImageStats stats;
 	if (count < 1) return stats;
 
-	double sum = 0, min = INFINITY, max = 0;
-	for (int i = 0; i < count; i++) {
-		sum += buffer[i];
-		if (buffer[i] > max) max = buffer[i];
-		if (buffer[i] < min) min = buffer[i];
-	}
-	double mean = sum / count;
+	pixel_moments moments;
+	pixel_kernels()->moments[pixel_type_of<T>::value](buffer, count, 1, &moments);
+	double min = moments.min[0], max = moments.max[0];
+	double mean = moments.sum[0] / count;
 
 	double hist_max;
 	if (typeid(T) == typeid(uint8_t)) {
@@ -81,26 +80,13 @@ ImageStats imageStatsThreeChannels(T const *buffer, int count) {
 	ImageStats stats;
 	if (count < 3) return stats;
 
-	double sum_r = 0, sum_g = 0, sum_b = 0;
-	double min_r = INFINITY, min_g = INFINITY, min_b = INFINITY;
-	double max_r = 0, max_g = 0, max_b = 0;
-
-	for (int i = 0; i < count * 3; i += 3) {
-		sum_r += buffer[i];
-		if (buffer[i] > max_r) max_r = buffer[i];
-		if (buffer[i] < min_r) min_r = buffer[i];
-
-		sum_g += buffer[i+1];
-		if (buffer[i + 1] > max_g) max_g = buffer[i + 1];
-		if (buffer[i + 1] < min_g) min_g = buffer[i + 1];
-
-		sum_b += buffer[i + 2];
-		if (buffer[i + 2] > max_b) max_b = buffer[i + 2];
-		if (buffer[i + 2] < min_b) min_b = buffer[i + 2];
-	}
-	double mean_r = sum_r / count;
-	double mean_g = sum_g / count;
-	double mean_b = sum_b / count;
+	pixel_moments moments;
+	pixel_kernels()->moments[pixel_type_of<T>::value](buffer, count, 3, &moments);
+	double min_r = moments.min[0], min_g = moments.min[1], min_b = moments.min[2];
+	double max_r = moments.max[0], max_g = moments.max[1], max_b = moments.max[2];
+	double mean_r = moments.sum[0] / count;
+	double mean_g = moments.sum[1] / count;
+	double mean_b = moments.sum[2] / count;
 
 	double hist_max;
 	if (typeid(T) == typeid(uint8_t)) {
@@ -168,6 +154,7 @@ ImageStats imageStatsThreeChannels(T const *buffer, int count) {
 }
 
 ImageStats imageStats(uint8_t const *input, int width, int height, int pix_fmt) {
+	PIPE_TRACE(PIPE_TRACE_IMAGE_STATS);
 	switch (pix_fmt) {
 		case PIX_FMT_Y8:
 			return imageStatsOneChannel(reinterpret_cast<uint8_t const*>(input), width * height);
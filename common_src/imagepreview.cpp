@@ -27,6 +27,10 @@
 #include <image_preview_lut.h>
 #include <dslr_raw.h>
 #include <utils.h>
+#include <pipetrace.h>
+#include <pixel_kernels.h>
+#include <calibration.h>
+#include <defectmap.h>
 
 #include <unistd.h>
 #include <thread>
@@ -67,135 +71,16 @@ int get_bayer_offsets(uint32_t pix_format) {
 	}
 }
 
-template <typename T> static inline void debayer(T *raw, int index, int row, int column, int width, int height, int offsets, float &red, float &green, float &blue) {
-	switch (offsets ^ ((column & 1) << 4 | (row & 1))) {
-		case 0x00:
-			red = raw[index];
-			if (column == 0) {
-				if (row == 0) {
-					green = (raw[index + 1] + raw[index + width]) / 2.0;
-					blue = raw[index + width + 1];
-				} else if (row == height - 1) {
-					green = (raw[index + 1] + raw[index - width]) / 2.0;
-					blue = raw[index - width + 1];
-				} else {
-					green = (raw[index + 1] + raw[index + width] + raw[index - width]) / 3.0;
-					blue = (raw[index - width + 1] + raw[index + width + 1]) / 2.0;
-				}
-			} else if (column == width - 1) {
-				if (row == 0) {
-					green = (raw[index - 1] + raw[index + width]) / 2.0;
-					blue = (raw[index + width - 1] + raw[index + width + 1]) / 2.0;
-				} else if (row == height - 1) {
-					green = (raw[index - 1] + raw[index - width]) / 2.0;
-					blue = (raw[index - width - 1] + raw[index - width + 1]) / 2.0;
-				} else {
-					green = (raw[index - 1] + raw[index + width] + raw[index - width]) / 3.0;
-					blue = (raw[index - width - 1] + raw[index + width - 1]) / 2.0;
-				}
-			} else {
-				if (row == 0) {
-					green = (raw[index + 1] + raw[index - 1] + raw[index + width]) / 3.0;
-					blue = (raw[index + width - 1] + raw[index + width + 1]) / 2.0;
-				} else if (row == height - 1) {
-					green = (raw[index + 1] + raw[index - 1] + raw[index - width]) / 3.0;
-					blue = (raw[index - width - 1] + raw[index - width + 1]) / 2.0;
-				} else {
-					green = (raw[index + 1] + raw[index - 1] + raw[index + width] + raw[index - width]) / 4.0;
-					blue = (raw[index - width - 1] + raw[index - width + 1] + raw[index + width - 1] + raw[index + width + 1]) / 4.0;
-				}
-			}
-			break;
-		case 0x10:
-			if (column == 0) {
-				red = raw[index + 1];
-			} else if (column == width - 1) {
-				red = raw[index - 1];
-			} else {
-				red = (raw[index - 1] + raw[index + 1]) / 2.0;
-			}
-			green = raw[index];
-			if (row == 0) {
-				blue = raw[index + width];
-			} else if (row == height - 1) {
-				blue = raw[index - width];
-			} else {
-				blue = (raw[index - width] + raw[index + width]) / 2.0;
-			}
-			break;
-		case 0x01:
-			if (row == 0) {
-				red = raw[index + width];
-			} else if (row == height - 1) {
-				red = raw[index - width];
-			} else {
-				red = (raw[index - width] + raw[index + width]) / 2.0;
-			}
-			green = raw[index];
-			if (column == 0) {
-				blue = raw[index + 1];
-			} else if (column == width - 1) {
-				blue = raw[index - 1];
-			} else {
-				blue = (raw[index - 1] + raw[index + 1]) / 2.0;
-			}
-			break;
-		case 0x11:
-			if (column == 0) {
-				if (row == 0) {
-					red = raw[index + width + 1];
-					green = (raw[index + 1] + raw[index + width]) / 2.0;
-				} else if (row == height - 1) {
-					red = raw[index - width + 1];
-					green = (raw[index + 1] + raw[index - width]) / 2.0;
-				} else {
-					red = raw[index - width + 1];
-					green = (raw[index + 1] + raw[index + width] + raw[index - width]) / 3.0;
-				}
-			} else if (column == width - 1) {
-				if (row == 0) {
-					red = raw[index + width - 1];
-					green = (raw[index - 1] + raw[index + width]) / 2.0;
-				} else if (row == height - 1) {
-					red = raw[index - width - 1];
-					green = (raw[index - 1] + raw[index - width]) / 2.0;
-				} else {
-					red = (raw[index - width - 1] + raw[index + width - 1]) / 2.0;
-					green = (raw[index - 1] + raw[index + width] + raw[index - width]) / 3.0;
-				}
-			} else {
-				if (row == 0) {
-					red = (raw[index + width - 1] + raw[index + width + 1]) / 2.0;
-					green = (raw[index + 1] + raw[index - 1] + raw[index + width]) / 3.0;
-				} else if (row == height - 1) {
-					red = (raw[index - width - 1] + raw[index - width + 1]) / 2.0;
-					green = (raw[index + 1] + raw[index - 1] + raw[index - width]) / 3.0;
-				} else {
-					red = (raw[index - width - 1] + raw[index - width + 1] + raw[index + width - 1] + raw[index + width + 1]) / 4.0;
-					green = (raw[index + 1] + raw[index - 1] + raw[index + width] + raw[index - width]) / 4.0;
-				}
-			}
-			blue = raw[index];
-			break;
-	}
-}
-
 template <typename T> void parallel_debayer(T *input_buffer, int width, int height, int offsets, T *output_buffer) {
+	PIPE_TRACE(PIPE_TRACE_DEBAYER);
+	auto debayer_row = pixel_kernels()->debayer_row[pixel_type_of<T>::value];
 	const int size = width * height;
 	if (size < MIN_SIZE_TO_PARALLELIZE) {
-		int input_index = 0;
 		for (int row_index = 0; row_index < height; row_index++) {
-			for (int column_index = 0; column_index < width; column_index++) {
-				float red = 0, green = 0, blue = 0;
-				int output_index = input_index * 3;
-				debayer(input_buffer, input_index, row_index, column_index, width, height, offsets, red, green, blue);
-				output_buffer[output_index] = red;
-				output_buffer[output_index + 1] = green;
-				output_buffer[output_index + 2] = blue;
-				input_index++;
-			}
+			debayer_row(input_buffer, row_index, width, height, offsets, output_buffer);
 		}
 	} else {
+		const bool yield = !is_priority_thread();
 		int max_threads = get_number_of_cores();
 		max_threads = (max_threads > 0) ? max_threads : AIN_DEFAULT_THREADS;
 		std::thread threads[max_threads];
@@ -205,17 +90,9 @@ template <typename T> void parallel_debayer(T *input_buffer, int width, int heig
 				const int start = chunk * rank;
 				int end = start + chunk;
 				end = (end > height) ? height : end;
-				int input_index = start * width;
 				for (int row_index = start; row_index < end; row_index++) {
-					for (int column_index = 0; column_index < width; column_index++) {
-						float red = 0, green = 0, blue = 0;
-						int output_index = input_index * 3;
-						debayer(input_buffer, input_index, row_index, column_index, width, height, offsets, red, green, blue);
-						output_buffer[output_index] = red;
-						output_buffer[output_index + 1] = green;
-						output_buffer[output_index + 2] = blue;
-						input_index++;
-					}
+					if (yield) yield_to_priority_work();
+					debayer_row(input_buffer, row_index, width, height, offsets, output_buffer);
 				}
 			});
 		}
@@ -225,6 +102,72 @@ template <typename T> void parallel_debayer(T *input_buffer, int width, int heig
 	}
 }
 
+template void parallel_debayer<uint8_t>(uint8_t *input_buffer, int width, int height, int offsets, uint8_t *output_buffer);
+template void parallel_debayer<uint16_t>(uint16_t *input_buffer, int width, int height, int offsets, uint16_t *output_buffer);
+template void parallel_debayer<uint32_t>(uint32_t *input_buffer, int width, int height, int offsets, uint32_t *output_buffer);
+template void parallel_debayer<float>(float *input_buffer, int width, int height, int offsets, float *output_buffer);
+
+/* Removes the hot pixels of a mono or CFA frame before it is debayered, see
+   defectmap.h. Buffers that can not be modified are corrected in a copy, which
+   is returned and must be freed, only if there are defects. */
+static char *correct_defects(char *data, int width, int height, unsigned int pix_format, bool in_place) {
+	if (!DefectMap::instance().is_enabled()) return nullptr;
+	pixel_type type;
+	bool cfa = true;
+	switch (pix_format) {
+		case PIX_FMT_Y8:
+			cfa = false;
+			// fall through
+		case PIX_FMT_SBGGR8:
+		case PIX_FMT_SGBRG8:
+		case PIX_FMT_SGRBG8:
+		case PIX_FMT_SRGGB8:
+			type = PIXEL_U8;
+			break;
+		case PIX_FMT_Y16:
+			cfa = false;
+			// fall through
+		case PIX_FMT_SBGGR16:
+		case PIX_FMT_SGBRG16:
+		case PIX_FMT_SGRBG16:
+		case PIX_FMT_SRGGB16:
+			type = PIXEL_U16;
+			break;
+		case PIX_FMT_Y32:
+			cfa = false;
+			// fall through
+		case PIX_FMT_SBGGR32:
+		case PIX_FMT_SGBRG32:
+		case PIX_FMT_SGRBG32:
+		case PIX_FMT_SRGGB32:
+			type = PIXEL_U32;
+			break;
+		case PIX_FMT_F32:
+			cfa = false;
+			// fall through
+		case PIX_FMT_SBGGRF:
+		case PIX_FMT_SGBRGF:
+		case PIX_FMT_SGRBGF:
+		case PIX_FMT_SRGGBF:
+			type = PIXEL_F32;
+			break;
+		default:
+			return nullptr;
+	}
+	PIPE_TRACE(PIPE_TRACE_DEFECTS);
+	std::shared_ptr<const defect_list> defects = DefectMap::instance().update(data, width, height, type, cfa);
+	if (defects == nullptr) return nullptr;
+	char *corrected = data;
+	if (!in_place) {
+		static const int sample_size[PIXEL_TYPES] = { 1, 2, 4, 4 };
+		const size_t size = (size_t)width * height * sample_size[type];
+		corrected = (char *)malloc(size);
+		memcpy(corrected, data, size);
+	}
+	DefectMap::instance().correct(corrected, width, height, type, cfa, *defects);
+	return in_place ? nullptr : corrected;
+}
+
 static unsigned int bayer_to_pix_format(const char *image_bayer_pat, const char bitpix, uint32_t prefered_bayer_pat) {
 	char bayerpat[5] = {0};
 
@@ -446,8 +389,14 @@ preview_image* create_fits_preview(unsigned char *raw_fits_buffer, unsigned long
 	}
 
 	if (header.naxis == 2) {
+		if (CalibrationLibrary::instance().is_enabled()) {
+			calibration_frame_info info;
+			calibration_frame_info_from_fits(&header, &info);
+			CalibrationLibrary::instance().calibrate(&info, fits_data, header.bitpix);
+		}
 		int bayer_pix_fmt = bayer_to_pix_format(header.bayerpat, header.bitpix, sconfig.bayer_pattern);
 		if (bayer_pix_fmt != 0) pix_format = bayer_pix_fmt;
+		correct_defects(fits_data, header.naxisn[0], header.naxisn[1], pix_format, true);
 	}
 
 	preview_image *img = create_preview(header.naxisn[0], header.naxisn[1],
@@ -503,7 +452,9 @@ preview_image* create_xisf_preview(unsigned char *xisf_buffer, unsigned long xis
 			if (bayer_pix_fmt != 0) pix_format = bayer_pix_fmt;
 		}
 
-		img = create_preview(header.width, header.height, pix_format, (char*)xisf_buffer + header.data_offset, sconfig);
+		char *corrected = correct_defects((char*)xisf_buffer + header.data_offset, header.width, header.height, pix_format, false);
+		img = create_preview(header.width, header.height, pix_format, corrected ? corrected : (char*)xisf_buffer + header.data_offset, sconfig);
+		free(corrected);
 	} else {
 		char *xisf_data = (char*)malloc(header.uncompressed_data_size);
 		int res = xisf_decompress(xisf_buffer, &header, (uint8_t*)xisf_data);
@@ -518,6 +469,7 @@ preview_image* create_xisf_preview(unsigned char *xisf_buffer, unsigned long xis
 			if (bayer_pix_fmt != 0) pix_format = bayer_pix_fmt;
 		}
 
+		correct_defects(xisf_data, header.width, header.height, pix_format, true);
 		img = create_preview(header.width, header.height, pix_format, (char*)xisf_data, sconfig);
 		free(xisf_data);
 	}
@@ -636,13 +588,76 @@ preview_image* create_raw_preview(unsigned char *raw_image_buffer, unsigned long
 		if (bayer_pix_fmt != 0) pix_format = bayer_pix_fmt;
 	}
 
+	char *corrected = correct_defects(raw_data, header->width, header->height, pix_format, false);
 	preview_image *img = create_preview(header->width, header->height,
-	        pix_format, raw_data, sconfig);
+	        pix_format, corrected ? corrected : raw_data, sconfig);
+	free(corrected);
 
 	indigo_debug("RAW_END: raw_data = %p", raw_data);
 	return img;
 }
 
+template <typename T> static void bgr_to_rgb(T *buffer, size_t pixel_count) {
+	for (size_t i = 0; i < pixel_count; i++, buffer += 3) {
+		T b = buffer[0];
+		buffer[0] = buffer[2];
+		buffer[2] = b;
+	}
+}
+
+/* One frame of a SER video, frame points to ser_frame_size() bytes. */
+preview_image* create_ser_preview(const ser_header *header, const uint8_t *frame, const stretch_config_t sconfig) {
+	static const char *bayer_patterns[] = { "RGGB", "GRBG", "GBRG", "BGGR" };
+	const int planes = ser_planes(header);
+	const int bitpix = ser_bytes_per_sample(header) * 8;
+	const size_t pixel_count = (size_t)header->width * header->height;
+	const size_t sample_count = pixel_count * planes;
+	unsigned int pix_format;
+	if (planes == 3) {
+		pix_format = (bitpix == 8) ? PIX_FMT_RGB24 : PIX_FMT_RGB48;
+	} else {
+		pix_format = (bitpix == 8) ? PIX_FMT_Y8 : PIX_FMT_Y16;
+	}
+
+	// 16-bit samples are little endian when the flag is 0, see ser.h
+	const bool swap = bitpix == 16 && header->little_endian != 0;
+	const bool bgr = header->color_id == SER_BGR;
+	char *data = (char *)frame;
+	char *converted = nullptr;
+	if (swap || bgr) {
+		converted = (char *)malloc(sample_count * bitpix / 8);
+		if (converted == nullptr) return nullptr;
+		if (swap) {
+			pixel_kernels()->swap16(converted, frame, sample_count);
+		} else {
+			memcpy(converted, frame, sample_count * bitpix / 8);
+		}
+		if (bgr && bitpix == 8) {
+			bgr_to_rgb((uint8_t *)converted, pixel_count);
+		} else if (bgr) {
+			bgr_to_rgb((uint16_t *)converted, pixel_count);
+		}
+		data = converted;
+	}
+
+	if (planes == 1) {
+		const char *bayerpat = nullptr;
+		if (header->color_id >= SER_BAYER_RGGB && header->color_id <= SER_BAYER_BGGR) {
+			bayerpat = bayer_patterns[header->color_id - SER_BAYER_RGGB];
+		}
+		if ((sconfig.bayer_pattern == BAYER_PAT_AUTO || sconfig.bayer_pattern == 0) && bayerpat) {
+			pix_format = bayer_to_pix_format(bayerpat, bitpix, sconfig.bayer_pattern);
+		} else if (sconfig.bayer_pattern != BAYER_PAT_AUTO && sconfig.bayer_pattern != 0) {
+			unsigned int bayer_pix_fmt = bayer_to_pix_format(bayerpat, bitpix, sconfig.bayer_pattern);
+			if (bayer_pix_fmt != 0) pix_format = bayer_pix_fmt;
+		}
+	}
+
+	preview_image *img = create_preview(header->width, header->height, pix_format, data, sconfig);
+	free(converted);
+	return img;
+}
+
 preview_image* create_preview(int width, int height, int pix_format, char *image_data, const stretch_config_t sconfig) {
 	preview_image* img = new preview_image(width, height, QImage::Format_RGB32);
 	if (pix_format == PIX_FMT_Y8) {
@@ -909,6 +924,7 @@ preview_image* create_preview(indigo_item *item, const stretch_config_t sconfig)
 }
 
 preview_image* create_preview(unsigned char *data, size_t size, const char* format, const stretch_config_t sconfig) {
+	PIPE_TRACE(PIPE_TRACE_DECODE);
 	preview_image *preview = nullptr;
 	if (data != NULL && format != NULL) {
 		if ((((uint8_t *)data)[0] == 0xFF && ((uint8_t *)data)[1] == 0xD8 && ((uint8_t *)data)[2] == 0xFF)) {
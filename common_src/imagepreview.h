@@ -26,6 +26,7 @@
 #include <image_preview_lut.h>
 #include <coordconv.h>
 #include <stretcher.h>
+#include <ser.h>
 
 #if !defined(INDIGO_WINDOWS)
 #define USE_LIBJPEG
@@ -295,6 +296,37 @@ public:
 		return 0;
 	};
 
+	/* center and radius of the circle around the image in degrees */
+	int wcs_field(double *ra, double *dec, double *radius) const {
+		if (m_pix_scale == 0) return -1;
+		*ra = m_center_ra;
+		*dec = m_center_dec;
+		*radius = sqrt((double)width() * width() + (double)height() * height()) / 2 * m_pix_scale;
+		return 0;
+	};
+
+	/* Image X Y of count points, ra and dec in degrees. This is the inverse of wcs_data(),
+	   points on the far side of the sky are set to NAN. Returns the number of visible points. */
+	int wcs_xy(const double *ra, const double *dec, int count, double *x, double *y) const {
+		if (m_pix_scale == 0) return -1;
+		int visible = gn_radec2xy_batch(ra, dec, count, m_center_ra, m_center_dec, 0, 0, 1, x, y);
+		double center_x = width() / 2.0;
+		double center_y = height() / 2.0;
+		double pix_scale_rad = m_pix_scale * M_PI / 180;
+		for (int i = 0; i < count; i++) {
+			if (isnan(x[i])) continue;
+			// wcs_data() uses gn_R0() of the radius, tan(angle) = 2 tan(radius * pix_scale / 2)
+			double tan_radius = sqrt(x[i] * x[i] + y[i] * y[i]);
+			double scale = 1 / pix_scale_rad;
+			if (tan_radius > 0) scale = 2 * atan(tan_radius / 2) / pix_scale_rad / tan_radius;
+			double dxr, dyr;
+			if (rotate_xy(x[i] * scale, y[i] * scale, m_rotation_angle, m_parity, &dxr, &dyr)) return -1;
+			x[i] = dxr + center_x;
+			y[i] = dyr + center_y;
+		}
+		return visible;
+	};
+
 	char *m_raw_data;
 	int m_width;
 	int m_height;
@@ -316,6 +348,7 @@ preview_image* create_jpeg_preview(unsigned char *jpg_buffer, unsigned long jpg_
 preview_image* create_fits_preview(unsigned char *fits_buffer, unsigned long fits_size, const stretch_config_t sconfig);
 preview_image* create_xisf_preview(unsigned char *xisf_buffer, unsigned long xisf_size, const stretch_config_t sconfig);
 preview_image* create_raw_preview(unsigned char *raw_image_buffer, unsigned long raw_size, const stretch_config_t sconfig);
+preview_image* create_ser_preview(const ser_header *header, const uint8_t *frame, const stretch_config_t sconfig);
 preview_image* create_preview(unsigned char *data, size_t size, const char* format, const stretch_config_t sconfig);
 preview_image* create_preview(int width, int height, int pixel_format, char *image_data, const stretch_config_t sconfig);
 preview_image* create_preview(indigo_property *property, indigo_item *item, const stretch_config_t sconfig);
@@ -1,5 +1,6 @@
 #include "imageviewer.h"
 #include <cmath>
+#include <string.h>
 #include <QGraphicsScene>
 #include <QMenu>
 #include <QActionGroup>
@@ -11,6 +12,10 @@
 #include <QHBoxLayout>
 #include <QToolButton>
 #include <QLabel>
+#include <QGraphicsPathItem>
+#include <QGraphicsSimpleTextItem>
+#include <QPainterPath>
+#include <pipetrace.h>
 
 // Graphics View with better mouse events handling
 class GraphicsView : public QGraphicsView {
@@ -120,6 +125,46 @@ ImageViewer::ImageViewer(QWidget *parent, bool show_prev_next, bool show_debayer
 	m_edge_clipping->setVisible(false);
 	m_edge_clipping_visible = false;
 
+	m_object_source = nullptr;
+	m_show_objects = false;
+	m_objects = new QGraphicsPathItem(m_pixmap);
+	m_objects->setBrush(QBrush(Qt::NoBrush));
+	pen.setCosmetic(true);
+	pen.setWidth(1);
+	pen.setColor(QColor(255, 170, 0));
+	m_objects->setPen(pen);
+	m_objects->setOpacity(0.8);
+	m_objects->setVisible(false);
+
+	m_stars = new QGraphicsPathItem(m_pixmap);
+	m_stars->setBrush(QBrush(Qt::NoBrush));
+	pen.setCosmetic(true);
+	pen.setWidth(1);
+	pen.setColor(QColor(0, 220, 120));
+	m_stars->setPen(pen);
+	m_stars->setOpacity(0.8);
+	m_stars->setVisible(false);
+
+	// the grid is clipped to the image by the parent rectangle
+	m_show_grid = false;
+	memset(m_grid_wcs, 0, sizeof(m_grid_wcs));
+	m_grid_clip = new QGraphicsRectItem(0, 0, 0, 0, m_pixmap);
+	m_grid_clip->setPen(Qt::NoPen);
+	m_grid_clip->setBrush(QBrush(Qt::NoBrush));
+	m_grid_clip->setFlag(QGraphicsItem::ItemClipsChildrenToShape);
+	m_grid_clip->setVisible(false);
+	m_grid = new QGraphicsPathItem(m_grid_clip);
+	m_grid->setBrush(QBrush(Qt::NoBrush));
+	pen.setCosmetic(true);
+	pen.setWidth(1);
+	pen.setColor(QColor(80, 180, 255));
+	m_grid->setPen(pen);
+	m_grid->setOpacity(0.6);
+	m_grid_label = new QGraphicsSimpleTextItem(m_grid_clip);
+	m_grid_label->setBrush(QColor(80, 180, 255));
+	m_grid_label->setOpacity(0.8);
+	m_grid_label->setFlag(QGraphicsItem::ItemIgnoresTransformations);
+
 	makeToolbar(show_prev_next, show_debayer);
 
 	auto box = new QVBoxLayout;
@@ -588,6 +633,289 @@ void ImageViewer::showWCS(bool show) {
 	m_show_wcs = show;
 }
 
+void ImageViewer::setObjectSource(ImageObjectSource *source) {
+	m_object_source = source;
+	updateObjects();
+}
+
+void ImageViewer::showObjects(bool show) {
+	m_show_objects = show;
+	updateObjects();
+}
+
+// catalog objects are projected on plate solved images only, the labels keep their size when zoomed
+void ImageViewer::updateObjects() {
+	while (!m_object_labels.isEmpty()) {
+		delete m_object_labels.takeLast();
+	}
+	m_objects->setPath(QPainterPath());
+	m_objects->setVisible(false);
+
+	const preview_image &im = m_pixmap->image();
+	double ra, dec, radius;
+	if (!m_show_objects || m_object_source == nullptr || m_pixmap->pixmap().isNull() || im.wcs_field(&ra, &dec, &radius)) {
+		return;
+	}
+
+	QVector<image_object> objects;
+	m_object_source->objectsInField(ra, dec, radius, objects);
+	int count = objects.size();
+	if (count == 0) return;
+
+	QVector<double> obj_ra(count), obj_dec(count), x(count), y(count);
+	for (int i = 0; i < count; i++) {
+		obj_ra[i] = objects[i].ra;
+		obj_dec[i] = objects[i].dec;
+	}
+	if (im.wcs_xy(obj_ra.constData(), obj_dec.constData(), count, x.data(), y.data()) <= 0) return;
+
+	double pix_scale = radius / (sqrt((double)im.width() * im.width() + (double)im.height() * im.height()) / 2);
+	QPainterPath path;
+	for (int i = 0; i < count; i++) {
+		if (std::isnan(x[i]) || x[i] < 0 || y[i] < 0 || x[i] >= im.width() || y[i] >= im.height()) continue;
+		double r = objects[i].radius / pix_scale;
+		if (r < 5) r = 5;
+		path.addEllipse(QPointF(x[i], y[i]), r, r);
+
+		QGraphicsSimpleTextItem *label = new QGraphicsSimpleTextItem(objects[i].label, m_pixmap);
+		label->setBrush(QColor(255, 170, 0));
+		label->setOpacity(0.8);
+		label->setFlag(QGraphicsItem::ItemIgnoresTransformations);
+		label->setPos(x[i] + r * M_SQRT1_2, y[i] + r * M_SQRT1_2);
+		m_object_labels.append(label);
+	}
+	m_objects->setPath(path);
+	m_objects->setVisible(true);
+}
+
+void ImageViewer::setStars(const std::vector<detected_star> &stars) {
+	QPainterPath path;
+	for (const detected_star &star : stars) {
+		double r = star.hfd;
+		if (r < 3) r = 3;
+		// the centroids are in pixel indices, the pixel centers are at .5 in the scene
+		path.addEllipse(QPointF(star.x + 0.5, star.y + 0.5), r, r);
+	}
+	m_stars->setPath(path);
+	m_stars->setVisible(!stars.empty());
+}
+
+void ImageViewer::showGrid(bool show) {
+	m_show_grid = show;
+	updateGrid();
+}
+
+#define GRID_LINES 6           // minimal number of lines across the field
+#define GRID_MAX_LINES 36
+#define GRID_SEGMENTS 16       // initial segments of a line
+#define GRID_MAX_DEPTH 6       // segment halvings
+#define GRID_TOLERANCE 0.5     // screen pixels
+
+// declination steps in degrees
+static const double grid_dec_steps[] = {
+	1 / 3600.0, 2 / 3600.0, 5 / 3600.0, 10 / 3600.0, 15 / 3600.0, 30 / 3600.0,
+	1 / 60.0, 2 / 60.0, 5 / 60.0, 10 / 60.0, 15 / 60.0, 30 / 60.0,
+	1, 2, 5, 10, 15, 30
+};
+
+// RA steps of 1s to 2h in degrees
+static const double grid_ra_steps[] = {
+	15 / 3600.0, 30 / 3600.0, 75 / 3600.0, 150 / 3600.0, 225 / 3600.0, 450 / 3600.0,
+	15 / 60.0, 30 / 60.0, 75 / 60.0, 150 / 60.0, 225 / 60.0, 450 / 60.0,
+	15, 30
+};
+
+static double gridStep(const double *steps, int count, double min_step) {
+	for (int i = 0; i < count; i++) {
+		if (steps[i] >= min_step) return steps[i];
+	}
+	return steps[count - 1];
+}
+
+static QString gridAngle(double degrees, const char *units[3]) {
+	if (degrees >= 1) return QString::number(degrees, 'g', 3) + units[0];
+	if (degrees * 60 >= 1) return QString::number(degrees * 60, 'g', 3) + units[1];
+	return QString::number(degrees * 3600, 'g', 3) + units[2];
+}
+
+typedef struct {
+	double t;
+	double x, y;
+	bool done;    // the segment starting here needs no more subdivision
+} grid_point;
+
+/* RA and Dec lines are projected in batches. Each pass projects the midpoints of all
+   segments that are not done, splits the ones deviating more than tolerance image
+   pixels from their chord or crossing the edge of the projection and closes the rest. */
+QPainterPath ImageViewer::makeGrid(const preview_image &im, double tolerance) {
+	QPainterPath path;
+	double ra, dec, radius;
+	if (im.wcs_field(&ra, &dec, &radius)) return path;
+
+	double dec_min = fmax(dec - radius, -90);
+	double dec_max = fmin(dec + radius, 90);
+	double ra_min = 0, ra_max = 360;
+	double max_abs_dec = fmax(fabs(dec_min), fabs(dec_max));
+	if (max_abs_dec < 90) {
+		double s = sin(radius * M_PI / 180) / cos(max_abs_dec * M_PI / 180);
+		if (s < 1) {
+			double dra = asin(s) * 180 / M_PI;
+			ra_min = ra - dra;
+			ra_max = ra + dra;
+		}
+	}
+
+	int dec_count = sizeof(grid_dec_steps) / sizeof(double);
+	int ra_count = sizeof(grid_ra_steps) / sizeof(double);
+	double dec_step = gridStep(grid_dec_steps, dec_count, fmax(2 * radius / GRID_LINES, (dec_max - dec_min) / GRID_MAX_LINES));
+	double ra_step = gridStep(grid_ra_steps, ra_count, fmax(dec_step / fmax(cos(dec * M_PI / 180), 0.1), (ra_max - ra_min) / GRID_MAX_LINES));
+
+	// lines from (ra0, dec0) to (ra1, dec1)
+	QVector<QVector<double>> lines;
+	for (double d = ceil(dec_min / dec_step) * dec_step; d <= dec_max; d += dec_step) {
+		if (fabs(d) < 90) lines.append({ ra_min, d, ra_max, d });
+	}
+	for (double r = ceil(ra_min / ra_step) * ra_step; r < ra_max && r < ra_min + 360; r += ra_step) {
+		lines.append({ r, dec_min, r, dec_max });
+	}
+
+	QVector<QVector<grid_point>> points(lines.size());
+	QVector<double> batch_ra, batch_dec, batch_x, batch_y;
+	QVector<QPair<int, int>> batch_owner;
+	auto project = [&]() {
+		batch_x.resize(batch_ra.size());
+		batch_y.resize(batch_ra.size());
+		if (im.wcs_xy(batch_ra.constData(), batch_dec.constData(), batch_ra.size(), batch_x.data(), batch_y.data()) < 0) {
+			batch_x.fill(NAN);
+			batch_y.fill(NAN);
+		}
+	};
+	auto add = [&](int line, double t, int segment) {
+		const QVector<double> &l = lines[line];
+		batch_ra.append(l[0] + (l[2] - l[0]) * t);
+		batch_dec.append(l[1] + (l[3] - l[1]) * t);
+		batch_owner.append(QPair<int, int>(line, segment));
+	};
+
+	for (int line = 0; line < lines.size(); line++) {
+		for (int i = 0; i <= GRID_SEGMENTS; i++) {
+			add(line, i / (double)GRID_SEGMENTS, i);
+		}
+	}
+	project();
+	for (int i = 0; i < batch_ra.size(); i++) {
+		points[batch_owner[i].first].append({ batch_owner[i].second / (double)GRID_SEGMENTS, batch_x[i], batch_y[i], false });
+	}
+
+	double width = im.width(), height = im.height();
+	for (int depth = 0; depth < GRID_MAX_DEPTH; depth++) {
+		batch_ra.clear();
+		batch_dec.clear();
+		batch_owner.clear();
+		for (int line = 0; line < lines.size(); line++) {
+			QVector<grid_point> &p = points[line];
+			for (int i = 0; i < p.size() - 1; i++) {
+				if (p[i].done) continue;
+				bool valid0 = !std::isnan(p[i].x), valid1 = !std::isnan(p[i + 1].x);
+				bool outside =
+					(p[i].x < 0 && p[i + 1].x < 0) || (p[i].x > width && p[i + 1].x > width) ||
+					(p[i].y < 0 && p[i + 1].y < 0) || (p[i].y > height && p[i + 1].y > height);
+				if ((!valid0 && !valid1) || (valid0 && valid1 && outside)) {
+					p[i].done = true;
+					continue;
+				}
+				add(line, (p[i].t + p[i + 1].t) / 2, i);
+			}
+		}
+		if (batch_ra.isEmpty()) break;
+		project();
+
+		// insert from the end of each line so that the segment indexes stay valid
+		for (int i = batch_ra.size() - 1; i >= 0; i--) {
+			QVector<grid_point> &p = points[batch_owner[i].first];
+			int segment = batch_owner[i].second;
+			grid_point &p0 = p[segment];
+			grid_point &p1 = p[segment + 1];
+			bool split;
+			if (std::isnan(p0.x) || std::isnan(p1.x)) {
+				split = true;
+			} else if (std::isnan(batch_x[i])) {
+				split = true;
+			} else {
+				split = hypot(batch_x[i] - (p0.x + p1.x) / 2, batch_y[i] - (p0.y + p1.y) / 2) > tolerance;
+			}
+			if (split) {
+				p.insert(segment + 1, { (p0.t + p1.t) / 2, batch_x[i], batch_y[i], false });
+			} else {
+				p0.done = true;
+			}
+		}
+	}
+
+	for (const QVector<grid_point> &p : points) {
+		bool drawing = false;
+		for (const grid_point &point : p) {
+			if (std::isnan(point.x)) {
+				drawing = false;
+			} else if (drawing) {
+				path.lineTo(point.x, point.y);
+			} else {
+				path.moveTo(point.x, point.y);
+				drawing = true;
+			}
+		}
+	}
+
+	// scale bar of one declination step
+	double bar = dec_step / im.m_pix_scale;
+	double bar_x = width * 0.05;
+	double bar_y = height * 0.95;
+	double tick = bar / 20;
+	path.moveTo(bar_x, bar_y);
+	path.lineTo(bar_x + bar, bar_y);
+	path.moveTo(bar_x, bar_y - tick);
+	path.lineTo(bar_x, bar_y + tick);
+	path.moveTo(bar_x + bar, bar_y - tick);
+	path.lineTo(bar_x + bar, bar_y + tick);
+
+	static const char *angle_units[3] = { "°", "'", "\"" };
+	static const char *time_units[3] = { "h", "m", "s" };
+	m_grid_label->setText(gridAngle(dec_step, angle_units) + " / " + gridAngle(ra_step / 15, time_units));
+	m_grid_label->setPos(bar_x, bar_y + tick);
+
+	indigo_debug("WCS grid: %d lines, tolerance %.2f px\n", lines.size(), tolerance);
+	return path;
+}
+
+/* The grid depends on the plate solution and on the zoom, as the lines are subdivided
+   to the screen resolution. Grids are cached in half octave zoom steps. */
+void ImageViewer::updateGrid() {
+	const preview_image &im = m_pixmap->image();
+	double ra, dec, radius;
+	if (!m_show_grid || m_pixmap->pixmap().isNull() || im.wcs_field(&ra, &dec, &radius)) {
+		m_grid_clip->setVisible(false);
+		m_grid_cache.clear();
+		return;
+	}
+
+	double wcs[6] = { im.m_center_ra, im.m_center_dec, im.m_rotation_angle, (double)im.m_parity, im.m_pix_scale, (double)im.width() * im.height() };
+	if (memcmp(wcs, m_grid_wcs, sizeof(wcs))) {
+		memcpy(m_grid_wcs, wcs, sizeof(wcs));
+		m_grid_cache.clear();
+	}
+
+	double scale = m_view->matrix().m11();
+	if (scale <= 0) scale = 1;
+	int zoom = (int)floor(log2(scale) * 2);
+	auto grid = m_grid_cache.find(zoom);
+	if (grid == m_grid_cache.end()) {
+		grid = m_grid_cache.insert(zoom, makeGrid(im, GRID_TOLERANCE / pow(2, (zoom + 1) / 2.0)));
+	}
+	m_grid_clip->setRect(0, 0, im.width(), im.height());
+	m_grid->setPath(grid.value());
+	m_grid_clip->setVisible(true);
+}
+
 void ImageViewer::showEdgeClipping(bool show) {
 	if (show) {
 		m_edge_clipping_visible = true;
@@ -661,6 +989,8 @@ void ImageViewer::onSetImage(preview_image &im) {
 		}
 	}
 	m_view->scene()->setSceneRect(0, 0, im.width(), im.height());
+	updateObjects();
+	updateGrid();
 
 	if (m_fit) zoomFit();
 
@@ -713,6 +1043,7 @@ void ImageViewer::setMatrix() {
 	matrix.scale(scale, scale);
 
 	m_view->setMatrix(matrix);
+	updateGrid();
 	emit zoomChanged(m_view->matrix().m11());
 }
 
@@ -722,6 +1053,7 @@ void ImageViewer::zoomFit() {
 	showZoom();
 	indigo_debug("Zoom FIT = %.2f", m_zoom_level);
 	m_fit = true;
+	updateGrid();
 	emit zoomChanged(m_view->matrix().m11());
 }
 
@@ -1012,7 +1344,10 @@ void PixmapItem::setImage(preview_image im) {
 	m_image = im;
 	indigo_debug("%s MIMAGE m_raw_data = %p",__FUNCTION__, m_image.m_raw_data);
 
-	setPixmap(QPixmap::fromImage(m_image));
+	{
+		PIPE_TRACE(PIPE_TRACE_FROM_IMAGE);
+		setPixmap(QPixmap::fromImage(m_image));
+	}
 
 	if (image_size != m_image.size())
 		emit sizeChanged(m_image.width(), m_image.height());
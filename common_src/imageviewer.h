@@ -4,7 +4,11 @@
 #include <QFrame>
 #include <image_stats.h>
 #include <imagepreview.h>
+#include <stardetector.h>
 #include <QGraphicsPixmapItem>
+#include <QVector>
+#include <QMap>
+#include <QPainterPath>
 
 QT_BEGIN_NAMESPACE
 class QLabel;
@@ -13,6 +17,27 @@ QT_END_NAMESPACE
 class PixmapItem;
 class GraphicsView;
 class QToolButton;
+class QGraphicsPathItem;
+class QGraphicsSimpleTextItem;
+
+/// Catalog object shown on plate solved images, ra, dec and radius in degrees
+typedef struct {
+	double ra;
+	double dec;
+	double radius;
+	QString label;
+} image_object;
+
+/**
+ * @brief ImageObjectSource provides the objects in a field of view
+ */
+class ImageObjectSource {
+public:
+	virtual ~ImageObjectSource() {};
+
+	/// Objects within radius of ra, dec, everything in degrees
+	virtual void objectsInField(double ra, double dec, double radius, QVector<image_object> &objects) = 0;
+};
 
 /**
  * @brief ImageViewer displays images and allows basic interaction with it
@@ -61,6 +86,9 @@ public:
 	void showStretchButton(bool show);
 	void showZoomButtons(bool show);
 
+	/// Catalog objects shown on plate solved images
+	void setObjectSource(ImageObjectSource *source);
+
 public slots:
 	void setText(const QString &txt);
 	void setToolTip(const QString &txt);
@@ -79,6 +107,10 @@ public slots:
 	void centerReference();
 
 	void showWCS(bool show);
+	void showObjects(bool show);
+	void showGrid(bool show);
+	/* marks the stars with circles of their HFD, an empty list clears them */
+	void setStars(const std::vector<detected_star> &stars);
 
 	void showEdgeClipping(bool show);
 	void resizeEdgeClipping(double edge_clipping);
@@ -130,6 +162,9 @@ protected:
 private:
 	void setMatrix();
 	void makeToolbar(bool show_prev_next, bool show_debayer);
+	void updateObjects();
+	void updateGrid();
+	QPainterPath makeGrid(const preview_image &im, double tolerance);
 
 private:
 	void showZoom();
@@ -149,12 +184,23 @@ private:
 	double m_edge_clipping_v;
 	QList<QGraphicsEllipseItem*> m_extra_selections;
 	bool m_extra_selections_visible;
+	ImageObjectSource *m_object_source;
+	QGraphicsPathItem *m_objects;
+	QList<QGraphicsSimpleTextItem*> m_object_labels;
+	QGraphicsPathItem *m_stars;
+	QGraphicsRectItem *m_grid_clip;
+	QGraphicsPathItem *m_grid;
+	QGraphicsSimpleTextItem *m_grid_label;
+	QMap<int, QPainterPath> m_grid_cache;
+	double m_grid_wcs[6];
 
 	QWidget *m_toolbar;
 	bool m_fit;
 	bool m_selection_visible;
 	bool m_ref_visible;
 	bool m_show_wcs;
+	bool m_show_objects;
+	bool m_show_grid;
 	bool m_edge_clipping_visible;
 	ToolBarMode m_bar_mode;
 	QToolButton *m_stretch_button;
@@ -0,0 +1,594 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <QElapsedTimer>
+#include <pixelformat.h>
+#include <livestack.h>
+#include <utils.h>
+#include <pipetrace.h>
+
+#define MIN_ROWS_TO_PARALLELIZE 64
+#define STAR_SEPARATION 3           /* binned pixels */
+#define STAR_MIN_NEIGHBOURS 2       /* above the threshold, a lone pixel is not a star */
+#define BACKGROUND_SAMPLES 16384
+#define TRIANGLE_MIN_SIDE 20.0      /* pixels */
+#define TRIANGLE_MIN_RATIO 0.1
+#define TRIANGLE_MIN_DIFFERENCE 0.03
+#define TRIANGLE_TOLERANCE 0.01
+#define MIN_VOTES 2
+
+typedef struct {
+	float ratio1;    /* middle / longest side */
+	float ratio2;    /* shortest / longest side */
+	int vertex[3];   /* opposite to the longest, middle and shortest side */
+} triangle;
+
+static int worker_threads() {
+	int max_threads = get_number_of_cores();
+	return (max_threads > 0) ? max_threads : AIN_DEFAULT_THREADS;
+}
+
+/* func(start_row, end_row) on row bands, one per worker thread */
+template <typename F> static void parallel_rows(int rows, F func) {
+	const int max_threads = worker_threads();
+	if (rows < MIN_ROWS_TO_PARALLELIZE || max_threads == 1) {
+		func(0, rows);
+		return;
+	}
+	const int chunk = (rows + max_threads - 1) / max_threads;
+	std::vector<std::thread> threads;
+	for (int rank = 0; rank < max_threads; rank++) {
+		const int start = chunk * rank;
+		const int end = std::min(start + chunk, rows);
+		if (start >= end) break;
+		threads.emplace_back(func, start, end);
+	}
+	for (auto &thread : threads) {
+		thread.join();
+	}
+}
+
+static int frame_channels(int pix_format) {
+	switch (pix_format) {
+		case PIX_FMT_Y8:
+		case PIX_FMT_Y16:
+		case PIX_FMT_Y32:
+		case PIX_FMT_F32:
+			return 1;
+		case PIX_FMT_RGB24:
+		case PIX_FMT_RGB48:
+		case PIX_FMT_RGB96:
+		case PIX_FMT_RGBF:
+			return 3;
+		default:
+			return 0;
+	}
+}
+
+/* as getRange() in stretcher.cpp */
+static double frame_range(int pix_format) {
+	switch (pix_format) {
+		case PIX_FMT_Y8:
+		case PIX_FMT_RGB24:
+			return (double)0xFF;
+		case PIX_FMT_Y16:
+		case PIX_FMT_RGB48:
+			return (double)0xFFFF;
+		default:
+			return (double)0xFFFFFFFF;
+	}
+}
+
+/* Stars */
+
+template <typename T> static void bin_luminance(const T *data, int width, int channels, float *output, int out_width, int out_height) {
+	const bool yield = !is_priority_thread();
+	parallel_rows(out_height, [=](int start, int end) {
+		for (int y = start; y < end; y++) {
+			if (yield) yield_to_priority_work();
+			const T *row0 = data + (size_t)2 * y * width * channels;
+			const T *row1 = row0 + (size_t)width * channels;
+			float *out = output + (size_t)y * out_width;
+			for (int x = 0; x < out_width; x++) {
+				const T *p0 = row0 + 2 * x * channels;
+				const T *p1 = row1 + 2 * x * channels;
+				float sum = 0;
+				for (int c = 0; c < 2 * channels; c++) {
+					sum += (float)p0[c] + (float)p1[c];
+				}
+				out[x] = sum;
+			}
+		}
+	});
+}
+
+static void background_and_noise(const float *image, size_t size, float *background, float *sigma) {
+	std::vector<float> samples;
+	const size_t step = std::max((size_t)1, size / BACKGROUND_SAMPLES);
+	samples.reserve(size / step + 1);
+	for (size_t i = 0; i < size; i += step) {
+		samples.push_back(image[i]);
+	}
+	std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+	const float median = samples[samples.size() / 2];
+	for (float &sample : samples) {
+		sample = fabsf(sample - median);
+	}
+	std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+	*background = median;
+	*sigma = samples[samples.size() / 2] * 1.4826f;
+}
+
+int live_stack_find_stars(const preview_image *frame, int max_stars, std::vector<live_stack_star> &stars) {
+	stars.clear();
+	const int channels = frame_channels(frame->m_pix_format);
+	if (frame->m_raw_data == nullptr || channels == 0) return 0;
+	const int width = frame->m_width / 2;
+	const int height = frame->m_height / 2;
+	if (width < 16 || height < 16) return 0;
+
+	std::vector<float> binned((size_t)width * height);
+	switch (frame->m_pix_format) {
+		case PIX_FMT_Y8:
+		case PIX_FMT_RGB24:
+			bin_luminance((const uint8_t *)frame->m_raw_data, frame->m_width, channels, binned.data(), width, height);
+			break;
+		case PIX_FMT_Y16:
+		case PIX_FMT_RGB48:
+			bin_luminance((const uint16_t *)frame->m_raw_data, frame->m_width, channels, binned.data(), width, height);
+			break;
+		case PIX_FMT_Y32:
+		case PIX_FMT_RGB96:
+			bin_luminance((const uint32_t *)frame->m_raw_data, frame->m_width, channels, binned.data(), width, height);
+			break;
+		default:
+			bin_luminance((const float *)frame->m_raw_data, frame->m_width, channels, binned.data(), width, height);
+			break;
+	}
+
+	float background, sigma;
+	background_and_noise(binned.data(), binned.size(), &background, &sigma);
+	const float threshold = background + LIVE_STACK_DETECTION_SIGMA * sigma;
+
+	// local maxima with enough pixels above the threshold, centroid of the 5x5 box around them
+	std::vector<std::vector<live_stack_star>> found(worker_threads());
+	std::atomic<int> next_band(0);
+	const float *image = binned.data();
+	parallel_rows(height - 4, [&, image](int start, int end) {
+		std::vector<live_stack_star> &band_stars = found[next_band++];
+		for (int y = start + 2; y < end + 2; y++) {
+			const float *row = image + (size_t)y * width;
+			for (int x = 2; x < width - 2; x++) {
+				const float v = row[x];
+				if (v <= threshold) continue;
+				const float *up = row - width;
+				const float *down = row + width;
+				// ties go to the upper left pixel of a saturated plateau
+				if (v <= row[x - 1] || v <= up[x - 1] || v <= up[x] || v <= up[x + 1]) continue;
+				if (v < row[x + 1] || v < down[x - 1] || v < down[x] || v < down[x + 1]) continue;
+				int neighbours = (row[x - 1] > threshold) + (row[x + 1] > threshold) + (up[x] > threshold) + (down[x] > threshold);
+				if (neighbours < STAR_MIN_NEIGHBOURS) continue;
+				double sum = 0, sum_x = 0, sum_y = 0;
+				for (int dy = -2; dy <= 2; dy++) {
+					const float *box = row + dy * width;
+					for (int dx = -2; dx <= 2; dx++) {
+						double w = box[x + dx] - background;
+						if (w <= 0) continue;
+						sum += w;
+						sum_x += w * dx;
+						sum_y += w * dy;
+					}
+				}
+				if (sum <= 0) continue;
+				live_stack_star star;
+				star.x = 2 * (x + sum_x / sum) + 0.5;
+				star.y = 2 * (y + sum_y / sum) + 0.5;
+				star.flux = sum;
+				band_stars.push_back(star);
+			}
+		}
+	});
+
+	std::vector<live_stack_star> candidates;
+	for (auto &band_stars : found) {
+		candidates.insert(candidates.end(), band_stars.begin(), band_stars.end());
+	}
+	std::sort(candidates.begin(), candidates.end(), [](const live_stack_star &a, const live_stack_star &b) {
+		return a.flux > b.flux;
+	});
+	// a fainter peak next to a brighter one is a part of the same star
+	const double separation = 2.0 * STAR_SEPARATION * 2.0 * STAR_SEPARATION;
+	for (const live_stack_star &candidate : candidates) {
+		bool close = false;
+		for (const live_stack_star &star : stars) {
+			double dx = star.x - candidate.x;
+			double dy = star.y - candidate.y;
+			if (dx * dx + dy * dy < separation) {
+				close = true;
+				break;
+			}
+		}
+		if (close) continue;
+		stars.push_back(candidate);
+		if ((int)stars.size() >= max_stars) break;
+	}
+	return (int)stars.size();
+}
+
+/* Alignment */
+
+static void create_triangles(const std::vector<live_stack_star> &stars, int count, std::vector<triangle> &triangles) {
+	triangles.clear();
+	for (int i = 0; i < count; i++) {
+		for (int j = i + 1; j < count; j++) {
+			for (int k = j + 1; k < count; k++) {
+				const int vertex[3] = { i, j, k };
+				double side[3];
+				side[0] = hypot(stars[j].x - stars[k].x, stars[j].y - stars[k].y);
+				side[1] = hypot(stars[i].x - stars[k].x, stars[i].y - stars[k].y);
+				side[2] = hypot(stars[i].x - stars[j].x, stars[i].y - stars[j].y);
+				int order[3] = { 0, 1, 2 };
+				std::sort(order, order + 3, [&side](int a, int b) { return side[a] > side[b]; });
+				const double a = side[order[0]], b = side[order[1]], c = side[order[2]];
+				if (a < TRIANGLE_MIN_SIDE || c / a < TRIANGLE_MIN_RATIO) continue;
+				// the order of nearly equal sides is not reliable
+				if ((a - b) / a < TRIANGLE_MIN_DIFFERENCE || (b - c) / a < TRIANGLE_MIN_DIFFERENCE) continue;
+				triangle t;
+				t.ratio1 = b / a;
+				t.ratio2 = c / a;
+				for (int v = 0; v < 3; v++) {
+					t.vertex[v] = vertex[order[v]];
+				}
+				triangles.push_back(t);
+			}
+		}
+	}
+	std::sort(triangles.begin(), triangles.end(), [](const triangle &a, const triangle &b) {
+		return a.ratio1 < b.ratio1;
+	});
+}
+
+static bool solve3(double m[3][3], const double r[3], double x[3]) {
+	double det =
+		m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+		m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+		m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+	if (fabs(det) < 1e-12) return false;
+	for (int i = 0; i < 3; i++) {
+		double c[3][3];
+		memcpy(c, m, sizeof(c));
+		for (int j = 0; j < 3; j++) {
+			c[j][i] = r[j];
+		}
+		x[i] = (
+			c[0][0] * (c[1][1] * c[2][2] - c[1][2] * c[2][1]) -
+			c[0][1] * (c[1][0] * c[2][2] - c[1][2] * c[2][0]) +
+			c[0][2] * (c[1][0] * c[2][1] - c[1][1] * c[2][0])
+		) / det;
+	}
+	return true;
+}
+
+/* least squares, the coordinates are centered for the conditioning */
+static bool fit_affine(const std::vector<live_stack_star> &from, const std::vector<live_stack_star> &to, live_stack_transform *transform) {
+	const int count = (int)from.size();
+	double cx = 0, cy = 0;
+	for (int i = 0; i < count; i++) {
+		cx += from[i].x;
+		cy += from[i].y;
+	}
+	cx /= count;
+	cy /= count;
+	double m[3][3] = {{0}};
+	double rx[3] = {0}, ry[3] = {0};
+	for (int i = 0; i < count; i++) {
+		const double p[3] = { 1, from[i].x - cx, from[i].y - cy };
+		for (int j = 0; j < 3; j++) {
+			for (int k = 0; k < 3; k++) {
+				m[j][k] += p[j] * p[k];
+			}
+			rx[j] += p[j] * to[i].x;
+			ry[j] += p[j] * to[i].y;
+		}
+	}
+	double a[3], b[3];
+	if (!solve3(m, rx, a) || !solve3(m, ry, b)) return false;
+	transform->a[0] = a[0] - a[1] * cx - a[2] * cy;
+	transform->a[1] = a[1];
+	transform->a[2] = a[2];
+	transform->b[0] = b[0] - b[1] * cx - b[2] * cy;
+	transform->b[1] = b[1];
+	transform->b[2] = b[2];
+	return true;
+}
+
+int live_stack_align(const std::vector<live_stack_star> &reference, const std::vector<live_stack_star> &stars, live_stack_transform *transform) {
+	const int reference_count = std::min((int)reference.size(), LIVE_STACK_MATCH_STARS);
+	const int count = std::min((int)stars.size(), LIVE_STACK_MATCH_STARS);
+	if (reference_count < 3 || count < 3) return 0;
+
+	std::vector<triangle> reference_triangles, triangles;
+	create_triangles(reference, reference_count, reference_triangles);
+	create_triangles(stars, count, triangles);
+
+	// every pair of similar triangles votes for the correspondence of its vertices
+	std::vector<int> votes(reference_count * count, 0);
+	for (const triangle &t : triangles) {
+		auto i = std::lower_bound(reference_triangles.begin(), reference_triangles.end(), t.ratio1 - TRIANGLE_TOLERANCE, [](const triangle &a, float ratio) {
+			return a.ratio1 < ratio;
+		});
+		for (; i != reference_triangles.end() && i->ratio1 <= t.ratio1 + TRIANGLE_TOLERANCE; ++i) {
+			if (fabsf(i->ratio2 - t.ratio2) > TRIANGLE_TOLERANCE) continue;
+			for (int v = 0; v < 3; v++) {
+				votes[i->vertex[v] * count + t.vertex[v]]++;
+			}
+		}
+	}
+
+	// mutually best correspondences
+	std::vector<live_stack_star> from, to;
+	for (int r = 0; r < reference_count; r++) {
+		int best = -1, best_votes = MIN_VOTES - 1;
+		for (int s = 0; s < count; s++) {
+			if (votes[r * count + s] > best_votes) {
+				best_votes = votes[r * count + s];
+				best = s;
+			}
+		}
+		if (best < 0) continue;
+		bool mutual = true;
+		for (int other = 0; other < reference_count; other++) {
+			if (other != r && votes[other * count + best] >= best_votes) {
+				mutual = false;
+				break;
+			}
+		}
+		if (!mutual) continue;
+		from.push_back(reference[r]);
+		to.push_back(stars[best]);
+	}
+
+	// drop the worst match until all fit
+	while ((int)from.size() >= LIVE_STACK_MIN_MATCHES) {
+		if (!fit_affine(from, to, transform)) return 0;
+		int worst = -1;
+		double worst_residual = LIVE_STACK_MAX_RESIDUAL;
+		for (int i = 0; i < (int)from.size(); i++) {
+			double x = transform->a[0] + transform->a[1] * from[i].x + transform->a[2] * from[i].y;
+			double y = transform->b[0] + transform->b[1] * from[i].x + transform->b[2] * from[i].y;
+			double residual = hypot(x - to[i].x, y - to[i].y);
+			if (residual > worst_residual) {
+				worst_residual = residual;
+				worst = i;
+			}
+		}
+		if (worst < 0) {
+			// the same optics, only shift and rotation are expected
+			double scale = sqrt(fabs(transform->a[1] * transform->b[2] - transform->a[2] * transform->b[1]));
+			if (fabs(scale - 1) > LIVE_STACK_MAX_SCALE_CHANGE) {
+				indigo_debug("Live stack: scale %.3f rejected\n", scale);
+				return 0;
+			}
+			return (int)from.size();
+		}
+		from.erase(from.begin() + worst);
+		to.erase(to.begin() + worst);
+	}
+	return 0;
+}
+
+/* Stack */
+
+template <typename T> static void accumulate_frame(const T *data, int width, int height, int channels, const live_stack_transform &t, bool kappa_sigma, float *mean, float *m2, uint16_t *count) {
+	const bool yield = !is_priority_thread();
+	parallel_rows(height, [=, &t](int start, int end) {
+		const float kappa = LIVE_STACK_KAPPA;
+		const size_t stride = (size_t)width * channels;
+		for (int y = start; y < end; y++) {
+			if (yield) yield_to_priority_work();
+			double sx = t.a[0] + t.a[2] * y;
+			double sy = t.b[0] + t.b[2] * y;
+			for (int x = 0; x < width; x++, sx += t.a[1], sy += t.b[1]) {
+				if (sx < 0 || sy < 0 || sx > width - 1 || sy > height - 1) continue;
+				const int ix = std::min((int)sx, width - 2);
+				const int iy = std::min((int)sy, height - 2);
+				const float fx = sx - ix;
+				const float fy = sy - iy;
+				const float w00 = (1 - fx) * (1 - fy), w01 = fx * (1 - fy), w10 = (1 - fx) * fy, w11 = fx * fy;
+				const T *p = data + iy * stride + (size_t)ix * channels;
+				const size_t index = (size_t)y * width + x;
+				const int n = count[index];
+				float *pixel_mean = mean + index * channels;
+				float *pixel_m2 = m2 + index * channels;
+				for (int c = 0; c < channels; c++) {
+					float v = w00 * p[c] + w01 * p[c + channels] + w10 * p[c + stride] + w11 * p[c + stride + channels];
+					if (kappa_sigma) {
+						if (n >= LIVE_STACK_SIGMA_MIN_FRAMES) {
+							const float limit = kappa * sqrtf(pixel_m2[c] / (n - 1));
+							v = std::min(std::max(v, pixel_mean[c] - limit), pixel_mean[c] + limit);
+						}
+						const float delta = v - pixel_mean[c];
+						pixel_mean[c] += delta / (n + 1);
+						pixel_m2[c] += delta * (v - pixel_mean[c]);
+					} else {
+						pixel_mean[c] += (v - pixel_mean[c]) / (n + 1);
+					}
+				}
+				count[index] = n + 1;
+			}
+		}
+	});
+}
+
+LiveStack::LiveStack() :
+	m_enabled(false),
+	m_reset_requested(false),
+	m_mode(LIVE_STACK_MEAN),
+	m_stack_mode(LIVE_STACK_MEAN),
+	m_width(0),
+	m_height(0),
+	m_channels(0),
+	m_pix_format(0),
+	m_input_range(1),
+	m_frames(0) {
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void LiveStack::set_mode(live_stack_mode mode) {
+	if (m_mode.exchange(mode) != mode) reset();
+}
+
+void LiveStack::clear() {
+	m_frames = 0;
+	m_reference_stars.clear();
+	// release the memory, the next stack may be of a different size
+	std::vector<float>().swap(m_mean);
+	std::vector<float>().swap(m_m2);
+	std::vector<uint16_t>().swap(m_count);
+	QMutexLocker lock(&m_stats_mutex);
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void LiveStack::start(const preview_image *frame, const std::vector<live_stack_star> &stars) {
+	clear();
+	m_width = frame->m_width;
+	m_height = frame->m_height;
+	m_pix_format = frame->m_pix_format;
+	m_channels = frame_channels(m_pix_format);
+	m_input_range = frame_range(m_pix_format);
+	m_stack_mode = mode();
+	m_reference_stars = stars;
+	const size_t size = (size_t)m_width * m_height * m_channels;
+	m_mean.assign(size, 0);
+	if (m_stack_mode == LIVE_STACK_KAPPA_SIGMA) m_m2.assign(size, 0);
+	m_count.assign((size_t)m_width * m_height, 0);
+	indigo_debug("Live stack: %dx%d %d channels, %d reference stars\n", m_width, m_height, m_channels, (int)stars.size());
+}
+
+void LiveStack::accumulate(const preview_image *frame, const live_stack_transform &transform) {
+	const bool kappa_sigma = m_stack_mode == LIVE_STACK_KAPPA_SIGMA;
+	float *m2 = kappa_sigma ? m_m2.data() : nullptr;
+	switch (m_pix_format) {
+		case PIX_FMT_Y8:
+		case PIX_FMT_RGB24:
+			accumulate_frame((const uint8_t *)frame->m_raw_data, m_width, m_height, m_channels, transform, kappa_sigma, m_mean.data(), m2, m_count.data());
+			break;
+		case PIX_FMT_Y16:
+		case PIX_FMT_RGB48:
+			accumulate_frame((const uint16_t *)frame->m_raw_data, m_width, m_height, m_channels, transform, kappa_sigma, m_mean.data(), m2, m_count.data());
+			break;
+		case PIX_FMT_Y32:
+		case PIX_FMT_RGB96:
+			accumulate_frame((const uint32_t *)frame->m_raw_data, m_width, m_height, m_channels, transform, kappa_sigma, m_mean.data(), m2, m_count.data());
+			break;
+		default:
+			accumulate_frame((const float *)frame->m_raw_data, m_width, m_height, m_channels, transform, kappa_sigma, m_mean.data(), m2, m_count.data());
+			break;
+	}
+	m_frames++;
+}
+
+live_stack_result LiveStack::add(const preview_image *frame) {
+	PIPE_TRACE(PIPE_TRACE_STACK);
+	QElapsedTimer timer;
+	timer.start();
+	QMutexLocker lock(&m_mutex);
+	if (m_reset_requested.exchange(false)) clear();
+
+	if (frame->m_raw_data == nullptr || frame_channels(frame->m_pix_format) == 0 || frame->m_width < 2 || frame->m_height < 2) {
+		set_stats(LIVE_STACK_UNSUPPORTED, 0, 0, nullptr, 0);
+		return LIVE_STACK_UNSUPPORTED;
+	}
+	std::vector<live_stack_star> stars;
+	int star_count = live_stack_find_stars(frame, LIVE_STACK_MAX_STARS, stars);
+	if (star_count < LIVE_STACK_MIN_MATCHES) {
+		set_stats(LIVE_STACK_NO_STARS, star_count, 0, nullptr, timer.nsecsElapsed() / 1e6);
+		return LIVE_STACK_NO_STARS;
+	}
+
+	live_stack_transform transform = {{ 0, 1, 0 }, { 0, 0, 1 }};
+	live_stack_result result;
+	int matches = 0;
+	if (m_frames == 0 || frame->m_width != m_width || frame->m_height != m_height || frame->m_pix_format != m_pix_format) {
+		start(frame, stars);
+		matches = star_count;
+		result = LIVE_STACK_REFERENCE;
+	} else if (m_frames >= LIVE_STACK_MAX_FRAMES) {
+		set_stats(LIVE_STACK_FULL, star_count, 0, nullptr, timer.nsecsElapsed() / 1e6);
+		return LIVE_STACK_FULL;
+	} else {
+		matches = live_stack_align(m_reference_stars, stars, &transform);
+		if (matches == 0) {
+			set_stats(LIVE_STACK_NO_MATCH, star_count, 0, nullptr, timer.nsecsElapsed() / 1e6);
+			return LIVE_STACK_NO_MATCH;
+		}
+		result = LIVE_STACK_ADDED;
+	}
+	accumulate(frame, transform);
+	set_stats(result, star_count, matches, &transform, timer.nsecsElapsed() / 1e6);
+	indigo_debug("Live stack: frame %d, %d stars, %d matched, %.1f ms\n", m_frames, star_count, matches, timer.nsecsElapsed() / 1e6);
+	return result;
+}
+
+void LiveStack::set_stats(live_stack_result result, int stars, int matches, const live_stack_transform *transform, double ms) {
+	QMutexLocker lock(&m_stats_mutex);
+	m_stats.stacked = m_frames;
+	if (result != LIVE_STACK_ADDED && result != LIVE_STACK_REFERENCE && m_frames > 0) m_stats.rejected++;
+	m_stats.last_result = result;
+	m_stats.last_stars = stars;
+	m_stats.last_matches = matches;
+	m_stats.last_ms = ms;
+	if (transform) {
+		const double cx = m_width / 2.0;
+		const double cy = m_height / 2.0;
+		m_stats.last_dx = transform->a[0] + transform->a[1] * cx + transform->a[2] * cy - cx;
+		m_stats.last_dy = transform->b[0] + transform->b[1] * cx + transform->b[2] * cy - cy;
+		m_stats.last_rotation = atan2(transform->b[1], transform->a[1]) * 180 / M_PI;
+	}
+}
+
+live_stack_stats LiveStack::stats() {
+	QMutexLocker lock(&m_stats_mutex);
+	return m_stats;
+}
+
+preview_image *LiveStack::create_preview(const stretch_config_t sconfig) {
+	QMutexLocker lock(&m_mutex);
+	if (m_frames == 0) return nullptr;
+	// float previews have the range of uint32_t
+	const float scale = (double)0xFFFFFFFF / m_input_range;
+	const size_t row_size = (size_t)m_width * m_channels;
+	float *data = (float *)malloc(row_size * m_height * sizeof(float));
+	const float *mean = m_mean.data();
+	parallel_rows(m_height, [=](int start, int end) {
+		for (size_t i = start * row_size; i < end * row_size; i++) {
+			data[i] = mean[i] * scale;
+		}
+	});
+	preview_image *img = new preview_image(m_width, m_height, QImage::Format_RGB32);
+	img->m_raw_data = (char *)data;
+	img->m_pix_format = m_channels == 1 ? PIX_FMT_F32 : PIX_FMT_RGBF;
+	img->m_width = m_width;
+	img->m_height = m_height;
+	stretch_preview(img, sconfig);
+	return img;
+}
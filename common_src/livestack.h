@@ -0,0 +1,137 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _LIVESTACK_H
+#define _LIVESTACK_H
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include <QMutex>
+#include <imagepreview.h>
+
+/* Live stacking of the decoded preview frames. Stars are detected on a 2x2
+   binned luminance, matched to the stars of the reference (first) frame by
+   similar triangles and the affine transform fitted to the matches maps the
+   reference grid onto the frame. The warped frame is added to a running float
+   mean, the kappa-sigma mode clips each sample to kappa standard deviations
+   of the mean so far (Welford), which needs one more float per sample. */
+
+#define LIVE_STACK_MAX_STARS 50          /* detected stars kept, the brightest */
+#define LIVE_STACK_MATCH_STARS 15        /* stars forming the triangles */
+#define LIVE_STACK_MIN_MATCHES 4
+#define LIVE_STACK_MAX_RESIDUAL 2.0      /* pixels */
+#define LIVE_STACK_MAX_SCALE_CHANGE 0.05
+#define LIVE_STACK_DETECTION_SIGMA 5.0
+#define LIVE_STACK_KAPPA 2.5
+#define LIVE_STACK_SIGMA_MIN_FRAMES 3    /* frames stacked before clipping starts */
+#define LIVE_STACK_MAX_FRAMES 65535
+
+typedef enum {
+	LIVE_STACK_MEAN = 0,
+	LIVE_STACK_KAPPA_SIGMA
+} live_stack_mode;
+
+typedef enum {
+	LIVE_STACK_ADDED = 0,
+	LIVE_STACK_REFERENCE,      /* the frame started a new stack */
+	LIVE_STACK_NO_STARS,
+	LIVE_STACK_NO_MATCH,
+	LIVE_STACK_FULL,
+	LIVE_STACK_UNSUPPORTED
+} live_stack_result;
+
+typedef struct {
+	int stacked;
+	int rejected;
+	live_stack_result last_result;
+	int last_stars;
+	int last_matches;
+	double last_dx;          /* pixels, shift of the frame center against the reference */
+	double last_dy;
+	double last_rotation;    /* degrees */
+	double last_ms;          /* time to align and add the last frame */
+} live_stack_stats;
+
+typedef struct {
+	double x;                /* full resolution pixels */
+	double y;
+	double flux;
+} live_stack_star;
+
+/* frame_x = a[0] + a[1] * x + a[2] * y, frame_y = b[0] + b[1] * x + b[2] * y */
+typedef struct {
+	double a[3];
+	double b[3];
+} live_stack_transform;
+
+class LiveStack {
+public:
+	LiveStack();
+	~LiveStack() {}
+
+	void set_enabled(bool enabled) { m_enabled = enabled; }
+	bool is_enabled() const { return m_enabled; }
+
+	/* a new mode starts a new stack */
+	void set_mode(live_stack_mode mode);
+	live_stack_mode mode() const { return (live_stack_mode)m_mode.load(); }
+
+	/* the stack is dropped before the next frame is added, does not wait for a running add() */
+	void reset() { m_reset_requested = true; }
+
+	/* frame is a decoded preview with raw data, it is not modified */
+	live_stack_result add(const preview_image *frame);
+
+	/* stretched copy of the stack, nullptr if empty */
+	preview_image *create_preview(const stretch_config_t sconfig);
+	live_stack_stats stats();
+
+private:
+	QMutex m_mutex;
+	QMutex m_stats_mutex;
+	std::atomic<bool> m_enabled;
+	std::atomic<bool> m_reset_requested;
+	std::atomic<int> m_mode;
+	live_stack_mode m_stack_mode;   /* of the current stack */
+
+	int m_width;
+	int m_height;
+	int m_channels;
+	int m_pix_format;         /* of the frames */
+	double m_input_range;
+	int m_frames;
+	std::vector<live_stack_star> m_reference_stars;
+	std::vector<float> m_mean;
+	std::vector<float> m_m2;
+	std::vector<uint16_t> m_count;
+	live_stack_stats m_stats;
+
+	void clear();
+	void start(const preview_image *frame, const std::vector<live_stack_star> &stars);
+	void accumulate(const preview_image *frame, const live_stack_transform &transform);
+	void set_stats(live_stack_result result, int stars, int matches, const live_stack_transform *transform, double ms);
+};
+
+/* brightest stars of the frame, count at most max_stars */
+int live_stack_find_stars(const preview_image *frame, int max_stars, std::vector<live_stack_star> &stars);
+
+/* transform mapping the reference star positions onto the frame star positions, returns the matched stars */
+int live_stack_align(const std::vector<live_stack_star> &reference, const std::vector<live_stack_star> &stars, live_stack_transform *transform);
+
+#endif /* _LIVESTACK_H */
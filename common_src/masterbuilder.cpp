@@ -0,0 +1,434 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <indigo/indigo_bus.h>
+#include <fits.h>
+#include <xisf.h>
+#include <utils.h>
+#include <masterbuilder.h>
+
+static inline uint16_t load16(const uint8_t *p, bool big_endian) {
+	return big_endian ? (p[0] << 8 | p[1]) : (p[1] << 8 | p[0]);
+}
+
+static inline uint32_t load32(const uint8_t *p, bool big_endian) {
+	return big_endian ?
+		((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3]) :
+		((uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0]);
+}
+
+static inline uint64_t load64(const uint8_t *p, bool big_endian) {
+	uint64_t high = load32(big_endian ? p : p + 4, big_endian);
+	uint64_t low = load32(big_endian ? p + 4 : p, big_endian);
+	return high << 32 | low;
+}
+
+static float median(float *values, int count) {
+	const int middle = count / 2;
+	std::nth_element(values, values + middle, values + count);
+	float value = values[middle];
+	if (count % 2 == 0) {
+		value = (value + *std::max_element(values, values + middle)) / 2;
+	}
+	return value;
+}
+
+/* reorders values */
+static float combine_values(float *values, int count, master_combine combine, float kappa) {
+	if (combine == MASTER_MEDIAN) return median(values, count);
+	int kept = count;
+	for (int iteration = 0; iteration < MASTER_SIGMA_ITERATIONS && kept > 2; iteration++) {
+		double sum = 0, sum2 = 0;
+		for (int i = 0; i < kept; i++) {
+			sum += values[i];
+			sum2 += (double)values[i] * values[i];
+		}
+		const double mean = sum / kept;
+		const double sigma = sqrt(std::max(0.0, sum2 / kept - mean * mean));
+		if (sigma == 0) break;
+		// clipped around the median, the mean is pulled by the outliers
+		const float center = median(values, kept);
+		const float limit = kappa * sigma;
+		int n = 0;
+		for (int i = 0; i < kept; i++) {
+			if (fabsf(values[i] - center) <= limit) values[n++] = values[i];
+		}
+		if (n == kept || n == 0) break;
+		kept = n;
+	}
+	double sum = 0;
+	for (int i = 0; i < kept; i++) {
+		sum += values[i];
+	}
+	return sum / kept;
+}
+
+static void fits_card(QByteArray &header, const char *keyword, const char *value) {
+	char card[81];
+	if (value && value[0] == '\'') {
+		snprintf(card, sizeof(card), "%-8s= %-20s", keyword, value);
+	} else if (value) {
+		snprintf(card, sizeof(card), "%-8s= %20s", keyword, value);
+	} else {
+		snprintf(card, sizeof(card), "%-8s", keyword);
+	}
+	header.append(QByteArray(card).leftJustified(80, ' ', true));
+}
+
+MasterBuilder::MasterBuilder() :
+	m_combine(MASTER_SIGMA_CLIPPED_MEAN),
+	m_kappa(MASTER_KAPPA) {
+	memset(&m_info, 0, sizeof(m_info));
+	m_bayerpat[0] = '\0';
+}
+
+MasterBuilder::~MasterBuilder() {
+	for (input_frame &frame : m_frames) {
+		delete frame.file;
+	}
+}
+
+bool MasterBuilder::add_file(const char *file_name) {
+	QFile *file = new QFile(QString::fromUtf8(file_name));
+	if (!file->open(QIODevice::ReadOnly)) {
+		m_error = QString("Can not open '%1'").arg(file_name);
+		delete file;
+		return false;
+	}
+	const qint64 size = file->size();
+	uchar *data = file->map(0, size);
+	if (data == nullptr) {
+		m_error = QString("Can not map '%1'").arg(file_name);
+		delete file;
+		return false;
+	}
+
+	input_frame frame;
+	frame.file = file;
+	frame.scale = 1;
+	char bayerpat[5] = "";
+	bool ok = false;
+	if (size >= 6 && !strncmp((const char *)data, "SIMPLE", 6)) {
+		fits_header header;
+		if (fits_read_header(data, size, &header) == FITS_OK && header.naxis == 2) {
+			frame.data_offset = header.data_offset;
+			frame.bitpix = header.bitpix;
+			frame.is_signed = true;
+			frame.big_endian = true;
+			frame.bzero = header.bzero;
+			frame.bscale = header.bscale;
+			calibration_frame_info_from_fits(&header, &frame.info);
+			strncpy(bayerpat, header.bayerpat, sizeof(bayerpat) - 1);
+			ok = true;
+		} else {
+			m_error = QString("'%1' is not a 2D FITS image").arg(file_name);
+		}
+	} else if (size >= 8 && !strncmp((const char *)data, "XISF0100", 8)) {
+		xisf_metadata metadata;
+		if (xisf_read_metadata(data, size, &metadata) == XISF_OK && metadata.channels == 1 && metadata.compression[0] == '\0') {
+			frame.data_offset = metadata.data_offset;
+			frame.bitpix = metadata.bitpix;
+			frame.is_signed = false;
+			frame.big_endian = metadata.big_endian;
+			frame.bzero = 0;
+			frame.bscale = 1;
+			memset(&frame.info, 0, sizeof(frame.info));
+			frame.info.type = calibration_frame_type_from_string(metadata.image_type);
+			frame.info.width = metadata.width;
+			frame.info.height = metadata.height;
+			frame.info.xbinning = 1;
+			frame.info.ybinning = 1;
+			// -1 if not present
+			frame.info.exposure = metadata.exposure_time >= 0 ? metadata.exposure_time : NAN;
+			frame.info.temperature = metadata.sensor_temperature != -1 ? metadata.sensor_temperature : NAN;
+			frame.info.gain = NAN;
+			strncpy(bayerpat, metadata.bayer_pattern, sizeof(bayerpat) - 1);
+			ok = true;
+		} else {
+			m_error = QString("'%1' is not an uncompressed monochrome or CFA XISF image").arg(file_name);
+		}
+	} else {
+		m_error = QString("'%1' is not a FITS or XISF file").arg(file_name);
+	}
+	file->unmap(data);
+
+	if (ok && frame.bitpix != 8 && frame.bitpix != 16 && frame.bitpix != 32 && frame.bitpix != -32 && frame.bitpix != -64) {
+		m_error = QString("'%1' has unsupported sample format").arg(file_name);
+		ok = false;
+	}
+	if (ok && frame.data_offset + (qint64)frame.info.width * frame.info.height * (abs(frame.bitpix) / 8) > size) {
+		m_error = QString("'%1' is truncated").arg(file_name);
+		ok = false;
+	}
+	if (ok && !m_frames.empty() && (frame.info.width != m_info.width || frame.info.height != m_info.height)) {
+		m_error = QString("'%1' is %2x%3, the frames are %4x%5").arg(file_name).arg(frame.info.width).arg(frame.info.height).arg(m_info.width).arg(m_info.height);
+		ok = false;
+	}
+	if (!ok) {
+		delete file;
+		return false;
+	}
+	if (m_frames.empty()) {
+		m_info = frame.info;
+		strncpy(m_bayerpat, bayerpat, sizeof(m_bayerpat));
+	} else if (frame.info.type != m_info.type) {
+		indigo_error("Master: '%s' is not of the type of the first frame\n", file_name);
+	}
+	m_frames.push_back(frame);
+	return true;
+}
+
+/* thread safe for different frames */
+bool MasterBuilder::read_rows(const input_frame &frame, int first_row, int rows, float *output) {
+	const int sample_size = abs(frame.bitpix) / 8;
+	const qint64 row_size = (qint64)m_info.width * sample_size;
+	const uint8_t *data = frame.file->map(frame.data_offset + first_row * row_size, rows * row_size);
+	if (data == nullptr) return false;
+	const size_t count = (size_t)rows * m_info.width;
+	const double bzero = frame.bzero;
+	const double bscale = frame.bscale * frame.scale;
+	const bool big_endian = frame.big_endian;
+	switch (frame.bitpix) {
+		case 8:
+			for (size_t i = 0; i < count; i++) {
+				output[i] = (data[i] + bzero) * bscale;
+			}
+			break;
+		case 16:
+			for (size_t i = 0; i < count; i++) {
+				uint16_t value = load16(data + 2 * i, big_endian);
+				output[i] = ((frame.is_signed ? (double)(int16_t)value : (double)value) + bzero) * bscale;
+			}
+			break;
+		case 32:
+			for (size_t i = 0; i < count; i++) {
+				uint32_t value = load32(data + 4 * i, big_endian);
+				output[i] = ((frame.is_signed ? (double)(int32_t)value : (double)value) + bzero) * bscale;
+			}
+			break;
+		case -32:
+			for (size_t i = 0; i < count; i++) {
+				uint32_t bits = load32(data + 4 * i, big_endian);
+				float value;
+				memcpy(&value, &bits, sizeof(value));
+				output[i] = (value + bzero) * bscale;
+			}
+			break;
+		case -64:
+			for (size_t i = 0; i < count; i++) {
+				uint64_t bits = load64(data + 8 * i, big_endian);
+				double value;
+				memcpy(&value, &bits, sizeof(value));
+				output[i] = (value + bzero) * bscale;
+			}
+			break;
+	}
+	frame.file->unmap((uchar *)data);
+	return true;
+}
+
+/* median of evenly spaced rows */
+float MasterBuilder::frame_level(const input_frame &frame) {
+	const int rows = std::min(MASTER_LEVEL_SAMPLE_ROWS, m_info.height);
+	std::vector<float> values((size_t)rows * m_info.width);
+	for (int i = 0; i < rows; i++) {
+		const int row = (int)((i + 0.5) * m_info.height / rows);
+		if (!read_rows(frame, row, 1, values.data() + (size_t)i * m_info.width)) return 0;
+	}
+	return median(values.data(), values.size());
+}
+
+QByteArray MasterBuilder::create_header() {
+	static const char *type_names[] = { "'Master Light'", "'Master Dark'", "'Master Flat'", "'Master Bias'", "'Master Dark Flat'" };
+	QByteArray header;
+	char value[80];
+
+	fits_card(header, "SIMPLE", "T");
+	fits_card(header, "BITPIX", "-32");
+	fits_card(header, "NAXIS", "2");
+	snprintf(value, sizeof(value), "%d", m_info.width);
+	fits_card(header, "NAXIS1", value);
+	snprintf(value, sizeof(value), "%d", m_info.height);
+	fits_card(header, "NAXIS2", value);
+	fits_card(header, "IMAGETYP", type_names[m_info.type]);
+
+	// mean of the frames where it is known
+	double exposure = 0, temperature = 0;
+	int exposures = 0, temperatures = 0;
+	for (const input_frame &frame : m_frames) {
+		if (!isnan(frame.info.exposure)) {
+			exposure += frame.info.exposure;
+			exposures++;
+		}
+		if (!isnan(frame.info.temperature)) {
+			temperature += frame.info.temperature;
+			temperatures++;
+		}
+	}
+	if (exposures) {
+		snprintf(value, sizeof(value), "%g", exposure / exposures);
+		fits_card(header, "EXPTIME", value);
+	}
+	if (temperatures) {
+		snprintf(value, sizeof(value), "%.2f", temperature / temperatures);
+		fits_card(header, "CCD-TEMP", value);
+	}
+	if (!isnan(m_info.gain)) {
+		snprintf(value, sizeof(value), "%g", m_info.gain);
+		fits_card(header, "GAIN", value);
+	}
+	snprintf(value, sizeof(value), "%d", m_info.xbinning);
+	fits_card(header, "XBINNING", value);
+	snprintf(value, sizeof(value), "%d", m_info.ybinning);
+	fits_card(header, "YBINNING", value);
+	if (m_info.filter[0] != '\0') {
+		snprintf(value, sizeof(value), "'%s'", m_info.filter);
+		fits_card(header, "FILTER", value);
+	}
+	if (m_bayerpat[0] != '\0') {
+		snprintf(value, sizeof(value), "'%s'", m_bayerpat);
+		fits_card(header, "BAYERPAT", value);
+	}
+	snprintf(value, sizeof(value), "%d", (int)m_frames.size());
+	fits_card(header, "NCOMBINE", value);
+	if (m_combine == MASTER_MEDIAN) {
+		fits_card(header, "COMMENT Combined with median", nullptr);
+	} else {
+		snprintf(value, sizeof(value), "COMMENT Combined with %.1f-sigma clipped mean", m_kappa);
+		fits_card(header, value, nullptr);
+	}
+	fits_card(header, "END", nullptr);
+	int padding = FITS_HEADER_BLOCK_SIZE - header.size() % FITS_HEADER_BLOCK_SIZE;
+	if (padding < FITS_HEADER_BLOCK_SIZE) header.append(padding, ' ');
+	return header;
+}
+
+bool MasterBuilder::build(const char *file_name, std::function<bool(int done, int total)> progress) {
+	if (m_frames.empty()) {
+		m_error = "No frames to combine";
+		return false;
+	}
+	const int width = m_info.width;
+	const int height = m_info.height;
+	const int count = (int)m_frames.size();
+
+	if (m_info.type == CALIBRATION_FLAT) {
+		float reference = 0;
+		for (int i = 0; i < count; i++) {
+			m_frames[i].scale = 1;
+			float level = frame_level(m_frames[i]);
+			if (i == 0) reference = level;
+			m_frames[i].scale = (level > 0 && reference > 0) ? reference / level : 1;
+			indigo_debug("Master: flat %d level %g scale %g\n", i, level, m_frames[i].scale);
+		}
+	}
+
+	const size_t row_memory = (size_t)width * count * sizeof(float);
+	const int strip_rows = std::max(1, std::min(height, (int)(MASTER_STRIP_MEMORY / row_memory)));
+	std::vector<float> strip((size_t)strip_rows * width * count);
+	std::vector<float> result((size_t)strip_rows * width);
+	QByteArray output_data;
+
+	QFile output(QString::fromUtf8(file_name));
+	if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		m_error = QString("Can not create '%1'").arg(file_name);
+		return false;
+	}
+	output.write(create_header());
+
+	int max_threads = get_number_of_cores();
+	max_threads = (max_threads > 0) ? max_threads : AIN_DEFAULT_THREADS;
+	indigo_debug("Master: %d frames %dx%d, %d rows per strip, %d threads\n", count, width, height, strip_rows, max_threads);
+
+	bool ok = true;
+	for (int first_row = 0; first_row < height && ok; first_row += strip_rows) {
+		const int rows = std::min(strip_rows, height - first_row);
+		const size_t strip_size = (size_t)rows * width;
+
+		// the frames are read in parallel, each one by a single thread
+		std::atomic<bool> read_ok(true);
+		std::vector<std::thread> threads;
+		const int read_threads = std::min(max_threads, count);
+		for (int t = 0; t < read_threads; t++) {
+			threads.emplace_back([&, t]() {
+				for (int i = t; i < count; i += read_threads) {
+					if (!read_rows(m_frames[i], first_row, rows, strip.data() + i * strip_size)) read_ok = false;
+				}
+			});
+		}
+		for (auto &thread : threads) {
+			thread.join();
+		}
+		threads.clear();
+		if (!read_ok) {
+			m_error = QString("Can not read rows %1 to %2").arg(first_row).arg(first_row + rows - 1);
+			ok = false;
+			break;
+		}
+
+		const int band = (rows + max_threads - 1) / max_threads;
+		for (int start = 0; start < rows; start += band) {
+			const int end = std::min(rows, start + band);
+			threads.emplace_back([&, start, end]() {
+				std::vector<float> values(count);
+				for (size_t pixel = (size_t)start * width; pixel < (size_t)end * width; pixel++) {
+					for (int i = 0; i < count; i++) {
+						values[i] = strip[i * strip_size + pixel];
+					}
+					result[pixel] = combine_values(values.data(), count, m_combine, m_kappa);
+				}
+			});
+		}
+		for (auto &thread : threads) {
+			thread.join();
+		}
+
+		output_data.resize(strip_size * sizeof(float));
+		uint8_t *bytes = (uint8_t *)output_data.data();
+		for (size_t i = 0; i < strip_size; i++) {
+			uint32_t bits;
+			memcpy(&bits, &result[i], sizeof(bits));
+			bytes[4 * i] = bits >> 24;
+			bytes[4 * i + 1] = bits >> 16;
+			bytes[4 * i + 2] = bits >> 8;
+			bytes[4 * i + 3] = bits;
+		}
+		if (output.write(output_data) != output_data.size()) {
+			m_error = QString("Can not write '%1'").arg(file_name);
+			ok = false;
+		} else if (progress && !progress(first_row + rows, height)) {
+			m_error = "Canceled";
+			ok = false;
+		}
+	}
+
+	if (ok) {
+		int padding = FITS_HEADER_BLOCK_SIZE - output.size() % FITS_HEADER_BLOCK_SIZE;
+		if (padding < FITS_HEADER_BLOCK_SIZE) output.write(QByteArray(padding, '\0'));
+		output.close();
+		indigo_log("Master: %d frames combined to '%s'\n", count, file_name);
+	} else {
+		output.remove();
+	}
+	return ok;
+}
@@ -0,0 +1,90 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _MASTERBUILDER_H
+#define _MASTERBUILDER_H
+
+#include <stdint.h>
+#include <functional>
+#include <vector>
+#include <QFile>
+#include <QString>
+#include <calibration.h>
+
+/* Combines dark, flat or bias frames into a master frame without loading
+   them. The frames are processed in horizontal strips, only the rows of the
+   current strip of every frame are mapped and converted to float, so the
+   memory needed is MASTER_STRIP_MEMORY regardless of the number and the size
+   of the frames. Flats are scaled to the median level of the first frame
+   before combining. The master is written as a 32-bit float FITS file with
+   the acquisition keywords the CalibrationLibrary matches the masters by. */
+
+#define MASTER_STRIP_MEMORY (256 << 20)   /* bytes for the strips of all frames */
+#define MASTER_KAPPA 3.0f
+#define MASTER_SIGMA_ITERATIONS 5
+#define MASTER_LEVEL_SAMPLE_ROWS 64     /* rows read to find the level of a flat */
+
+typedef enum {
+	MASTER_SIGMA_CLIPPED_MEAN = 0,
+	MASTER_MEDIAN
+} master_combine;
+
+class MasterBuilder {
+public:
+	MasterBuilder();
+	~MasterBuilder();
+
+	/* 2D FITS and uncompressed XISF, all frames must have the same size */
+	bool add_file(const char *file_name);
+	int frame_count() const { return (int)m_frames.size(); }
+	const calibration_frame_info &info() const { return m_info; }
+
+	void set_combine(master_combine combine) { m_combine = combine; }
+	void set_kappa(float kappa) { m_kappa = kappa; }
+
+	/* progress is called after each strip with the rows done, returning false cancels the build */
+	bool build(const char *file_name, std::function<bool(int done, int total)> progress = nullptr);
+
+	const QString &error() const { return m_error; }
+
+private:
+	typedef struct {
+		QFile *file;
+		qint64 data_offset;
+		int bitpix;
+		bool is_signed;     /* FITS integers are signed and offset by BZERO */
+		bool big_endian;
+		double bzero;
+		double bscale;
+		float scale;
+		calibration_frame_info info;
+	} input_frame;
+
+	std::vector<input_frame> m_frames;
+	calibration_frame_info m_info;
+	char m_bayerpat[5];
+	master_combine m_combine;
+	float m_kappa;
+	QString m_error;
+
+	bool read_rows(const input_frame &frame, int first_row, int rows, float *output);
+	float frame_level(const input_frame &frame);
+	QByteArray create_header();
+};
+
+#endif /* _MASTERBUILDER_H */
@@ -0,0 +1,278 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <map>
+#include <set>
+#include <string>
+#include <algorithm>
+#include <QThread>
+#include <indigo/indigo_bus.h>
+#include "pipetrace.h"
+
+typedef struct {
+	const char *stage;
+	int64_t start;
+	int64_t end;
+} pipe_trace_event;
+
+/* Written only by its thread, the mutex is contended only while exporting. */
+typedef struct {
+	std::mutex mutex;
+	int tid;
+	char name[64];
+	pipe_trace_event events[PIPE_TRACE_EVENTS];
+	uint64_t count;
+} pipe_trace_buffer;
+
+typedef struct {
+	int tid;
+	pipe_trace_event event;
+} pipe_trace_retired_event;
+
+std::atomic<bool> pipe_trace_on(false);
+
+static std::mutex buffers_mutex;
+static std::vector<pipe_trace_buffer *> buffers;
+static int next_tid = 1;
+
+/* Pool threads expire when idle, the events of the finished threads are kept in
+   one more ring of PIPE_TRACE_EVENTS with the names of their threads. */
+static std::vector<pipe_trace_retired_event> retired_events;
+static uint64_t retired_count = 0;
+static std::map<int, std::string> retired_names;
+
+static void retire_buffer(pipe_trace_buffer *buffer);
+
+/* frees the buffer when its thread finishes */
+class pipe_trace_thread {
+public:
+	pipe_trace_buffer *buffer = nullptr;
+
+	~pipe_trace_thread() {
+		if (buffer) retire_buffer(buffer);
+	}
+};
+
+static thread_local pipe_trace_thread thread_buffer;
+
+static const char *stage_order[] = {
+	PIPE_TRACE_BLOB,
+	PIPE_TRACE_DOWNLOAD,
+	PIPE_TRACE_DECODE,
+	PIPE_TRACE_CALIBRATE,
+	PIPE_TRACE_DEFECTS,
+	PIPE_TRACE_DEBAYER,
+	PIPE_TRACE_STACK,
+	PIPE_TRACE_COMPUTE_PARAMS,
+	PIPE_TRACE_STRETCH,
+	PIPE_TRACE_IMAGE_STATS,
+	PIPE_TRACE_FROM_IMAGE,
+	PIPE_TRACE_SAVE
+};
+
+void pipe_trace_enable(bool enable) {
+	pipe_trace_on.store(enable, std::memory_order_relaxed);
+	indigo_debug("Pipeline tracing %s\n", enable ? "enabled" : "disabled");
+}
+
+int64_t pipe_trace_now() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static pipe_trace_buffer *get_thread_buffer() {
+	if (thread_buffer.buffer) return thread_buffer.buffer;
+	pipe_trace_buffer *buffer = new pipe_trace_buffer;
+	buffer->count = 0;
+	QString name = QThread::currentThread()->objectName();
+	std::lock_guard<std::mutex> lock(buffers_mutex);
+	buffer->tid = next_tid++;
+	if (name.isEmpty()) {
+		snprintf(buffer->name, sizeof(buffer->name), "Thread %d", buffer->tid);
+	} else {
+		snprintf(buffer->name, sizeof(buffer->name), "%s", name.toUtf8().constData());
+	}
+	buffers.push_back(buffer);
+	thread_buffer.buffer = buffer;
+	return buffer;
+}
+
+/* called on the exit of the thread of the buffer */
+static void retire_buffer(pipe_trace_buffer *buffer) {
+	std::lock_guard<std::mutex> lock(buffers_mutex);
+	buffers.erase(std::remove(buffers.begin(), buffers.end(), buffer), buffers.end());
+	uint64_t first = buffer->count > PIPE_TRACE_EVENTS ? buffer->count - PIPE_TRACE_EVENTS : 0;
+	for (uint64_t i = first; i < buffer->count; i++) {
+		pipe_trace_retired_event retired = { buffer->tid, buffer->events[i % PIPE_TRACE_EVENTS] };
+		if (retired_events.size() < PIPE_TRACE_EVENTS) {
+			retired_events.push_back(retired);
+		} else {
+			retired_events[retired_count % PIPE_TRACE_EVENTS] = retired;
+		}
+		retired_count++;
+	}
+	if (buffer->count > 0) {
+		retired_names[buffer->tid] = buffer->name;
+		// only the names of the threads with events left in the ring
+		std::set<int> tids;
+		for (const pipe_trace_retired_event &retired : retired_events) tids.insert(retired.tid);
+		for (auto name = retired_names.begin(); name != retired_names.end();) {
+			if (tids.count(name->first)) {
+				++name;
+			} else {
+				name = retired_names.erase(name);
+			}
+		}
+	}
+	delete buffer;
+}
+
+void pipe_trace_add(const char *stage, int64_t start, int64_t end) {
+	pipe_trace_buffer *buffer = get_thread_buffer();
+	std::lock_guard<std::mutex> lock(buffer->mutex);
+	pipe_trace_event *event = &buffer->events[buffer->count % PIPE_TRACE_EVENTS];
+	event->stage = stage;
+	event->start = start;
+	event->end = end;
+	buffer->count++;
+}
+
+void pipe_trace_clear() {
+	std::lock_guard<std::mutex> lock(buffers_mutex);
+	for (pipe_trace_buffer *buffer : buffers) {
+		std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+		buffer->count = 0;
+	}
+	retired_events.clear();
+	retired_count = 0;
+	retired_names.clear();
+}
+
+/* calls func(tid, event) for the events kept in all buffers and of the finished threads, oldest first */
+template <typename F> static void for_each_event(F func) {
+	std::lock_guard<std::mutex> lock(buffers_mutex);
+	for (pipe_trace_buffer *buffer : buffers) {
+		std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+		uint64_t first = buffer->count > PIPE_TRACE_EVENTS ? buffer->count - PIPE_TRACE_EVENTS : 0;
+		for (uint64_t i = first; i < buffer->count; i++) {
+			func(buffer->tid, &buffer->events[i % PIPE_TRACE_EVENTS]);
+		}
+	}
+	const size_t size = retired_events.size();
+	const size_t oldest = (size < PIPE_TRACE_EVENTS) ? 0 : retired_count % PIPE_TRACE_EVENTS;
+	for (size_t i = 0; i < size; i++) {
+		pipe_trace_retired_event &retired = retired_events[(oldest + i) % size];
+		func(retired.tid, &retired.event);
+	}
+}
+
+/* thread names are user visible strings */
+static std::string json_escape(const char *text) {
+	std::string escaped;
+	for (const char *c = text; *c; c++) {
+		if (*c == '"' || *c == '\\') {
+			escaped += '\\';
+			escaped += *c;
+		} else if ((unsigned char)*c < 0x20) {
+			char code[8];
+			snprintf(code, sizeof(code), "\\u%04x", (unsigned char)*c);
+			escaped += code;
+		} else {
+			escaped += *c;
+		}
+	}
+	return escaped;
+}
+
+bool pipe_trace_export(const char *file_name) {
+	FILE *file = fopen(file_name, "w");
+	if (file == nullptr) {
+		indigo_error("Can not create trace file %s: %s\n", file_name, strerror(errno));
+		return false;
+	}
+	int64_t epoch = INT64_MAX;
+	for_each_event([&](int, pipe_trace_event *event) {
+		if (event->start < epoch) epoch = event->start;
+	});
+
+	int count = 0;
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	{
+		std::lock_guard<std::mutex> lock(buffers_mutex);
+		std::map<int, std::string> names = retired_names;
+		for (pipe_trace_buffer *buffer : buffers) names[buffer->tid] = buffer->name;
+		for (auto &name : names) {
+			fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", count++ ? ",\n" : "", name.first, json_escape(name.second.c_str()).c_str());
+		}
+	}
+	for_each_event([&](int tid, pipe_trace_event *event) {
+		fprintf(
+			file,
+			"%s{\"name\":\"%s\",\"cat\":\"pipeline\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+			count++ ? ",\n" : "",
+			event->stage,
+			tid,
+			(event->start - epoch) / 1e3,
+			(event->end - event->start) / 1e3
+		);
+	});
+	fprintf(file, "\n]}\n");
+	bool ok = !ferror(file);
+	if (fclose(file)) ok = false;
+	indigo_debug("Pipeline trace with %d events written to %s\n", count, file_name);
+	return ok;
+}
+
+QVector<pipe_trace_stats> pipe_trace_summary() {
+	std::vector<const char *> stages(stage_order, stage_order + sizeof(stage_order) / sizeof(stage_order[0]));
+	std::vector<std::vector<std::pair<int64_t, double>>> durations(stages.size());
+	for_each_event([&](int, pipe_trace_event *event) {
+		size_t stage = 0;
+		while (stage < stages.size() && strcmp(stages[stage], event->stage)) stage++;
+		if (stage == stages.size()) {
+			stages.push_back(event->stage);
+			durations.resize(stages.size());
+		}
+		durations[stage].push_back(std::make_pair(event->start, (event->end - event->start) / 1e6));
+	});
+
+	QVector<pipe_trace_stats> summary;
+	for (size_t stage = 0; stage < stages.size(); stage++) {
+		std::vector<std::pair<int64_t, double>> &recent = durations[stage];
+		if (recent.empty()) continue;
+		// the most recent events of the stage from all threads
+		std::sort(recent.begin(), recent.end());
+		if (recent.size() > PIPE_TRACE_RECENT) recent.erase(recent.begin(), recent.end() - PIPE_TRACE_RECENT);
+		std::vector<double> values;
+		for (auto &r : recent) values.push_back(r.second);
+		std::sort(values.begin(), values.end());
+		pipe_trace_stats stats;
+		stats.stage = stages[stage];
+		stats.count = values.size();
+		stats.p50 = values[(values.size() - 1) / 2];
+		stats.p95 = values[(size_t)((values.size() - 1) * 0.95)];
+		stats.max = values.back();
+		summary.append(stats);
+	}
+	return summary;
+}
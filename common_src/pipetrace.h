@@ -0,0 +1,97 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _PIPETRACE_H
+#define _PIPETRACE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <QVector>
+
+#define PIPE_TRACE_EVENTS 4096      /* events kept per thread */
+#define PIPE_TRACE_RECENT 100       /* events per stage in the statistics */
+
+/* stages of the image pipeline in processing order */
+#define PIPE_TRACE_BLOB "blob"
+#define PIPE_TRACE_DOWNLOAD "download"
+#define PIPE_TRACE_DECODE "decode"
+#define PIPE_TRACE_CALIBRATE "calibrate"
+#define PIPE_TRACE_DEFECTS "defects"
+#define PIPE_TRACE_DEBAYER "debayer"
+#define PIPE_TRACE_STACK "stack"
+#define PIPE_TRACE_COMPUTE_PARAMS "computeParams"
+#define PIPE_TRACE_STRETCH "stretch"
+#define PIPE_TRACE_IMAGE_STATS "imageStats"
+#define PIPE_TRACE_FROM_IMAGE "fromImage"
+#define PIPE_TRACE_SAVE "save"
+
+typedef struct {
+	const char *stage;
+	int count;
+	double p50;      /* ms */
+	double p95;
+	double max;
+} pipe_trace_stats;
+
+extern std::atomic<bool> pipe_trace_on;
+
+static inline bool pipe_trace_enabled() {
+	return pipe_trace_on.load(std::memory_order_relaxed);
+}
+
+void pipe_trace_enable(bool enable);
+void pipe_trace_clear();
+
+/* ns on a monotonic clock */
+int64_t pipe_trace_now();
+
+/* stage must be a string literal, events are kept in a buffer of the calling thread */
+void pipe_trace_add(const char *stage, int64_t start, int64_t end);
+
+/* Chrome / Perfetto trace event JSON */
+bool pipe_trace_export(const char *file_name);
+
+/* latencies of the recent events of each stage */
+QVector<pipe_trace_stats> pipe_trace_summary();
+
+/* Traces the enclosing scope, the cost of a disabled trace is one relaxed atomic load. */
+class PipeTraceScope {
+public:
+	PipeTraceScope(const char *stage) {
+		if (pipe_trace_enabled()) {
+			m_stage = stage;
+			m_start = pipe_trace_now();
+		} else {
+			m_stage = nullptr;
+		}
+	}
+
+	~PipeTraceScope() {
+		if (m_stage) pipe_trace_add(m_stage, m_start, pipe_trace_now());
+	}
+
+private:
+	const char *m_stage;
+	int64_t m_start;
+};
+
+#define PIPE_TRACE_NAME2(line) pipe_trace_scope_##line
+#define PIPE_TRACE_NAME(line) PIPE_TRACE_NAME2(line)
+#define PIPE_TRACE(stage) PipeTraceScope PIPE_TRACE_NAME(__LINE__)(stage)
+
+#endif /* _PIPETRACE_H */
@@ -0,0 +1,319 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <vector>
+#include <indigo/indigo_bus.h>
+#include "pixel_kernels.h"
+
+#if defined(__linux__) && defined(__arm__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+/* AVX2 on x86. FMA is left out on purpose, contracted multiply-adds would change the float results. */
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define PIXEL_KERNELS_AVX2
+#endif
+
+/* NEON on 32-bit ARM Linux when the baseline does not have it (armhf). It is the baseline on aarch64. */
+#if defined(__arm__) && defined(__linux__) && defined(__GNUC__) && !defined(__clang__) && !defined(__ARM_NEON)
+#define PIXEL_KERNELS_NEON
+#endif
+
+/* the per pixel helpers have to be inlined into the loops to vectorize */
+#if defined(__GNUC__) || defined(__clang__)
+#define PIXEL_KERNEL_INLINE inline __attribute__((always_inline))
+#else
+#define PIXEL_KERNEL_INLINE inline
+#endif
+
+/* pixels of a debayered row kept in float, it has to be even */
+#define DEBAYER_BLOCK 128
+
+#define PIXEL_KERNEL_SET(ns, set_name) \
+	static const pixel_kernel_set ns##_set = { \
+		set_name, \
+		ns::swap16, \
+		ns::swap32, \
+		ns::unshuffle, \
+		{ ns::stretch_mono<uint8_t>, ns::stretch_mono<uint16_t>, ns::stretch_mono<uint32_t>, ns::stretch_mono<float> }, \
+		{ ns::stretch_rgb<uint8_t>, ns::stretch_rgb<uint16_t>, ns::stretch_rgb<uint32_t>, ns::stretch_rgb<float> }, \
+		{ ns::debayer_row<uint8_t>, ns::debayer_row<uint16_t>, ns::debayer_row<uint32_t>, ns::debayer_row<float> }, \
+		{ ns::moments<uint8_t>, ns::moments<uint16_t>, ns::moments<uint32_t>, ns::moments<float> }, \
+		{ ns::calibrate<uint8_t>, ns::calibrate<uint16_t>, ns::calibrate<uint32_t>, ns::calibrate<float> } \
+	}
+
+namespace generic {
+#include "pixel_kernels_impl.h"
+}
+PIXEL_KERNEL_SET(generic, "generic");
+
+/* The scalar code the rewritten kernels are checked against, it is selected by name only, to benchmark it. */
+namespace reference {
+#include "pixel_kernels_reference.h"
+}
+static const pixel_kernel_set reference_set = {
+	"reference",
+	generic::swap16,
+	generic::swap32,
+	generic::unshuffle,
+	{ reference::stretch_mono<uint8_t>, reference::stretch_mono<uint16_t>, reference::stretch_mono<uint32_t>, reference::stretch_mono<float> },
+	{ reference::stretch_rgb<uint8_t>, reference::stretch_rgb<uint16_t>, reference::stretch_rgb<uint32_t>, reference::stretch_rgb<float> },
+	{ reference::debayer_row<uint8_t>, reference::debayer_row<uint16_t>, reference::debayer_row<uint32_t>, reference::debayer_row<float> },
+	{ generic::moments<uint8_t>, generic::moments<uint16_t>, generic::moments<uint32_t>, generic::moments<float> },
+	{ reference::calibrate<uint8_t>, reference::calibrate<uint16_t>, reference::calibrate<uint32_t>, reference::calibrate<float> }
+};
+
+#ifdef PIXEL_KERNELS_AVX2
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+namespace avx2 {
+#include "pixel_kernels_impl.h"
+}
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+PIXEL_KERNEL_SET(avx2, "avx2");
+#endif
+
+#ifdef PIXEL_KERNELS_NEON
+#pragma GCC push_options
+#pragma GCC target("fpu=neon")
+namespace neon {
+#include "pixel_kernels_impl.h"
+}
+#pragma GCC pop_options
+PIXEL_KERNEL_SET(neon, "neon");
+#endif
+
+static const pixel_kernel_set *kernel_sets[] = {
+	&generic_set,
+#ifdef PIXEL_KERNELS_AVX2
+	&avx2_set,
+#endif
+#ifdef PIXEL_KERNELS_NEON
+	&neon_set,
+#endif
+};
+
+#define KERNEL_SETS (int)(sizeof(kernel_sets) / sizeof(kernel_sets[0]))
+
+static std::atomic<const pixel_kernel_set *> selected_set(nullptr);
+
+static bool is_supported(const pixel_kernel_set *set) {
+#ifdef PIXEL_KERNELS_AVX2
+	if (set == &avx2_set) {
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+	}
+#endif
+#ifdef PIXEL_KERNELS_NEON
+	if (set == &neon_set) {
+		return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+	}
+#endif
+	return set == &generic_set;
+}
+
+int pixel_kernels_available(const pixel_kernel_set **sets, int max) {
+	int count = 0;
+	for (int i = 0; i < KERNEL_SETS && count < max; i++) {
+		if (is_supported(kernel_sets[i])) sets[count++] = kernel_sets[i];
+	}
+	return count;
+}
+
+bool pixel_kernels_select(const char *name) {
+	if (!strcmp(reference_set.name, name)) {
+		selected_set = &reference_set;
+		indigo_debug("Pixel kernels: %s selected\n", name);
+		return true;
+	}
+	for (int i = 0; i < KERNEL_SETS; i++) {
+		if (!strcmp(kernel_sets[i]->name, name) && is_supported(kernel_sets[i])) {
+			selected_set = kernel_sets[i];
+			indigo_debug("Pixel kernels: %s selected\n", name);
+			return true;
+		}
+	}
+	indigo_error("Pixel kernels: %s is not available on this CPU\n", name);
+	return false;
+}
+
+const pixel_kernel_set *pixel_kernels(void) {
+	const pixel_kernel_set *set = selected_set.load(std::memory_order_acquire);
+	if (set) return set;
+
+	// the last supported set is the best one
+	const pixel_kernel_set *sets[KERNEL_SETS];
+	int count = pixel_kernels_available(sets, KERNEL_SETS);
+	set = sets[count - 1];
+	const char *forced = getenv("AIN_PIXEL_KERNELS");
+	if (forced && *forced) {
+		for (int i = 0; i < count; i++) {
+			if (!strcmp(sets[i]->name, forced)) set = sets[i];
+		}
+	}
+	selected_set.store(set, std::memory_order_release);
+	indigo_debug("Pixel kernels: using %s\n", set->name);
+	return set;
+}
+
+/* Self check, every set gets the same pseudo random input as the reference one. */
+
+static uint32_t check_random(uint32_t &seed) {
+	seed = seed * 1664525u + 1013904223u;
+	return seed;
+}
+
+template <typename T> static std::vector<T> check_samples(int count, uint32_t seed) {
+	std::vector<T> samples(count);
+	for (int i = 0; i < count; i++) {
+		uint32_t r = check_random(seed);
+		if (sizeof(T) == 1) samples[i] = r >> 24;
+		else if (sizeof(T) == 2) samples[i] = r >> 16;
+		else samples[i] = r;
+	}
+	// the extremes
+	samples[0] = 0;
+	samples[count - 1] = (T)~(T)0;
+	return samples;
+}
+
+template <> std::vector<float> check_samples<float>(int count, uint32_t seed) {
+	std::vector<float> samples(count);
+	for (int i = 0; i < count; i++) {
+		samples[i] = check_random(seed) / 4294967296.0 * (double)0xFFFFFFFF;
+	}
+	samples[0] = 0;
+	samples[count - 1] = (double)0xFFFFFFFF;
+	return samples;
+}
+
+static void check_stretch_params(pixel_stretch_params *params, double max_input, float shadows, float midtones, float highlights) {
+	// as in stretcher.cpp
+	const float factor = highlights == shadows ? 1.0f : 1.0f / (highlights - shadows);
+	params->native_shadows = shadows * max_input;
+	params->native_highlights = highlights * max_input;
+	params->midtones = midtones;
+	params->k1 = (midtones - 1) * factor * 255 / max_input;
+	params->k2 = ((2 * midtones) - 1) * factor / max_input;
+}
+
+static int check_result(const pixel_kernel_set *set, const char *kernel, int type, const void *expected, const void *result, size_t size) {
+	if (memcmp(expected, result, size) == 0) return 0;
+	indigo_error("Pixel kernels: %s %s (type %d) differs from reference\n", set->name, kernel, type);
+	return 1;
+}
+
+template <typename T> static int check_type(const pixel_kernel_set *set) {
+	const pixel_type type = pixel_type_of<T>::value;
+	const int width = 37, height = 23, size = width * height;
+	const double max_input = sizeof(T) == 1 ? 254 : sizeof(T) == 2 ? 65534 : 4294967294.0;
+	std::vector<T> mono = check_samples<T>(size, 42 + type);
+	std::vector<T> rgb = check_samples<T>(size * 3, 4242 + type);
+	int failed = 0;
+
+	pixel_stretch_params params[3];
+	check_stretch_params(&params[0], max_input, 0.05f, 0.2f, 0.95f);
+	check_stretch_params(&params[1], max_input, 0.1f, 0.5f, 0.8f);
+	check_stretch_params(&params[2], max_input, 0.0f, 0.7f, 1.0f);
+	std::vector<uint32_t> expected(size), result(size);
+	for (int step = 1; step <= 2; step++) {
+		reference_set.stretch_mono[type](mono.data(), size, step, &params[0], expected.data());
+		set->stretch_mono[type](mono.data(), size, step, &params[0], result.data());
+		failed += check_result(set, "stretch_mono", type, expected.data(), result.data(), (size + step - 1) / step * sizeof(uint32_t));
+	}
+	reference_set.stretch_rgb[type](rgb.data(), size, params, expected.data());
+	set->stretch_rgb[type](rgb.data(), size, params, result.data());
+	failed += check_result(set, "stretch_rgb", type, expected.data(), result.data(), size * sizeof(uint32_t));
+
+	std::vector<T> expected_rgb(size * 3), result_rgb(size * 3);
+	for (int offsets : { 0x00, 0x01, 0x10, 0x11 }) {
+		for (int row = 0; row < height; row++) {
+			reference_set.debayer_row[type](mono.data(), row, width, height, offsets, expected_rgb.data());
+			set->debayer_row[type](mono.data(), row, width, height, offsets, result_rgb.data());
+		}
+		failed += check_result(set, "debayer_row", type, expected_rgb.data(), result_rgb.data(), size * 3 * sizeof(T));
+	}
+
+	pixel_moments expected_moments, result_moments;
+	for (int channels : { 1, 3 }) {
+		const T *buffer = channels == 1 ? mono.data() : rgb.data();
+		memset(&expected_moments, 0, sizeof(expected_moments));
+		memset(&result_moments, 0, sizeof(result_moments));
+		reference_set.moments[type](buffer, size, channels, &expected_moments);
+		set->moments[type](buffer, size, channels, &result_moments);
+		failed += check_result(set, "moments", type, &expected_moments, &result_moments, sizeof(pixel_moments));
+	}
+
+	std::vector<float> dark(size), flat(size);
+	uint32_t seed = 4711 + type;
+	for (int i = 0; i < size; i++) {
+		dark[i] = check_random(seed) / 4294967296.0 * max_input / 8;
+		flat[i] = 0.5 + check_random(seed) / 4294967296.0;
+	}
+	for (int calibration = 0; calibration < 3; calibration++) {
+		const float *dark_frame = calibration != 2 ? dark.data() : nullptr;
+		const float *flat_frame = calibration != 1 ? flat.data() : nullptr;
+		std::vector<T> expected_frame = mono, result_frame = mono;
+		reference_set.calibrate[type](expected_frame.data(), size, dark_frame, flat_frame);
+		set->calibrate[type](result_frame.data(), size, dark_frame, flat_frame);
+		failed += check_result(set, "calibrate", type, expected_frame.data(), result_frame.data(), size * sizeof(T));
+	}
+	return failed;
+}
+
+int pixel_kernels_self_check(void) {
+	const pixel_kernel_set *sets[KERNEL_SETS];
+	int count = pixel_kernels_available(sets, KERNEL_SETS);
+	int failed = 0;
+	const size_t size = 4099;
+	std::vector<uint8_t> bytes = check_samples<uint8_t>(size, 7);
+	std::vector<uint8_t> expected(size), result(size);
+	for (int i = 0; i < count; i++) {
+		const pixel_kernel_set *set = sets[i];
+		reference_set.swap16(expected.data(), bytes.data(), size / 2);
+		set->swap16(result.data(), bytes.data(), size / 2);
+		failed += check_result(set, "swap16", PIXEL_U16, expected.data(), result.data(), size / 2 * 2);
+		reference_set.swap32(expected.data(), bytes.data(), size / 4);
+		set->swap32(result.data(), bytes.data(), size / 4);
+		failed += check_result(set, "swap32", PIXEL_U32, expected.data(), result.data(), size / 4 * 4);
+		for (size_t item_size : { 1, 2, 3, 4, 8 }) {
+			reference_set.unshuffle(expected.data(), bytes.data(), size, item_size);
+			set->unshuffle(result.data(), bytes.data(), size, item_size);
+			failed += check_result(set, "unshuffle", (int)item_size, expected.data(), result.data(), size);
+		}
+		failed += check_type<uint8_t>(set);
+		failed += check_type<uint16_t>(set);
+		failed += check_type<uint32_t>(set);
+		failed += check_type<float>(set);
+		indigo_debug("Pixel kernels: %s checked\n", set->name);
+	}
+	return failed;
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _PIXEL_KERNELS_H
+#define _PIXEL_KERNELS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The inner loops of the image pipeline are compiled once for the baseline
+   architecture and once more for each instruction set listed below. The set
+   matching the CPU is selected on first use. All variants are built from the
+   same source (pixel_kernels_impl.h) and must give bit identical results,
+   pixel_kernels_self_check() verifies that against the scalar reference
+   (pixel_kernels_reference.h). */
+
+typedef enum {
+	PIXEL_U8 = 0,
+	PIXEL_U16,
+	PIXEL_U32,
+	PIXEL_F32,
+	PIXEL_TYPES
+} pixel_type;
+
+typedef struct {
+	double native_shadows;     /* shadows * max input, converted to the sample type by the kernel */
+	double native_highlights;
+	float midtones;
+	float k1;
+	float k2;
+} pixel_stretch_params;
+
+typedef struct {
+	double sum[3];
+	double min[3];
+	double max[3];
+} pixel_moments;
+
+typedef struct {
+	const char *name;
+	/* output may be the same as input */
+	void (*swap16)(void *output, const void *input, size_t count);
+	void (*swap32)(void *output, const void *input, size_t count);
+	void (*unshuffle)(uint8_t *output, const uint8_t *input, size_t size, size_t item_size);
+	/* one output row of QRgb, mono reads every step-th sample, RGB reads count consecutive pixels */
+	void (*stretch_mono[PIXEL_TYPES])(const void *input, int count, int step, const pixel_stretch_params *params, uint32_t *output);
+	void (*stretch_rgb[PIXEL_TYPES])(const void *input, int count, const pixel_stretch_params params[3], uint32_t *output);
+	/* one row of a bilinear debayer, output is the whole interleaved RGB frame */
+	void (*debayer_row[PIXEL_TYPES])(const void *raw, int row, int width, int height, int offsets, void *output);
+	/* sum, min and max of each of 1 or 3 interleaved channels */
+	void (*moments[PIXEL_TYPES])(const void *buffer, int count, int channels, pixel_moments *moments);
+	/* (sample - dark) * flat in place, dark or flat may be NULL, integer results are rounded and clamped to the type */
+	void (*calibrate[PIXEL_TYPES])(void *buffer, int count, const float *dark, const float *flat);
+} pixel_kernel_set;
+
+/* the set selected for this CPU, AIN_PIXEL_KERNELS=<name> in the environment forces one */
+extern const pixel_kernel_set *pixel_kernels(void);
+
+/* sets compiled in and supported by this CPU, the generic set is always the first */
+extern int pixel_kernels_available(const pixel_kernel_set **sets, int max);
+/* one of the available sets or "reference" */
+extern bool pixel_kernels_select(const char *name);
+
+/* runs every available set against the reference one, returns the number of mismatches */
+extern int pixel_kernels_self_check(void);
+
+#ifdef __cplusplus
+}
+
+template <typename T> struct pixel_type_of;
+template <> struct pixel_type_of<uint8_t> { static const pixel_type value = PIXEL_U8; };
+template <> struct pixel_type_of<uint16_t> { static const pixel_type value = PIXEL_U16; };
+template <> struct pixel_type_of<uint32_t> { static const pixel_type value = PIXEL_U32; };
+template <> struct pixel_type_of<float> { static const pixel_type value = PIXEL_F32; };
+#endif
+
+#endif /* _PIXEL_KERNELS_H */
@@ -0,0 +1,424 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Kernel bodies of pixel_kernels.cpp. This file is included once for each
+// instruction set, inside its own namespace and target pragma, so there is no
+// include guard. Do not include headers or call non inline functions from here,
+// they would be compiled for the baseline. The loops are written to vectorize,
+// but every kernel must give the same bits as pixel_kernels_reference.h.
+
+static inline uint32_t kernel_rgb(int red, int green, int blue) {
+	// the same as qRgb()
+	return (0xffu << 24) | ((red & 0xffu) << 16) | ((green & 0xffu) << 8) | (blue & 0xffu);
+}
+
+static void swap16(void *output, const void *input, size_t count) {
+	const uint16_t *in = (const uint16_t *)input;
+	uint16_t *out = (uint16_t *)output;
+	for (size_t i = 0; i < count; i++) {
+		const uint16_t value = in[i];
+		out[i] = (uint16_t)(value << 8 | value >> 8);
+	}
+}
+
+static void swap32(void *output, const void *input, size_t count) {
+	const uint32_t *in = (const uint32_t *)input;
+	uint32_t *out = (uint32_t *)output;
+	for (size_t i = 0; i < count; i++) {
+		const uint32_t value = in[i];
+		out[i] = (value << 24) | ((value << 8) & 0x00ff0000u) | ((value >> 8) & 0x0000ff00u) | (value >> 24);
+	}
+}
+
+template <int ITEM_SIZE> static inline void unshuffle_items(uint8_t *output, const uint8_t *input, size_t items) {
+	for (size_t i = 0; i < items; i++) {
+		for (int j = 0; j < ITEM_SIZE; j++) {
+			output[i * ITEM_SIZE + j] = input[j * items + i];
+		}
+	}
+}
+
+static void unshuffle(uint8_t *output, const uint8_t *input, size_t size, size_t item_size) {
+	if (size == 0 || item_size == 0 || input == nullptr || output == nullptr) return;
+	const size_t items = size / item_size;
+	switch (item_size) {
+		case 2:
+			unshuffle_items<2>(output, input, items);
+			break;
+		case 4:
+			unshuffle_items<4>(output, input, items);
+			break;
+		case 8:
+			unshuffle_items<8>(output, input, items);
+			break;
+		default:
+			for (size_t j = 0; j < item_size; j++) {
+				for (size_t i = 0; i < items; i++) {
+					output[i * item_size + j] = input[j * items + i];
+				}
+			}
+	}
+	// the bytes not forming a whole item are stored as they are
+	for (size_t i = items * item_size; i < size; i++) {
+		output[i] = input[i];
+	}
+}
+
+/* The plain float to T conversion. AVX2 converts only to signed integers, so a non negative
+   float below 2^32 is truncated to uint32_t by shifting its mantissa. It takes integer
+   operations only, float ones behind the clamps of calibrate() are not if-converted. */
+template <typename T> static inline T sample_of(float value) {
+	return value;
+}
+
+template <> inline uint32_t sample_of<uint32_t>(float value) {
+	union { float value; uint32_t bits; } sample = { value };
+	const int exponent = (sample.bits >> 23) & 0xff;
+	const uint32_t mantissa = (sample.bits & 0x7fffff) | 0x800000;
+	const int right = 150 - exponent < 31 ? 150 - exponent : 31;
+	return exponent >= 150 ? mantissa << (exponent - 150) : mantissa >> right;
+}
+
+/* Branch free so that the loops vectorize, every sample is divided and masked afterwards. */
+template <typename T> static inline int stretch_value(const T value, const T native_shadows, const T native_highlights, const float k1, const float k2, const float midtones) {
+	const int in_range = -(int)(value >= native_shadows);
+	const int saturated = -(int)(value >= native_highlights);
+	const T floored = value - native_shadows;
+	const int val = (floored * k1) / (floored * k2 - midtones);
+	return ((val & ~saturated) | (255 & saturated)) & in_range;
+}
+
+/* STEP 0 is a step known at run time only */
+template <typename T, int STEP> static inline void stretch_mono_step(const T *in, int count, int step, const pixel_stretch_params *params, uint32_t *__restrict output) {
+	const T native_shadows = params->native_shadows;
+	const T native_highlights = params->native_highlights;
+	const float midtones = params->midtones;
+	const float k1 = params->k1;
+	const float k2 = params->k2;
+	if (STEP) step = STEP;
+	const int out_count = (count + step - 1) / step;
+	for (int iout = 0; iout < out_count; iout++) {
+		const int val = stretch_value(in[iout * step], native_shadows, native_highlights, k1, k2, midtones);
+		output[iout] = kernel_rgb(val, val, val);
+	}
+}
+
+template <typename T> static void stretch_mono(const void *input, int count, int step, const pixel_stretch_params *params, uint32_t *output) {
+	const T *in = (const T *)input;
+	if (step == 1) {
+		stretch_mono_step<T, 1>(in, count, step, params, output);
+	} else if (step == 2) {
+		stretch_mono_step<T, 2>(in, count, step, params, output);
+	} else {
+		stretch_mono_step<T, 0>(in, count, step, params, output);
+	}
+}
+
+template <typename T> static void stretch_rgb(const void *input, int count, const pixel_stretch_params params[3], uint32_t *__restrict output) {
+	const T *in = (const T *)input;
+	const T shadows_r = params[0].native_shadows, shadows_g = params[1].native_shadows, shadows_b = params[2].native_shadows;
+	const T highlights_r = params[0].native_highlights, highlights_g = params[1].native_highlights, highlights_b = params[2].native_highlights;
+	const float k1_r = params[0].k1, k1_g = params[1].k1, k1_b = params[2].k1;
+	const float k2_r = params[0].k2, k2_g = params[1].k2, k2_b = params[2].k2;
+	const float midtones_r = params[0].midtones, midtones_g = params[1].midtones, midtones_b = params[2].midtones;
+	for (int i = 0; i < count; i++) {
+		const int red = stretch_value(in[3 * i], shadows_r, highlights_r, k1_r, k2_r, midtones_r);
+		const int green = stretch_value(in[3 * i + 1], shadows_g, highlights_g, k1_g, k2_g, midtones_g);
+		const int blue = stretch_value(in[3 * i + 2], shadows_b, highlights_b, k1_b, k2_b, midtones_b);
+		output[i] = kernel_rgb(red, green, blue);
+	}
+}
+
+/* Border pixels, each of the cases of the bilinear interpolation. */
+template <typename T> static inline void debayer(const T *raw, int index, int row, int column, int width, int height, int offsets, float &red, float &green, float &blue) {
+	switch (offsets ^ ((column & 1) << 4 | (row & 1))) {
+		case 0x00:
+			red = raw[index];
+			if (column == 0) {
+				if (row == 0) {
+					green = (raw[index + 1] + raw[index + width]) / 2.0;
+					blue = raw[index + width + 1];
+				} else if (row == height - 1) {
+					green = (raw[index + 1] + raw[index - width]) / 2.0;
+					blue = raw[index - width + 1];
+				} else {
+					green = (raw[index + 1] + raw[index + width] + raw[index - width]) / 3.0;
+					blue = (raw[index - width + 1] + raw[index + width + 1]) / 2.0;
+				}
+			} else if (column == width - 1) {
+				if (row == 0) {
+					green = (raw[index - 1] + raw[index + width]) / 2.0;
+					blue = (raw[index + width - 1] + raw[index + width + 1]) / 2.0;
+				} else if (row == height - 1) {
+					green = (raw[index - 1] + raw[index - width]) / 2.0;
+					blue = (raw[index - width - 1] + raw[index - width + 1]) / 2.0;
+				} else {
+					green = (raw[index - 1] + raw[index + width] + raw[index - width]) / 3.0;
+					blue = (raw[index - width - 1] + raw[index + width - 1]) / 2.0;
+				}
+			} else {
+				if (row == 0) {
+					green = (raw[index + 1] + raw[index - 1] + raw[index + width]) / 3.0;
+					blue = (raw[index + width - 1] + raw[index + width + 1]) / 2.0;
+				} else if (row == height - 1) {
+					green = (raw[index + 1] + raw[index - 1] + raw[index - width]) / 3.0;
+					blue = (raw[index - width - 1] + raw[index - width + 1]) / 2.0;
+				} else {
+					green = (raw[index + 1] + raw[index - 1] + raw[index + width] + raw[index - width]) / 4.0;
+					blue = (raw[index - width - 1] + raw[index - width + 1] + raw[index + width - 1] + raw[index + width + 1]) / 4.0;
+				}
+			}
+			break;
+		case 0x10:
+			if (column == 0) {
+				red = raw[index + 1];
+			} else if (column == width - 1) {
+				red = raw[index - 1];
+			} else {
+				red = (raw[index - 1] + raw[index + 1]) / 2.0;
+			}
+			green = raw[index];
+			if (row == 0) {
+				blue = raw[index + width];
+			} else if (row == height - 1) {
+				blue = raw[index - width];
+			} else {
+				blue = (raw[index - width] + raw[index + width]) / 2.0;
+			}
+			break;
+		case 0x01:
+			if (row == 0) {
+				red = raw[index + width];
+			} else if (row == height - 1) {
+				red = raw[index - width];
+			} else {
+				red = (raw[index - width] + raw[index + width]) / 2.0;
+			}
+			green = raw[index];
+			if (column == 0) {
+				blue = raw[index + 1];
+			} else if (column == width - 1) {
+				blue = raw[index - 1];
+			} else {
+				blue = (raw[index - 1] + raw[index + 1]) / 2.0;
+			}
+			break;
+		case 0x11:
+			if (column == 0) {
+				if (row == 0) {
+					red = raw[index + width + 1];
+					green = (raw[index + 1] + raw[index + width]) / 2.0;
+				} else if (row == height - 1) {
+					red = raw[index - width + 1];
+					green = (raw[index + 1] + raw[index - width]) / 2.0;
+				} else {
+					red = raw[index - width + 1];
+					green = (raw[index + 1] + raw[index + width] + raw[index - width]) / 3.0;
+				}
+			} else if (column == width - 1) {
+				if (row == 0) {
+					red = raw[index + width - 1];
+					green = (raw[index - 1] + raw[index + width]) / 2.0;
+				} else if (row == height - 1) {
+					red = raw[index - width - 1];
+					green = (raw[index - 1] + raw[index - width]) / 2.0;
+				} else {
+					red = (raw[index - width - 1] + raw[index + width - 1]) / 2.0;
+					green = (raw[index - 1] + raw[index + width] + raw[index - width]) / 3.0;
+				}
+			} else {
+				if (row == 0) {
+					red = (raw[index + width - 1] + raw[index + width + 1]) / 2.0;
+					green = (raw[index + 1] + raw[index - 1] + raw[index + width]) / 3.0;
+				} else if (row == height - 1) {
+					red = (raw[index - width - 1] + raw[index - width + 1]) / 2.0;
+					green = (raw[index + 1] + raw[index - 1] + raw[index - width]) / 3.0;
+				} else {
+					red = (raw[index - width - 1] + raw[index - width + 1] + raw[index + width - 1] + raw[index + width + 1]) / 4.0;
+					green = (raw[index + 1] + raw[index - 1] + raw[index + width] + raw[index - width]) / 4.0;
+				}
+			}
+			blue = raw[index];
+			break;
+	}
+}
+
+template <typename T> static inline void debayer_pixel(const T *raw, int index, int row, int column, int width, int height, int offsets, T *output) {
+	float red = 0, green = 0, blue = 0;
+	debayer(raw, index, row, column, width, height, offsets, red, green, blue);
+	output[index * 3] = red;
+	output[index * 3 + 1] = green;
+	output[index * 3 + 2] = blue;
+}
+
+/* The interior branches of debayer() with the pattern known at compile time. Halving and
+   quartering in float gives the same bits as the division of the sum in double. */
+template <typename T, int PATTERN> static PIXEL_KERNEL_INLINE void debayer_inner(const T *north, const T *center, const T *south, int c, float *red_out, float *green_out, float *blue_out) {
+	float red, green, blue;
+	switch (PATTERN) {
+		case 0x00:
+			red = center[c];
+			green = (float)(center[c + 1] + center[c - 1] + south[c] + north[c]) * 0.25f;
+			blue = (float)(north[c - 1] + north[c + 1] + south[c - 1] + south[c + 1]) * 0.25f;
+			break;
+		case 0x10:
+			red = (float)(center[c - 1] + center[c + 1]) * 0.5f;
+			green = center[c];
+			blue = (float)(north[c] + south[c]) * 0.5f;
+			break;
+		case 0x01:
+			red = (float)(north[c] + south[c]) * 0.5f;
+			green = center[c];
+			blue = (float)(center[c - 1] + center[c + 1]) * 0.5f;
+			break;
+		default:
+			red = (float)(north[c - 1] + north[c + 1] + south[c - 1] + south[c + 1]) * 0.25f;
+			green = (float)(center[c + 1] + center[c - 1] + south[c] + north[c]) * 0.25f;
+			blue = center[c];
+			break;
+	}
+	*red_out = red;
+	*green_out = green;
+	*blue_out = blue;
+}
+
+/* Columns 1 to width - 2, odd columns have PATTERN ^ 0x10. The pixels are interpolated
+   into planes of DEBAYER_BLOCK and interleaved from them, both loops vectorize. */
+template <typename T, int PATTERN> static void debayer_interior(const T *raw, int index, int width, T *output) {
+	const T *north = raw + index - width;
+	const T *center = raw + index;
+	const T *south = raw + index + width;
+	float red[DEBAYER_BLOCK], green[DEBAYER_BLOCK], blue[DEBAYER_BLOCK];
+	for (int first = 1; first < width - 1; first += DEBAYER_BLOCK) {
+		const int count = width - 1 - first < DEBAYER_BLOCK ? width - 1 - first : DEBAYER_BLOCK;
+		const int pairs = count / 2;
+		for (int pair = 0; pair < pairs; pair++) {
+			const int c = first + 2 * pair;
+			debayer_inner<T, PATTERN ^ 0x10>(north, center, south, c, red + 2 * pair, green + 2 * pair, blue + 2 * pair);
+			debayer_inner<T, PATTERN>(north, center, south, c + 1, red + 2 * pair + 1, green + 2 * pair + 1, blue + 2 * pair + 1);
+		}
+		if (count & 1) {
+			debayer_inner<T, PATTERN ^ 0x10>(north, center, south, first + count - 1, red + count - 1, green + count - 1, blue + count - 1);
+		}
+		T *__restrict out = output + (index + first) * 3;
+		for (int i = 0; i < count; i++) {
+			out[3 * i] = sample_of<T>(red[i]);
+			out[3 * i + 1] = sample_of<T>(green[i]);
+			out[3 * i + 2] = sample_of<T>(blue[i]);
+		}
+	}
+}
+
+template <typename T> static void debayer_row(const void *raw_data, int row, int width, int height, int offsets, void *output_data) {
+	const T *raw = (const T *)raw_data;
+	T *output = (T *)output_data;
+	const int index = row * width;
+	if (row == 0 || row == height - 1 || width < 3) {
+		for (int column = 0; column < width; column++) {
+			debayer_pixel(raw, index + column, row, column, width, height, offsets, output);
+		}
+		return;
+	}
+	debayer_pixel(raw, index, row, 0, width, height, offsets, output);
+	switch (offsets ^ (row & 1)) {
+		case 0x00:
+			debayer_interior<T, 0x00>(raw, index, width, output);
+			break;
+		case 0x01:
+			debayer_interior<T, 0x01>(raw, index, width, output);
+			break;
+		case 0x10:
+			debayer_interior<T, 0x10>(raw, index, width, output);
+			break;
+		case 0x11:
+			debayer_interior<T, 0x11>(raw, index, width, output);
+			break;
+	}
+	debayer_pixel(raw, index + width - 1, row, width - 1, width, height, offsets, output);
+}
+
+/* Integer samples are summed exactly, floats in order as doubles. */
+template <typename T> struct moments_sum { typedef uint64_t type; };
+template <> struct moments_sum<float> { typedef double type; };
+
+template <typename T> struct moments_min { static T value() { return (T)~(T)0; } };
+template <> struct moments_min<float> { static float value() { return INFINITY; } };
+
+template <typename T, int CHANNELS> static inline void moments_channel(const T *buffer, int count, int channel, pixel_moments *moments) {
+	typename moments_sum<T>::type sum = 0;
+	T min = moments_min<T>::value();
+	T max = 0;
+	for (int i = 0; i < count; i++) {
+		const T value = buffer[i * CHANNELS + channel];
+		sum += value;
+		if (value > max) max = value;
+		if (value < min) min = value;
+	}
+	moments->sum[channel] = sum;
+	moments->min[channel] = min;
+	moments->max[channel] = max;
+}
+
+template <typename T> static void moments(const void *buffer, int count, int channels, pixel_moments *moments) {
+	const T *in = (const T *)buffer;
+	if (channels == 1) {
+		moments_channel<T, 1>(in, count, 0, moments);
+	} else {
+		moments_channel<T, 3>(in, count, 0, moments);
+		moments_channel<T, 3>(in, count, 1, moments);
+		moments_channel<T, 3>(in, count, 2, moments);
+	}
+}
+
+/* The largest float below 2^32 for uint32_t, a larger one would overflow the conversion. */
+template <typename T> struct calibrate_limit { static float value() { return (float)(T)~(T)0; } };
+template <> struct calibrate_limit<uint32_t> { static float value() { return 4294967040.0f; } };
+template <> struct calibrate_limit<float> { static float value() { return INFINITY; } };
+
+/* Rounded before clamping, which gives the same values as the other way round, and clamped
+   with selects that map to max and min so that the loops vectorize. NaN gives 0 like the
+   conversion of the reference on x86. */
+template <typename T> static inline T calibrated_value(float value, const float limit) {
+	value = value + 0.5f;
+	value = value > 0.5f ? value : 0.5f;
+	value = value < limit ? value : limit;
+	return sample_of<T>(value);
+}
+
+template <> inline float calibrated_value<float>(float value, const float limit) {
+	(void)limit;
+	return value;
+}
+
+template <typename T> static void calibrate(void *buffer, int count, const float *dark, const float *flat) {
+	T *data = (T *)buffer;
+	const float limit = calibrate_limit<T>::value();
+	if (dark && flat) {
+		for (int i = 0; i < count; i++) {
+			data[i] = calibrated_value<T>(((float)data[i] - dark[i]) * flat[i], limit);
+		}
+	} else if (dark) {
+		for (int i = 0; i < count; i++) {
+			data[i] = calibrated_value<T>((float)data[i] - dark[i], limit);
+		}
+	} else if (flat) {
+		for (int i = 0; i < count; i++) {
+			data[i] = calibrated_value<T>((float)data[i] * flat[i], limit);
+		}
+	}
+}
@@ -0,0 +1,229 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// The scalar kernels as they were before they were written to vectorize. This
+// file is included once, in the reference namespace of pixel_kernels.cpp, and
+// pixel_kernels_self_check() compares every set against it. Do not change the
+// arithmetic here, it is what the other sets have to match.
+
+static inline uint32_t kernel_rgb(int red, int green, int blue) {
+	// the same as qRgb()
+	return (0xffu << 24) | ((red & 0xffu) << 16) | ((green & 0xffu) << 8) | (blue & 0xffu);
+}
+
+template <typename T> static void stretch_mono(const void *input, int count, int step, const pixel_stretch_params *params, uint32_t *output) {
+	const T *in = (const T *)input;
+	const T native_shadows = params->native_shadows;
+	const T native_highlights = params->native_highlights;
+	const float midtones = params->midtones;
+	const float k1 = params->k1;
+	const float k2 = params->k2;
+	for (int i = 0, iout = 0; i < count; i += step, iout++) {
+		const T value = in[i];
+		if (value < native_shadows) {
+			output[iout] = kernel_rgb(0, 0, 0);
+		} else if (value >= native_highlights) {
+			output[iout] = kernel_rgb(255, 255, 255);
+		} else {
+			const T floored = (value - native_shadows);
+			int val = (floored * k1) / (floored * k2 - midtones);
+			output[iout] = kernel_rgb(val, val, val);
+		}
+	}
+}
+
+template <typename T> static inline uint8_t stretch_value(const T value, const T native_shadows, const T native_highlights, const float k1, const float k2, const float midtones) {
+	if (value < native_shadows) return 0;
+	if (value >= native_highlights) return 255;
+	const T floored = (value - native_shadows);
+	return (floored * k1) / (floored * k2 - midtones);
+}
+
+template <typename T> static void stretch_rgb(const void *input, int count, const pixel_stretch_params params[3], uint32_t *output) {
+	const T *in = (const T *)input;
+	const T shadows_r = params[0].native_shadows, shadows_g = params[1].native_shadows, shadows_b = params[2].native_shadows;
+	const T highlights_r = params[0].native_highlights, highlights_g = params[1].native_highlights, highlights_b = params[2].native_highlights;
+	const float k1_r = params[0].k1, k1_g = params[1].k1, k1_b = params[2].k1;
+	const float k2_r = params[0].k2, k2_g = params[1].k2, k2_b = params[2].k2;
+	const float midtones_r = params[0].midtones, midtones_g = params[1].midtones, midtones_b = params[2].midtones;
+	for (int i = 0; i < count; i++) {
+		const uint8_t red = stretch_value(in[3 * i], shadows_r, highlights_r, k1_r, k2_r, midtones_r);
+		const uint8_t green = stretch_value(in[3 * i + 1], shadows_g, highlights_g, k1_g, k2_g, midtones_g);
+		const uint8_t blue = stretch_value(in[3 * i + 2], shadows_b, highlights_b, k1_b, k2_b, midtones_b);
+		output[i] = kernel_rgb(red, green, blue);
+	}
+}
+
+template <typename T> static inline void debayer(const T *raw, int index, int row, int column, int width, int height, int offsets, float &red, float &green, float &blue) {
+	switch (offsets ^ ((column & 1) << 4 | (row & 1))) {
+		case 0x00:
+			red = raw[index];
+			if (column == 0) {
+				if (row == 0) {
+					green = (raw[index + 1] + raw[index + width]) / 2.0;
+					blue = raw[index + width + 1];
+				} else if (row == height - 1) {
+					green = (raw[index + 1] + raw[index - width]) / 2.0;
+					blue = raw[index - width + 1];
+				} else {
+					green = (raw[index + 1] + raw[index + width] + raw[index - width]) / 3.0;
+					blue = (raw[index - width + 1] + raw[index + width + 1]) / 2.0;
+				}
+			} else if (column == width - 1) {
+				if (row == 0) {
+					green = (raw[index - 1] + raw[index + width]) / 2.0;
+					blue = (raw[index + width - 1] + raw[index + width + 1]) / 2.0;
+				} else if (row == height - 1) {
+					green = (raw[index - 1] + raw[index - width]) / 2.0;
+					blue = (raw[index - width - 1] + raw[index - width + 1]) / 2.0;
+				} else {
+					green = (raw[index - 1] + raw[index + width] + raw[index - width]) / 3.0;
+					blue = (raw[index - width - 1] + raw[index + width - 1]) / 2.0;
+				}
+			} else {
+				if (row == 0) {
+					green = (raw[index + 1] + raw[index - 1] + raw[index + width]) / 3.0;
+					blue = (raw[index + width - 1] + raw[index + width + 1]) / 2.0;
+				} else if (row == height - 1) {
+					green = (raw[index + 1] + raw[index - 1] + raw[index - width]) / 3.0;
+					blue = (raw[index - width - 1] + raw[index - width + 1]) / 2.0;
+				} else {
+					green = (raw[index + 1] + raw[index - 1] + raw[index + width] + raw[index - width]) / 4.0;
+					blue = (raw[index - width - 1] + raw[index - width + 1] + raw[index + width - 1] + raw[index + width + 1]) / 4.0;
+				}
+			}
+			break;
+		case 0x10:
+			if (column == 0) {
+				red = raw[index + 1];
+			} else if (column == width - 1) {
+				red = raw[index - 1];
+			} else {
+				red = (raw[index - 1] + raw[index + 1]) / 2.0;
+			}
+			green = raw[index];
+			if (row == 0) {
+				blue = raw[index + width];
+			} else if (row == height - 1) {
+				blue = raw[index - width];
+			} else {
+				blue = (raw[index - width] + raw[index + width]) / 2.0;
+			}
+			break;
+		case 0x01:
+			if (row == 0) {
+				red = raw[index + width];
+			} else if (row == height - 1) {
+				red = raw[index - width];
+			} else {
+				red = (raw[index - width] + raw[index + width]) / 2.0;
+			}
+			green = raw[index];
+			if (column == 0) {
+				blue = raw[index + 1];
+			} else if (column == width - 1) {
+				blue = raw[index - 1];
+			} else {
+				blue = (raw[index - 1] + raw[index + 1]) / 2.0;
+			}
+			break;
+		case 0x11:
+			if (column == 0) {
+				if (row == 0) {
+					red = raw[index + width + 1];
+					green = (raw[index + 1] + raw[index + width]) / 2.0;
+				} else if (row == height - 1) {
+					red = raw[index - width + 1];
+					green = (raw[index + 1] + raw[index - width]) / 2.0;
+				} else {
+					red = raw[index - width + 1];
+					green = (raw[index + 1] + raw[index + width] + raw[index - width]) / 3.0;
+				}
+			} else if (column == width - 1) {
+				if (row == 0) {
+					red = raw[index + width - 1];
+					green = (raw[index - 1] + raw[index + width]) / 2.0;
+				} else if (row == height - 1) {
+					red = raw[index - width - 1];
+					green = (raw[index - 1] + raw[index - width]) / 2.0;
+				} else {
+					red = (raw[index - width - 1] + raw[index + width - 1]) / 2.0;
+					green = (raw[index - 1] + raw[index + width] + raw[index - width]) / 3.0;
+				}
+			} else {
+				if (row == 0) {
+					red = (raw[index + width - 1] + raw[index + width + 1]) / 2.0;
+					green = (raw[index + 1] + raw[index - 1] + raw[index + width]) / 3.0;
+				} else if (row == height - 1) {
+					red = (raw[index - width - 1] + raw[index - width + 1]) / 2.0;
+					green = (raw[index + 1] + raw[index - 1] + raw[index - width]) / 3.0;
+				} else {
+					red = (raw[index - width - 1] + raw[index - width + 1] + raw[index + width - 1] + raw[index + width + 1]) / 4.0;
+					green = (raw[index + 1] + raw[index - 1] + raw[index + width] + raw[index - width]) / 4.0;
+				}
+			}
+			blue = raw[index];
+			break;
+	}
+}
+
+template <typename T> static void debayer_row(const void *raw_data, int row, int width, int height, int offsets, void *output_data) {
+	const T *raw = (const T *)raw_data;
+	T *output = (T *)output_data;
+	for (int column = 0; column < width; column++) {
+		const int index = row * width + column;
+		float red = 0, green = 0, blue = 0;
+		debayer(raw, index, row, column, width, height, offsets, red, green, blue);
+		output[index * 3] = red;
+		output[index * 3 + 1] = green;
+		output[index * 3 + 2] = blue;
+	}
+}
+
+/* The largest float below 2^32 for uint32_t, a larger one would overflow the conversion. */
+template <typename T> struct calibrate_limit { static float value() { return (float)(T)~(T)0; } };
+template <> struct calibrate_limit<uint32_t> { static float value() { return 4294967040.0f; } };
+template <> struct calibrate_limit<float> { static float value() { return INFINITY; } };
+
+template <typename T> static inline T calibrated_value(float value, const float limit) {
+	value = value < 0 ? 0 : value > limit ? limit : value;
+	return (T)(value + 0.5f);
+}
+
+template <> inline float calibrated_value<float>(float value, const float limit) {
+	(void)limit;
+	return value;
+}
+
+template <typename T> static void calibrate(void *buffer, int count, const float *dark, const float *flat) {
+	T *data = (T *)buffer;
+	const float limit = calibrate_limit<T>::value();
+	if (dark && flat) {
+		for (int i = 0; i < count; i++) {
+			data[i] = calibrated_value<T>(((float)data[i] - dark[i]) * flat[i], limit);
+		}
+	} else if (dark) {
+		for (int i = 0; i < count; i++) {
+			data[i] = calibrated_value<T>((float)data[i] - dark[i], limit);
+		}
+	} else if (flat) {
+		for (int i = 0; i < count; i++) {
+			data[i] = calibrated_value<T>((float)data[i] * flat[i], limit);
+		}
+	}
+}
@@ -0,0 +1,142 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "ser.h"
+#include <string.h>
+
+/* 0001-01-01 to 1970-01-01 in 100 ns ticks */
+#define SER_UNIX_EPOCH_TICKS 621355968000000000LL
+
+static void put_int32(uint8_t *buffer, int32_t value) {
+	uint32_t v = (uint32_t)value;
+	buffer[0] = v & 0xFF;
+	buffer[1] = (v >> 8) & 0xFF;
+	buffer[2] = (v >> 16) & 0xFF;
+	buffer[3] = (v >> 24) & 0xFF;
+}
+
+static int32_t get_int32(const uint8_t *buffer) {
+	return (int32_t)((uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) | ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24));
+}
+
+void ser_put_int64(uint8_t *buffer, int64_t value) {
+	uint64_t v = (uint64_t)value;
+	for (int i = 0; i < 8; i++) {
+		buffer[i] = (v >> (8 * i)) & 0xFF;
+	}
+}
+
+int64_t ser_get_int64(const uint8_t *buffer) {
+	uint64_t v = 0;
+	for (int i = 7; i >= 0; i--) {
+		v = (v << 8) | buffer[i];
+	}
+	return (int64_t)v;
+}
+
+static void put_string(uint8_t *buffer, const char *value) {
+	size_t length = strnlen(value, SER_STRING_SIZE);
+	memset(buffer, 0, SER_STRING_SIZE);
+	memcpy(buffer, value, length);
+}
+
+static void get_string(const uint8_t *buffer, char *value) {
+	memcpy(value, buffer, SER_STRING_SIZE);
+	value[SER_STRING_SIZE] = '\0';
+	/* space padded by some writers */
+	for (int i = SER_STRING_SIZE - 1; i >= 0 && (value[i] == ' ' || value[i] == '\0'); i--) {
+		value[i] = '\0';
+	}
+}
+
+void ser_write_header(const ser_header *header, uint8_t *buffer) {
+	memcpy(buffer, SER_FILE_ID, 14);
+	put_int32(buffer + 14, header->lu_id);
+	put_int32(buffer + 18, header->color_id);
+	put_int32(buffer + 22, header->little_endian);
+	put_int32(buffer + 26, header->width);
+	put_int32(buffer + 30, header->height);
+	put_int32(buffer + 34, header->pixel_depth);
+	put_int32(buffer + 38, header->frame_count);
+	put_string(buffer + 42, header->observer);
+	put_string(buffer + 82, header->instrument);
+	put_string(buffer + 122, header->telescope);
+	ser_put_int64(buffer + 162, header->date_time);
+	ser_put_int64(buffer + 170, header->date_time_utc);
+}
+
+int ser_read_header(const uint8_t *buffer, size_t size, ser_header *header) {
+	if (buffer == NULL || header == NULL) return SER_INVALIDPARAM;
+	if (size < SER_HEADER_SIZE || memcmp(buffer, SER_FILE_ID, 14)) return SER_INVALIDDATA;
+	header->lu_id = get_int32(buffer + 14);
+	header->color_id = get_int32(buffer + 18);
+	header->little_endian = get_int32(buffer + 22);
+	header->width = get_int32(buffer + 26);
+	header->height = get_int32(buffer + 30);
+	header->pixel_depth = get_int32(buffer + 34);
+	header->frame_count = get_int32(buffer + 38);
+	get_string(buffer + 42, header->observer);
+	get_string(buffer + 82, header->instrument);
+	get_string(buffer + 122, header->telescope);
+	header->date_time = ser_get_int64(buffer + 162);
+	header->date_time_utc = ser_get_int64(buffer + 170);
+	if (header->width <= 0 || header->height <= 0 || header->frame_count < 0) return SER_INVALIDDATA;
+	if (header->pixel_depth < 1 || header->pixel_depth > 16) return SER_UNSUPPORTED;
+	switch (header->color_id) {
+		case SER_MONO:
+		case SER_BAYER_RGGB:
+		case SER_BAYER_GRBG:
+		case SER_BAYER_GBRG:
+		case SER_BAYER_BGGR:
+		case SER_RGB:
+		case SER_BGR:
+			break;
+		default:
+			return SER_UNSUPPORTED;
+	}
+	return SER_OK;
+}
+
+int ser_planes(const ser_header *header) {
+	return (header->color_id == SER_RGB || header->color_id == SER_BGR) ? 3 : 1;
+}
+
+int ser_bytes_per_sample(const ser_header *header) {
+	return header->pixel_depth > 8 ? 2 : 1;
+}
+
+size_t ser_frame_size(const ser_header *header) {
+	return (size_t)header->width * header->height * ser_planes(header) * ser_bytes_per_sample(header);
+}
+
+int ser_color_id_from_bayer(const char *bayerpat) {
+	if (bayerpat == NULL) return SER_MONO;
+	if (!strncmp(bayerpat, "RGGB", 4)) return SER_BAYER_RGGB;
+	if (!strncmp(bayerpat, "GRBG", 4)) return SER_BAYER_GRBG;
+	if (!strncmp(bayerpat, "GBRG", 4)) return SER_BAYER_GBRG;
+	if (!strncmp(bayerpat, "BGGR", 4)) return SER_BAYER_BGGR;
+	return SER_MONO;
+}
+
+int64_t ser_ticks_from_unix_us(int64_t unix_us) {
+	return unix_us * 10 + SER_UNIX_EPOCH_TICKS;
+}
+
+int64_t ser_unix_us_from_ticks(int64_t ticks) {
+	return (ticks - SER_UNIX_EPOCH_TICKS) / 10;
+}
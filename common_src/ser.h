@@ -0,0 +1,91 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _SER_H
+#define _SER_H
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* SER video format: a 178 byte header, the frames one after the other and an
+   optional trailer with one UTC timestamp per frame. All the header fields are
+   little endian, timestamps are 100 ns ticks since 0001-01-01. */
+
+#define SER_HEADER_SIZE 178
+#define SER_FILE_ID "LUCAM-RECORDER"
+#define SER_STRING_SIZE 40
+
+typedef enum ser_error {
+	SER_OK = 0,
+	SER_INVALIDDATA = -1,
+	SER_INVALIDPARAM = -2,
+	SER_UNSUPPORTED = -3
+} ser_error;
+
+typedef enum ser_color_id {
+	SER_MONO = 0,
+	SER_BAYER_RGGB = 8,
+	SER_BAYER_GRBG = 9,
+	SER_BAYER_GBRG = 10,
+	SER_BAYER_BGGR = 11,
+	SER_RGB = 100,
+	SER_BGR = 101
+} ser_color_id;
+
+typedef struct ser_header {
+	int32_t lu_id;
+	int32_t color_id;
+	/* 0 for little endian 16-bit data, the inverse of the specification but what
+	   the capture programs write and the readers expect */
+	int32_t little_endian;
+	int32_t width;
+	int32_t height;
+	int32_t pixel_depth;
+	int32_t frame_count;
+	char observer[SER_STRING_SIZE + 1];
+	char instrument[SER_STRING_SIZE + 1];
+	char telescope[SER_STRING_SIZE + 1];
+	int64_t date_time;
+	int64_t date_time_utc;
+} ser_header;
+
+void ser_write_header(const ser_header *header, uint8_t *buffer);
+int ser_read_header(const uint8_t *buffer, size_t size, ser_header *header);
+
+int ser_planes(const ser_header *header);
+int ser_bytes_per_sample(const ser_header *header);
+size_t ser_frame_size(const ser_header *header);
+
+/* SER_MONO if the pattern is not known */
+int ser_color_id_from_bayer(const char *bayerpat);
+
+int64_t ser_ticks_from_unix_us(int64_t unix_us);
+int64_t ser_unix_us_from_ticks(int64_t ticks);
+
+void ser_put_int64(uint8_t *buffer, int64_t value);
+int64_t ser_get_int64(const uint8_t *buffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SER_H */
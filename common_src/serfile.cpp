@@ -0,0 +1,117 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <string.h>
+#include <serfile.h>
+#include <indigo/indigo_bus.h>
+
+SerFile::SerFile() :
+	m_frame_size(0),
+	m_frame_count(0) {
+	memset(&m_header, 0, sizeof(m_header));
+}
+
+SerFile::~SerFile() {
+	close();
+}
+
+bool SerFile::open(const char *file_name) {
+	close();
+	m_file.setFileName(QString::fromUtf8(file_name));
+	if (!m_file.open(QIODevice::ReadOnly)) {
+		indigo_error("SER: %s can not be open\n", file_name);
+		return false;
+	}
+	uint8_t header[SER_HEADER_SIZE];
+	int res = SER_INVALIDDATA;
+	if (m_file.read((char *)header, SER_HEADER_SIZE) == SER_HEADER_SIZE) {
+		res = ser_read_header(header, SER_HEADER_SIZE, &m_header);
+	}
+	if (res != SER_OK) {
+		indigo_error("SER: %s is not a supported SER file (%d)\n", file_name, res);
+		m_file.close();
+		return false;
+	}
+
+	m_frame_size = ser_frame_size(&m_header);
+	qint64 data_size = m_file.size() - SER_HEADER_SIZE;
+	qint64 complete_frames = data_size / (qint64)m_frame_size;
+	// an interrupted capture has fewer frames than the header says, or none in the header
+	m_frame_count = (m_header.frame_count > 0 && m_header.frame_count <= complete_frames) ? m_header.frame_count : (int)complete_frames;
+	if (m_frame_count == 0) {
+		indigo_error("SER: %s has no frames\n", file_name);
+		m_file.close();
+		return false;
+	}
+
+	qint64 trailer_offset = SER_HEADER_SIZE + (qint64)m_frame_count * m_frame_size;
+	qint64 trailer_size = (qint64)m_frame_count * 8;
+	if (m_frame_count == m_header.frame_count && m_file.size() >= trailer_offset + trailer_size) {
+		QVector<uint8_t> trailer(trailer_size);
+		if (m_file.seek(trailer_offset) && m_file.read((char *)trailer.data(), trailer_size) == trailer_size) {
+			m_timestamps.resize(m_frame_count);
+			for (int i = 0; i < m_frame_count; i++) {
+				int64_t ticks = ser_get_int64(trailer.data() + i * 8);
+				m_timestamps[i] = ticks > 0 ? ser_unix_us_from_ticks(ticks) : 0;
+			}
+		}
+	}
+	indigo_debug("SER: %s %dx%d %d bit, color %d, %d frames%s\n", file_name, m_header.width, m_header.height, m_header.pixel_depth, m_header.color_id, m_frame_count, m_timestamps.isEmpty() ? "" : " with timestamps");
+	return true;
+}
+
+void SerFile::close() {
+	QMutexLocker lock(&m_mutex);
+	if (m_file.isOpen()) m_file.close();
+	m_timestamps.clear();
+	m_frame_count = 0;
+	m_frame_size = 0;
+}
+
+int64_t SerFile::timestamp(int frame) const {
+	if (frame < 0 || frame >= m_timestamps.size()) return 0;
+	return m_timestamps[frame];
+}
+
+double SerFile::frame_interval() const {
+	if (m_timestamps.size() < 2 || m_timestamps.first() == 0 || m_timestamps.last() <= m_timestamps.first()) return 0;
+	return (m_timestamps.last() - m_timestamps.first()) / 1e6 / (m_timestamps.size() - 1);
+}
+
+const uint8_t *SerFile::map_frame(int frame) {
+	QMutexLocker lock(&m_mutex);
+	if (!m_file.isOpen() || frame < 0 || frame >= m_frame_count) return nullptr;
+	uchar *data = m_file.map(SER_HEADER_SIZE + (qint64)frame * m_frame_size, m_frame_size);
+	if (data == nullptr) {
+		indigo_error("SER: frame %d can not be mapped: %s\n", frame, m_file.errorString().toUtf8().constData());
+	}
+	return data;
+}
+
+void SerFile::unmap_frame(const uint8_t *data) {
+	QMutexLocker lock(&m_mutex);
+	if (data) m_file.unmap((uchar *)data);
+}
+
+preview_image *SerFile::create_frame_preview(int frame, const stretch_config_t sconfig) {
+	const uint8_t *data = map_frame(frame);
+	if (data == nullptr) return nullptr;
+	preview_image *preview = create_ser_preview(&m_header, data, sconfig);
+	unmap_frame(data);
+	return preview;
+}
@@ -0,0 +1,65 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _SERFILE_H
+#define _SERFILE_H
+
+#include <QFile>
+#include <QMutex>
+#include <QVector>
+#include <ser.h>
+#include <imagepreview.h>
+
+/* SER video opened for random access. Only the header and the timestamp
+   trailer are read at open(), each frame is mapped when it is needed, so
+   the file size is limited neither by the memory nor by the address space. */
+class SerFile {
+public:
+	SerFile();
+	~SerFile();
+
+	bool open(const char *file_name);
+	void close();
+	bool is_open() const { return m_file.isOpen(); }
+
+	const ser_header &header() const { return m_header; }
+	int frame_count() const { return m_frame_count; }
+	size_t frame_size() const { return m_frame_size; }
+	bool has_timestamps() const { return !m_timestamps.isEmpty(); }
+	/* UTC microseconds since the epoch, 0 if not known */
+	int64_t timestamp(int frame) const;
+	/* mean frame interval from the timestamps in seconds, 0 if not known */
+	double frame_interval() const;
+
+	/* thread safe, the data is valid until unmap_frame() */
+	const uint8_t *map_frame(int frame);
+	void unmap_frame(const uint8_t *data);
+
+	/* thread safe */
+	preview_image *create_frame_preview(int frame, const stretch_config_t sconfig);
+
+private:
+	QFile m_file;
+	QMutex m_mutex;
+	ser_header m_header;
+	size_t m_frame_size;
+	int m_frame_count;
+	QVector<int64_t> m_timestamps;
+};
+
+#endif /* _SERFILE_H */
@@ -0,0 +1,144 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <sharpness.h>
+#include <pixelformat.h>
+
+/* sums of bin x bin blocks, the rest of the rows and columns is left out */
+template <typename T, int C> static void bin_frame(const T *data, int width, int bin, int out_width, int out_height, float *output) {
+	const int block = bin * C;
+	for (int oy = 0; oy < out_height; oy++) {
+		float *out = output + (size_t)oy * out_width;
+		std::fill(out, out + out_width, 0.0f);
+		for (int y = oy * bin; y < (oy + 1) * bin; y++) {
+			const T *row = data + (size_t)y * width * C;
+			for (int ox = 0; ox < out_width; ox++) {
+				const T *pixel = row + (size_t)ox * block;
+				float sum = 0;
+				for (int i = 0; i < block; i++) {
+					sum += pixel[i];
+				}
+				out[ox] += sum;
+			}
+		}
+	}
+}
+
+double frame_sharpness(const void *data, int width, int height, int pix_format) {
+	int channels = 1;
+	bool cfa = false;
+	bool wide = false;
+	switch (pix_format) {
+		case PIX_FMT_Y8:
+			break;
+		case PIX_FMT_Y16:
+			wide = true;
+			break;
+		case PIX_FMT_RGB24:
+			channels = 3;
+			break;
+		case PIX_FMT_RGB48:
+			channels = 3;
+			wide = true;
+			break;
+		case PIX_FMT_SBGGR8:
+		case PIX_FMT_SGBRG8:
+		case PIX_FMT_SGRBG8:
+		case PIX_FMT_SRGGB8:
+			cfa = true;
+			break;
+		case PIX_FMT_SBGGR16:
+		case PIX_FMT_SGBRG16:
+		case PIX_FMT_SGRBG16:
+		case PIX_FMT_SRGGB16:
+			cfa = true;
+			wide = true;
+			break;
+		default:
+			return 0;
+	}
+
+	int bin = (std::max(width, height) + SHARPNESS_SIZE - 1) / SHARPNESS_SIZE;
+	if (cfa) bin = (bin + 1) & ~1;
+	if (bin < 1) bin = 1;
+	const int out_width = width / bin;
+	const int out_height = height / bin;
+	if (out_width < 3 || out_height < 3) return 0;
+
+	std::vector<float> binned((size_t)out_width * out_height);
+	if (wide) {
+		if (channels == 3) {
+			bin_frame<uint16_t, 3>((const uint16_t *)data, width, bin, out_width, out_height, binned.data());
+		} else {
+			bin_frame<uint16_t, 1>((const uint16_t *)data, width, bin, out_width, out_height, binned.data());
+		}
+	} else {
+		if (channels == 3) {
+			bin_frame<uint8_t, 3>((const uint8_t *)data, width, bin, out_width, out_height, binned.data());
+		} else {
+			bin_frame<uint8_t, 1>((const uint8_t *)data, width, bin, out_width, out_height, binned.data());
+		}
+	}
+
+	// the variances of the Laplacian and of the frame over the inner pixels, the means first as they are large
+	auto laplacian = [&](const float *pixel) {
+		return 4 * pixel[0] - pixel[-1] - pixel[1] - pixel[-out_width] - pixel[out_width];
+	};
+	double sum = 0, lap_sum = 0;
+	for (int y = 1; y < out_height - 1; y++) {
+		const float *row = binned.data() + (size_t)y * out_width;
+		for (int x = 1; x < out_width - 1; x++) {
+			sum += row[x];
+			lap_sum += laplacian(row + x);
+		}
+	}
+	const double count = (double)(out_width - 2) * (out_height - 2);
+	const double mean = sum / count;
+	const double lap_mean = lap_sum / count;
+	double variance = 0, lap_variance = 0;
+	for (int y = 1; y < out_height - 1; y++) {
+		const float *row = binned.data() + (size_t)y * out_width;
+		for (int x = 1; x < out_width - 1; x++) {
+			const double d = row[x] - mean;
+			const double lap_d = laplacian(row + x) - lap_mean;
+			variance += d * d;
+			lap_variance += lap_d * lap_d;
+		}
+	}
+	if (variance <= 0) return 0;
+	return lap_variance / variance;
+}
+
+SharpnessRanking::SharpnessRanking(int64_t window_us) {
+	m_window = window_us;
+}
+
+double SharpnessRanking::add(int64_t time_us, double sharpness) {
+	while (!m_frames.empty() && m_frames.front().first < time_us - m_window) {
+		m_frames.pop_front();
+	}
+	int sharper = 0;
+	for (const auto &frame : m_frames) {
+		if (frame.second > sharpness) sharper++;
+	}
+	m_frames.push_back(std::make_pair(time_us, sharpness));
+	return (double)sharper / m_frames.size();
+}
@@ -0,0 +1,52 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _SHARPNESS_H
+#define _SHARPNESS_H
+
+#include <stdint.h>
+#include <deque>
+
+/* Sharpness of a frame for lucky imaging, the variance of the Laplacian of
+   the frame binned to at most SHARPNESS_SIZE pixels across, relative to the
+   variance of the binned frame. It takes a few ms for any frame size, does
+   not depend on the brightness or the offset and drops as the seeing blurs
+   the frame. CFA frames are binned by an even factor so each binned pixel
+   has the same share of the colors. The values are meant for ranking the
+   frames of one run, not for comparing different targets. */
+
+#define SHARPNESS_SIZE 256
+
+/* pix_format is PIX_FMT_Y8, Y16, RGB24, RGB48 or one of the 8 and 16 bit CFA formats, returns 0 if it can not be measured */
+double frame_sharpness(const void *data, int width, int height, int pix_format);
+
+/* Ranks the frames among the ones of the last window_us microseconds. */
+class SharpnessRanking {
+public:
+	SharpnessRanking(int64_t window_us);
+
+	void reset() { m_frames.clear(); }
+	/* adds a frame, returns the fraction of the frames in the window sharper than it, 0 for the sharpest */
+	double add(int64_t time_us, double sharpness);
+
+private:
+	int64_t m_window;
+	std::deque<std::pair<int64_t, double>> m_frames;
+};
+
+#endif /* _SHARPNESS_H */
@@ -0,0 +1,287 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <type_traits>
+#include <thread>
+#include <QElapsedTimer>
+#include <indigo/indigo_bus.h>
+#include <stardetector.h>
+#include <pixelformat.h>
+#include <utils.h>
+
+#define TILE_SAMPLE_STEP 3   /* every n-th pixel of every n-th row is used for the background */
+
+typedef struct {
+	int x;
+	int y;
+	float value;
+} component_pixel;
+
+/* luminance at x, y */
+template <typename T, int C> struct frame_reader {
+	typedef T sample_type;
+	const T *data;
+	int width;
+	int height;
+
+	inline float operator()(int x, int y) const {
+		const T *pixel = data + ((size_t)y * width + x) * C;
+		if (C == 1) return pixel[0];
+		return ((float)pixel[0] + (float)pixel[1] + (float)pixel[2]) / 3;
+	}
+};
+
+static float median(std::vector<float> &values) {
+	if (values.empty()) return 0;
+	const size_t middle = values.size() / 2;
+	std::nth_element(values.begin(), values.begin() + middle, values.end());
+	return values[middle];
+}
+
+template <typename R> static void tile_background(const R &image, int x0, int y0, int x1, int y1, float *background, float *noise) {
+	std::vector<float> sample;
+	sample.reserve(((x1 - x0) / TILE_SAMPLE_STEP + 1) * ((y1 - y0) / TILE_SAMPLE_STEP + 1));
+	for (int y = y0; y < y1; y += TILE_SAMPLE_STEP) {
+		for (int x = x0; x < x1; x += TILE_SAMPLE_STEP) {
+			sample.push_back(image(x, y));
+		}
+	}
+	*background = median(sample);
+	for (float &value : sample) {
+		value = fabsf(value - *background);
+	}
+	*noise = 1.4826f * median(sample);
+	// integer frames often have no deviation at all, a step of the sample is the least noise
+	if (std::is_integral<typename R::sample_type>::value && *noise < 1.0f) *noise = 1.0f;
+}
+
+/* centroid, flux and shape of a component, false if it can not be measured */
+template <typename R> static bool measure_star(const R &image, const std::vector<component_pixel> &pixels, float background, float saturation, detected_star *star) {
+	double sum = 0, sum_x = 0, sum_y = 0;
+	float peak = 0;
+	for (const component_pixel &pixel : pixels) {
+		const double w = pixel.value - background;
+		sum += w;
+		sum_x += w * pixel.x;
+		sum_y += w * pixel.y;
+		peak = std::max(peak, pixel.value);
+	}
+	if (sum <= 0) return false;
+	const double cx = sum_x / sum;
+	const double cy = sum_y / sum;
+
+	// the wings below the detection threshold are measured in a circle around the centroid,
+	// negative residuals are kept as clipping the noise at the background widens the star
+	const int radius = std::min(STAR_DETECTION_MARGIN, (int)ceil(2 * sqrt(pixels.size() / M_PI)) + 2);
+	const int wx0 = (int)floor(cx) - radius, wx1 = (int)floor(cx) + radius;
+	const int wy0 = (int)floor(cy) - radius, wy1 = (int)floor(cy) + radius;
+	if (wx0 < 0 || wy0 < 0 || wx1 >= image.width || wy1 >= image.height) return false;
+	double flux = 0, sum_d = 0, mxx = 0, myy = 0, mxy = 0;
+	for (int y = wy0; y <= wy1; y++) {
+		const double dy = y - cy;
+		for (int x = wx0; x <= wx1; x++) {
+			const double dx = x - cx;
+			const double d = sqrt(dx * dx + dy * dy);
+			if (d > radius) continue;
+			const double w = image(x, y) - background;
+			flux += w;
+			sum_d += w * d;
+			mxx += w * dx * dx;
+			myy += w * dy * dy;
+			mxy += w * dx * dy;
+		}
+	}
+	if (flux <= 0 || sum_d <= 0) return false;
+	mxx /= flux;
+	myy /= flux;
+	mxy /= flux;
+	// eigenvalues of the covariance, the variances along the axes of the star
+	const double half_sum = (mxx + myy) / 2;
+	if (half_sum <= 0) return false;
+	const double root = sqrt((mxx - myy) * (mxx - myy) / 4 + mxy * mxy);
+	const double major = half_sum + root;
+	const double minor = std::max(0.0, half_sum - root);
+
+	star->x = cx;
+	star->y = cy;
+	star->flux = flux;
+	star->peak = peak - background;
+	star->hfd = 2 * sum_d / flux;
+	star->fwhm = 2.3548 * sqrt(half_sum);
+	star->eccentricity = major > 0 ? sqrt(1 - minor / major) : 0;
+	star->pixels = (int)pixels.size();
+	star->saturated = peak >= saturation;
+	return true;
+}
+
+template <typename R> static void detect_tile(const R &image, int x0, int y0, int x1, int y1, float background, float noise, float saturation, std::vector<detected_star> &stars) {
+	const float threshold = background + STAR_DETECTION_SIGMA * noise;
+	const int rx0 = std::max(0, x0 - STAR_DETECTION_MARGIN);
+	const int ry0 = std::max(0, y0 - STAR_DETECTION_MARGIN);
+	const int rx1 = std::min(image.width, x1 + STAR_DETECTION_MARGIN);
+	const int ry1 = std::min(image.height, y1 + STAR_DETECTION_MARGIN);
+	const int region_width = rx1 - rx0;
+	std::vector<uint8_t> visited((size_t)region_width * (ry1 - ry0), 0);
+	std::vector<component_pixel> pixels;
+	std::vector<component_pixel> stack;
+
+	for (int y = y0; y < y1; y++) {
+		for (int x = x0; x < x1; x++) {
+			uint8_t &seen = visited[(size_t)(y - ry0) * region_width + x - rx0];
+			if (seen) continue;
+			const float value = image(x, y);
+			if (value <= threshold) continue;
+
+			// flood fill within the tile and its margin
+			pixels.clear();
+			stack.clear();
+			seen = 1;
+			stack.push_back({ x, y, value });
+			bool clipped = false;
+			while (!stack.empty()) {
+				const component_pixel pixel = stack.back();
+				stack.pop_back();
+				pixels.push_back(pixel);
+				if (pixel.x == rx0 || pixel.y == ry0 || pixel.x == rx1 - 1 || pixel.y == ry1 - 1) clipped = true;
+				for (int ny = std::max(ry0, pixel.y - 1); ny <= std::min(ry1 - 1, pixel.y + 1); ny++) {
+					for (int nx = std::max(rx0, pixel.x - 1); nx <= std::min(rx1 - 1, pixel.x + 1); nx++) {
+						uint8_t &neighbour_seen = visited[(size_t)(ny - ry0) * region_width + nx - rx0];
+						if (neighbour_seen) continue;
+						const float neighbour = image(nx, ny);
+						if (neighbour <= threshold) continue;
+						neighbour_seen = 1;
+						stack.push_back({ nx, ny, neighbour });
+					}
+				}
+			}
+			if (clipped || (int)pixels.size() < STAR_DETECTION_MIN_PIXELS) continue;
+
+			// the star belongs to the tile of its peak, ties go to the first pixel in raster order
+			const component_pixel *peak = &pixels[0];
+			for (const component_pixel &pixel : pixels) {
+				if (pixel.value > peak->value || (pixel.value == peak->value && (pixel.y < peak->y || (pixel.y == peak->y && pixel.x < peak->x)))) peak = &pixel;
+			}
+			if (peak->x < x0 || peak->x >= x1 || peak->y < y0 || peak->y >= y1) continue;
+
+			detected_star star;
+			if (measure_star(image, pixels, background, saturation, &star)) {
+				stars.push_back(star);
+			}
+		}
+	}
+}
+
+template <typename R> static void detect(const R &image, float saturation, int thread_count, star_detection *result) {
+	const int tiles_x = (image.width + STAR_DETECTION_TILE - 1) / STAR_DETECTION_TILE;
+	const int tiles_y = (image.height + STAR_DETECTION_TILE - 1) / STAR_DETECTION_TILE;
+	const int tile_count = tiles_x * tiles_y;
+	std::vector<float> backgrounds(tile_count), noises(tile_count);
+
+	int max_threads = thread_count > 0 ? thread_count : get_number_of_cores();
+	max_threads = (max_threads > 0) ? max_threads : AIN_DEFAULT_THREADS;
+	max_threads = std::min(max_threads, tile_count);
+	std::vector<std::vector<detected_star>> found(max_threads);
+	std::atomic<int> next_tile(0);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < max_threads; t++) {
+		threads.emplace_back([&, t]() {
+			int tile;
+			while ((tile = next_tile++) < tile_count) {
+				const int x0 = (tile % tiles_x) * STAR_DETECTION_TILE;
+				const int y0 = (tile / tiles_x) * STAR_DETECTION_TILE;
+				const int x1 = std::min(image.width, x0 + STAR_DETECTION_TILE);
+				const int y1 = std::min(image.height, y0 + STAR_DETECTION_TILE);
+				tile_background(image, x0, y0, x1, y1, &backgrounds[tile], &noises[tile]);
+				// a flat tile of a float frame, e.g. an overscan area or a blank frame
+				if (noises[tile] <= 0) continue;
+				detect_tile(image, x0, y0, x1, y1, backgrounds[tile], noises[tile], saturation, found[t]);
+			}
+		});
+	}
+	for (auto &thread : threads) {
+		thread.join();
+	}
+
+	for (auto &thread_stars : found) {
+		result->stars.insert(result->stars.end(), thread_stars.begin(), thread_stars.end());
+	}
+	result->background = median(backgrounds);
+	result->noise = median(noises);
+}
+
+int detect_stars(const void *data, int width, int height, int pix_format, star_detection *result, int max_stars, int threads) {
+	QElapsedTimer timer;
+	timer.start();
+	result->stars.clear();
+	result->background = result->noise = 0;
+	result->hfd = result->fwhm = result->eccentricity = 0;
+	result->ms = 0;
+	if (data == nullptr || width < 3 || height < 3) return -1;
+
+	switch (pix_format) {
+		case PIX_FMT_Y8:
+			detect(frame_reader<uint8_t, 1> { (const uint8_t *)data, width, height }, STAR_DETECTION_SATURATION * 0xFF, threads, result);
+			break;
+		case PIX_FMT_Y16:
+			detect(frame_reader<uint16_t, 1> { (const uint16_t *)data, width, height }, STAR_DETECTION_SATURATION * 0xFFFF, threads, result);
+			break;
+		case PIX_FMT_Y32:
+			detect(frame_reader<uint32_t, 1> { (const uint32_t *)data, width, height }, STAR_DETECTION_SATURATION * 0xFFFFFFFF, threads, result);
+			break;
+		case PIX_FMT_F32:
+			detect(frame_reader<float, 1> { (const float *)data, width, height }, INFINITY, threads, result);
+			break;
+		case PIX_FMT_RGB24:
+			detect(frame_reader<uint8_t, 3> { (const uint8_t *)data, width, height }, STAR_DETECTION_SATURATION * 0xFF, threads, result);
+			break;
+		case PIX_FMT_RGB48:
+			detect(frame_reader<uint16_t, 3> { (const uint16_t *)data, width, height }, STAR_DETECTION_SATURATION * 0xFFFF, threads, result);
+			break;
+		case PIX_FMT_RGB96:
+			detect(frame_reader<uint32_t, 3> { (const uint32_t *)data, width, height }, STAR_DETECTION_SATURATION * 0xFFFFFFFF, threads, result);
+			break;
+		case PIX_FMT_RGBF:
+			detect(frame_reader<float, 3> { (const float *)data, width, height }, INFINITY, threads, result);
+			break;
+		default:
+			return -1;
+	}
+
+	std::vector<detected_star> &stars = result->stars;
+	std::sort(stars.begin(), stars.end(), [](const detected_star &a, const detected_star &b) {
+		return a.flux > b.flux;
+	});
+	if ((int)stars.size() > max_stars) stars.resize(max_stars);
+
+	std::vector<float> hfd, fwhm, eccentricity;
+	for (const detected_star &star : stars) {
+		if (star.saturated) continue;
+		hfd.push_back(star.hfd);
+		fwhm.push_back(star.fwhm);
+		eccentricity.push_back(star.eccentricity);
+	}
+	result->hfd = median(hfd);
+	result->fwhm = median(fwhm);
+	result->eccentricity = median(eccentricity);
+	result->ms = timer.nsecsElapsed() / 1e6;
+	indigo_debug("Star detection: %d stars, HFD %.2f, FWHM %.2f, eccentricity %.2f, background %.1f, noise %.1f, %.1f ms\n", (int)stars.size(), result->hfd, result->fwhm, result->eccentricity, result->background, result->noise, result->ms);
+	return (int)stars.size();
+}
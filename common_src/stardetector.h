@@ -0,0 +1,66 @@
+// Copyright (c) 2022 Rumen G.Bogdanovski
+// All rights reserved.
+//
+// You can use this software under the terms of 'INDIGO Astronomy
+// open-source license' (see LICENSE.md).
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHORS 'AS IS' AND ANY EXPRESS
+// OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+// DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+// GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+// WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef _STARDETECTOR_H
+#define _STARDETECTOR_H
+
+#include <stdint.h>
+#include <vector>
+
+/* Detects and measures the stars of a mono or RGB frame. The frame is split
+   into tiles processed in parallel. The background and the noise of each
+   tile are its median and MAD (as in ImageStats), the stars are the 8-connected
+   components of the pixels above the background + STAR_DETECTION_SIGMA * noise
+   owned by the tile of their peak pixel. Components touching the tile margin
+   or the frame edge are too large or incomplete to be measured. */
+
+#define STAR_DETECTION_TILE 256
+#define STAR_DETECTION_MARGIN 32         /* pixels a star may extend into the next tile */
+#define STAR_DETECTION_SIGMA 5.0
+#define STAR_DETECTION_MIN_PIXELS 4      /* smaller components are noise or hot pixels */
+#define STAR_DETECTION_MAX_STARS 5000    /* the brightest are kept */
+#define STAR_DETECTION_SATURATION 0.98   /* of the range of integer samples */
+
+typedef struct {
+	double x;               /* pixels, sub-pixel centroid */
+	double y;
+	double flux;            /* above the background */
+	double peak;            /* above the background */
+	double hfd;             /* half flux diameter, pixels */
+	double fwhm;            /* from the second moments, pixels */
+	double eccentricity;    /* 0 for a round star */
+	int pixels;             /* of the component */
+	bool saturated;
+} detected_star;
+
+typedef struct {
+	std::vector<detected_star> stars;   /* brightest first */
+	double background;      /* median of the tiles */
+	double noise;
+	/* medians of the unsaturated stars, 0 if there are none */
+	double hfd;
+	double fwhm;
+	double eccentricity;
+	double ms;              /* detection time */
+} star_detection;
+
+/* pix_format is PIX_FMT_Y8..F32 or PIX_FMT_RGB24..RGBF, RGB is measured on the mean of the channels,
+   threads 0 uses all cores, returns the star count or -1 */
+int detect_stars(const void *data, int width, int height, int pix_format, star_detection *result, int max_stars = STAR_DETECTION_MAX_STARS, int threads = 0);
+
+#endif /* _STARDETECTOR_H */
@@ -5,9 +5,12 @@
 //#include <indigo/indigo_raw_utils.h>
 
 #include <math.h>
+#include <type_traits>
 #include <QCoreApplication>
 #include <QtConcurrent>
 #include <utils.h>
+#include <pipetrace.h>
+#include <pixel_kernels.h>
 
 // Returns the median value of the vector.
 // The values is modified
@@ -50,18 +53,24 @@ void stretchOneChannel(
 
 	const float hsRangeFactor = highlights == shadows ? 1.0f : 1.0f / (highlights - shadows);
 
-	const T nativeShadows = shadows * maxInput;
-	const T nativeHighlights = highlights * maxInput;
-
-	const float k1 = (midtones - 1) * hsRangeFactor * maxOutput / maxInput;
-	const float k2 = ((2 * midtones) - 1) * hsRangeFactor / maxInput;
-
+	pixel_stretch_params params;
+	params.native_shadows = shadows * maxInput;
+	params.native_highlights = highlights * maxInput;
+	params.midtones = midtones;
+	params.k1 = (midtones - 1) * hsRangeFactor * maxOutput / maxInput;
+	params.k2 = ((2 * midtones) - 1) * hsRangeFactor / maxInput;
+	auto stretch_row = pixel_kernels()->stretch_mono[pixel_type_of<typename std::remove_const<T>::type>::value];
+
+	// only the workers of a lane may wait for the priority lane, the global pool is shared by both lanes
+	QThreadPool *pool = lane_thread_pool();
+	const bool yield = pool != nullptr && !is_priority_thread();
+	if (pool == nullptr) pool = QThreadPool::globalInstance();
 	QVector<QFuture<void>> futures;
 	int num_threads = get_number_of_cores();
 	num_threads = (num_threads > 0) ? num_threads : AIN_DEFAULT_THREADS;
 	for (int rank = 0; rank < num_threads; rank++) {
 		const int chunk = ceil(image_height / (double)num_threads);
-		futures.append(QtConcurrent::run([ = ]() {
+		futures.append(QtConcurrent::run(pool, [ = ]() {
 			int start_row = chunk * rank;
 			int end_row = start_row + chunk;
 			end_row = (end_row > image_height) ? image_height : end_row;
@@ -70,16 +79,8 @@ void stretchOneChannel(
 				T * inputLine  = input_buffer + j * image_width;
 				auto * scanLine = reinterpret_cast<QRgb*>(output_image->scanLine(jout));
 				QCoreApplication::processEvents();
-				for (int i = 0, iout = 0; i < image_width; i += sampling, iout++) {
-					const T input = inputLine[i];
-					if (input < nativeShadows) output_image->setPixel(iout, jout, qRgb(0, 0, 0));
-					else if (input >= nativeHighlights) output_image->setPixel(iout, jout, qRgb(maxOutput,maxOutput,maxOutput));
-					else {
-						const T inputFloored = (input - nativeShadows);
-						int val = (inputFloored * k1) / (inputFloored * k2 - midtones);
-						scanLine[iout] = qRgb(val, val, val);
-					}
-				}
+				if (yield) yield_to_priority_work();
+				stretch_row(inputLine, image_width, sampling, &params, scanLine);
 			}
 		}));
 	}
@@ -125,66 +126,49 @@ void stretchThreeChannels(
 	const float hsRangeFactorG = highlightsG == shadowsG ? 1.0f : 1.0f / (highlightsG - shadowsG);
 	const float hsRangeFactorB = highlightsB == shadowsB ? 1.0f : 1.0f / (highlightsB - shadowsB);
 
-	const T nativeShadowsR = shadowsR * maxInput;
-	const T nativeShadowsG = shadowsG * maxInput;
-	const T nativeShadowsB = shadowsB * maxInput;
-	const T nativeHighlightsR = highlightsR * maxInput;
-	const T nativeHighlightsG = highlightsG * maxInput;
-	const T nativeHighlightsB = highlightsB * maxInput;
-
-	const float k1R = (midtonesR - 1) * hsRangeFactorR * maxOutput / maxInput;
-	const float k1G = (midtonesG - 1) * hsRangeFactorG * maxOutput / maxInput;
-	const float k1B = (midtonesB - 1) * hsRangeFactorB * maxOutput / maxInput;
-	const float k2R = ((2 * midtonesR) - 1) * hsRangeFactorR / maxInput;
-	const float k2G = ((2 * midtonesG) - 1) * hsRangeFactorG / maxInput;
-	const float k2B = ((2 * midtonesB) - 1) * hsRangeFactorB / maxInput;
-
-	const int skip = sampling * 3;
-	const int imageWidth3 = imageWidth * 3;
-
+	pixel_stretch_params params[3];
+	params[0].native_shadows = shadowsR * maxInput;
+	params[1].native_shadows = shadowsG * maxInput;
+	params[2].native_shadows = shadowsB * maxInput;
+	params[0].native_highlights = highlightsR * maxInput;
+	params[1].native_highlights = highlightsG * maxInput;
+	params[2].native_highlights = highlightsB * maxInput;
+	params[0].midtones = midtonesR;
+	params[1].midtones = midtonesG;
+	params[2].midtones = midtonesB;
+
+	params[0].k1 = (midtonesR - 1) * hsRangeFactorR * maxOutput / maxInput;
+	params[1].k1 = (midtonesG - 1) * hsRangeFactorG * maxOutput / maxInput;
+	params[2].k1 = (midtonesB - 1) * hsRangeFactorB * maxOutput / maxInput;
+	params[0].k2 = ((2 * midtonesR) - 1) * hsRangeFactorR / maxInput;
+	params[1].k2 = ((2 * midtonesG) - 1) * hsRangeFactorG / maxInput;
+	params[2].k2 = ((2 * midtonesB) - 1) * hsRangeFactorB / maxInput;
+	auto stretch_row = pixel_kernels()->stretch_rgb[pixel_type_of<typename std::remove_const<T>::type>::value];
+
+	// samples are read consecutively, the row is not advanced by the sampling
+	const int outputWidth = (imageWidth + sampling - 1) / sampling;
+
+	// only the workers of a lane may wait for the priority lane, the global pool is shared by both lanes
+	QThreadPool *pool = lane_thread_pool();
+	const bool yield = pool != nullptr && !is_priority_thread();
+	if (pool == nullptr) pool = QThreadPool::globalInstance();
 	QVector<QFuture<void>> futures;
 	int num_threads = get_number_of_cores();
 	num_threads = (num_threads > 0) ?  num_threads : AIN_DEFAULT_THREADS;
 	for (int rank = 0; rank < num_threads; rank++) {
 		const int chunk = ceil(imageHeight / (double)num_threads);
-		futures.append(QtConcurrent::run([ = ]() {
+		futures.append(QtConcurrent::run(pool, [ = ]() {
 			int start_row = chunk * rank;
 			int end_row = start_row + chunk;
 			end_row = (end_row > imageHeight) ? imageHeight : end_row;
 			//indigo_error("stretchThreeChannels(): %d - start_row %d, end_row %d, rows %d", rank, start_row, end_row, end_row-start_row);
-			int index = start_row * imageWidth3;
+			int index = start_row * imageWidth * 3;
 			for (int j = start_row, jout = start_row; j < end_row; j += sampling, jout++) {
 				QCoreApplication::processEvents();
+				if (yield) yield_to_priority_work();
 				auto * scanLine = reinterpret_cast<QRgb*>(outputImage->scanLine(jout));
-				for (int i = 0, iout = 0; i < imageWidth3; i += skip, iout++) {
-					const T inputR = inputBuffer[index++];
-					const T inputG = inputBuffer[index++];
-					const T inputB = inputBuffer[index++];
-
-					uint8_t red, green, blue;
-
-					if (inputR < nativeShadowsR) red = 0;
-					else if (inputR >= nativeHighlightsR) red = maxOutput;
-					else {
-						const T inputFloored = (inputR - nativeShadowsR);
-						red = (inputFloored * k1R) / (inputFloored * k2R - midtonesR);
-					}
-
-					if (inputG < nativeShadowsG) green = 0;
-					else if (inputG >= nativeHighlightsG) green = maxOutput;
-					else {
-						const T inputFloored = (inputG - nativeShadowsG);
-						green = (inputFloored * k1G) / (inputFloored * k2G - midtonesG);
-					}
-
-					if (inputB < nativeShadowsB) blue = 0;
-					else if (inputB >= nativeHighlightsB) blue = maxOutput;
-					else {
-						const T inputFloored = (inputB - nativeShadowsB);
-						blue = (inputFloored * k1B) / (inputFloored * k2B - midtonesB);
-					}
-					scanLine[iout] = qRgb(red, green, blue);
-				}
+				stretch_row(inputBuffer + index, outputWidth, params, scanLine);
+				index += outputWidth * 3;
 			}
 		}));
 	}
@@ -407,6 +391,7 @@ Stretcher::Stretcher(int width, int height, int data_type) {
 }
 
 void Stretcher::stretch(uint8_t const *input, QImage *outputImage, int sampling) {
+	PIPE_TRACE(PIPE_TRACE_STRETCH);
 	Q_ASSERT(outputImage->width() == (m_image_width + sampling - 1) / sampling);
 	Q_ASSERT(outputImage->height() == (m_image_height + sampling - 1) / sampling);
 	/*
@@ -496,6 +481,7 @@ void Stretcher::stretch(uint8_t const *input, QImage *outputImage, int sampling)
 }
 
 StretchParams Stretcher::computeParams(uint8_t const *input, const float B, const float C) {
+	PIPE_TRACE(PIPE_TRACE_COMPUTE_PARAMS);
 	StretchParams result;
 
 	StretchParams1Channel *params = &result.grey_red;
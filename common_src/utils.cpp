@@ -22,6 +22,10 @@
 #include <time.h>
 #include <sys/time.h>
 #include <unistd.h>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
 
 #include <QDir>
 #include <QString>
@@ -34,7 +38,15 @@
 #include <windows.h>
 #endif
 
+static std::atomic<int> number_of_cores_limit(0);
+
+void set_number_of_cores(int cores) {
+	number_of_cores_limit = cores;
+}
+
 int get_number_of_cores() {
+	int limit = number_of_cores_limit;
+	if (limit > 0) return limit;
 #ifdef INDIGO_WINDOWS
 	SYSTEM_INFO sysinfo;
 	GetSystemInfo(&sysinfo);
@@ -46,6 +58,54 @@ int get_number_of_cores() {
 #endif
 }
 
+static std::atomic<int> priority_work_count(0);
+static std::atomic<unsigned> priority_work_generation(0);
+static std::mutex priority_work_mutex;
+static std::condition_variable priority_work_done;
+static thread_local bool priority_thread = false;
+static thread_local unsigned yielded_generation = 0;
+static thread_local QThreadPool *lane_pool = nullptr;
+
+void set_priority_thread(bool priority) {
+	priority_thread = priority;
+}
+
+bool is_priority_thread() {
+	return priority_thread;
+}
+
+void set_lane_thread_pool(QThreadPool *pool) {
+	lane_pool = pool;
+}
+
+QThreadPool *lane_thread_pool() {
+	return lane_pool;
+}
+
+void begin_priority_work() {
+	if (priority_work_count++ == 0) priority_work_generation++;
+}
+
+void end_priority_work() {
+	if (--priority_work_count == 0) {
+		std::lock_guard<std::mutex> lock(priority_work_mutex);
+		priority_work_done.notify_all();
+	}
+}
+
+void yield_to_priority_work() {
+	if (priority_work_count.load(std::memory_order_relaxed) == 0) return;
+
+	// once per period of priority work, a lane that is busy all the time must not stall every row
+	const unsigned generation = priority_work_generation.load();
+	if (generation == yielded_generation) return;
+	yielded_generation = generation;
+	std::unique_lock<std::mutex> lock(priority_work_mutex);
+	priority_work_done.wait_for(lock, std::chrono::milliseconds(AIN_MAX_PRIORITY_WAIT), [] {
+		return priority_work_count.load() == 0;
+	});
+}
+
 void get_timestamp(char *timestamp_str) {
 	assert(timestamp_str != nullptr);
 	struct timeval tmnow;
@@ -153,6 +213,24 @@ void get_current_output_dir(char *output_dir, char *prefix) {
 	}
 }
 
+void get_calibration_dir(char *calibration_dir, char *prefix) {
+	assert(calibration_dir != nullptr);
+	QString path_prefix = QDir::homePath();
+
+	if (prefix != nullptr && prefix[0] != '\0') path_prefix = QString(prefix);
+
+	if (!path_prefix.endsWith("/")) {
+		path_prefix = path_prefix + QString("/");
+	}
+	if (!path_prefix.endsWith("/ain_data/")) {
+		path_prefix = path_prefix + QString("ain_data/");
+	}
+	QString qlocation = QDir::toNativeSeparators(path_prefix + QString("masters/"));
+	QDir dir = QDir::root();
+	dir.mkpath(qlocation);
+	strncpy(calibration_dir, qlocation.toUtf8().constData(), PATH_LEN);
+}
+
 void get_indigo_device_domain(char *device_domain, const char *device_name) {
 	char *at = strrchr((char*)device_name, '@');
 	if (at && at[1] != '\0') {
@@ -20,8 +20,27 @@
 #define _UTILS_H
 
 #define AIN_DEFAULT_THREADS 4
+#define AIN_MAX_PRIORITY_WAIT 100 /* ms */
+
+class QThreadPool;
 
 int get_number_of_cores();
+/* overrides the number of worker threads of the image kernels, 0 uses all cores */
+void set_number_of_cores(int cores);
+
+/* Image processing of normal priority (imager frames) calls yield_to_priority_work()
+   at row boundaries and pauses while a priority thread (guider frames) is processing,
+   once per period of priority work and never longer than AIN_MAX_PRIORITY_WAIT.
+   Only threads owned by a lane may wait, a worker of the global QThreadPool never
+   does, so the kernels started from a lane thread run in the lane's own pool. */
+void set_priority_thread(bool priority);
+bool is_priority_thread();
+void set_lane_thread_pool(QThreadPool *pool);
+/* the pool of the lane of the calling thread, nullptr outside of a lane */
+QThreadPool *lane_thread_pool();
+void begin_priority_work();
+void end_priority_work();
+void yield_to_priority_work();
 
 void get_timestamp(char *timestamp_str);
 void get_date(char *date_str);
@@ -29,6 +48,7 @@ void get_date_jd(char *date_str);
 void get_time(char *time_str);
 
 void get_current_output_dir(char *output_dir, char *prefix = nullptr);
+void get_calibration_dir(char *calibration_dir, char *prefix = nullptr);
 
 void get_indigo_device_domain(char *device_domain, const char *device_name);
 void remove_indigo_device_domain(char *device_name, int levels);
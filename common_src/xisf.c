@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <xml.h>
 #include <xisf.h>
+#include <pixel_kernels.h>
 #include <zlib.h>
 #include <lz4.h>
 
@@ -45,26 +46,6 @@ static int xisf_metadata_init(xisf_metadata *metadata) {
 	metadata->sensor_temperature = -1;
 }
 
-static void un_shuffle(uint8_t *output, const uint8_t *input, size_t size, size_t item_size) {
-	if (size > 0) {
-		if (item_size > 0) {
-			if (input != NULL) {
-				if (output != NULL) {
-					size_t items = size / item_size;
-					const uint8_t* s = input;
-					for (size_t j = 0; j < item_size; ++j) {
-						uint8_t* u = output + j;
-						for (size_t i = 0; i < items; ++i, ++s, u += item_size) {
-							*u = *s;
-						}
-					}
-					memcpy(output + items * item_size, s, size % item_size);
-				}
-			}
-		}
-	}
-}
-
 int xisf_read_metadata(uint8_t *xisf_data, int xisf_size, xisf_metadata *metadata) {
 	if (!xisf_data || !xisf_size || !metadata) {
 		return XISF_INVALIDPARAM;
@@ -322,7 +303,7 @@ int xisf_decompress(uint8_t *xisf_data, xisf_metadata *metadata, uint8_t *decomp
 			free(shuffled_data);
 			return XISF_INVALIDDATA;
 		}
-		un_shuffle(decompressed_data, shuffled_data, uncompressed_data_size, metadata->shuffle_size);
+		pixel_kernels()->unshuffle(decompressed_data, (const uint8_t *)shuffled_data, uncompressed_data_size, metadata->shuffle_size);
 		free(shuffled_data);
 		return XISF_OK;
 	} else if (!strcmp(metadata->compression, "lz4") || !strcmp(metadata->compression, "lz4hc")) {
@@ -339,7 +320,7 @@ int xisf_decompress(uint8_t *xisf_data, xisf_metadata *metadata, uint8_t *decomp
 			free(shuffled_data);
 			return XISF_INVALIDDATA;
 		}
-		un_shuffle(decompressed_data, shuffled_data, uncompressed_data_size, metadata->shuffle_size);
+		pixel_kernels()->unshuffle(decompressed_data, (const uint8_t *)shuffled_data, uncompressed_data_size, metadata->shuffle_size);
 		free(shuffled_data);
 		return XISF_OK;
 	}
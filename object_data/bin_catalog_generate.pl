@@ -0,0 +1,163 @@
+#!/usr/bin/perl
+use strict;
+use warnings;
+
+# Generates the binary catalog loaded with CatalogFile (ain_imager_src/catalogfile.h)
+#
+# usage: bin_catalog_generate.pl [-c indigo_cat_data.c] [-s stars.csv ...] -o catalog.aincat
+#
+#   -c  the generated C catalog (indigo_star_data[] and indigo_dso_data[]), Ain Imager
+#       compiles it in and skips these objects in catalog files
+#   -s  star list "id;ra;dec;mag;names", ra in hours, dec in degrees, names separated
+#       by ",", a numeric id is a HIP number - for deep catalogs like Tycho-2
+#
+# Records are sorted by position: by 1 degree declination zone and by RA in the zone.
+# All values are little endian.
+
+my $MAGIC = "AINCAT01";
+my $ZONES = 180;
+my $STAR = 255;
+my $HEADER_SIZE = 40;
+my $RECORD_SIZE = 48;
+
+# indigo_dso_type from indigo_cat_data.h
+my %types = (
+	'GALAXY' => 0,
+	'GALAXY_PAIR' => 1,
+	'GALAXY_TRIPLET' => 2,
+	'OPEN_CLUSTER' => 3,
+	'GLOBULAR_CLUSTER' => 4,
+	'NEBULA' => 5,
+	'PLANETARY_NEBULA' => 6,
+	'REFLECTION_NEBULA' => 7,
+	'EMISSION_NEBULA' => 8,
+	'SUPERNOVA_REMNANT' => 9,
+	'HII_REGION' => 10,
+	'ASSOCIATION_OF_STARS' => 11,
+	'STAR_CLUSTER_NEBULA' => 12,
+	'GROUP_OF_GALAXIES' => 13,
+	'NOVA_STAR' => 14
+);
+
+my $num = qr/[-+]?[\d.]+(?:[eE][-+]?\d+)?/;
+my $str = qr/"((?:[^"\\]|\\.)*)"/;
+
+my @records;
+
+sub add_record($$$$$$$$$$) {
+	my ($id, $names, $hip, $type, $ra, $dec, $mag, $r1, $r2, $angle) = @_;
+	my $zone = int($dec + 90);
+	$zone = 0 if $zone < 0;
+	$zone = $ZONES - 1 if $zone >= $ZONES;
+	push @records, {
+		id => $id, names => $names, hip => $hip, type => $type, zone => $zone,
+		ra => $ra * 15, dec => $dec, mag => $mag, r1 => $r1, r2 => $r2, angle => $angle
+	};
+}
+
+sub read_c_catalog($) {
+	my ($file) = @_;
+	open(my $data, '<', $file) or die "Could not open '$file' $!\n";
+	my $section = "";
+	while (my $line = <$data>) {
+		if ($line =~ /indigo_star_data\[\]/) {
+			$section = "star";
+		} elsif ($line =~ /indigo_dso_data\[\]/) {
+			$section = "dso";
+		} elsif ($line =~ /^};/) {
+			$section = "";
+		} elsif ($section eq "star" and $line =~ /^\s*{\s*(\d+),\s*($num),\s*($num),\s*$num,\s*$num,\s*$num,\s*$num,\s*($num),\s*(?:NULL|$str)\s*}/) {
+			add_record("HIP $1", defined $5 ? $5 : "", $1, $STAR, $2, $3, $4, 0, 0, 0);
+		} elsif ($section eq "dso" and $line =~ /^\s*{\s*$str,\s*(\w+),\s*($num),\s*($num),\s*($num),\s*($num),\s*($num),\s*($num),\s*$str\s*}/) {
+			die "Unknown object type $2\n" unless defined $types{$2};
+			add_record($1, $9, 0, $types{$2}, $3, $4, $5, $6, $7, $8);
+		}
+	}
+	close($data);
+}
+
+sub read_star_list($) {
+	my ($file) = @_;
+	open(my $data, '<', $file) or die "Could not open '$file' $!\n";
+	while (my $line = <$data>) {
+		chomp $line;
+		next if $line =~ /^\s*(#|$)/;
+		my @f = split ";", $line;
+		next if @f < 4 or !($f[1] =~ /^$num$/);
+		my $hip = ($f[0] =~ /^\d+$/) ? $f[0] : 0;
+		my $id = $hip ? "HIP $hip" : $f[0];
+		add_record($id, defined $f[4] ? $f[4] : "", $hip, $STAR, $f[1], $f[2], $f[3], 0, 0, 0);
+	}
+	close($data);
+}
+
+my $output;
+while (@ARGV) {
+	my $arg = shift @ARGV;
+	if ($arg eq "-c") {
+		read_c_catalog(shift @ARGV);
+	} elsif ($arg eq "-s") {
+		read_star_list(shift @ARGV);
+	} elsif ($arg eq "-o") {
+		$output = shift @ARGV;
+	} else {
+		die "Unknown argument '$arg'\n";
+	}
+}
+die "usage: $0 [-c indigo_cat_data.c] [-s stars.csv ...] -o catalog.aincat\n" unless defined $output and @records;
+
+@records = sort { $a->{zone} <=> $b->{zone} or $a->{ra} <=> $b->{ra} } @records;
+
+# string pool, offset 0 is the empty string
+my $pool = "\0";
+my %pooled = ("" => 0);
+sub pool_string($) {
+	my ($s) = @_;
+	return $pooled{$s} if defined $pooled{$s};
+	my $offset = length($pool);
+	$pool .= $s . "\0";
+	$pooled{$s} = $offset;
+	return $offset;
+}
+
+# name index, lower case keys of ids and all aliases
+my @names;
+my @zones = (0) x ($ZONES + 1);
+my $max_r1 = 0;
+my $body = "";
+for (my $i = 0; $i < @records; $i++) {
+	my $r = $records[$i];
+	$zones[$r->{zone} + 1] = $i + 1;
+	$max_r1 = $r->{r1} if $r->{r1} > $max_r1;
+	$body .= pack("d<d<f<f<f<f<VVl<Cx3",
+		$r->{ra}, $r->{dec}, $r->{mag}, $r->{r1}, $r->{r2}, $r->{angle},
+		pool_string($r->{id}), pool_string($r->{names}), $r->{hip}, $r->{type});
+	foreach my $name ($r->{id}, split(/\s*,\s*/, $r->{names})) {
+		$name =~ s/^\s+|\s+$//g;
+		push @names, [ lc($name), $i ] if $name ne "";
+	}
+}
+# zones without records start where the previous one ends
+for (my $z = 1; $z <= $ZONES; $z++) {
+	$zones[$z] = $zones[$z - 1] if $zones[$z] < $zones[$z - 1];
+}
+@names = sort { $a->[0] cmp $b->[0] or $a->[1] <=> $b->[1] } @names;
+my $name_table = "";
+foreach my $name (@names) {
+	$name_table .= pack("VV", pool_string($name->[0]), $name->[1]);
+}
+
+my $record_offset = $HEADER_SIZE;
+my $zone_offset = $record_offset + length($body);
+my $name_offset = $zone_offset + 4 * ($ZONES + 1);
+my $string_offset = $name_offset + length($name_table);
+
+open(my $out, '>:raw', $output) or die "Could not create '$output' $!\n";
+print $out pack("a8VVVVVVVf<", $MAGIC, scalar(@records), $record_offset, $zone_offset, scalar(@names), $name_offset, $string_offset, length($pool), $max_r1);
+print $out $body;
+print $out pack("V*", @zones);
+print $out $name_table;
+print $out $pool;
+close($out);
+
+printf STDERR "%d records, %d names, %d bytes of strings\n", scalar(@records), scalar(@names), length($pool);